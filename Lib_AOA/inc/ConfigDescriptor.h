@@ -57,6 +57,13 @@
 		#define ANDROID_INTERFACE_SUBCLASS   0xFF
 		#define ANDROID_INTERFACE_PROTOCOL   /*0x01*/ 0x00 // EA: When testing with Nexus One and XOOM has protocol=0x00. Bug?
 
+		/** Number of accessory mode devices (by VID/PID/release) whose data endpoints are remembered, so
+		 *  the Configuration Descriptor is only read and parsed the first time such a device is attached.
+		 */
+		#ifndef ANDROID_CONFIG_CACHE_SIZE
+		#define ANDROID_CONFIG_CACHE_SIZE    4
+		#endif
+
 	/* Enums: */
 		/** Enum for the possible return codes of the \ref ProcessConfigurationDescriptor() function. */
 		enum AndroidHost_GetConfigDescriptorDataCodes_t
@@ -70,6 +77,7 @@
 
 	/* Function Prototypes: */
 		uint8_t ProcessConfigurationDescriptor(uint8_t corenum);
+		void InvalidateConfigurationCache(uint8_t corenum);
 
 		uint8_t DCOMP_NextAndroidAccessoryInterface(void* const CurrentDescriptor);
 		uint8_t DCOMP_NextInterfaceBulkEndpoint(void* CurrentDescriptor);
@@ -50,6 +50,15 @@
 		#define ANDROID_ACCESSORY_PRODUCT_ID        0x2D00
 		#define ANDROID_ACCESSORY_ADB_PRODUCT_ID    0x2D01
 
+	/* Type Defines: */
+		/** Identification of an attached device, as read from its Device Descriptor. */
+		typedef struct
+		{
+			uint16_t VendorID; /**< Vendor ID, 0 if no descriptor has been read */
+			uint16_t ProductID; /**< Product ID */
+			uint16_t ReleaseNumber; /**< Product release number */
+		} AndroidHost_DeviceID_t;
+
 	/* Enums: */
 		/** Enum for the possible return codes of the \ref ProcessDeviceDescriptor() function. */
 		enum AndroidHost_GetDeviceDescriptorDataCodes_t
@@ -64,6 +73,7 @@
 
 	/* Function Prototypes: */
 		uint8_t ProcessDeviceDescriptor(uint8_t corenum);
+		const AndroidHost_DeviceID_t* GetDeviceID(uint8_t corenum);
 
 #endif
 
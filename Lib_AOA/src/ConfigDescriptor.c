@@ -36,12 +36,31 @@
  */
 
 #include "ConfigDescriptor.h"
+#include "DeviceDescriptor.h"
+
+/** Data endpoints of an accessory mode device, see \ref ANDROID_CONFIG_CACHE_SIZE. */
+typedef struct
+{
+	AndroidHost_DeviceID_t ID; /**< Device the entry is for, VendorID is 0 for an unused entry */
+	uint8_t  DataINAddress;
+	uint16_t DataINSize;
+	uint8_t  DataOUTAddress;
+	uint16_t DataOUTSize;
+} AndroidHost_CachedConfig_t;
+
+static AndroidHost_CachedConfig_t ConfigCache[ANDROID_CONFIG_CACHE_SIZE];
+static uint8_t ConfigCacheNext;
+
+static AndroidHost_CachedConfig_t* FindCachedConfig(const AndroidHost_DeviceID_t* ID);
+static void ConfigureDataPipes(uint8_t corenum, const AndroidHost_CachedConfig_t* Config);
 
 /** Reads and processes an attached device's descriptors, to determine compatibility and pipe configurations. This
  *  routine will read in the entire configuration descriptor, and configure the hosts pipes to correctly communicate
  *  with compatible devices.
  *
- *  This routine searches for the first interface containing bulk IN and OUT data endpoints.
+ *  This routine searches for the first interface containing bulk IN and OUT data endpoints. The endpoints found
+ *  are remembered for the VID/PID/release read by \ref ProcessDeviceDescriptor(), when the same device is attached
+ *  again the pipes are configured without reading the Configuration Descriptor.
  *
  *  \return An error code from the \ref AndroidHost_GetConfigDescriptorDataCodes_t enum.
  */
@@ -54,6 +73,15 @@ uint8_t ProcessConfigurationDescriptor(uint8_t corenum)
 	USB_Descriptor_Endpoint_t* DataINEndpoint  = NULL;
 	USB_Descriptor_Endpoint_t* DataOUTEndpoint = NULL;
 
+	const AndroidHost_DeviceID_t* ID     = GetDeviceID(corenum);
+	AndroidHost_CachedConfig_t*   Cached = FindCachedConfig(ID);
+
+	if (Cached != NULL)
+	{
+		ConfigureDataPipes(corenum, Cached);
+		return SuccessfulConfigRead;
+	}
+
 	/* Retrieve the entire configuration descriptor into the allocated buffer */
 	switch (USB_Host_GetDeviceConfigDescriptor(corenum, 1, &CurrConfigBytesRem, ConfigDescriptorData, sizeof(ConfigDescriptorData)))
 	{
@@ -94,16 +122,67 @@ uint8_t ProcessConfigurationDescriptor(uint8_t corenum)
 		  DataOUTEndpoint = EndpointData;
 	}
 
+	/* Remember the endpoints, replacing the oldest entry */
+	Cached = &ConfigCache[ConfigCacheNext];
+	ConfigCacheNext = (ConfigCacheNext + 1) % ANDROID_CONFIG_CACHE_SIZE;
+
+	Cached->ID             = *ID;
+	Cached->DataINAddress  = DataINEndpoint->EndpointAddress;
+	Cached->DataINSize     = DataINEndpoint->EndpointSize;
+	Cached->DataOUTAddress = DataOUTEndpoint->EndpointAddress;
+	Cached->DataOUTSize    = DataOUTEndpoint->EndpointSize;
+
+	ConfigureDataPipes(corenum, Cached);
+
+	/* Valid data found, return success */
+	return SuccessfulConfigRead;
+}
+
+/** Forgets the remembered endpoints of the device attached to the given core, the Configuration Descriptor is
+ *  read again the next time it is attached. Call this if the device can't be used with the cached configuration.
+ */
+void InvalidateConfigurationCache(uint8_t corenum)
+{
+	AndroidHost_CachedConfig_t* Cached = FindCachedConfig(GetDeviceID(corenum));
+
+	if (Cached != NULL)
+	  Cached->ID.VendorID = 0;
+}
+
+/** Finds the cache entry of a device.
+ *
+ *  \return Pointer to the entry or NULL if the device isn't in the cache.
+ */
+static AndroidHost_CachedConfig_t* FindCachedConfig(const AndroidHost_DeviceID_t* ID)
+{
+	uint8_t i;
+
+	if (ID->VendorID == 0)
+	  return NULL;
+
+	for (i = 0; i < ANDROID_CONFIG_CACHE_SIZE; i++)
+	{
+		if ((ConfigCache[i].ID.VendorID      == ID->VendorID)  &&
+		    (ConfigCache[i].ID.ProductID     == ID->ProductID) &&
+		    (ConfigCache[i].ID.ReleaseNumber == ID->ReleaseNumber))
+		{
+			return &ConfigCache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/** Configures the Android Accessory data IN and OUT pipes. */
+static void ConfigureDataPipes(uint8_t corenum, const AndroidHost_CachedConfig_t* Config)
+{
 	/* Configure the Android Accessory data IN pipe */
 	Pipe_ConfigurePipe(corenum, ANDROID_DATA_IN_PIPE, EP_TYPE_BULK, PIPE_TOKEN_IN,
-	                   DataINEndpoint->EndpointAddress, DataINEndpoint->EndpointSize, PIPE_BANK_SINGLE);
+	                   Config->DataINAddress, Config->DataINSize, PIPE_BANK_SINGLE);
 
 	/* Configure the Android Accessory data OUT pipe */
 	Pipe_ConfigurePipe(corenum, ANDROID_DATA_OUT_PIPE, EP_TYPE_BULK, PIPE_TOKEN_OUT,
-					   DataOUTEndpoint->EndpointAddress, DataOUTEndpoint->EndpointSize, PIPE_BANK_SINGLE);
-
-	/* Valid data found, return success */
-	return SuccessfulConfigRead;
+					   Config->DataOUTAddress, Config->DataOUTSize, PIPE_BANK_SINGLE);
 }
 
 /** Descriptor comparator function. This comparator function is can be called while processing an attached USB device's
@@ -44,6 +44,9 @@
 #include "DeviceDescriptor.h"
 #include "ConfigDescriptor.h"
 
+/** IDs of the device last processed by \ref ProcessDeviceDescriptor() on each core. */
+static AndroidHost_DeviceID_t DeviceID[MAX_USB_CORE];
+
 /** Reads and processes an attached device's Device Descriptor, to determine compatibility
  *
  *  This routine checks to ensure that the attached device's VID and PID matches Google's for Android devices.
@@ -54,6 +57,8 @@ uint8_t ProcessDeviceDescriptor(uint8_t corenum)
 {
 	USB_Descriptor_Device_t DeviceDescriptor;
 
+	DeviceID[corenum].VendorID = 0;
+
 	/* Send the request to retrieve the device descriptor */
 	if (USB_Host_GetDeviceDescriptor(corenum, &DeviceDescriptor) != HOST_SENDCONTROL_Successful)
 	  return DevControlError;
@@ -62,6 +67,10 @@ uint8_t ProcessDeviceDescriptor(uint8_t corenum)
 	if (DeviceDescriptor.Header.Type != DTYPE_Device)
 	  return InvalidDeviceDataReturned;
 
+	DeviceID[corenum].VendorID      = DeviceDescriptor.VendorID;
+	DeviceID[corenum].ProductID     = DeviceDescriptor.ProductID;
+	DeviceID[corenum].ReleaseNumber = DeviceDescriptor.ReleaseNumber;
+
 	/* Validate returned device Vendor ID against the Android ADK spec values */
 /*
  * EA: Second time XOOM is connected it announces itself with VID=MOTOROLA (0x22b8)
@@ -86,3 +95,12 @@ uint8_t ProcessDeviceDescriptor(uint8_t corenum)
 	return AccessoryModeAndroidDevice;
 }
 
+/** Returns the IDs of the device last processed by \ref ProcessDeviceDescriptor() on the given core.
+ *
+ *  \return Pointer to the IDs, VendorID is 0 if no Device Descriptor has been read.
+ */
+const AndroidHost_DeviceID_t* GetDeviceID(uint8_t corenum)
+{
+	return &DeviceID[corenum];
+}
+
@@ -6,33 +6,60 @@
 C_SRCS += \
 ../src/board.c \
 ../src/btn.c \
+../src/canbench.c \
+../src/canaf.c \
+../src/canbaud.c \
+../src/canbtr.c \
+../src/canbus.c \
+../src/canlog.c \
 ../src/canpt.c \
-../src/eadebug.c \
+../src/canroute.c \
+../src/dlog.c \
 ../src/eeprom.c \
 ../src/rfpt.c \
 ../src/rgb.c \
+../src/sdbench.c \
+../src/serial.c \
 ../src/time.c \
 ../src/xbee.c 
 
 OBJS += \
 ./src/board.o \
 ./src/btn.o \
+./src/canbench.o \
+./src/canaf.o \
+./src/canbaud.o \
+./src/canbtr.o \
+./src/canbus.o \
+./src/canlog.o \
 ./src/canpt.o \
-./src/eadebug.o \
+./src/canroute.o \
+./src/dlog.o \
 ./src/eeprom.o \
 ./src/rfpt.o \
 ./src/rgb.o \
+./src/sdbench.o \
+./src/serial.o \
 ./src/time.o \
 ./src/xbee.o 
 
 C_DEPS += \
 ./src/board.d \
 ./src/btn.d \
+./src/canbench.d \
+./src/canaf.d \
+./src/canbaud.d \
+./src/canbtr.d \
+./src/canbus.d \
+./src/canlog.d \
 ./src/canpt.d \
-./src/eadebug.d \
+./src/canroute.d \
+./src/dlog.d \
 ./src/eeprom.d \
 ./src/rfpt.d \
 ./src/rgb.d \
+./src/sdbench.d \
+./src/serial.d \
 ./src/time.d \
 ./src/xbee.d 
 
@@ -41,7 +68,7 @@ C_DEPS += \
 src/%.o: ../src/%.c
 	@echo 'Building file: $<'
 	@echo 'Invoking: MCU C Compiler'
-	arm-none-eabi-gcc -DDEBUG -D__CODE_RED -D__REDLIB__ -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_CMSISv2p00_LPC17xx\inc" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\src\include" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\port" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\src\include\ipv4" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_Board\inc" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_MCU\inc" -O0 -g3 -Wall -c -fmessage-length=0 -fno-builtin -ffunction-sections -mcpu=cortex-m3 -mthumb -D__REDLIB__ -specs=redlib.specs -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.o)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
+	arm-none-eabi-gcc -DDEBUG -D__CODE_RED -D__REDLIB__ -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_CMSISv2p00_LPC17xx\inc" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\src\include" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\port" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_lwip\src\include\ipv4" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_Board\inc" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_MCU\inc" -I"D:\Td2WorkspaceTest\DemoAoaCan\Lib_FatFs_SD\inc" -O0 -g3 -Wall -c -fmessage-length=0 -fno-builtin -ffunction-sections -mcpu=cortex-m3 -mthumb -D__REDLIB__ -specs=redlib.specs -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.o)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
 	@echo 'Finished building: $<'
 	@echo ' '
 
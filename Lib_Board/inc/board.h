@@ -26,6 +26,8 @@ typedef enum {
   ERR_TIMEOUT,
   ERR_NOT_INIT,
   ERR_CAN_SEND,
+  ERR_CAN_FILTER,
+  ERR_FILE,
   ERR_RF_CMD_ERROR,
   ERR_RF_READ_ERROR,
 
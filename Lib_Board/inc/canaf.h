@@ -0,0 +1,109 @@
+/****************************************************************************************************//**
+*
+* @file		canaf.h
+* @brief	Compiler for the CAN acceptance filter look-up table
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANAF_H
+#define __CANAF_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Maximum number of filters passed to canaf_compile
+#ifndef CANAF_MAX_FILTERS
+#define CANAF_MAX_FILTERS (64)
+#endif
+
+// Size of the acceptance filter RAM in words
+#define CANAF_RAM_WORDS (512)
+
+// Maximum number of FullCAN objects
+#define CANAF_MAX_FULLCAN (64)
+
+// Results of canaf_match
+#define CANAF_MATCH_NONE    (0)
+#define CANAF_MATCH_FULLCAN (1)
+#define CANAF_MATCH_RX      (2)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * IDs to accept on a controller. A single 11-bit ID (idLow == idHigh) can
+ * be put in a FullCAN object, such frames are not put in the receive
+ * buffer and must be read with canaf_readFullCan.
+ */
+typedef struct {
+  uint8_t ctrl;       // CAN1_CTRL or CAN2_CTRL
+  uint8_t format;     // STD_ID_FORMAT or EXT_ID_FORMAT
+  uint8_t fullCan;
+  uint32_t idLow;
+  uint32_t idHigh;
+} canaf_filter_t;
+
+/*
+ * Section start addresses (byte offsets in the filter RAM, same values as
+ * written to SFF_sa, SFF_GRP_sa, EFF_sa, EFF_GRP_sa and ENDofTable)
+ */
+typedef struct {
+  uint16_t sffSa;
+  uint16_t sffGrpSa;
+  uint16_t effSa;
+  uint16_t effGrpSa;
+  uint16_t endOfTable;
+  uint8_t numFullCan;
+} canaf_layout_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canaf_compile(const canaf_filter_t* filters, uint16_t num,
+    uint32_t* ram, canaf_layout_t* layout);
+uint8_t canaf_match(const uint32_t* ram, const canaf_layout_t* layout,
+    uint8_t ctrl, uint8_t format, uint32_t id);
+
+error_t canaf_setup(const canaf_filter_t* filters, uint16_t num);
+uint8_t canaf_readFullCan(uint8_t* ctrl, can_frame_t* frame);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
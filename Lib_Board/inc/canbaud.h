@@ -0,0 +1,71 @@
+/****************************************************************************************************//**
+*
+* @file		canbaud.h
+* @brief	CAN bit rate detection in listen-only mode
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANBAUD_H
+#define __CANBAUD_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_can.h"
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Time each candidate bit rate is listened to, in ms
+#ifndef CANBAUD_DWELL_MS
+#define CANBAUD_DWELL_MS (250)
+#endif
+
+// Error free frames after which a candidate is taken at once
+#ifndef CANBAUD_LOCK_FRAMES
+#define CANBAUD_LOCK_FRAMES (8)
+#endif
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canbaud_detect(LPC_CAN_TypeDef* CANx, const uint32_t* rates,
+    uint8_t num, uint16_t samplePoint, uint32_t* bitrate);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -0,0 +1,74 @@
+/****************************************************************************************************//**
+*
+* @file		canbench.h
+* @brief	Cycle count comparison of the CAN frame copy paths
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANBENCH_H
+#define __CANBENCH_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Number of frames moved between two reads of the cycle counter
+#ifndef CANBENCH_BATCH
+#define CANBENCH_BATCH (32)
+#endif
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Cycles per frame, the fastest of all rounds
+ */
+typedef struct {
+  uint32_t rxMsg;    // RFS/RID/RDA/RDB unpacked to CAN_MSG_Type, copied to a ring slot
+  uint32_t rxFrame;  // RFS/RID/RDA/RDB read into a can_frame_t ring slot
+  uint32_t txMsg;    // CAN_MSG_Type ring slot packed into TFI/TID/TDA/TDB
+  uint32_t txFrame;  // can_frame_t ring slot written to TFI/TID/TDA/TDB
+} canbench_result_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canbench_run(uint32_t rounds, canbench_result_t* res);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
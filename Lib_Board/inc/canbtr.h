@@ -0,0 +1,125 @@
+/****************************************************************************************************//**
+*
+* @file		canbtr.h
+* @brief	CAN bit timing solver
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANBTR_H
+#define __CANBTR_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc_types.h"
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// CAN peripheral clock constant bit rates are checked against at build
+// time (CCLK 120 MHz divided by 4, as set up by CAN_Init)
+#ifndef CANBTR_PCLK_HZ
+#define CANBTR_PCLK_HZ (30000000)
+#endif
+
+// Largest accepted difference between requested and generated bit rate
+#ifndef CANBTR_MAX_ERROR_PPM
+#define CANBTR_MAX_ERROR_PPM (5000)
+#endif
+
+// Time quanta per bit tried by the solver. TSEG1 is 1-16 and TSEG2 1-8
+// quanta, plus one quantum for the sync segment.
+#define CANBTR_TQ_MIN (8)
+#define CANBTR_TQ_MAX (25)
+
+// Range of the prescaler and the synchronization jump width
+#define CANBTR_BRP_MAX (1024)
+#define CANBTR_SJW_MAX (4)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+/*
+ * Build time check of a constant bit rate, e.g.
+ *
+ *   #if !CANBTR_RATE_VALID(CANBTR_PCLK_HZ, 33333)
+ *   #error "bit rate can't be generated"
+ *   #endif
+ *
+ * True if some number of quanta per bit gives a prescaler in range and a
+ * bit rate within CANBTR_MAX_ERROR_PPM, computed like canbtr_solve does.
+ * Only integer constants may be used as arguments.
+ */
+#define CANBTR_BRP(pclk, rate, tq) (((pclk) + (rate) * (tq) / 2) / ((rate) * (tq)))
+#define CANBTR_ABS(x) ((x) < 0 ? -(x) : (x))
+#define CANBTR_TQ_VALID(pclk, rate, tq) \
+  (CANBTR_BRP(pclk, rate, tq) >= 1 && CANBTR_BRP(pclk, rate, tq) <= CANBTR_BRP_MAX \
+  && CANBTR_ABS((pclk) - CANBTR_BRP(pclk, rate, tq) * (tq) * (rate)) * 1000000 \
+  / (CANBTR_BRP(pclk, rate, tq) * (tq) * (rate)) <= (CANBTR_MAX_ERROR_PPM))
+#define CANBTR_RATE_VALID(pclk, rate) ((rate) > 0 && ( \
+  CANBTR_TQ_VALID(pclk, rate, 8) || CANBTR_TQ_VALID(pclk, rate, 9) \
+  || CANBTR_TQ_VALID(pclk, rate, 10) || CANBTR_TQ_VALID(pclk, rate, 11) \
+  || CANBTR_TQ_VALID(pclk, rate, 12) || CANBTR_TQ_VALID(pclk, rate, 13) \
+  || CANBTR_TQ_VALID(pclk, rate, 14) || CANBTR_TQ_VALID(pclk, rate, 15) \
+  || CANBTR_TQ_VALID(pclk, rate, 16) || CANBTR_TQ_VALID(pclk, rate, 17) \
+  || CANBTR_TQ_VALID(pclk, rate, 18) || CANBTR_TQ_VALID(pclk, rate, 19) \
+  || CANBTR_TQ_VALID(pclk, rate, 20) || CANBTR_TQ_VALID(pclk, rate, 21) \
+  || CANBTR_TQ_VALID(pclk, rate, 22) || CANBTR_TQ_VALID(pclk, rate, 23) \
+  || CANBTR_TQ_VALID(pclk, rate, 24) || CANBTR_TQ_VALID(pclk, rate, 25)))
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Bit timing. brp, tseg1, tseg2 and sjw are in quanta (not the register
+ * values, which are one less), 'btr' is the value for the BTR register.
+ */
+typedef struct {
+  uint16_t brp;
+  uint8_t tseg1;
+  uint8_t tseg2;
+  uint8_t sjw;
+  uint32_t btr;
+  uint32_t bitrate;      // generated bit rate
+  uint16_t samplePoint;  // generated sample point in 1/1000 of the bit
+  uint32_t errorPpm;     // difference to the requested bit rate
+} canbtr_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canbtr_solve(uint32_t pclk, uint32_t bitrate, uint16_t samplePoint,
+    uint8_t sjw, canbtr_t* timing);
+error_t canbtr_decode(uint32_t pclk, uint32_t btr, canbtr_t* timing);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -0,0 +1,183 @@
+/****************************************************************************************************//**
+*
+* @file		canbus.h
+* @brief	Interrupt driven transmit and receive queues for the CAN1/CAN2 controllers
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANBUS_H
+#define __CANBUS_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_can.h"
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Number of CAN controllers handled by this module (CAN1 and CAN2)
+#define CAN_NUM_CTRL (2)
+
+// Number of frames that can be queued for transmission on each controller.
+// Must be a power of two.
+#ifndef CAN_TX_QUEUE_SIZE
+#define CAN_TX_QUEUE_SIZE (32)
+#endif
+
+// Number of received frames buffered for each controller.
+// Must be a power of two.
+#ifndef CAN_RX_QUEUE_SIZE
+#define CAN_RX_QUEUE_SIZE (64)
+#endif
+
+// Length of the window the bus load is measured over, in ms
+#ifndef CAN_LOAD_WINDOW_MS
+#define CAN_LOAD_WINDOW_MS (1000)
+#endif
+
+// Delay before leaving bus-off. The delay is doubled for every bus-off
+// up to the max value and restarts at min after CAN_BUSOFF_RESET_MS
+// without bus-off.
+#ifndef CAN_BUSOFF_DELAY_MIN_MS
+#define CAN_BUSOFF_DELAY_MIN_MS (10)
+#endif
+#ifndef CAN_BUSOFF_DELAY_MAX_MS
+#define CAN_BUSOFF_DELAY_MAX_MS (2560)
+#endif
+#ifndef CAN_BUSOFF_RESET_MS
+#define CAN_BUSOFF_RESET_MS (10000)
+#endif
+
+// Synchronization jump width (quanta) used by can_setBitrate
+#ifndef CAN_BTR_SJW
+#define CAN_BTR_SJW (1)
+#endif
+
+// Error states in can_stats_t
+#define CAN_STATE_ACTIVE  (0)
+#define CAN_STATE_PASSIVE (1)
+#define CAN_STATE_BUSOFF  (2)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+// Index (0 for CAN1, 1 for CAN2) of a controller
+#define CAN_CTRL_IDX(CANx) ((CANx) == LPC_CAN1 ? 0 : 1)
+
+// Field accessors for can_frame_t
+#define CAN_FRAME_LEN(f)    (((f)->rfs >> 16) & 0x0F)
+#define CAN_FRAME_IS_EXT(f) (((f)->rfs & CAN_RFS_FF) != 0)
+#define CAN_FRAME_IS_RTR(f) (((f)->rfs & CAN_RFS_RTR) != 0)
+#define CAN_FRAME_FORMAT(f) (CAN_FRAME_IS_EXT(f) ? EXT_ID_FORMAT : STD_ID_FORMAT)
+
+// Payload of a can_frame_t as bytes (data[0] is byte 0 to 3, little endian)
+#define CAN_FRAME_DATA(f)   ((uint8_t*)(f)->data)
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Frame stored the way the controller holds it in RFS/RID/RDA/RDB, so it
+ * can be moved to and from the controller registers as four words. Only
+ * the FF, RTR and DLC bits of 'rfs' are used when sending.
+ */
+typedef struct {
+  uint32_t rfs;
+  uint32_t id;
+  uint32_t data[2];
+} can_frame_t;
+
+/*
+ * Called from the CAN interrupt for every frame read from a controller,
+ * 'dropped' is set if the frame didn't fit in the receive queue.
+ */
+typedef void (*can_rx_hook_t)(uint8_t ctrl, const can_frame_t* frame,
+    uint8_t dropped);
+
+/*
+ * Statistics of a controller. Counters are never reset. 'lastAlc' is the
+ * ALCBIT field and 'lastEcc' bits 23:16 (ERRC, ERRDIR, ERRBIT) of ICR as
+ * captured at the last arbitration lost and bus error interrupt.
+ */
+typedef struct {
+  uint32_t rxFrames;     // frames put in the receive queue
+  uint32_t rxBytes;      // data bytes of those frames
+  uint32_t rxDropped;    // frames lost because the receive queue was full
+  uint32_t rxHighWater;  // highest number of frames waiting in the queue
+  uint32_t txFrames;     // frames sent
+  uint32_t txBytes;      // data bytes of those frames
+  uint32_t txDropped;    // frames not queued because the queue was full
+  uint32_t overruns;     // data overrun interrupts
+  uint32_t errPassive;   // transitions to error passive
+  uint32_t busOff;       // transitions to bus-off
+  uint32_t arbLost;      // arbitration lost interrupts
+  uint32_t busErrors;    // bus error interrupts
+  uint32_t latencyMax;   // longest time (us) from receive to release
+  uint32_t latencyAvg;   // moving average of the same time (us)
+  uint8_t lastAlc;
+  uint8_t lastEcc;
+  uint8_t rxErr;         // RXERR from GSR when the statistics were read
+  uint8_t txErr;         // TXERR from GSR
+  uint8_t state;         // CAN_STATE_x
+  uint8_t busLoad;       // percent of the bus used during the last window
+} can_stats_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+void can_tx_init(LPC_CAN_TypeDef* CANx);
+error_t can_tx_enqueue(LPC_CAN_TypeDef* CANx, CAN_MSG_Type* msg);
+error_t can_tx_enqueueFrame(LPC_CAN_TypeDef* CANx, const can_frame_t* frame);
+uint32_t can_tx_pending(LPC_CAN_TypeDef* CANx);
+void can_tx_isr(LPC_CAN_TypeDef* CANx, uint32_t icr);
+
+void can_rx_init(LPC_CAN_TypeDef* CANx);
+can_frame_t* can_rx_peek(LPC_CAN_TypeDef* CANx);
+void can_rx_release(LPC_CAN_TypeDef* CANx);
+uint32_t can_rx_pending(LPC_CAN_TypeDef* CANx);
+void can_rx_isr(LPC_CAN_TypeDef* CANx, uint32_t icr);
+void can_rx_setHook(can_rx_hook_t hook);
+
+void can_err_init(LPC_CAN_TypeDef* CANx);
+void can_err_isr(LPC_CAN_TypeDef* CANx, uint32_t icr);
+void can_err_task(void);
+void can_getStats(LPC_CAN_TypeDef* CANx, can_stats_t* stats);
+
+error_t can_setBitrate(LPC_CAN_TypeDef* CANx, uint32_t bitrate,
+    uint16_t samplePoint);
+
+void can_frame_fromMsg(can_frame_t* frame, const CAN_MSG_Type* msg);
+void can_frame_toMsg(const can_frame_t* frame, CAN_MSG_Type* msg);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
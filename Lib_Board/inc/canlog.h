@@ -0,0 +1,109 @@
+/****************************************************************************************************//**
+*
+* @file		canlog.h
+* @brief	Timestamped capture of CAN traffic to a file on the SD card
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANLOG_H
+#define __CANLOG_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Size of each of the two capture buffers in 512 byte sectors
+#ifndef CANLOG_BUF_SECTORS
+#define CANLOG_BUF_SECTORS (4)
+#endif
+
+// Bytes of contiguous space reserved on the card for the file when
+// capturing starts, 0 to allocate clusters one at a time
+#ifndef CANLOG_RESERVE
+#define CANLOG_RESERVE (8UL * 1024 * 1024)
+#endif
+
+// FAT entries of drive 0 scanned by each canlog_task call while not
+// capturing, to build the free cluster map f_stream needs (f_mapfree).
+// 0 if the application calls f_mapfree itself.
+#ifndef CANLOG_MAP_ENTRIES
+#define CANLOG_MAP_ENTRIES (1024)
+#endif
+
+// File formats
+#define CANLOG_FORMAT_BINARY  (0)   // canlog_rec_t records
+#define CANLOG_FORMAT_CANDUMP (1)   // text as written by 'candump -l'
+
+// canlog_rec_t flags
+#define CANLOG_FLAG_DROPPED (0x01)  // frame was lost by the receive queue
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Record in a binary log file, 16 records per sector. 'timestamp' is in
+ * us since startup, 'bus' is 0 for CAN1 and 1 for CAN2.
+ */
+typedef struct {
+  uint64_t timestamp;
+  uint8_t bus;
+  uint8_t flags;
+  uint16_t reserved1;
+  uint32_t reserved2;
+  can_frame_t frame;
+} canlog_rec_t;
+
+typedef struct {
+  uint32_t captured;   // frames put in a capture buffer
+  uint32_t lost;       // frames lost because both buffers were full
+  uint32_t written;    // frames written to the file
+  uint32_t errors;     // failed file writes
+} canlog_stats_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canlog_start(const char* fileName, uint8_t format);
+error_t canlog_stop(void);
+void canlog_task(void);
+void canlog_getStats(canlog_stats_t* stats);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
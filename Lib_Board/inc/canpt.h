@@ -24,6 +24,7 @@
 *** INCLUDES
 ********************************************************************************************************/
 
+#include "canroute.h"
 
 /********************************************************************************************************
 *** DEFINES
@@ -40,6 +41,15 @@
 #define CANPT_CAN1_BAUDRATE (33333)
 #define CANPT_CAN2_BAUDRATE (33333)
 
+// Sample point of CAN1-CAN2 in 1/1000 of the bit
+#define CANPT_SAMPLE_POINT (875)
+
+// Set to 1 to detect the bit rate of both buses at startup (canbaud.h),
+// the rates above are used for a bus without traffic
+#ifndef CANPT_AUTOBAUD
+#define CANPT_AUTOBAUD (0)
+#endif
+
 // Mask for common IDs -> 0x0 to 0xF
 #define CANPT_MSG_CMN_MASK (0x7F0)
 
@@ -123,13 +133,15 @@ typedef struct {
 
 //error_t sendMessage(uint8_t reqId, uint8_t dataLen);
 error_t sendMessage(LPC_CAN_TypeDef * CANx, uint8_t reqId, uint8_t dataLen);
-//void canpt_init(canpt_callb_t* callbacks);
-void canpt_init();
+void canpt_init(canpt_callb_t* callbacks);
+error_t canpt_setRoutes(const canroute_t* table, uint16_t num);
 error_t canpt_discover(void);
 void canpt_task(void);
+void canpt_printStats(void);
 error_t canpt_subscribe(uint8_t reqId, uint8_t periphId, uint8_t subAct,
     uint8_t* valBuf, uint8_t len);
 error_t canpt_unsubscribe(uint8_t reqId, uint8_t subId);
+error_t canpt_unsubscribeList(uint8_t reqId, const uint8_t* subIds, uint8_t num);
 error_t canpt_getTemperature(uint8_t reqId);
 error_t canpt_getLight(uint8_t reqId);
 error_t canpt_getButton(uint8_t reqId);
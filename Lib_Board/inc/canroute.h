@@ -0,0 +1,111 @@
+/****************************************************************************************************//**
+*
+* @file		canroute.h
+* @brief	Routing table for the CAN1/CAN2 gateway
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __CANROUTE_H
+#define __CANROUTE_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Maximum number of routes in a routing table
+#ifndef CANROUTE_MAX_ROUTES
+#define CANROUTE_MAX_ROUTES (64)
+#endif
+
+// Bus numbers (same numbering as CAN1_CTRL/CAN2_CTRL in the acceptance filter)
+#define CANROUTE_BUS1 (0)
+#define CANROUTE_BUS2 (1)
+#define CANROUTE_NUM_BUSES (2)
+
+// newId value for routes that keep the received ID
+#define CANROUTE_ID_KEEP (0xFFFFFFFF)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+// Destination mask bit for a bus
+#define CANROUTE_DST(bus) (1 << (bus))
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Optional payload transform. May modify the frame (it is a copy of the
+ * received frame). Return 0 to drop the frame.
+ */
+typedef uint8_t (*canroute_transform_t)(can_frame_t* frame);
+
+/*
+ * A route. Frames received on 'srcBus' with the given ID format and an ID
+ * in [idLow, idHigh] are sent on all buses in 'dstMask'. If 'mask' is
+ * non-zero the ID must also satisfy (id & mask) == (idLow & mask).
+ *
+ * If 'newId' is not CANROUTE_ID_KEEP the range is moved to start at
+ * 'newId', i.e. the forwarded ID is newId + (id - idLow).
+ *
+ * 'fullCan' can be set for a single high rate 11-bit ID to receive it in a
+ * FullCAN object instead of the receive buffer.
+ */
+typedef struct {
+  uint8_t srcBus;
+  uint8_t format;
+  uint8_t dstMask;
+  uint32_t idLow;
+  uint32_t idHigh;
+  uint32_t mask;
+  uint32_t newId;
+  canroute_transform_t transform;
+  uint8_t fullCan;
+} canroute_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t canroute_compile(const canroute_t* routes, uint16_t num);
+uint16_t canroute_count(void);
+const canroute_t* canroute_get(uint16_t idx);
+const canroute_t* canroute_lookup(uint8_t bus, uint8_t format, uint32_t id);
+void canroute_range(const canroute_t* route, uint32_t* low, uint32_t* high);
+uint8_t canroute_apply(const canroute_t* route, can_frame_t* frame);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -0,0 +1,175 @@
+/****************************************************************************************************//**
+*
+* @file		dlog.h
+* @brief	Deferred binary logging to the console
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __DLOG_H
+#define __DLOG_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc_types.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Log levels
+#define DLOG_LEVEL_NONE (0)
+#define DLOG_LEVEL_ERR  (1)
+#define DLOG_LEVEL_WARN (2)
+#define DLOG_LEVEL_INFO (3)
+#define DLOG_LEVEL_DBG  (4)
+
+// Records above this level are removed at compile time
+#ifndef DLOG_LEVEL
+#ifdef DEBUG
+#define DLOG_LEVEL DLOG_LEVEL_DBG
+#else
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+#endif
+
+// Size of the record ring in 32-bit words, must be a power of two
+#ifndef DLOG_RING_WORDS
+#define DLOG_RING_WORDS (512)
+#endif
+
+// Most arguments of a record and most bytes of a data record
+#define DLOG_MAX_ARGS (8)
+#define DLOG_MAX_DATA (64)
+
+// Most bytes copied of a %s argument in RAM, longer strings are cut
+#ifndef DLOG_MAX_STR
+#define DLOG_MAX_STR (16)
+#endif
+
+// True if a %s argument may change after the call and must be copied
+// (local and AHB SRAM), strings in flash are logged by address
+#ifndef DLOG_IS_RAM
+#define DLOG_IS_RAM(addr) ((addr) >= 0x10000000UL && (addr) < 0x20084000UL)
+#endif
+
+// First byte of every record on the console
+#define DLOG_SYNC (0x1E)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+/*
+ * A record holds the address of the format string and the arguments as
+ * 32-bit words, formatting is done by the host decoder (tools/dlog_decode.py)
+ * using the .axf file of the build. The format must be a string literal.
+ * Strings (%s) in flash are logged by address, strings in RAM are copied
+ * into the record (at most DLOG_MAX_STR bytes).
+ *
+ *   DLOG_INFO("CAN%d: bus off, tec=%d\r\n", ctrl + 1, tec);
+ *   DLOG_DBG_DATA("rx: ", buf, len);
+ */
+
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b) a##b
+
+// ", (uint32_t)(a1), (uint32_t)(a2) ..." for each argument
+#define DLOG_ARGS(...) DLOG_CAT(DLOG_ARGS_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define DLOG_ARGS_0(...)
+#define DLOG_ARGS_1(a) , (uint32_t)(a)
+#define DLOG_ARGS_2(a, ...) , (uint32_t)(a) DLOG_ARGS_1(__VA_ARGS__)
+#define DLOG_ARGS_3(a, ...) , (uint32_t)(a) DLOG_ARGS_2(__VA_ARGS__)
+#define DLOG_ARGS_4(a, ...) , (uint32_t)(a) DLOG_ARGS_3(__VA_ARGS__)
+#define DLOG_ARGS_5(a, ...) , (uint32_t)(a) DLOG_ARGS_4(__VA_ARGS__)
+#define DLOG_ARGS_6(a, ...) , (uint32_t)(a) DLOG_ARGS_5(__VA_ARGS__)
+#define DLOG_ARGS_7(a, ...) , (uint32_t)(a) DLOG_ARGS_6(__VA_ARGS__)
+#define DLOG_ARGS_8(a, ...) , (uint32_t)(a) DLOG_ARGS_7(__VA_ARGS__)
+
+#define DLOG_WRITE(level, fmt, ...) do { \
+    static const char _dlogFmt[] = fmt; \
+    const uint32_t _dlogArgs[] = {0 DLOG_ARGS(__VA_ARGS__)}; \
+    dlog_write((level), _dlogFmt, DLOG_NARGS(__VA_ARGS__), &_dlogArgs[1]); \
+  } while (0)
+
+#define DLOG_WRITE_DATA(level, fmt, buf, len) do { \
+    static const char _dlogFmt[] = fmt; \
+    dlog_writeData((level), _dlogFmt, (buf), (len)); \
+  } while (0)
+
+#if DLOG_LEVEL >= DLOG_LEVEL_ERR
+#define DLOG_ERR(...) DLOG_WRITE(DLOG_LEVEL_ERR, __VA_ARGS__)
+#else
+#define DLOG_ERR(...) do { } while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_WARN
+#define DLOG_WARN(...) DLOG_WRITE(DLOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define DLOG_WARN(...) do { } while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_INFO
+#define DLOG_INFO(...) DLOG_WRITE(DLOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define DLOG_INFO(...) do { } while (0)
+#endif
+
+#if DLOG_LEVEL >= DLOG_LEVEL_DBG
+#define DLOG_DBG(...) DLOG_WRITE(DLOG_LEVEL_DBG, __VA_ARGS__)
+#define DLOG_DBG_DATA(fmt, buf, len) DLOG_WRITE_DATA(DLOG_LEVEL_DBG, fmt, buf, len)
+#else
+#define DLOG_DBG(...) do { } while (0)
+#define DLOG_DBG_DATA(fmt, buf, len) do { } while (0)
+#endif
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint32_t written;    // records put in the ring
+  uint32_t dropped;    // records lost because the ring was full
+  uint32_t sent;       // records sent to the console
+  uint16_t maxUsed;    // most words used in the ring
+} dlog_stats_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+void dlog_write(uint8_t level, const char* fmt, uint8_t nargs, const uint32_t* args);
+void dlog_writeData(uint8_t level, const char* fmt, const void* data, uint32_t len);
+void dlog_task(void);
+void dlog_flush(void);
+void dlog_getStats(dlog_stats_t* stats);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -20,19 +20,14 @@
 
 #include "LPC17xx.h"
 #include "board.h"
-extern uint8_t g_dbbuf[];
+#include "dlog.h"
 
-#ifdef DEBUG
-
-#define dbg(...) do {\
-    sprintf((char*)g_dbbuf, __VA_ARGS__); \
-    console_sendString(g_dbbuf); \
-  } while(0);
-
-
-#else
-#define dbg(...)
-#endif
+/*
+ * Debug output goes through the deferred log, see dlog.h. The format
+ * must be a string literal and there can be at most DLOG_MAX_ARGS
+ * arguments.
+ */
+#define dbg(...) DLOG_DBG(__VA_ARGS__)
 
 #endif /* end __DEBUG_H */
 /****************************************************************************
@@ -0,0 +1,74 @@
+/****************************************************************************************************//**
+*
+* @file		sdbench.h
+* @brief	Throughput measurement of the SD card driver
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __SDBENCH_H
+#define __SDBENCH_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Number of sectors moved by one multi-block transfer
+#ifndef SDBENCH_MULTI_SECTORS
+#define SDBENCH_MULTI_SECTORS (8)
+#endif
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Throughput in kB/s (1000 bytes per second), 0 if not measured
+ */
+typedef struct {
+  uint32_t singleRead;   // one CMD17 per sector
+  uint32_t multiRead;    // CMD18 runs of SDBENCH_MULTI_SECTORS
+  uint32_t singleWrite;  // one CMD24 per sector
+  uint32_t multiWrite;   // CMD25 runs of SDBENCH_MULTI_SECTORS
+} sdbench_result_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t sdbench_run(uint32_t sector, uint32_t count, uint8_t write, sdbench_result_t* res);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
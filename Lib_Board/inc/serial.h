@@ -0,0 +1,89 @@
+/****************************************************************************************************//**
+*
+* @file		serial.h
+* @brief	Interrupt driven UART transmit and receive through ring buffers
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "lpc17xx_uart.h"
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Number of UARTs handled by this module (UART0 to UART3)
+#define SERIAL_NUM_PORTS (4)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+// Index (0 for UART0 .. 3 for UART3) of a UART
+#define SERIAL_PORT_IDX(UARTx) \
+  ((UARTx) == (LPC_UART_TypeDef*)LPC_UART0 ? 0 : \
+   (UARTx) == (LPC_UART_TypeDef*)LPC_UART1 ? 1 : \
+   (UARTx) == LPC_UART2 ? 2 : 3)
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Statistics of a UART. Counters are never reset.
+ */
+typedef struct {
+  uint32_t txBytes;      // bytes written to the transmit FIFO
+  uint32_t txDropped;    // bytes not queued because the transmit ring was full
+  uint32_t rxBytes;      // bytes put in the receive ring
+  uint32_t rxDropped;    // bytes lost because the receive ring was full
+  uint32_t rxHighWater;  // highest number of bytes waiting in the receive ring
+  uint32_t lineErrors;   // overrun, parity, framing and break conditions
+} serial_stats_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+error_t serial_init(LPC_UART_TypeDef* UARTx, uint8_t* txBuf, uint16_t txSize,
+    uint8_t* rxBuf, uint16_t rxSize, UART_FITO_LEVEL_Type rxTrigger);
+uint32_t serial_write(LPC_UART_TypeDef* UARTx, const uint8_t* data, uint32_t len);
+uint32_t serial_read(LPC_UART_TypeDef* UARTx, uint8_t* buf, uint32_t len);
+uint32_t serial_txFree(LPC_UART_TypeDef* UARTx);
+uint32_t serial_txPending(LPC_UART_TypeDef* UARTx);
+uint32_t serial_rxPending(LPC_UART_TypeDef* UARTx);
+void serial_isr(LPC_UART_TypeDef* UARTx);
+void serial_getStats(LPC_UART_TypeDef* UARTx, serial_stats_t* stats);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -21,6 +21,8 @@
 
 void time_init (void);
 uint32_t time_get (void);
+uint32_t time_getUs (void);
+uint64_t time_getUs64 (void);
 
 
 #endif /* end __TIME_H */
@@ -28,8 +28,11 @@
 #include "lpc17xx_uart.h"
 #include "lpc17xx_i2c.h"
 #include "lpc17xx_ssp.h"
+#include "lpc17xx_gpdma.h"
 #include "lpc17xx_adc.h"
+#include <string.h>
 #include "board.h"
+#include "serial.h"
 
 #include "lwip/inet.h"
 #include "lwip/init.h"
@@ -47,10 +50,21 @@ void ethernetif_poll(void);
 #define RF_DEV      ((LPC_UART_TypeDef *)LPC_UART1)
 
 /*
- * UART receive buffer helper macros
+ * UART ring sizes, must be powers of two
  */
 
-#define RX_BUF_SIZE (512)
+#ifndef CONSOLE_TX_BUF_SIZE
+#define CONSOLE_TX_BUF_SIZE (1024)
+#endif
+#ifndef CONSOLE_RX_BUF_SIZE
+#define CONSOLE_RX_BUF_SIZE (64)
+#endif
+#ifndef RF_TX_BUF_SIZE
+#define RF_TX_BUF_SIZE (256)
+#endif
+#ifndef RF_RX_BUF_SIZE
+#define RF_RX_BUF_SIZE (512)
+#endif
 
 /******************************************************************************
  * External global variables
@@ -63,64 +77,29 @@ void ethernetif_poll(void);
 static struct netif _eth0If;
 
 /*
- * UART receive buffer
+ * UART rings
  */
 
-static uint8_t rxqIn = 0;
-static uint8_t rxqOut = 0;
-static uint8_t rxq[RX_BUF_SIZE];
+static uint8_t consoleTx[CONSOLE_TX_BUF_SIZE];
+static uint8_t consoleRx[CONSOLE_RX_BUF_SIZE];
+static uint8_t rfTx[RF_TX_BUF_SIZE];
+static uint8_t rfRx[RF_RX_BUF_SIZE];
 
 /******************************************************************************
  * Local Functions
  *****************************************************************************/
 
-static void rxq_put(uint8_t data)
-{
-  // full
-  if (rxqOut == (rxqIn + 1) % RX_BUF_SIZE) {
-    return;
-  }
-  rxq[rxqIn] = data;
-  rxqIn = (rxqIn + 1) % RX_BUF_SIZE;
-}
-
-static uint8_t rxq_get(void)
+/*
+ * Queue data on a UART, with BLOCKING all or nothing
+ */
+static uint32_t uartQueue(LPC_UART_TypeDef* dev, uint8_t *txbuf,
+    uint32_t buflen, TRANSFER_BLOCK_Type flag)
 {
-  uint8_t d = 0;
-  // empty
-  if (rxqIn == rxqOut) {
+  if (flag == BLOCKING && serial_txFree(dev) < buflen) {
     return 0;
   }
 
-  d = rxq[rxqOut];
-  rxqOut = (rxqOut + 1) % RX_BUF_SIZE;
-
-  return d;
-}
-
-static uint8_t rxq_isEmpty(void)
-{
-  return (rxqIn == rxqOut);
-}
-
-static void rf_uartRecvCb(void)
-{
-  uint8_t data = 0;
-  uint32_t len = 0;
-
-  while(1) {
-      len = UART_Receive(RF_DEV, &data, 1, NONE_BLOCKING);
-
-      if (len) {
-        rxq_put(data);
-      }
-
-      // there is no more data
-      else {
-
-        break;
-      }
-  }
+  return serial_write(dev, txbuf, buflen);
 }
 
 
@@ -153,44 +132,49 @@ void console_init(void)
 	uartCfg.Stopbits = UART_STOPBIT_1;
 
 	UART_Init(CONSOLE_DEV, &uartCfg);
-	UART_TxCmd(CONSOLE_DEV, ENABLE);
+
+	serial_init(CONSOLE_DEV, consoleTx, CONSOLE_TX_BUF_SIZE,
+	    consoleRx, CONSOLE_RX_BUF_SIZE, UART_FIFO_TRGLEV2);
 }
 
 /******************************************************************************
  *
  * Description:
- *   Send data to the console.
+ *   Queue data for the console, sent from the UART interrupt. Never
+ *   waits for the UART.
  *
  * Params:
  *   [in] txbuf - buffer containing data to send
  *   [in] buflen - number of bytes to send
- *   [in] flag - indicates blocking or non-blocking transfer
+ *   [in] flag - BLOCKING queues all data or nothing, NONE_BLOCKING
+ *               as much as fits
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes queued.
  *
  *****************************************************************************/
 uint32_t console_send(uint8_t *txbuf, uint32_t buflen,
 		TRANSFER_BLOCK_Type flag)
 {
-	return UART_Send(CONSOLE_DEV, txbuf, buflen, flag);
+	return uartQueue(CONSOLE_DEV, txbuf, buflen, flag);
 }
 
 /******************************************************************************
  *
  * Description:
- *   Send a null-terminates string to the console.
+ *   Queue a null-terminated string for the console, the whole string
+ *   or nothing.
  *
  * Params:
  *   [in] str - the string to send
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes queued.
  *
  *****************************************************************************/
 uint32_t console_sendString(uint8_t *str)
 {
-	return UART_SendString(CONSOLE_DEV, str);
+	return uartQueue(CONSOLE_DEV, str, strlen((char*)str), BLOCKING);
 }
 
 /******************************************************************************
@@ -200,16 +184,24 @@ uint32_t console_sendString(uint8_t *str)
  *
  * Params:
  *   [in] rxbuf - pointer to receive buffer
- *   [in] buflen -
+ *   [in] buflen - length of buffer
+ *   [in] flag - BLOCKING waits until buflen bytes have been received,
+ *               NONE_BLOCKING returns what has been received
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes received.
  *
  *****************************************************************************/
 uint32_t console_receive(uint8_t *rxbuf, uint32_t buflen,
 		TRANSFER_BLOCK_Type flag)
 {
-	return UART_Receive(CONSOLE_DEV, rxbuf, buflen, flag);
+	uint32_t pos = 0;
+
+	do {
+		pos += serial_read(CONSOLE_DEV, &rxbuf[pos], buflen - pos);
+	} while (flag == BLOCKING && pos < buflen);
+
+	return pos;
 }
 
 /******************************************************************************
@@ -341,49 +333,48 @@ void rf_uart_init(void)
 
 	UART_Init(RF_DEV, &uartCfg);
 
-	UART_SetupCbs(RF_DEV, 0, &rf_uartRecvCb);
-
-	UART_TxCmd(RF_DEV, ENABLE);
-
-	UART_IntConfig(RF_DEV, UART_INTCFG_RBR, ENABLE);
-	NVIC_EnableIRQ(UART1_IRQn);
+	serial_init(RF_DEV, rfTx, RF_TX_BUF_SIZE, rfRx, RF_RX_BUF_SIZE,
+	    UART_FIFO_TRGLEV2);
 }
 
 /******************************************************************************
  *
  * Description:
- *   Send data to the XBee/Jennic module.
+ *   Queue data for the XBee/Jennic module, sent from the UART interrupt.
+ *   Never waits for the UART.
  *
  * Params:
  *   [in] txbuf - buffer containing data to send
  *   [in] buflen - number of bytes to send
- *   [in] flag - indicates blocking or non-blocking transfer
+ *   [in] flag - BLOCKING queues all data or nothing (use it for frames),
+ *               NONE_BLOCKING as much as fits
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes queued.
  *
  *****************************************************************************/
 uint32_t rf_uart_send(uint8_t *txbuf, uint32_t buflen,
 		TRANSFER_BLOCK_Type flag)
 {
-	return UART_Send(RF_DEV, txbuf, buflen, flag);
+	return uartQueue(RF_DEV, txbuf, buflen, flag);
 }
 
 /******************************************************************************
  *
  * Description:
- *   Send a null-terminates string to the XBee/Jennic.
+ *   Queue a null-terminated string for the XBee/Jennic, the whole string
+ *   or nothing.
  *
  * Params:
  *   [in] str - the string to send
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes queued.
  *
  *****************************************************************************/
 uint32_t rf_uart_sendString(uint8_t *str)
 {
-	return UART_SendString(RF_DEV, str);
+	return uartQueue(RF_DEV, str, strlen((char*)str), BLOCKING);
 }
 
 /******************************************************************************
@@ -396,21 +387,12 @@ uint32_t rf_uart_sendString(uint8_t *str)
  *   [in] buflen - length of buffer
  *
  * Returns:
- *   Number of bytes sent.
+ *   Number of bytes received.
  *
  *****************************************************************************/
 uint32_t rf_uart_receive(uint8_t *buf, uint32_t buflen)
 {
-
-  uint32_t pos = 0;
-
-  while(buflen > 0 && !rxq_isEmpty()) {
-    buf[pos] = rxq_get();
-    pos++;
-    buflen--;
-  }
-
-  return pos;
+  return serial_read(RF_DEV, buf, buflen);
 }
 
 /******************************************************************************
@@ -421,18 +403,40 @@ uint32_t rf_uart_receive(uint8_t *buf, uint32_t buflen)
  *****************************************************************************/
 uint8_t rf_uart_recvIsEmpty(void)
 {
-  return rxq_isEmpty();
+  return (serial_rxPending(RF_DEV) == 0);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *   UART0 (console) interrupt handler
+ *
+ *****************************************************************************/
+void UART0_IRQHandler(void)
+{
+  serial_isr(CONSOLE_DEV);
 }
 
 /******************************************************************************
  *
  * Description:
- *   UART1 interrupt handler
+ *   UART1 (XBee/Jennic) interrupt handler
  *
  *****************************************************************************/
 void UART1_IRQHandler(void)
 {
-  UART1_StdIntHandler();
+  serial_isr(RF_DEV);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *   GPDMA interrupt handler (SD card data blocks)
+ *
+ *****************************************************************************/
+void DMA_IRQHandler(void)
+{
+  GPDMA_IntHandler();
 }
 
 /******************************************************************************
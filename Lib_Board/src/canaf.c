@@ -0,0 +1,509 @@
+/****************************************************************************************************//**
+*
+* @file		canaf.c
+* @brief	Compiler for the CAN acceptance filter look-up table
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * The CAN_Load*Entry functions in lpc17xx_can.c insert one entry at a time
+ * and move the rest of the table up for every entry. canaf_compile instead
+ * sorts and merges all wanted IDs and ranges first and then writes the
+ * complete table once, in order:
+ *
+ *   - FullCAN IDs, two per word
+ *   - explicit 11-bit IDs, two per word
+ *   - 11-bit ranges, one per word
+ *   - explicit 29-bit IDs, one per word
+ *   - 29-bit ranges, two words each
+ *   - FullCAN message objects, three words each
+ *
+ * Overlapping and adjacent ranges are merged. A range of one or two IDs
+ * costs less (or the same) as explicit entries and is stored that way.
+ *
+ * canaf_compile and canaf_match only work on the memory passed to them and
+ * can be built on a host. canaf_setup and canaf_readFullCan access the
+ * acceptance filter.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+#include "canaf.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SECT_FULLCAN (0)
+#define SECT_STD     (1)
+#define SECT_EXT     (2)
+
+#define STD_ID_MAX (0x7FF)
+#define EXT_ID_MAX (0x1FFFFFFF)
+
+// unused (disabled) half of the last word of an 11-bit section
+#define STD_PAD (0xFFFF)
+#define STD_DISABLE (1 << 12)
+
+// AFMR values
+#define AFMR_ACC_OFF (0x01)
+#define AFMR_ACC_BP  (0x02)
+#define AFMR_EFCAN   (0x04)
+
+// FullCAN message object, first word
+#define FC_SEM_MASK     (0x03000000)
+#define FC_SEM_UPDATING (0x01000000)
+#define FC_SEM_UPDATED  (0x03000000)
+#define FC_INFO_MASK    (0x400F0000)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+// sort key: controller in bits 31:29 as in the 29-bit entries
+#define KEY(ctrl, id) (((uint32_t)(ctrl) << 29) | (id))
+#define KEY_CTRL(k)   ((k) >> 29)
+#define KEY_ID(k)     ((k) & EXT_ID_MAX)
+
+// 16-bit entry for an 11-bit ID
+#define STD_ENTRY(k)  ((uint16_t)((KEY_CTRL(k) << 13) | KEY_ID(k)))
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  uint8_t sect;
+  uint32_t lo;
+  uint32_t hi;
+} range_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static canaf_layout_t layout;
+static uint8_t nextObj = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static void putStd(uint32_t* ram, uint16_t* pos, uint16_t* cnt, uint16_t entry);
+static uint8_t matchStd(const uint32_t* ram, uint16_t from, uint16_t to,
+    uint16_t entry);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Compile a set of filters into an acceptance filter table
+ *
+ * Params:
+ *   [in] filters: IDs and ranges to accept
+ *   [in] num: number of filters
+ *   [out] ram: table, CANAF_RAM_WORDS words. Only the used words
+ *              (endOfTable / 4 plus the FullCAN objects) are written.
+ *   [out] layout: section start addresses
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT if a filter is invalid or ERR_CAN_FILTER if the
+ *   table doesn't fit in the filter RAM
+ *
+ *****************************************************************************/
+error_t canaf_compile(const canaf_filter_t* filters, uint16_t num,
+    uint32_t* ram, canaf_layout_t* layout)
+{
+  range_t r[CANAF_MAX_FILTERS];
+  range_t e;
+  const canaf_filter_t* f = NULL;
+  uint16_t n = 0;
+  uint16_t numFc = 0;
+  uint16_t numStd = 0;
+  uint16_t numGrpStd = 0;
+  uint16_t numExt = 0;
+  uint16_t numGrpExt = 0;
+  uint16_t pos = 0;
+  uint16_t cnt = 0;
+  int i = 0;
+  int j = 0;
+
+  if (num > CANAF_MAX_FILTERS || (filters == NULL && num > 0)
+      || ram == NULL || layout == NULL) {
+    return ERR_ARGUMENT;
+  }
+
+  for (i = 0; i < num; i++) {
+    f = &filters[i];
+
+    if (f->ctrl > CAN2_CTRL || f->format > EXT_ID_FORMAT
+        || f->idLow > f->idHigh
+        || f->idHigh > (f->format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX)) {
+      return ERR_ARGUMENT;
+    }
+
+    if (f->fullCan && (f->format != STD_ID_FORMAT || f->idLow != f->idHigh)) {
+      return ERR_ARGUMENT;
+    }
+
+    e.sect = (f->fullCan ? SECT_FULLCAN
+        : (f->format == EXT_ID_FORMAT ? SECT_EXT : SECT_STD));
+    e.lo = KEY(f->ctrl, f->idLow);
+    e.hi = KEY(f->ctrl, f->idHigh);
+
+    // insertion sort on (section, key)
+    for (j = i; j > 0 && (r[j-1].sect > e.sect
+        || (r[j-1].sect == e.sect && r[j-1].lo > e.lo)); j--) {
+      r[j] = r[j-1];
+    }
+    r[j] = e;
+  }
+
+  // merge duplicates, overlapping and adjacent ranges
+  for (i = 0; i < num; i++) {
+    if (n > 0 && r[n-1].sect == r[i].sect
+        && KEY_CTRL(r[n-1].lo) == KEY_CTRL(r[i].lo)
+        && r[i].lo <= r[n-1].hi + (r[i].sect == SECT_FULLCAN ? 0 : 1)) {
+      if (r[i].hi > r[n-1].hi) {
+        r[n-1].hi = r[i].hi;
+      }
+      continue;
+    }
+    r[n++] = r[i];
+  }
+
+  for (i = 0; i < n; i++) {
+    switch (r[i].sect) {
+    case SECT_FULLCAN:
+      numFc++;
+      break;
+    case SECT_STD:
+      if (r[i].hi - r[i].lo < 2) {
+        numStd += r[i].hi - r[i].lo + 1;
+      }
+      else {
+        numGrpStd++;
+      }
+      break;
+    default:
+      if (r[i].hi - r[i].lo < 2) {
+        numExt += r[i].hi - r[i].lo + 1;
+      }
+      else {
+        numGrpExt++;
+      }
+      break;
+    }
+  }
+
+  if (numFc > CANAF_MAX_FULLCAN
+      || ((numFc + 1) >> 1) + ((numStd + 1) >> 1) + numGrpStd + numExt
+      + (numGrpExt << 1) + numFc * 3 > CANAF_RAM_WORDS) {
+    return ERR_CAN_FILTER;
+  }
+
+  // FullCAN IDs
+  cnt = 0;
+  for (i = 0; i < n && r[i].sect == SECT_FULLCAN; i++) {
+    putStd(ram, &pos, &cnt, STD_ENTRY(r[i].lo));
+  }
+  layout->sffSa = pos << 2;
+
+  // explicit 11-bit IDs
+  cnt = 0;
+  for (i = 0; i < n; i++) {
+    if (r[i].sect == SECT_STD && r[i].hi - r[i].lo < 2) {
+      putStd(ram, &pos, &cnt, STD_ENTRY(r[i].lo));
+      if (r[i].hi != r[i].lo) {
+        putStd(ram, &pos, &cnt, STD_ENTRY(r[i].hi));
+      }
+    }
+  }
+  layout->sffGrpSa = pos << 2;
+
+  // 11-bit ranges
+  for (i = 0; i < n; i++) {
+    if (r[i].sect == SECT_STD && r[i].hi - r[i].lo >= 2) {
+      ram[pos++] = ((uint32_t)STD_ENTRY(r[i].lo) << 16) | STD_ENTRY(r[i].hi);
+    }
+  }
+  layout->effSa = pos << 2;
+
+  // explicit 29-bit IDs
+  for (i = 0; i < n; i++) {
+    if (r[i].sect == SECT_EXT && r[i].hi - r[i].lo < 2) {
+      ram[pos++] = r[i].lo;
+      if (r[i].hi != r[i].lo) {
+        ram[pos++] = r[i].hi;
+      }
+    }
+  }
+  layout->effGrpSa = pos << 2;
+
+  // 29-bit ranges
+  for (i = 0; i < n; i++) {
+    if (r[i].sect == SECT_EXT && r[i].hi - r[i].lo >= 2) {
+      ram[pos++] = r[i].lo;
+      ram[pos++] = r[i].hi;
+    }
+  }
+  layout->endOfTable = pos << 2;
+
+  // empty FullCAN message objects
+  for (i = 0; i < numFc * 3; i++) {
+    ram[pos++] = 0;
+  }
+  layout->numFullCan = numFc;
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Check how a compiled table handles a frame. This models the look-up
+ *    done by the acceptance filter and is meant for verifying tables.
+ *
+ * Params:
+ *   [in] ram: table from canaf_compile
+ *   [in] layout: layout from canaf_compile
+ *   [in] ctrl: CAN1_CTRL or CAN2_CTRL
+ *   [in] format: STD_ID_FORMAT or EXT_ID_FORMAT
+ *   [in] id: frame ID
+ *
+ * Returns:
+ *   CANAF_MATCH_NONE, CANAF_MATCH_FULLCAN or CANAF_MATCH_RX
+ *
+ *****************************************************************************/
+uint8_t canaf_match(const uint32_t* ram, const canaf_layout_t* layout,
+    uint8_t ctrl, uint8_t format, uint32_t id)
+{
+  uint32_t key = KEY(ctrl, id);
+  uint16_t lo = 0;
+  uint16_t hi = 0;
+  int i = 0;
+
+  if (format == STD_ID_FORMAT) {
+    if (matchStd(ram, 0, layout->sffSa >> 2, STD_ENTRY(key))) {
+      return CANAF_MATCH_FULLCAN;
+    }
+
+    if (matchStd(ram, layout->sffSa >> 2, layout->sffGrpSa >> 2,
+        STD_ENTRY(key))) {
+      return CANAF_MATCH_RX;
+    }
+
+    for (i = layout->sffGrpSa >> 2; i < (layout->effSa >> 2); i++) {
+      lo = ram[i] >> 16;
+      hi = ram[i] & 0xFFFF;
+      if ((lo & STD_DISABLE) == 0 && STD_ENTRY(key) >= lo
+          && STD_ENTRY(key) <= hi) {
+        return CANAF_MATCH_RX;
+      }
+    }
+  }
+  else {
+    for (i = layout->effSa >> 2; i < (layout->effGrpSa >> 2); i++) {
+      if (ram[i] == key) {
+        return CANAF_MATCH_RX;
+      }
+    }
+
+    for (i = layout->effGrpSa >> 2; i < (layout->endOfTable >> 2); i += 2) {
+      if (key >= ram[i] && key <= ram[i+1]) {
+        return CANAF_MATCH_RX;
+      }
+    }
+  }
+
+  return CANAF_MATCH_NONE;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Compile a set of filters straight into the acceptance filter RAM and
+ *    enable the filter. Replaces any table loaded before; don't mix with
+ *    the CAN_Load*Entry functions. If the table can't be compiled the
+ *    filter is put in bypass mode and all frames are accepted.
+ *
+ * Params:
+ *   [in] filters: IDs and ranges to accept
+ *   [in] num: number of filters
+ *
+ * Returns:
+ *   See canaf_compile
+ *
+ *****************************************************************************/
+error_t canaf_setup(const canaf_filter_t* filters, uint16_t num)
+{
+  error_t err = ERR_OK;
+
+  LPC_CANAF->AFMR = AFMR_ACC_OFF;
+
+  err = canaf_compile(filters, num, (uint32_t*)LPC_CANAF_RAM->mask, &layout);
+  if (err != ERR_OK) {
+    layout.sffSa = layout.sffGrpSa = layout.effSa = layout.effGrpSa = 0;
+    layout.endOfTable = 0;
+    layout.numFullCan = 0;
+  }
+
+  nextObj = 0;
+
+  LPC_CANAF->SFF_sa = layout.sffSa;
+  LPC_CANAF->SFF_GRP_sa = layout.sffGrpSa;
+  LPC_CANAF->EFF_sa = layout.effSa;
+  LPC_CANAF->EFF_GRP_sa = layout.effGrpSa;
+  LPC_CANAF->ENDofTable = layout.endOfTable;
+
+  if (err != ERR_OK) {
+    LPC_CANAF->AFMR = AFMR_ACC_BP;
+  }
+  else {
+    LPC_CANAF->AFMR = (layout.numFullCan > 0 ? AFMR_EFCAN : 0);
+  }
+
+  return err;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Read a frame received in a FullCAN object. The objects are polled
+ *    round-robin, no interrupt is used.
+ *
+ * Params:
+ *   [out] ctrl: controller the frame was received on
+ *   [out] frame: the frame
+ *
+ * Returns:
+ *   1 if a frame was read, 0 if no object has been updated
+ *
+ *****************************************************************************/
+uint8_t canaf_readFullCan(uint8_t* ctrl, can_frame_t* frame)
+{
+  volatile uint32_t* obj = NULL;
+  uint32_t w = 0;
+  uint32_t a = 0;
+  uint32_t b = 0;
+  int n = 0;
+
+  for (n = 0; n < layout.numFullCan; n++) {
+    obj = &LPC_CANAF_RAM->mask[(layout.endOfTable >> 2) + nextObj * 3];
+
+    if (++nextObj >= layout.numFullCan) {
+      nextObj = 0;
+    }
+
+    w = obj[0];
+    while ((w & FC_SEM_MASK) == FC_SEM_UPDATED) {
+
+      // clear the semaphore, if it is set again while reading the object
+      // has been overwritten by a new frame
+      obj[0] = w & ~FC_SEM_MASK;
+      a = obj[1];
+      b = obj[2];
+
+      if ((obj[0] & FC_SEM_MASK) == 0) {
+        // RTR and DLC are at the same positions as in RFS
+        *ctrl = (w >> 13) & 0x07;
+        frame->rfs = w & FC_INFO_MASK;
+        frame->id = w & STD_ID_MAX;
+        frame->data[0] = a;
+        frame->data[1] = b;
+
+        return 1;
+      }
+
+      while (((w = obj[0]) & FC_SEM_MASK) == FC_SEM_UPDATING);
+    }
+  }
+
+  return 0;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Add a 16-bit entry to an 11-bit section. The first entry of a word is
+ *    stored in the upper half, an unused lower half is disabled.
+ *
+ *****************************************************************************/
+static void putStd(uint32_t* ram, uint16_t* pos, uint16_t* cnt, uint16_t entry)
+{
+  if ((*cnt & 1) == 0) {
+    ram[*pos] = ((uint32_t)entry << 16) | STD_PAD;
+    (*pos)++;
+  }
+  else {
+    ram[*pos - 1] = (ram[*pos - 1] & 0xFFFF0000) | entry;
+  }
+
+  (*cnt)++;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Search a section of 16-bit entries
+ *
+ *****************************************************************************/
+static uint8_t matchStd(const uint32_t* ram, uint16_t from, uint16_t to,
+    uint16_t entry)
+{
+  int i = 0;
+
+  for (i = from; i < to; i++) {
+    if ((ram[i] >> 16) == entry || (ram[i] & 0xFFFF) == entry) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
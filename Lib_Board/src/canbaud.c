@@ -0,0 +1,274 @@
+/****************************************************************************************************//**
+*
+* @file		canbaud.c
+* @brief	CAN bit rate detection in listen-only mode
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * The controller is put in listen-only mode so it never sends an error
+ * frame or an acknowledge while a wrong bit rate is tried. Each candidate
+ * is listened to for at most CANBAUD_DWELL_MS and scored by the frames
+ * received minus the bus errors seen (bus error interrupts and increments
+ * of the receive error counter). A candidate that receives
+ * CANBAUD_LOCK_FRAMES frames without any error is taken at once.
+ *
+ * Frames are only received if another node acknowledges them, a bus with
+ * a single sender can't be detected.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include "LPC17xx.h"
+#include "lpc17xx_can.h"
+#include "lpc17xx_clkpwr.h"
+#include "board.h"
+#include "canbus.h"
+#include "canbtr.h"
+#include "canbaud.h"
+#include "time.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define GSR_RXERR(gsr) (((gsr) >> 16) & 0xFF)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+// tried when no candidates are given, most common rates first
+static const uint32_t defaultRates[] = {
+  500000, 250000, 125000, 1000000, 33333, 83333, 50000, 100000, 20000, 10000
+};
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static int32_t listen(LPC_CAN_TypeDef* CANx);
+static uint32_t solve(LPC_CAN_TypeDef* CANx, uint32_t bitrate,
+    uint16_t samplePoint);
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Find the bit rate of the bus a controller is connected to and switch
+ *    the controller to normal mode at that rate. Takes at most
+ *    num * CANBAUD_DWELL_MS. The CAN interrupt is masked while probing and
+ *    received frames are discarded, call this before the bus is used.
+ *
+ *    The acceptance filter must let frames through (bypass or a table
+ *    accepting them).
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] rates: candidate bit rates, NULL for a list of common rates
+ *   [in] num: number of candidates
+ *   [in] samplePoint: sample point in 1/1000 of the bit, 500-950
+ *   [out] bitrate: detected bit rate
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT or ERR_TIMEOUT if no candidate received more
+ *   frames than errors. On ERR_TIMEOUT the controller is left in normal
+ *   mode at its previous rate.
+ *
+ *****************************************************************************/
+error_t canbaud_detect(LPC_CAN_TypeDef* CANx, const uint32_t* rates,
+    uint8_t num, uint16_t samplePoint, uint32_t* bitrate)
+{
+  uint32_t btr = CANx->BTR;
+  uint32_t bestBtr = 0;
+  uint32_t rateBtr = 0;
+  uint32_t ier = CANx->IER;
+  uint32_t irqOn = NVIC->ISER[(uint32_t)CAN_IRQn >> 5]
+      & (1 << ((uint32_t)CAN_IRQn & 0x1F));
+  int32_t score = 0;
+  int32_t bestScore = 0;
+  int i = 0;
+  int best = -1;
+
+  if (rates == NULL) {
+    rates = defaultRates;
+    num = sizeof(defaultRates) / sizeof(defaultRates[0]);
+  }
+
+  if (bitrate == NULL || num == 0) {
+    return ERR_ARGUMENT;
+  }
+
+  // the receive buffer and ICR are polled
+  NVIC_DisableIRQ(CAN_IRQn);
+  CANx->IER = CAN_IER_BEIE;
+
+  for (i = 0; i < num; i++) {
+    rateBtr = solve(CANx, rates[i], samplePoint);
+    if (rateBtr == 0) {
+      continue;
+    }
+
+    // BTR and LOM can only be written in reset mode
+    CAN_ModeConfig(CANx, CAN_LISTENONLY_MODE, ENABLE);
+    CANx->BTR = rateBtr;
+    CAN_ModeConfig(CANx, CAN_RESET_MODE, DISABLE);
+
+    score = listen(CANx);
+    if (score > bestScore) {
+      bestScore = score;
+      best = i;
+      bestBtr = rateBtr;
+    }
+
+    if (score >= CANBAUD_LOCK_FRAMES) {
+      break;
+    }
+  }
+
+  // back to normal mode at the winner, error counters start from zero
+  CAN_ModeConfig(CANx, CAN_LISTENONLY_MODE, DISABLE);
+  if (best >= 0) {
+    CANx->BTR = bestBtr;
+    *bitrate = rates[best];
+  }
+  else {
+    CANx->BTR = btr;
+  }
+  CANx->GSR = 0;
+  CAN_ModeConfig(CANx, CAN_RESET_MODE, DISABLE);
+
+  (void)CANx->ICR;
+  CANx->IER = ier;
+  if (irqOn) {
+    NVIC_EnableIRQ(CAN_IRQn);
+  }
+
+  return (best >= 0 ? ERR_OK : ERR_TIMEOUT);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Listen to the bus at the current rate
+ *
+ * Returns:
+ *   Frames received minus bus errors. A result of CANBAUD_LOCK_FRAMES or
+ *   more means error free reception.
+ *
+ *****************************************************************************/
+static int32_t listen(LPC_CAN_TypeDef* CANx)
+{
+  uint32_t start = time_get();
+  uint32_t rxErr = GSR_RXERR(CANx->GSR);
+  uint32_t now = 0;
+  int32_t frames = 0;
+  int32_t errors = 0;
+
+  (void)CANx->ICR;
+
+  do {
+    while (CANx->SR & CAN_SR_RBS) {
+      frames++;
+      CANx->CMR = CAN_CMR_RRB;
+    }
+
+    if (CANx->ICR & CAN_ICR_BEI) {
+      errors++;
+    }
+
+    if (frames >= CANBAUD_LOCK_FRAMES && errors == 0) {
+      return frames;
+    }
+
+    now = time_get();
+  } while (now - start < CANBAUD_DWELL_MS);
+
+  // the counter may be frozen in listen-only mode, bus errors count anyway
+  now = GSR_RXERR(CANx->GSR);
+  if (now > rxErr) {
+    errors += now - rxErr;
+  }
+
+  // a wrong rate can't lock, even if some frames got through
+  if (errors > 0 && frames - errors >= CANBAUD_LOCK_FRAMES) {
+    return CANBAUD_LOCK_FRAMES - 1;
+  }
+
+  return frames - errors;
+}
+
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the BTR value for a bit rate
+ *
+ * Returns:
+ *   The value or 0 if the rate can't be generated
+ *
+ *****************************************************************************/
+static uint32_t solve(LPC_CAN_TypeDef* CANx, uint32_t bitrate,
+    uint16_t samplePoint)
+{
+  canbtr_t timing;
+  uint32_t pclk = CLKPWR_GetPCLK(CANx == LPC_CAN1 ?
+      CLKPWR_PCLKSEL_CAN1 : CLKPWR_PCLKSEL_CAN2);
+
+  if (canbtr_solve(pclk, bitrate, samplePoint, CAN_BTR_SJW, &timing) != ERR_OK) {
+    return 0;
+  }
+
+  return timing.btr;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
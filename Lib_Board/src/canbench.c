@@ -0,0 +1,345 @@
+/****************************************************************************************************//**
+*
+* @file		canbench.c
+* @brief	Cycle count comparison of the CAN frame copy paths
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Compares the per frame cost of moving a frame between the controller
+ * registers and a queue slot the old way (byte wise through CAN_MSG_Type,
+ * as CAN_ReceiveMsg/CAN_SendMsg and the old queue memcpy did) with the
+ * can_frame_t word copies used by canbus.c.
+ *
+ * The copies run against an image of the register block in RAM so that no
+ * frame is received or sent, the APB wait states of the real controller are
+ * not included. The old paths are copies of the library code because its
+ * parameter checks reject the image in DEBUG builds.
+ *
+ * Cycles are counted with the DWT cycle counter. CANBENCH_CYCLES() and
+ * CANBENCH_CYCLES_INIT() can be defined to use another counter, e.g. when
+ * the file is built on a host.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+#include "dlog.h"
+#include "canbench.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#ifndef CANBENCH_CYCLES
+#define DWT_CTRL           (*(volatile uint32_t*)0xE0001000)
+#define DWT_CYCCNT         (*(volatile uint32_t*)0xE0001004)
+#define DWT_CTRL_CYCCNTENA (1UL << 0)
+
+#define CANBENCH_CYCLES() (DWT_CYCCNT)
+#define CANBENCH_CYCLES_INIT() do { \
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; \
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA; \
+  } while (0)
+#endif
+
+// number of queue slots the frames are spread over
+#define SLOTS (8)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define NOINLINE __attribute__ ((noinline))
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef void (*path_t)(LPC_CAN_TypeDef* CANx, void* slot);
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static LPC_CAN_TypeDef regs;
+static CAN_MSG_Type msgSlots[SLOTS];
+static can_frame_t frameSlots[SLOTS];
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static void rxMsg(LPC_CAN_TypeDef* CANx, void* slot);
+static void rxFrame(LPC_CAN_TypeDef* CANx, void* slot);
+static void txMsg(LPC_CAN_TypeDef* CANx, void* slot);
+static void txFrame(LPC_CAN_TypeDef* CANx, void* slot);
+static uint32_t measure(path_t path, void* slots, uint32_t slotSize, uint32_t rounds);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if CANBENCH_BATCH < 1
+#error "CANBENCH_BATCH must be at least 1"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Measure the cycles per frame of the old and new receive and send
+ *    copies and log the results.
+ *
+ * Params:
+ *   [in] rounds: number of batches of CANBENCH_BATCH frames per path, the
+ *                fastest batch is reported
+ *   [out] res: results, may be NULL
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT
+ *
+ *****************************************************************************/
+error_t canbench_run(uint32_t rounds, canbench_result_t* res)
+{
+  canbench_result_t r;
+  int i = 0;
+
+  if (rounds == 0) {
+    return ERR_ARGUMENT;
+  }
+
+  CANBENCH_CYCLES_INIT();
+
+  // an extended data frame with 8 bytes waiting in the receive buffer and
+  // a free transmit buffer (SR is read-only in the register type)
+  memset(&regs, 0, sizeof(regs));
+  *(volatile uint32_t*)&regs.SR = CAN_SR_RBS | CAN_SR_TBS1;
+  regs.RFS = CAN_RFS_FF | (8UL << 16);
+  regs.RID = 0x12345678;
+  regs.RDA = 0x44332211;
+  regs.RDB = 0x88776655;
+
+  // the same frame in the queue slots
+  for (i = 0; i < SLOTS; i++) {
+    msgSlots[i].format = EXT_ID_FORMAT;
+    msgSlots[i].type = DATA_FRAME;
+    msgSlots[i].len = 8;
+    msgSlots[i].id = regs.RID;
+    memcpy(msgSlots[i].dataA, "\x11\x22\x33\x44", 4);
+    memcpy(msgSlots[i].dataB, "\x55\x66\x77\x88", 4);
+
+    frameSlots[i].rfs = regs.RFS;
+    frameSlots[i].id = regs.RID;
+    frameSlots[i].data[0] = regs.RDA;
+    frameSlots[i].data[1] = regs.RDB;
+  }
+
+  r.rxMsg = measure(rxMsg, msgSlots, sizeof(msgSlots[0]), rounds);
+  r.rxFrame = measure(rxFrame, frameSlots, sizeof(frameSlots[0]), rounds);
+  r.txMsg = measure(txMsg, msgSlots, sizeof(msgSlots[0]), rounds);
+  r.txFrame = measure(txFrame, frameSlots, sizeof(frameSlots[0]), rounds);
+
+  DLOG_INFO("canbench: rx CAN_MSG_Type %u, can_frame_t %u cycles/frame\r\n",
+      r.rxMsg, r.rxFrame);
+  DLOG_INFO("canbench: tx CAN_MSG_Type %u, can_frame_t %u cycles/frame\r\n",
+      r.txMsg, r.txFrame);
+
+  if (res != NULL) {
+    *res = r;
+  }
+
+  return ERR_OK;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Old receive path: CAN_ReceiveMsg into a CAN_MSG_Type, then copied into
+ *    the queue slot.
+ *
+ *****************************************************************************/
+static NOINLINE void rxMsg(LPC_CAN_TypeDef* CANx, void* slot)
+{
+  CAN_MSG_Type msg;
+  uint32_t data = 0;
+
+  if (CANx->SR & CAN_SR_RBS) {
+    msg.format = (uint8_t)((CANx->RFS & 0x80000000) >> 31);
+    msg.type = (uint8_t)((CANx->RFS & 0x40000000) >> 30);
+    msg.len = (uint8_t)((CANx->RFS & 0x000F0000) >> 16);
+    msg.id = CANx->RID;
+
+    if (msg.type == DATA_FRAME) {
+      data = CANx->RDA;
+      msg.dataA[0] = data & 0x000000FF;
+      msg.dataA[1] = (data & 0x0000FF00) >> 8;
+      msg.dataA[2] = (data & 0x00FF0000) >> 16;
+      msg.dataA[3] = (data & 0xFF000000) >> 24;
+
+      data = CANx->RDB;
+      msg.dataB[0] = data & 0x000000FF;
+      msg.dataB[1] = (data & 0x0000FF00) >> 8;
+      msg.dataB[2] = (data & 0x00FF0000) >> 16;
+      msg.dataB[3] = (data & 0xFF000000) >> 24;
+    }
+
+    CANx->CMR = CAN_CMR_RRB;
+    memcpy(slot, &msg, sizeof(msg));
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    New receive path: the four registers read into the queue slot, as
+ *    can_rx_isr does.
+ *
+ *****************************************************************************/
+static NOINLINE void rxFrame(LPC_CAN_TypeDef* CANx, void* slot)
+{
+  can_frame_t* frame = (can_frame_t*)slot;
+
+  if (CANx->SR & CAN_SR_RBS) {
+    frame->rfs = CANx->RFS;
+    frame->id = CANx->RID;
+    frame->data[0] = CANx->RDA;
+    frame->data[1] = CANx->RDB;
+    CANx->CMR = CAN_CMR_RRB;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Old send path: CAN_SendMsg from a CAN_MSG_Type queue slot into
+ *    transmit buffer 1.
+ *
+ *****************************************************************************/
+static NOINLINE void txMsg(LPC_CAN_TypeDef* CANx, void* slot)
+{
+  CAN_MSG_Type* msg = (CAN_MSG_Type*)slot;
+  uint32_t data = 0;
+
+  if (CANx->SR & CAN_SR_TBS1) {
+    CANx->TFI1 &= ~0x00F0000;
+    CANx->TFI1 |= (msg->len) << 16;
+    if (msg->type == REMOTE_FRAME) {
+      CANx->TFI1 |= (1UL << 30);
+    }
+    else {
+      CANx->TFI1 &= ~(1UL << 30);
+    }
+    if (msg->format == EXT_ID_FORMAT) {
+      CANx->TFI1 |= (1UL << 31);
+    }
+    else {
+      CANx->TFI1 &= ~(1UL << 31);
+    }
+
+    CANx->TID1 = msg->id;
+
+    data = (msg->dataA[0]) | ((msg->dataA[1]) << 8) | ((msg->dataA[2]) << 16)
+        | ((uint32_t)(msg->dataA[3]) << 24);
+    CANx->TDA1 = data;
+
+    data = (msg->dataB[0]) | ((msg->dataB[1]) << 8) | ((msg->dataB[2]) << 16)
+        | ((uint32_t)(msg->dataB[3]) << 24);
+    CANx->TDB1 = data;
+
+    CANx->CMR = (CAN_CMR_TR | CAN_CMR_STB1);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    New send path: the queue slot written to transmit buffer 1 as four
+ *    words, as canbus.c does.
+ *
+ *****************************************************************************/
+static NOINLINE void txFrame(LPC_CAN_TypeDef* CANx, void* slot)
+{
+  const can_frame_t* frame = (const can_frame_t*)slot;
+  volatile uint32_t* reg = &CANx->TFI1;
+
+  if (CANx->SR & CAN_SR_TBS1) {
+    reg[0] = frame->rfs & (CAN_RFS_FF | CAN_RFS_RTR | (0x0FUL << 16));
+    reg[1] = frame->id;
+    reg[2] = frame->data[0];
+    reg[3] = frame->data[1];
+    CANx->CMR = (CAN_CMR_TR | CAN_CMR_STB1);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Run a path for 'rounds' batches of CANBENCH_BATCH frames spread over
+ *    the queue slots.
+ *
+ * Returns:
+ *   Cycles per frame of the fastest batch
+ *
+ *****************************************************************************/
+static uint32_t measure(path_t path, void* slots, uint32_t slotSize, uint32_t rounds)
+{
+  uint32_t best = 0xFFFFFFFF;
+  uint32_t t = 0;
+  uint32_t i = 0;
+
+  while (rounds-- > 0) {
+    t = CANBENCH_CYCLES();
+    for (i = 0; i < CANBENCH_BATCH; i++) {
+      path(&regs, (uint8_t*)slots + (i % SLOTS) * slotSize);
+    }
+    t = CANBENCH_CYCLES() - t;
+
+    if (t < best) {
+      best = t;
+    }
+  }
+
+  return (best + CANBENCH_BATCH / 2) / CANBENCH_BATCH;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,251 @@
+/****************************************************************************************************//**
+*
+* @file		canbtr.c
+* @brief	CAN bit timing solver
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Computes BTR values for any bit rate the CAN clock can generate. Every
+ * number of quanta per bit (CANBTR_TQ_MIN to CANBTR_TQ_MAX) is tried with
+ * the nearest prescaler; the timing with the smallest bit rate error wins,
+ * then the one closest to the requested sample point, then the one with
+ * most quanta (finest resynchronization).
+ *
+ * This file doesn't access any peripheral and can be built on a host.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include "lpc_types.h"
+#include "board.h"
+#include "canbtr.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define TSEG1_MAX (16)
+#define TSEG2_MAX (8)
+
+// accepted sample points, in 1/1000 of the bit
+#define SAMPLE_POINT_MIN (500)
+#define SAMPLE_POINT_MAX (950)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define BTR_VALUE(brp, sjw, tseg1, tseg2) \
+  (((uint32_t)(brp) - 1) | (((uint32_t)(sjw) - 1) << 14) \
+  | (((uint32_t)(tseg1) - 1) << 16) | (((uint32_t)(tseg2) - 1) << 20))
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static uint32_t rateError(uint32_t pclk, uint32_t bitrate, uint32_t div);
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if CANBTR_TQ_MAX > 1 + TSEG1_MAX + TSEG2_MAX
+#error "CANBTR_TQ_MAX doesn't fit in TSEG1 and TSEG2"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Find the bit timing for a bit rate
+ *
+ * Params:
+ *   [in] pclk: CAN peripheral clock (Hz)
+ *   [in] bitrate: requested bit rate (bit/s)
+ *   [in] samplePoint: requested sample point in 1/1000 of the bit, 500-950
+ *   [in] sjw: synchronization jump width in quanta, 1-4
+ *   [out] timing: the bit timing
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT if an argument is out of range or the bit rate
+ *   can't be generated within CANBTR_MAX_ERROR_PPM
+ *
+ *****************************************************************************/
+error_t canbtr_solve(uint32_t pclk, uint32_t bitrate, uint16_t samplePoint,
+    uint8_t sjw, canbtr_t* timing)
+{
+  uint32_t bestErr = 0xFFFFFFFF;
+  uint32_t bestSpErr = 0xFFFFFFFF;
+  uint32_t err = 0;
+  uint32_t spErr = 0;
+  uint32_t brp = 0;
+  int32_t tseg1 = 0;
+  int32_t tseg2 = 0;
+  uint16_t sp = 0;
+  uint8_t tq = 0;
+
+  if (timing == NULL || bitrate == 0 || bitrate > pclk
+      || samplePoint < SAMPLE_POINT_MIN || samplePoint > SAMPLE_POINT_MAX
+      || sjw < 1 || sjw > CANBTR_SJW_MAX) {
+    return ERR_ARGUMENT;
+  }
+
+  for (tq = CANBTR_TQ_MAX; tq >= CANBTR_TQ_MIN; tq--) {
+
+    brp = (pclk + (bitrate * tq) / 2) / (bitrate * tq);
+    if (brp < 1 || brp > CANBTR_BRP_MAX) {
+      continue;
+    }
+
+    // sync segment and TSEG1 come before the sample point
+    tseg1 = (samplePoint * tq + 500) / 1000 - 1;
+    if (tseg1 > TSEG1_MAX) {
+      tseg1 = TSEG1_MAX;
+    }
+    tseg2 = tq - 1 - tseg1;
+
+    if (tseg2 < sjw) {
+      tseg2 = sjw;
+    }
+    if (tseg2 > TSEG2_MAX) {
+      tseg2 = TSEG2_MAX;
+    }
+    tseg1 = tq - 1 - tseg2;
+
+    if (tseg1 < 1 || tseg1 > TSEG1_MAX) {
+      continue;
+    }
+
+    err = rateError(pclk, bitrate, brp * tq);
+    sp = ((1 + tseg1) * 1000) / tq;
+    spErr = (sp > samplePoint ? sp - samplePoint : samplePoint - sp);
+
+    // equal results keep the timing with more quanta, found first
+    if (err > bestErr || (err == bestErr && spErr >= bestSpErr)) {
+      continue;
+    }
+
+    bestErr = err;
+    bestSpErr = spErr;
+    timing->brp = brp;
+    timing->tseg1 = tseg1;
+    timing->tseg2 = tseg2;
+    timing->sjw = sjw;
+    timing->samplePoint = sp;
+  }
+
+  if (bestErr > CANBTR_MAX_ERROR_PPM) {
+    return ERR_ARGUMENT;
+  }
+
+  timing->btr = BTR_VALUE(timing->brp, timing->sjw, timing->tseg1,
+      timing->tseg2);
+  timing->bitrate = pclk / (timing->brp * (1 + timing->tseg1 + timing->tseg2));
+  timing->errorPpm = bestErr;
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the bit timing of a BTR register value
+ *
+ * Params:
+ *   [in] pclk: CAN peripheral clock (Hz)
+ *   [in] btr: BTR register value
+ *   [out] timing: the bit timing, errorPpm is set to 0
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT if timing is NULL
+ *
+ *****************************************************************************/
+error_t canbtr_decode(uint32_t pclk, uint32_t btr, canbtr_t* timing)
+{
+  uint8_t tq = 0;
+
+  if (timing == NULL) {
+    return ERR_ARGUMENT;
+  }
+
+  timing->brp = (btr & 0x3FF) + 1;
+  timing->sjw = ((btr >> 14) & 0x03) + 1;
+  timing->tseg1 = ((btr >> 16) & 0x0F) + 1;
+  timing->tseg2 = ((btr >> 20) & 0x07) + 1;
+  timing->btr = btr;
+
+  tq = 1 + timing->tseg1 + timing->tseg2;
+  timing->bitrate = pclk / (timing->brp * tq);
+  timing->samplePoint = ((1 + timing->tseg1) * 1000) / tq;
+  timing->errorPpm = 0;
+
+  return ERR_OK;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the difference between the bit rate generated by dividing the
+ *    clock and the requested one, in ppm of the requested rate
+ *
+ * Params:
+ *   [in] pclk: CAN peripheral clock (Hz)
+ *   [in] bitrate: requested bit rate
+ *   [in] div: prescaler times quanta per bit
+ *
+ *****************************************************************************/
+static uint32_t rateError(uint32_t pclk, uint32_t bitrate, uint32_t div)
+{
+  uint64_t want = (uint64_t)bitrate * div;
+  uint64_t diff = (pclk > want ? pclk - want : want - pclk);
+
+  return (uint32_t)((diff * 1000000) / want);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
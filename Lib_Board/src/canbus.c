@@ -0,0 +1,1006 @@
+/****************************************************************************************************//**
+*
+* @file		canbus.c
+* @brief	Interrupt driven transmit and receive queues for the CAN1/CAN2 controllers
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Besides the queues this module keeps the statistics of each controller.
+ * Counters are updated where the event is handled (receive, transmit and
+ * error interrupts) at constant cost. The bus load is estimated from the
+ * frames received and sent: frames rejected by the acceptance filter,
+ * FullCAN frames and stuff bits are not counted.
+ *
+ * A controller in bus-off is put back on the bus by can_err_task after a
+ * delay that grows with repeated bus-offs.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "LPC17xx.h"
+#include <string.h>
+#include "lpc17xx_can.h"
+#include "lpc17xx_clkpwr.h"
+#include "board.h"
+#include "canbus.h"
+#include "canbtr.h"
+#include "time.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define TX_QUEUE_MASK (CAN_TX_QUEUE_SIZE - 1)
+#define RX_QUEUE_MASK (CAN_RX_QUEUE_SIZE - 1)
+
+// all three transmit buffers released
+#define TX_BUFS_FREE (CAN_SR_TBS1 | CAN_SR_TBS2 | CAN_SR_TBS3)
+
+// transmit done interrupt flags for buffer 1, 2 and 3
+#define TX_BUFS_INT (CAN_ICR_TI1 | CAN_ICR_TI2 | CAN_ICR_TI3)
+
+// highest value of the TFI priority field
+#define TX_PRIO_MAX (0xFF)
+
+// transmission complete status for buffer 1, 2 and 3
+#define TX_BUFS_DONE (CAN_SR_TCS1 | CAN_SR_TCS2 | CAN_SR_TCS3)
+
+// RFS bits copied to TFI (FF, RTR and DLC are at the same positions)
+#define FRAME_INFO_MASK (CAN_RFS_FF | CAN_RFS_RTR | FRAME_DLC(0x0F))
+
+// frame length in bits (SOF up to intermission) without data and stuff bits
+#define FRAME_BITS_STD (47)
+#define FRAME_BITS_EXT (67)
+
+// interrupts handled by can_err_isr
+#define ERR_INT (CAN_ICR_EI | CAN_ICR_DOI | CAN_ICR_EPI | CAN_ICR_ALI \
+    | CAN_ICR_BEI)
+
+// error counter value where a controller becomes error passive
+#define ERR_PASSIVE_LIMIT (128)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+// DLC field of RFS/TFI
+#define FRAME_DLC(n) (((uint32_t)(n) & 0x0F) << 16)
+
+// error counters of GSR
+#define GSR_RXERR(gsr) (((gsr) >> 16) & 0xFF)
+#define GSR_TXERR(gsr) (((gsr) >> 24) & 0xFF)
+
+// ALCBIT and ERRC/ERRDIR/ERRBIT captures of ICR
+#define ICR_ALC(icr) (((icr) >> 24) & 0x1F)
+#define ICR_ECC(icr) (((icr) >> 16) & 0xFF)
+
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  can_frame_t frames[CAN_TX_QUEUE_SIZE];
+
+  // free running indexes, 'in' is only written by the task and 'out' only
+  // while the CAN interrupt is masked or from the CAN interrupt itself
+  volatile uint32_t in;
+  volatile uint32_t out;
+
+  // priority given to the next frame loaded into a transmit buffer
+  uint16_t prio;
+
+  // transmit buffers aborted to renumber their priorities (bit n = buffer n)
+  uint8_t aborted;
+} txq_t;
+
+/*
+ * Single producer (CAN interrupt) / single consumer (task) ring. 'in' is
+ * only written by the interrupt and 'out' only by the task.
+ */
+typedef struct
+{
+  can_frame_t frames[CAN_RX_QUEUE_SIZE];
+  uint32_t stamps[CAN_RX_QUEUE_SIZE];  // time_getUs() when received
+  volatile uint32_t in;
+  volatile uint32_t out;
+} rxq_t;
+
+/*
+ * Statistics and error state of a controller. The statistics are written
+ * by the interrupt, except txDropped and the latency (can_tx_enqueueFrame
+ * and can_rx_release) and busLoad (can_err_task).
+ */
+typedef struct
+{
+  can_stats_t stats;
+
+  // bits received and sent in the current load window
+  uint32_t bits;
+  uint32_t windowStart;
+
+  // set by the interrupt at bus-off, cleared by can_err_task when the
+  // controller is put back on the bus
+  volatile uint8_t recover;
+  uint32_t busOffTime;
+  uint32_t busOffDelay;
+} ctrl_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+// status bit and 'select tx buffer' command bit for transmit buffer 1, 2, 3
+static const uint32_t txBufStatus[3] = {CAN_SR_TBS1, CAN_SR_TBS2, CAN_SR_TBS3};
+static const uint32_t txBufSelect[3] = {CAN_CMR_STB1, CAN_CMR_STB2, CAN_CMR_STB3};
+static const uint32_t txBufInt[3] = {CAN_ICR_TI1, CAN_ICR_TI2, CAN_ICR_TI3};
+static const uint32_t txBufDone[3] = {CAN_SR_TCS1, CAN_SR_TCS2, CAN_SR_TCS3};
+
+static LPC_CAN_TypeDef* const ctrlRegs[CAN_NUM_CTRL] = {LPC_CAN1, LPC_CAN2};
+static const uint32_t ctrlPclk[CAN_NUM_CTRL] = {
+  CLKPWR_PCLKSEL_CAN1,
+  CLKPWR_PCLKSEL_CAN2
+};
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static txq_t txq[CAN_NUM_CTRL];
+static rxq_t rxq[CAN_NUM_CTRL];
+static ctrl_t ctrls[CAN_NUM_CTRL];
+
+static volatile can_rx_hook_t rxHook = NULL;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if (CAN_TX_QUEUE_SIZE & (CAN_TX_QUEUE_SIZE - 1)) != 0
+#error "CAN_TX_QUEUE_SIZE must be a power of two"
+#endif
+
+#if (CAN_RX_QUEUE_SIZE & (CAN_RX_QUEUE_SIZE - 1)) != 0
+#error "CAN_RX_QUEUE_SIZE must be a power of two"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write a frame into one of the three transmit buffers and request
+ *    transmission.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] buf: transmit buffer (0-2)
+ *   [in] frame: the frame
+ *   [in] prio: value for the TFI priority field
+ *
+ *****************************************************************************/
+static void loadTxBuffer(LPC_CAN_TypeDef* CANx, uint8_t buf,
+    const can_frame_t* frame, uint8_t prio)
+{
+  // TFIn, TIDn, TDAn and TDBn are laid out consecutively for each buffer
+  volatile uint32_t* reg = &CANx->TFI1 + (buf * 4);
+
+  reg[0] = (frame->rfs & FRAME_INFO_MASK) | prio;
+  reg[1] = frame->id;
+  reg[2] = frame->data[0];
+  reg[3] = frame->data[1];
+
+  CANx->CMR = (CAN_CMR_TR | txBufSelect[buf]);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Give the pending transmit buffers the lowest priorities again once the
+ *    priority counter has run out. The pending transmissions are aborted
+ *    and requested again with priorities from 0 on, in their old order. A
+ *    frame already on the bus can't be aborted; it is either sent or fails
+ *    without a retry, and as it must go first the others are held until
+ *    it is done. Must be called like fillTxBuffers.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in/out] sr: SR of the controller, the buffers requested again are
+ *     marked as busy
+ *
+ * Returns:
+ *   1 if renumbered, 0 if the buffers are held until a frame on the bus
+ *   is done (its transmit interrupt calls fillTxBuffers again)
+ *
+ *****************************************************************************/
+static uint8_t renumberTxBuffers(LPC_CAN_TypeDef* CANx, uint32_t* sr)
+{
+  txq_t* q = &txq[CAN_CTRL_IDX(CANx)];
+  volatile uint32_t* tfi = NULL;
+  uint32_t cmr = 0;
+  uint8_t order[3];
+  uint8_t prio[3];
+  uint8_t n = 0;
+  uint8_t i = 0;
+  uint8_t buf = 0;
+
+  if (q->aborted == 0) {
+    for (buf = 0; buf < 3; buf++) {
+      if ((*sr & txBufStatus[buf]) == 0) {
+        q->aborted |= (1 << buf);
+        cmr |= txBufSelect[buf];
+      }
+    }
+    CANx->CMR = (CAN_CMR_AT | cmr);
+    *sr = CANx->SR;
+  }
+
+  for (buf = 0; buf < 3; buf++) {
+    if ((q->aborted & (1 << buf)) != 0 && (*sr & txBufStatus[buf]) == 0) {
+      return 0;
+    }
+  }
+
+  // the frames not sent, sorted by their old priority (ties go to the
+  // lower buffer number, like in the controller)
+  for (buf = 0; buf < 3; buf++) {
+    if ((q->aborted & (1 << buf)) == 0 || (*sr & txBufDone[buf]) != 0) {
+      continue;
+    }
+    tfi = &CANx->TFI1 + (buf * 4);
+    for (i = n; i > 0 && prio[i - 1] > (*tfi & TX_PRIO_MAX); i--) {
+      order[i] = order[i - 1];
+      prio[i] = prio[i - 1];
+    }
+    order[i] = buf;
+    prio[i] = (*tfi & TX_PRIO_MAX);
+    n++;
+  }
+
+  q->aborted = 0;
+  q->prio = 0;
+
+  // the buffers were released by the abort, so they can be written again
+  for (i = 0; i < n; i++) {
+    tfi = &CANx->TFI1 + (order[i] * 4);
+    *tfi = (*tfi & ~TX_PRIO_MAX) | q->prio++;
+    CANx->CMR = (CAN_CMR_TR | txBufSelect[order[i]]);
+    *sr &= ~txBufStatus[order[i]];
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Move queued frames into all free transmit buffers. Must be called
+ *    from the CAN interrupt or with the CAN interrupt masked.
+ *
+ *    Transmit priority mode is used and every loaded frame gets a higher
+ *    TFI priority value than the frames already pending, so the controller
+ *    always sends the frames in the order they were queued. The priority
+ *    counter restarts when all buffers are idle, or the pending buffers
+ *    are renumbered when it runs out while they are still busy.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+static void fillTxBuffers(LPC_CAN_TypeDef* CANx)
+{
+  txq_t* q = &txq[CAN_CTRL_IDX(CANx)];
+  uint32_t sr = CANx->SR;
+  uint8_t buf = 0;
+
+  // in reset mode (bus-off) until can_err_task recovers the controller
+  if (CANx->MOD & CAN_MOD_RM) {
+    return;
+  }
+
+  if (q->aborted == 0 && (sr & TX_BUFS_FREE) == TX_BUFS_FREE) {
+    q->prio = 0;
+  }
+  else if (q->aborted != 0 || q->prio > TX_PRIO_MAX) {
+    if (!renumberTxBuffers(CANx, &sr)) {
+      return;
+    }
+  }
+
+  for (buf = 0; buf < 3; buf++) {
+
+    if (q->out == q->in || q->prio > TX_PRIO_MAX) {
+      break;
+    }
+
+    if ((sr & txBufStatus[buf]) == 0) {
+      continue;
+    }
+
+    loadTxBuffer(CANx, buf, &q->frames[q->out & TX_QUEUE_MASK], q->prio++);
+    q->out++;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get number of data bytes of a frame from its RFS/TFI word
+ *
+ *****************************************************************************/
+static uint32_t frameBytes(uint32_t rfs)
+{
+  uint32_t len = (rfs >> 16) & 0x0F;
+
+  if (rfs & CAN_RFS_RTR) {
+    return 0;
+  }
+
+  return (len > 8 ? 8 : len);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get number of bits a frame occupies on the bus, without stuff bits
+ *
+ *****************************************************************************/
+static uint32_t frameBits(uint32_t rfs)
+{
+  return ((rfs & CAN_RFS_FF) ? FRAME_BITS_EXT : FRAME_BITS_STD)
+      + frameBytes(rfs) * 8;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the bit rate a controller is configured for, from BTR
+ *
+ *****************************************************************************/
+static uint32_t bitRate(uint8_t idx)
+{
+  canbtr_t timing;
+
+  canbtr_decode(CLKPWR_GetPCLK(ctrlPclk[idx]), ctrlRegs[idx]->BTR, &timing);
+
+  return timing.bitrate;
+}
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Initialize the transmit queue of a controller. CAN_Init must have been
+ *    called for the controller. The caller is responsible for enabling
+ *    the CAN interrupt in the NVIC and for calling can_tx_isr from it.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+void can_tx_init(LPC_CAN_TypeDef* CANx)
+{
+  txq_t* q = &txq[CAN_CTRL_IDX(CANx)];
+
+  q->in = 0;
+  q->out = 0;
+  q->prio = 0;
+  q->aborted = 0;
+
+  // transmit order is given by the TFI priority field and not the CAN ID
+  CAN_ModeConfig(CANx, CAN_RESET_MODE, ENABLE);
+  CAN_ModeConfig(CANx, CAN_TXPRIORITY_MODE, ENABLE);
+  CAN_ModeConfig(CANx, CAN_RESET_MODE, DISABLE);
+
+  CAN_IRQCmd(CANx, CANINT_TIE1, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_TIE2, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_TIE3, ENABLE);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Queue a frame for transmission. The function never waits for the bus,
+ *    the frame is copied and sent from the transmit interrupt.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] msg: the frame to send
+ *
+ * Returns:
+ *   ERR_OK if queued, ERR_CAN_SEND if the queue is full
+ *
+ *****************************************************************************/
+error_t can_tx_enqueue(LPC_CAN_TypeDef* CANx, CAN_MSG_Type* msg)
+{
+  can_frame_t frame;
+
+  can_frame_fromMsg(&frame, msg);
+
+  return can_tx_enqueueFrame(CANx, &frame);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Queue a frame for transmission, see can_tx_enqueue.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] frame: the frame to send
+ *
+ * Returns:
+ *   ERR_OK if queued, ERR_CAN_SEND if the queue is full
+ *
+ *****************************************************************************/
+error_t can_tx_enqueueFrame(LPC_CAN_TypeDef* CANx, const can_frame_t* frame)
+{
+  txq_t* q = &txq[CAN_CTRL_IDX(CANx)];
+  uint32_t in = q->in;
+
+  if (in - q->out >= CAN_TX_QUEUE_SIZE) {
+    ctrls[CAN_CTRL_IDX(CANx)].stats.txDropped++;
+    return ERR_CAN_SEND;
+  }
+
+  q->frames[in & TX_QUEUE_MASK] = *frame;
+
+  // frame must be complete before the interrupt can see it
+  __DMB();
+  q->in = in + 1;
+
+  // start transmission if the interrupt chain is not running
+  NVIC_DisableIRQ(CAN_IRQn);
+  fillTxBuffers(CANx);
+  NVIC_EnableIRQ(CAN_IRQn);
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get number of frames waiting in the transmit queue (not including
+ *    frames already loaded into a transmit buffer).
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+uint32_t can_tx_pending(LPC_CAN_TypeDef* CANx)
+{
+  txq_t* q = &txq[CAN_CTRL_IDX(CANx)];
+
+  return (q->in - q->out);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Transmit part of the CAN interrupt handler. Counts the frames sent
+ *    and refills the transmit buffers that have completed.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] icr: value read from the ICR register of the controller
+ *
+ *****************************************************************************/
+void can_tx_isr(LPC_CAN_TypeDef* CANx, uint32_t icr)
+{
+  ctrl_t* c = &ctrls[CAN_CTRL_IDX(CANx)];
+  uint32_t sr = 0;
+  uint32_t tfi = 0;
+  uint8_t buf = 0;
+
+  if ((icr & TX_BUFS_INT) == 0) {
+    return;
+  }
+
+  sr = CANx->SR;
+
+  for (buf = 0; buf < 3; buf++) {
+    if ((icr & txBufInt[buf]) != 0 && (sr & txBufDone[buf]) != 0) {
+      tfi = *(&CANx->TFI1 + (buf * 4));
+      c->stats.txFrames++;
+      c->stats.txBytes += frameBytes(tfi);
+      c->bits += frameBits(tfi);
+    }
+  }
+
+  fillTxBuffers(CANx);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Initialize the receive queue of a controller and enable the receive
+ *    interrupt. CAN_Init must have been called for the controller.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+void can_rx_init(LPC_CAN_TypeDef* CANx)
+{
+  rxq_t* q = &rxq[CAN_CTRL_IDX(CANx)];
+
+  q->in = 0;
+  q->out = 0;
+
+  CAN_IRQCmd(CANx, CANINT_RIE, ENABLE);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the oldest received frame without removing it from the queue. The
+ *    frame stays valid until can_rx_release is called.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ * Returns:
+ *   The frame or NULL if the queue is empty
+ *
+ *****************************************************************************/
+can_frame_t* can_rx_peek(LPC_CAN_TypeDef* CANx)
+{
+  rxq_t* q = &rxq[CAN_CTRL_IDX(CANx)];
+  uint32_t out = q->out;
+
+  if (q->in == out) {
+    return NULL;
+  }
+
+  // don't read the slot before the index that published it
+  __DMB();
+
+  return &q->frames[out & RX_QUEUE_MASK];
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Remove the frame returned by can_rx_peek from the queue. The time
+ *    since the frame was received is counted as the forward latency.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+void can_rx_release(LPC_CAN_TypeDef* CANx)
+{
+  rxq_t* q = &rxq[CAN_CTRL_IDX(CANx)];
+  can_stats_t* s = &ctrls[CAN_CTRL_IDX(CANx)].stats;
+  uint32_t latency = 0;
+
+  if (q->in == q->out) {
+    return;
+  }
+
+  latency = time_getUs() - q->stamps[q->out & RX_QUEUE_MASK];
+  if (latency > s->latencyMax) {
+    s->latencyMax = latency;
+  }
+  // average over the last ~16 frames
+  s->latencyAvg = s->latencyAvg - (s->latencyAvg >> 4) + (latency >> 4);
+
+  // all reads of the slot must be done before it is handed back
+  __DMB();
+  q->out = q->out + 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get number of frames waiting in the receive queue.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+uint32_t can_rx_pending(LPC_CAN_TypeDef* CANx)
+{
+  rxq_t* q = &rxq[CAN_CTRL_IDX(CANx)];
+
+  return (q->in - q->out);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Receive part of the CAN interrupt handler. Moves all frames available
+ *    in the controller into the receive queue.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] icr: value read from the ICR register of the controller
+ *
+ *****************************************************************************/
+void can_rx_isr(LPC_CAN_TypeDef* CANx, uint32_t icr)
+{
+  rxq_t* q = &rxq[CAN_CTRL_IDX(CANx)];
+  ctrl_t* c = &ctrls[CAN_CTRL_IDX(CANx)];
+  can_rx_hook_t hook = rxHook;
+  can_frame_t* frame = NULL;
+  can_frame_t lost;
+  uint32_t in = 0;
+  uint32_t used = 0;
+
+  if ((icr & CAN_ICR_RI) == 0) {
+    return;
+  }
+
+  while (CANx->SR & CAN_SR_RBS) {
+
+    in = q->in;
+    used = in - q->out;
+
+    if (used >= CAN_RX_QUEUE_SIZE) {
+      // no room, release the receive buffer and count the loss
+      if (hook != NULL) {
+        lost.rfs = CANx->RFS;
+        lost.id = CANx->RID;
+        lost.data[0] = CANx->RDA;
+        lost.data[1] = CANx->RDB;
+        hook(CAN_CTRL_IDX(CANx), &lost, 1);
+      }
+      c->bits += frameBits(CANx->RFS);
+      CANx->CMR = CAN_CMR_RRB;
+      c->stats.rxDropped++;
+      continue;
+    }
+
+    // RFS, RID, RDA and RDB are copied as they are
+    frame = &q->frames[in & RX_QUEUE_MASK];
+    frame->rfs = CANx->RFS;
+    frame->id = CANx->RID;
+    frame->data[0] = CANx->RDA;
+    frame->data[1] = CANx->RDB;
+    CANx->CMR = CAN_CMR_RRB;
+    q->stamps[in & RX_QUEUE_MASK] = time_getUs();
+
+    if (hook != NULL) {
+      hook(CAN_CTRL_IDX(CANx), frame, 0);
+    }
+
+    // frame must be complete before the task can see it
+    __DMB();
+    q->in = in + 1;
+
+    c->stats.rxFrames++;
+    c->stats.rxBytes += frameBytes(frame->rfs);
+    c->bits += frameBits(frame->rfs);
+    if (used + 1 > c->stats.rxHighWater) {
+      c->stats.rxHighWater = used + 1;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Set a function that is called from the CAN interrupt for every
+ *    received frame, e.g. to capture traffic. Set to NULL to remove.
+ *
+ * Params:
+ *   [in] hook: the function, must not block
+ *
+ *****************************************************************************/
+void can_rx_setHook(can_rx_hook_t hook)
+{
+  rxHook = hook;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Reset the statistics of a controller and enable the error, overrun and
+ *    arbitration lost interrupts. CAN_Init must have been called for the
+ *    controller and can_err_isr must be called from the CAN interrupt.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *
+ *****************************************************************************/
+void can_err_init(LPC_CAN_TypeDef* CANx)
+{
+  ctrl_t* c = &ctrls[CAN_CTRL_IDX(CANx)];
+
+  NVIC_DisableIRQ(CAN_IRQn);
+  memset(c, 0, sizeof(ctrl_t));
+  c->windowStart = time_get();
+  c->busOffDelay = CAN_BUSOFF_DELAY_MIN_MS;
+  NVIC_EnableIRQ(CAN_IRQn);
+
+  CAN_IRQCmd(CANx, CANINT_EIE, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_DOIE, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_EPIE, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_ALIE, ENABLE);
+  CAN_IRQCmd(CANx, CANINT_BEIE, ENABLE);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Error part of the CAN interrupt handler. Counts errors, captures ALC
+ *    and ECC and follows the error state of the controller.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] icr: value read from the ICR register of the controller
+ *
+ *****************************************************************************/
+void can_err_isr(LPC_CAN_TypeDef* CANx, uint32_t icr)
+{
+  ctrl_t* c = &ctrls[CAN_CTRL_IDX(CANx)];
+  can_stats_t* s = &c->stats;
+  uint32_t gsr = 0;
+  uint32_t now = 0;
+  uint8_t state = 0;
+
+  if ((icr & ERR_INT) == 0) {
+    return;
+  }
+
+  if (icr & CAN_ICR_DOI) {
+    s->overruns++;
+    CANx->CMR = CAN_CMR_CDO;
+  }
+
+  if (icr & CAN_ICR_ALI) {
+    s->arbLost++;
+    s->lastAlc = ICR_ALC(icr);
+  }
+
+  if (icr & CAN_ICR_BEI) {
+    s->busErrors++;
+    s->lastEcc = ICR_ECC(icr);
+  }
+
+  if ((icr & (CAN_ICR_EI | CAN_ICR_EPI)) == 0) {
+    return;
+  }
+
+  gsr = CANx->GSR;
+
+  if (gsr & CAN_GSR_BS) {
+    state = CAN_STATE_BUSOFF;
+  }
+  else if (GSR_RXERR(gsr) >= ERR_PASSIVE_LIMIT
+      || GSR_TXERR(gsr) >= ERR_PASSIVE_LIMIT) {
+    state = CAN_STATE_PASSIVE;
+  }
+  else {
+    state = CAN_STATE_ACTIVE;
+  }
+
+  if (state == s->state) {
+    return;
+  }
+
+  if (state == CAN_STATE_BUSOFF) {
+    // the controller has entered reset mode by itself. Repeated bus-offs
+    // double the delay before it is put back on the bus.
+    now = time_get();
+    if (s->busOff == 0 || now - c->busOffTime >= CAN_BUSOFF_RESET_MS) {
+      c->busOffDelay = CAN_BUSOFF_DELAY_MIN_MS;
+    }
+    else if (c->busOffDelay < CAN_BUSOFF_DELAY_MAX_MS) {
+      c->busOffDelay *= 2;
+    }
+    c->busOffTime = now;
+    c->recover = 1;
+    s->busOff++;
+  }
+  else if (state == CAN_STATE_PASSIVE) {
+    s->errPassive++;
+  }
+
+  if (s->state == CAN_STATE_BUSOFF) {
+    // back on the bus, restart the transmit chain
+    fillTxBuffers(CANx);
+  }
+
+  s->state = state;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Call this function regularly. Puts controllers in bus-off back on the
+ *    bus when their delay has expired and updates the bus load.
+ *
+ *****************************************************************************/
+void can_err_task(void)
+{
+  ctrl_t* c = NULL;
+  uint32_t now = time_get();
+  uint32_t elapsed = 0;
+  uint32_t bits = 0;
+  uint32_t load = 0;
+  uint8_t i = 0;
+
+  for (i = 0; i < CAN_NUM_CTRL; i++) {
+    c = &ctrls[i];
+
+    if (c->recover && now - c->busOffTime >= c->busOffDelay) {
+      c->recover = 0;
+      // the controller leaves bus-off after 128 x 11 recessive bits
+      CAN_ModeConfig(ctrlRegs[i], CAN_RESET_MODE, DISABLE);
+    }
+
+    elapsed = now - c->windowStart;
+    if (elapsed < CAN_LOAD_WINDOW_MS) {
+      continue;
+    }
+
+    NVIC_DisableIRQ(CAN_IRQn);
+    bits = c->bits;
+    c->bits = 0;
+    NVIC_EnableIRQ(CAN_IRQn);
+    c->windowStart = now;
+
+    load = (uint32_t)(((uint64_t)bits * 100 * 1000)
+        / ((uint64_t)bitRate(i) * elapsed));
+    c->stats.busLoad = (load > 100 ? 100 : load);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the statistics of a controller (counters are never reset).
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [out] stats: statistics
+ *
+ *****************************************************************************/
+void can_getStats(LPC_CAN_TypeDef* CANx, can_stats_t* stats)
+{
+  uint32_t gsr = CANx->GSR;
+
+  NVIC_DisableIRQ(CAN_IRQn);
+  *stats = ctrls[CAN_CTRL_IDX(CANx)].stats;
+  NVIC_EnableIRQ(CAN_IRQn);
+
+  stats->rxErr = GSR_RXERR(gsr);
+  stats->txErr = GSR_TXERR(gsr);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Change the bit rate of a controller. Unlike CAN_Init this keeps the
+ *    acceptance filter, the queues and the interrupt setup. Frames being
+ *    sent or received while the rate is changed are lost.
+ *
+ * Params:
+ *   [in] CANx: CAN controller
+ *   [in] bitrate: bit rate (bit/s)
+ *   [in] samplePoint: sample point in 1/1000 of the bit, 500-950
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT if the bit rate can't be generated (see
+ *   canbtr_solve)
+ *
+ *****************************************************************************/
+error_t can_setBitrate(LPC_CAN_TypeDef* CANx, uint32_t bitrate,
+    uint16_t samplePoint)
+{
+  uint8_t idx = CAN_CTRL_IDX(CANx);
+  canbtr_t timing;
+  uint32_t mod = 0;
+  error_t err = ERR_OK;
+
+  err = canbtr_solve(CLKPWR_GetPCLK(ctrlPclk[idx]), bitrate, samplePoint,
+      CAN_BTR_SJW, &timing);
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  NVIC_DisableIRQ(CAN_IRQn);
+
+  // BTR can only be written in reset mode, the other mode bits are kept
+  mod = CANx->MOD;
+  CANx->MOD = mod | CAN_MOD_RM;
+  CANx->BTR = timing.btr;
+  CANx->MOD = mod & ~CAN_MOD_RM;
+
+  // load measured at the old rate is dropped
+  ctrls[idx].bits = 0;
+  ctrls[idx].windowStart = time_get();
+
+  // transmit buffers were released by reset mode
+  fillTxBuffers(CANx);
+
+  NVIC_EnableIRQ(CAN_IRQn);
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Convert a CAN_MSG_Type frame to a can_frame_t
+ *
+ * Params:
+ *   [out] frame: converted frame
+ *   [in] msg: the frame
+ *
+ *****************************************************************************/
+void can_frame_fromMsg(can_frame_t* frame, const CAN_MSG_Type* msg)
+{
+  frame->rfs = FRAME_DLC(msg->len);
+  if (msg->type == REMOTE_FRAME) {
+    frame->rfs |= CAN_RFS_RTR;
+  }
+  if (msg->format == EXT_ID_FORMAT) {
+    frame->rfs |= CAN_RFS_FF;
+  }
+
+  frame->id = msg->id;
+  frame->data[0] = msg->dataA[0] | (msg->dataA[1] << 8)
+      | (msg->dataA[2] << 16) | ((uint32_t)msg->dataA[3] << 24);
+  frame->data[1] = msg->dataB[0] | (msg->dataB[1] << 8)
+      | (msg->dataB[2] << 16) | ((uint32_t)msg->dataB[3] << 24);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Convert a can_frame_t to a CAN_MSG_Type frame
+ *
+ * Params:
+ *   [in] frame: the frame
+ *   [out] msg: converted frame
+ *
+ *****************************************************************************/
+void can_frame_toMsg(const can_frame_t* frame, CAN_MSG_Type* msg)
+{
+  msg->id = frame->id;
+  msg->len = CAN_FRAME_LEN(frame);
+  msg->format = CAN_FRAME_FORMAT(frame);
+  msg->type = (CAN_FRAME_IS_RTR(frame) ? REMOTE_FRAME : DATA_FRAME);
+  msg->dataA[0] = frame->data[0];
+  msg->dataA[1] = frame->data[0] >> 8;
+  msg->dataA[2] = frame->data[0] >> 16;
+  msg->dataA[3] = frame->data[0] >> 24;
+  msg->dataB[0] = frame->data[1];
+  msg->dataB[1] = frame->data[1] >> 8;
+  msg->dataB[2] = frame->data[1] >> 16;
+  msg->dataB[3] = frame->data[1] >> 24;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,491 @@
+/****************************************************************************************************//**
+*
+* @file		canlog.c
+* @brief	Timestamped capture of CAN traffic to a file on the SD card
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Frames are stamped and stored in one of two RAM buffers from the CAN
+ * interrupt (through the receive hook of canbus). When a buffer is full
+ * the interrupt continues in the other one and canlog_task writes the full
+ * buffer to the file. The interrupt never waits: if both buffers are full
+ * the frame is only counted as lost.
+ *
+ * Binary files are written in whole sectors. For text files the records
+ * are formatted by canlog_task when written, into a sector sized buffer.
+ *
+ * The file is written as a stream (f_stream) into CANLOG_RESERVE bytes of
+ * contiguous space, so writes don't touch the FAT and take about the same
+ * time each. Without enough contiguous space the clusters are allocated
+ * one at a time.
+ *
+ * f_stream only finds space in the free cluster map of FatFs, which is
+ * built in slices after mounting. canlog_task builds it while not
+ * capturing, so it should be called from the idle loop all the time.
+ *
+ * The file system must be mounted (f_mount) before canlog_start. Frames
+ * received in FullCAN objects don't pass the receive interrupt and are not
+ * captured.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+#include "canlog.h"
+#include "time.h"
+#include "ff.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SECTOR_SIZE (512)
+#define RECS_PER_BUF (CANLOG_BUF_SECTORS * SECTOR_SIZE / sizeof(canlog_rec_t))
+
+// longest candump line: "(4294967295.999999) can1 1FFFFFFF#0011223344556677\n"
+#define LINE_MAX (56)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  canlog_rec_t recs[RECS_PER_BUF];
+
+  // 'count' is only written by the interrupt while 'full' is 0 and by the
+  // task while 'full' is 1
+  volatile uint16_t count;
+  volatile uint8_t full;
+} logbuf_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const char hexDigits[16] = "0123456789ABCDEF";
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static logbuf_t bufs[2];
+
+// buffer filled by the interrupt and next buffer to write
+static uint8_t active = 0;
+static uint8_t next = 0;
+
+static FIL file;
+static uint8_t logFormat = CANLOG_FORMAT_BINARY;
+static uint8_t running = 0;
+
+// text waiting to be written, always less than a sector
+static char text[SECTOR_SIZE];
+static uint16_t textLen = 0;
+
+static canlog_stats_t stats;
+
+// f_mapfree failed, not called again before the next capture
+static uint8_t mapStopped = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static void capture(uint8_t ctrl, const can_frame_t* frame, uint8_t dropped);
+static void buildMap(void);
+static void writeBuffer(logbuf_t* b);
+static void writeFile(const void* data, uint32_t len);
+static uint8_t formatRecord(const canlog_rec_t* rec, char* line);
+static char* putHex(char* p, uint32_t val, uint8_t digits);
+static char* putDec(char* p, uint32_t val, uint8_t digits);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if CANLOG_BUF_SECTORS < 1
+#error "CANLOG_BUF_SECTORS must be at least 1"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Create a log file and start capturing all received frames
+ *
+ * Params:
+ *   [in] fileName: name of the file, an existing file is overwritten
+ *   [in] format: CANLOG_FORMAT_BINARY or CANLOG_FORMAT_CANDUMP
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT if already running or ERR_FILE if the file
+ *   couldn't be created
+ *
+ *****************************************************************************/
+error_t canlog_start(const char* fileName, uint8_t format)
+{
+  if (running || fileName == NULL || format > CANLOG_FORMAT_CANDUMP) {
+    return ERR_ARGUMENT;
+  }
+
+  if (f_open(&file, fileName, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+    return ERR_FILE;
+  }
+
+#if CANLOG_RESERVE > 0
+  // not fatal, the file is then extended through the FAT
+  f_stream(&file, CANLOG_RESERVE);
+#endif
+
+  // the volume is mounted, the map may be built again afterwards
+  mapStopped = 0;
+
+  bufs[0].count = 0;
+  bufs[0].full = 0;
+  bufs[1].count = 0;
+  bufs[1].full = 0;
+  active = 0;
+  next = 0;
+  textLen = 0;
+  logFormat = format;
+  memset(&stats, 0, sizeof(stats));
+  running = 1;
+
+  can_rx_setHook(capture);
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Stop capturing, write all captured frames and close the file
+ *
+ * Returns:
+ *   ERR_OK, ERR_NOT_INIT if not running or ERR_FILE if a write failed
+ *
+ *****************************************************************************/
+error_t canlog_stop(void)
+{
+  int i = 0;
+
+  if (!running) {
+    return ERR_NOT_INIT;
+  }
+
+  can_rx_setHook(NULL);
+
+  // oldest buffer first, the other one may be partly filled
+  for (i = 0; i < 2; i++) {
+    writeBuffer(&bufs[next]);
+    next ^= 1;
+  }
+
+  if (textLen > 0) {
+    writeFile(text, textLen);
+    textLen = 0;
+  }
+
+  running = 0;
+
+  if (f_close(&file) != FR_OK) {
+    stats.errors++;
+  }
+
+  return (stats.errors == 0 ? ERR_OK : ERR_FILE);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write full capture buffers to the file, or build the free cluster
+ *    map of the file system while not capturing. Call this function from
+ *    the idle loop, while capturing at least once per buffer fill time.
+ *
+ *****************************************************************************/
+void canlog_task(void)
+{
+  if (!running) {
+    buildMap();
+    return;
+  }
+
+  if (!bufs[next].full) {
+    return;
+  }
+
+  writeBuffer(&bufs[next]);
+  next ^= 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get capture statistics of the current or last capture
+ *
+ * Params:
+ *   [out] s: statistics
+ *
+ *****************************************************************************/
+void canlog_getStats(canlog_stats_t* s)
+{
+  NVIC_DisableIRQ(CAN_IRQn);
+  *s = stats;
+  NVIC_EnableIRQ(CAN_IRQn);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Receive hook, called from the CAN interrupt
+ *
+ *****************************************************************************/
+static void capture(uint8_t ctrl, const can_frame_t* frame, uint8_t dropped)
+{
+  logbuf_t* b = &bufs[active];
+  canlog_rec_t* rec = NULL;
+
+  if (b->full) {
+    stats.lost++;
+    return;
+  }
+
+  rec = &b->recs[b->count];
+  rec->timestamp = time_getUs64();
+  rec->bus = ctrl;
+  rec->flags = (dropped ? CANLOG_FLAG_DROPPED : 0);
+  rec->reserved1 = 0;
+  rec->reserved2 = 0;
+  rec->frame = *frame;
+  stats.captured++;
+
+  if (++b->count == RECS_PER_BUF) {
+    // records must be complete before the task can see the buffer
+    __DMB();
+    b->full = 1;
+    active ^= 1;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Scan the next CANLOG_MAP_ENTRIES FAT entries of drive 0 into the free
+ *    cluster map. Returns at once when the map is complete. Stops until the
+ *    next capture when the volume can't be read, a missing card would
+ *    otherwise be initialised on every call.
+ *
+ *****************************************************************************/
+static void buildMap(void)
+{
+#if CANLOG_MAP_ENTRIES > 0
+  FRESULT res;
+
+  if (mapStopped) {
+    return;
+  }
+
+  // FR_NOT_ENABLED: not mounted yet
+  res = f_mapfree("", CANLOG_MAP_ENTRIES);
+  if (res != FR_OK && res != FR_NOT_ENABLED) {
+    mapStopped = 1;
+  }
+#endif
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write the records of a buffer to the file and hand the buffer back to
+ *    the interrupt. The buffer must be full or the hook removed.
+ *
+ *****************************************************************************/
+static void writeBuffer(logbuf_t* b)
+{
+  char line[LINE_MAX];
+  uint8_t len = 0;
+  uint16_t n = 0;
+  int i = 0;
+
+  __DMB();
+
+  if (logFormat == CANLOG_FORMAT_BINARY) {
+    writeFile(b->recs, b->count * sizeof(canlog_rec_t));
+  }
+  else {
+    for (i = 0; i < b->count; i++) {
+      len = formatRecord(&b->recs[i], line);
+
+      n = SECTOR_SIZE - textLen;
+      if (n > len) {
+        n = len;
+      }
+      memcpy(&text[textLen], line, n);
+      textLen += n;
+
+      if (textLen == SECTOR_SIZE) {
+        writeFile(text, SECTOR_SIZE);
+        memcpy(text, &line[n], len - n);
+        textLen = len - n;
+      }
+    }
+  }
+
+  stats.written += b->count;
+  b->count = 0;
+
+  __DMB();
+  b->full = 0;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write to the log file and count failures
+ *
+ *****************************************************************************/
+static void writeFile(const void* data, uint32_t len)
+{
+  UINT bw = 0;
+
+  if (f_write(&file, data, len, &bw) != FR_OK || bw != len) {
+    stats.errors++;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Format a record as a candump log line, e.g.
+ *    "(12.000345) can0 123#0102" or "(12.000345) can1 00020000#R"
+ *
+ * Returns:
+ *   Length of the line, including the newline
+ *
+ *****************************************************************************/
+static uint8_t formatRecord(const canlog_rec_t* rec, char* line)
+{
+  const can_frame_t* f = &rec->frame;
+  char* p = line;
+  uint8_t i = 0;
+  uint8_t len = CAN_FRAME_LEN(f);
+
+  if (len > 8) {
+    len = 8;
+  }
+
+  *p++ = '(';
+  p = putDec(p, (uint32_t)(rec->timestamp / 1000000), 1);
+  *p++ = '.';
+  p = putDec(p, (uint32_t)(rec->timestamp % 1000000), 6);
+  *p++ = ')';
+  *p++ = ' ';
+  *p++ = 'c';
+  *p++ = 'a';
+  *p++ = 'n';
+  *p++ = '0' + rec->bus;
+  *p++ = ' ';
+  p = putHex(p, f->id, (CAN_FRAME_IS_EXT(f) ? 8 : 3));
+  *p++ = '#';
+
+  if (CAN_FRAME_IS_RTR(f)) {
+    *p++ = 'R';
+  }
+  else {
+    for (i = 0; i < len; i++) {
+      p = putHex(p, CAN_FRAME_DATA(f)[i], 2);
+    }
+  }
+
+  *p++ = '\n';
+
+  return (p - line);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write a value as upper case hex digits
+ *
+ *****************************************************************************/
+static char* putHex(char* p, uint32_t val, uint8_t digits)
+{
+  int i = 0;
+
+  for (i = digits - 1; i >= 0; i--) {
+    p[i] = hexDigits[val & 0x0F];
+    val >>= 4;
+  }
+
+  return p + digits;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write a value as decimal digits, padded with zeros to 'digits'
+ *
+ *****************************************************************************/
+static char* putDec(char* p, uint32_t val, uint8_t digits)
+{
+  char buf[10];
+  int n = 0;
+
+  do {
+    buf[n++] = '0' + (val % 10);
+    val /= 10;
+  } while (val > 0);
+
+  while (n < digits) {
+    buf[n++] = '0';
+  }
+
+  while (n > 0) {
+    *p++ = buf[--n];
+  }
+
+  return p;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
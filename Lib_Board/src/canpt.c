@@ -22,27 +22,48 @@
 #include "lpc17xx_can.h"
 #include "board.h"
 #include "canpt.h"
+#include "canbus.h"
+#include "canroute.h"
+#include "canaf.h"
+#include "canbtr.h"
+#include "canbaud.h"
 #include "time.h"
+#include "dlog.h"
 
 /********************************************************************************************************
 *** PRIVATE DEFINES
 ********************************************************************************************************/
 
-#define NODE_MAX_NUM  (10)
-#define NODE_MAX_CAPS (12)
+// Maximum number of attached nodes, at most 255
+#ifndef NODE_MAX_NUM
+#define NODE_MAX_NUM  (128)
+#endif
 
-typedef struct
-{
-  uint8_t reqId;
-  uint32_t aliveTime;
-  uint32_t lastPoll;
-  uint8_t caps[NODE_MAX_CAPS];
-} node_t;
+// Bytes of published capabilities stored for all nodes (two per byte)
+#ifndef NODE_CAP_POOL_SIZE
+#define NODE_CAP_POOL_SIZE (NODE_MAX_NUM * 4)
+#endif
 
 #define NODE_POLL_TIME  (2500)
 #define NODE_ALIVE_TIME (500)
 
-#define NUM_RX_MSGS (5)
+// Maximum number of poll messages queued by one call to canpt_task
+#define NODE_POLL_BATCH (8)
+
+// bus the nodes are attached to
+#define NODE_BUS (CANROUTE_BUS1)
+
+// no node (list end, unused ID)
+#define NODE_NIL (0xFF)
+
+// acceptance filters added to the routes for the protocol frames
+#define NODE_FILTERS (2)
+
+// Timer wheel for the node deadlines. The wheel must span more than the
+// longest deadline (NODE_ALIVE_TIME + NODE_POLL_TIME).
+#define WHEEL_TICK_MS (50)
+#define WHEEL_SLOTS   (128)
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
 
 /********************************************************************************************************
 *** PRIVATE MACROS
@@ -53,27 +74,70 @@ typedef struct
 *** PRIVATE DATA TYPES
 ********************************************************************************************************/
 
+/*
+ * Attached node. 'next' and 'prev' link the node into timer wheel 'slot'
+ * (free nodes are linked through 'next'). The published capabilities are
+ * stored as received, capLen bytes at capOfs in capPool.
+ */
+typedef struct
+{
+  uint8_t reqId;
+  uint8_t next;
+  uint8_t prev;
+  uint8_t slot;
+  uint8_t capLen;
+  uint16_t capOfs;
+  uint32_t aliveTime;
+  uint32_t lastPoll;
+  uint32_t due;
+} node_t;
 
 /********************************************************************************************************
 *** PRIVATE TABLES
 ********************************************************************************************************/
 
+// controller for each routing bus number
+static LPC_CAN_TypeDef* const buses[CANROUTE_NUM_BUSES] = {
+  LPC_CAN1,
+  LPC_CAN2
+};
+
+// routes used unless canpt_setRoutes is called before canpt_init
+static const canroute_t defaultRoutes[] = {
+  // srcBus, format, dstMask, idLow, idHigh, mask, newId, transform, fullCan
+  {CANROUTE_BUS1, EXT_ID_FORMAT, CANROUTE_DST(CANROUTE_BUS2),
+      0x1FFFF, 0x20001, 0, CANROUTE_ID_KEEP, NULL, 0},
+  {CANROUTE_BUS2, STD_ID_FORMAT, CANROUTE_DST(CANROUTE_BUS1),
+      0x000, 0x00F, 0, CANROUTE_ID_KEEP, NULL, 0},
+  {CANROUTE_BUS2, STD_ID_FORMAT, CANROUTE_DST(CANROUTE_BUS1),
+      CANPT_CAN2_ID, CANPT_CAN2_ID, 0, CANROUTE_ID_KEEP, NULL, 0},
+};
+
 
 /********************************************************************************************************
 *** PUBLIC GLOBAL VARIABLES
 ********************************************************************************************************/
 
 static CAN_MSG_Type txMsg;
-static CAN_MSG_Type rxMsg;
 
 static canpt_callb_t* _cb = NULL;
 
 static node_t nodes[NODE_MAX_NUM];
 static uint8_t numNodes = 0;
 
-static CAN_MSG_Type rxMsgs[NUM_RX_MSGS];
-static uint8_t rxMsgIn = 0;
-static uint8_t rxMsgOut = 0;
+// index in nodes[] for each node ID, NODE_NIL if not attached
+static uint8_t nodeIdx[256];
+static uint8_t freeNodes = NODE_NIL;
+
+static uint8_t capPool[NODE_CAP_POOL_SIZE];
+static uint16_t capUsed = 0;
+
+// first node of each slot and next tick to process
+static uint8_t wheel[WHEEL_SLOTS];
+static uint32_t wheelTick = 0;
+
+static const canroute_t* routes = defaultRoutes;
+static uint16_t numRoutes = sizeof(defaultRoutes) / sizeof(defaultRoutes[0]);
 
 /********************************************************************************************************
 *** PRIVATE GLOBAL VARIABLES
@@ -84,11 +148,29 @@ static uint8_t rxMsgOut = 0;
 *** PRIVATE FUNCTION PROTOTYPES
 ********************************************************************************************************/
 
+static void processFrame(const can_frame_t* frame);
+
 
 /********************************************************************************************************
 *** CONFIGURATION ERRORS
 ********************************************************************************************************/
 
+#if NODE_MAX_NUM > 255
+#error "NODE_MAX_NUM must be at most 255"
+#endif
+
+#if !CANBTR_RATE_VALID(CANBTR_PCLK_HZ, CANPT_CAN1_BAUDRATE)
+#error "CANPT_CAN1_BAUDRATE can't be generated from the CAN clock"
+#endif
+
+#if !CANBTR_RATE_VALID(CANBTR_PCLK_HZ, CANPT_CAN2_BAUDRATE)
+#error "CANPT_CAN2_BAUDRATE can't be generated from the CAN clock"
+#endif
+
+#if WHEEL_SLOTS * WHEEL_TICK_MS <= NODE_ALIVE_TIME + NODE_POLL_TIME
+#error "Timer wheel doesn't cover the node deadlines"
+#endif
+
 
 /*-----------------------------------------------------------------------------------------------------*/
 
@@ -100,61 +182,106 @@ static uint8_t rxMsgOut = 0;
 /******************************************************************************
  *
  * Description:
- *    Put a CAN message in the queue
+ *    Put a node in the timer wheel slot of a deadline. The node is never
+ *    put in the slot being processed, so a deadline is only handled when
+ *    it has passed.
  *
  * Params:
- *   [in] d: message to put in the queue
+ *   [in] idx: index of the node
+ *   [in] due: deadline (ms)
  *
  *****************************************************************************/
-static void q_put(CAN_MSG_Type* d)
+static void scheduleNode(uint8_t idx, uint32_t due)
 {
-  CAN_MSG_Type* m;
+  node_t* n = &nodes[idx];
+  uint32_t tick = due / WHEEL_TICK_MS + 1;
+  uint8_t slot = 0;
 
-  if (rxMsgOut == (rxMsgIn + 1) % NUM_RX_MSGS) {
-    return;
+  if ((int32_t)(tick - wheelTick) < 1) {
+    tick = wheelTick + 1;
   }
 
-  m = &rxMsgs[rxMsgIn];
-  rxMsgIn = (rxMsgIn + 1) % NUM_RX_MSGS;
-
-  m->id = d->id;
-  m->type = d->type;
-  m->len = d->len;
-  m->format = d->format;
-  memcpy(m->dataA, d->dataA, 4);
-  memcpy(m->dataB, d->dataB, 4);
+  slot = tick & WHEEL_MASK;
+  n->slot = slot;
+  n->due = due;
+  n->prev = NODE_NIL;
+  n->next = wheel[slot];
+  if (n->next != NODE_NIL) {
+    nodes[n->next].prev = idx;
+  }
+  wheel[slot] = idx;
 }
 
 /******************************************************************************
  *
  * Description:
- *    Get a CAN message from the queue
+ *    Remove a node from its timer wheel slot
  *
  *****************************************************************************/
-static CAN_MSG_Type* q_get(void)
+static void unscheduleNode(uint8_t idx)
 {
-  CAN_MSG_Type* m;
+  node_t* n = &nodes[idx];
+
+  if (n->prev != NODE_NIL) {
+    nodes[n->prev].next = n->next;
+  }
+  else {
+    wheel[n->slot] = n->next;
+  }
 
-  // empty
-  if (rxMsgIn == rxMsgOut) {
-    return NULL;
+  if (n->next != NODE_NIL) {
+    nodes[n->next].prev = n->prev;
   }
+}
 
-  m = &rxMsgs[rxMsgOut];
-  rxMsgOut = (rxMsgOut + 1) % NUM_RX_MSGS;
+/******************************************************************************
+ *
+ * Description:
+ *    Get the next deadline of a node: its next poll or, if it doesn't
+ *    answer before, its expiry
+ *
+ *****************************************************************************/
+static uint32_t nextDeadline(node_t* n)
+{
+  uint32_t poll = n->lastPoll + NODE_POLL_TIME;
+  uint32_t expiry = n->aliveTime + NODE_ALIVE_TIME + NODE_POLL_TIME;
 
-  return m;
+  return ((int32_t)(expiry - poll) < 0 ? expiry : poll);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Check if the queue is empty
+ *    Remove a node, free its capabilities and notify the application
  *
  *****************************************************************************/
-static uint8_t q_isEmpty(void)
+static void detachNode(uint8_t idx)
 {
-  return (rxMsgIn == rxMsgOut);
+  node_t* n = &nodes[idx];
+  uint8_t reqId = n->reqId;
+  int i = 0;
+
+  unscheduleNode(idx);
+
+  // keep the capability pool packed, nodes are rarely removed
+  memmove(&capPool[n->capOfs], &capPool[n->capOfs + n->capLen],
+      capUsed - (n->capOfs + n->capLen));
+  capUsed -= n->capLen;
+  for (i = 0; i < NODE_MAX_NUM; i++) {
+    if (nodes[i].reqId != 0 && nodes[i].capOfs > n->capOfs) {
+      nodes[i].capOfs -= n->capLen;
+    }
+  }
+
+  nodeIdx[reqId] = NODE_NIL;
+  n->reqId = 0;
+  n->next = freeNodes;
+  freeNodes = idx;
+  numNodes--;
+
+  if (_cb != NULL && _cb->nodeDetached != NULL) {
+    _cb->nodeDetached(reqId);
+  }
 }
 
 /******************************************************************************
@@ -170,39 +297,35 @@ static uint8_t q_isEmpty(void)
  *****************************************************************************/
 static void handlePublish(uint8_t reqId, uint8_t* buf, uint8_t len)
 {
-  int i = 0;
-  int j = 0;
+  node_t* n = NULL;
+  uint8_t idx = 0;
 
   // ignore the message if the node is already registered
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId == reqId) {
-      return;
-    }
+  if (reqId == 0 || nodeIdx[reqId] != NODE_NIL) {
+    return;
   }
 
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId == 0) {
-      nodes[i].reqId = reqId;
-      nodes[i].aliveTime = time_get();
-      numNodes++;
-
-      for (j = 0; j < len; j++) {
-        if (j >= NODE_MAX_CAPS) {
-          break;
-        }
-        nodes[i].caps[j*2]   = ((buf[j]) & 0xf0);
-
-        if (j+1 >= NODE_MAX_CAPS) {
-          break;
-        }
-        nodes[i].caps[j*2+1] = (((buf[j] & 0x0f) << 4)& 0xff);
-      }
-
-      break;
-    }
+  if (freeNodes == NODE_NIL || capUsed + len > NODE_CAP_POOL_SIZE) {
+    return;
   }
 
-  if (i < NODE_MAX_NUM && _cb != NULL && _cb->nodeAttached != NULL ) {
+  idx = freeNodes;
+  n = &nodes[idx];
+  freeNodes = n->next;
+
+  n->reqId = reqId;
+  n->aliveTime = time_get();
+  n->lastPoll = n->aliveTime;
+  n->capOfs = capUsed;
+  n->capLen = len;
+  memcpy(&capPool[capUsed], buf, len);
+  capUsed += len;
+
+  nodeIdx[reqId] = idx;
+  numNodes++;
+  scheduleNode(idx, nextDeadline(n));
+
+  if (_cb != NULL && _cb->nodeAttached != NULL ) {
     _cb->nodeAttached(reqId);
   }
 
@@ -238,13 +361,9 @@ static void handleValue(uint8_t reqId, uint8_t periphId, uint8_t* buf, uint8_t l
  *****************************************************************************/
 static void handlePollResponse(uint8_t reqId)
 {
-  int i = 0;
-
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId == reqId) {
-      nodes[i].aliveTime = time_get();
-      break;
-    }
+  // the deadline isn't moved, the node is checked again at its next poll
+  if (nodeIdx[reqId] != NODE_NIL) {
+    nodes[nodeIdx[reqId]].aliveTime = time_get();
   }
 }
 
@@ -279,53 +398,186 @@ static void handleSubscribeResponse(uint8_t reqId, uint8_t subId)
 //error_t sendMessage(uint8_t reqId, uint8_t dataLen)
 error_t sendMessage(LPC_CAN_TypeDef * CANx, uint8_t reqId, uint8_t dataLen)
 {
-  Status status;
-  error_t err = ERR_OK;
-  uint32_t s = 0;
-  uint32_t to = 0;
-
 //  txMsg.id = reqId;
   txMsg.id = 0x20000;
   txMsg.format = EXT_ID_FORMAT;
   txMsg.dataA[0] = CANPT_NODE_UNIQUE_ID;
   txMsg.len = dataLen + 1;
 
-  to = time_get() + 500;
-//  status = CAN_SendMsg(LPC_CAN1, &txMsg);
-//  status = CAN_SendMsg(LPC_CAN2, &txMsg);
-  status = CAN_SendMsg(CANx, &txMsg);
-  if (status != SUCCESS) {
-    err = ERR_CAN_SEND;
+  // the frame is copied into the transmit queue, txMsg can be reused at once
+  return can_tx_enqueue(CANx, &txMsg);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send a received frame on the buses given by its route and process
+ *    the protocol frames received on the node bus. Other frames without a
+ *    route are dropped.
+ *
+ * Params:
+ *   [in] bus: bus the frame was received on
+ *   [in] frame: the frame, not modified
+ *
+ * Returns:
+ *   1 if the frame was handled, 0 if a destination queue is full
+ *
+ *****************************************************************************/
+static uint8_t routeFrame(uint8_t bus, const can_frame_t* frame)
+{
+  can_frame_t fwd;
+  const canroute_t* route = NULL;
+  uint8_t dst = 0;
+  int i = 0;
+
+  route = canroute_lookup(bus, CAN_FRAME_FORMAT(frame), frame->id);
+
+  // don't send the frame on some of the buses only
+  for (i = 0; route != NULL && i < CANROUTE_NUM_BUSES; i++) {
+    if ((route->dstMask & CANROUTE_DST(i)) != 0
+        && can_tx_pending(buses[i]) >= CAN_TX_QUEUE_SIZE) {
+      return 0;
+    }
   }
-  else {
 
-    do {
-//      s = CAN_GetCTRLStatus(LPC_CAN1, CANCTRL_GLOBAL_STS);
-//        s = CAN_GetCTRLStatus(LPC_CAN2, CANCTRL_GLOBAL_STS);
-        s = CAN_GetCTRLStatus(CANx, CANCTRL_GLOBAL_STS);
+  // the frame is handled once, it can't come back after this point
+  if (bus == NODE_BUS) {
+    processFrame(frame);
+  }
+
+  if (route == NULL) {
+    return 1;
+  }
+
+  fwd = *frame;
+  dst = canroute_apply(route, &fwd);
+
+  for (i = 0; i < CANROUTE_NUM_BUSES; i++) {
+    if ((dst & CANROUTE_DST(i)) != 0) {
+      can_tx_enqueueFrame(buses[i], &fwd);
+    }
+  }
+
+  return 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Route the oldest frame in the receive queue of a bus
+ *
+ * Params:
+ *   [in] bus: CANROUTE_BUS1 or CANROUTE_BUS2
+ *
+ * Returns:
+ *   1 if a frame was handled, 0 if there was nothing to do or no room
+ *
+ *****************************************************************************/
+static uint8_t forwardFrame(uint8_t bus)
+{
+  can_frame_t* frame = NULL;
+
+  frame = can_rx_peek(buses[bus]);
+  if (frame == NULL || routeFrame(bus, frame) == 0) {
+    return 0;
+  }
+
+  can_rx_release(buses[bus]);
 
-    } while ((s & CAN_GSR_TCS) == 0 && to > time_get());
+  return 1;
+}
 
-    if (to <= time_get()) {
-      err = ERR_TIMEOUT;
+/******************************************************************************
+ *
+ * Description:
+ *    Route a frame received in a FullCAN object. Nothing is read unless
+ *    all transmit queues have room, a FullCAN object can't be left unread.
+ *
+ * Returns:
+ *   1 if a frame was handled, 0 if there was nothing to do or no room
+ *
+ *****************************************************************************/
+static uint8_t forwardFullCan(void)
+{
+  can_frame_t frame;
+  uint8_t bus = 0;
+  int i = 0;
+
+  for (i = 0; i < CANROUTE_NUM_BUSES; i++) {
+    if (can_tx_pending(buses[i]) >= CAN_TX_QUEUE_SIZE) {
+      return 0;
     }
+  }
 
-    //while (((s = CAN_GetCTRLStatus(LPC_CAN1, CANCTRL_GLOBAL_STS)) & CAN_GSR_TCS) == 0);
+  if (canaf_readFullCan(&bus, &frame) == 0 || bus >= CANROUTE_NUM_BUSES) {
+    return 0;
   }
 
-  return err;
+  return routeFrame(bus, &frame);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Load the acceptance filter from the compiled routing table and the
+ *    protocol IDs so that other frames are never received. A masked route
+ *    loads the range covering all IDs that can match, the exact check is
+ *    done by canroute_lookup.
+ *
+ * Returns:
+ *   See canaf_setup
+ *
+ *****************************************************************************/
+static error_t loadFilters(void)
+{
+  canaf_filter_t filters[CANROUTE_MAX_ROUTES + NODE_FILTERS];
+  const canroute_t* r = NULL;
+  int i = 0;
+
+  for (i = 0; i < canroute_count(); i++) {
+    r = canroute_get(i);
+    filters[i].ctrl = r->srcBus;
+    filters[i].format = r->format;
+    filters[i].fullCan = r->fullCan;
+    canroute_range(r, &filters[i].idLow, &filters[i].idHigh);
+  }
+
+  // broadcast IDs and frames directed to this node
+  filters[i].ctrl = NODE_BUS;
+  filters[i].format = STD_ID_FORMAT;
+  filters[i].fullCan = 0;
+  filters[i].idLow = 0;
+  filters[i].idHigh = ~CANPT_MSG_CMN_MASK & 0x7FF;
+  i++;
+
+  filters[i].ctrl = NODE_BUS;
+  filters[i].format = STD_ID_FORMAT;
+  filters[i].fullCan = 0;
+  filters[i].idLow = CANPT_NODE_UNIQUE_ID;
+  filters[i].idHigh = CANPT_NODE_UNIQUE_ID;
+  i++;
+
+  return canaf_setup(filters, i);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Send a poll message.
+ *    Queue a poll message for a node.
  *
  *****************************************************************************/
 static error_t canpt_poll(uint8_t reqId)
 {
-  txMsg.dataA[1] = CANPT_MSG_POLL;
-//  return sendMessage(reqId, 1);
+  CAN_MSG_Type msg;
+
+  msg.id = reqId;
+  msg.format = STD_ID_FORMAT;
+  msg.type = DATA_FRAME;
+  msg.len = 2;
+  msg.dataA[0] = CANPT_NODE_UNIQUE_ID;
+  msg.dataA[1] = CANPT_MSG_POLL;
+
+  return can_tx_enqueue(buses[NODE_BUS], &msg);
 }
 
 /******************************************************************************
@@ -394,35 +646,79 @@ static void processMessage(CAN_MSG_Type* msg)
 /******************************************************************************
  *
  * Description:
- *    For attached nodes check if they are still accessible/alive.
+ *    Process a protocol frame received on the node bus: a broadcast
+ *    message or a message directed to this node. Other frames are
+ *    ignored.
+ *
+ * Params:
+ *   [in] frame: the frame
+ *
+ *****************************************************************************/
+static void processFrame(const can_frame_t* frame)
+{
+  CAN_MSG_Type msg;
+
+  if (CAN_FRAME_IS_EXT(frame) || CAN_FRAME_IS_RTR(frame)
+      || CAN_FRAME_LEN(frame) < 2) {
+    return;
+  }
+
+  if ((frame->id & CANPT_MSG_CMN_MASK) == 0) {
+    can_frame_toMsg(frame, &msg);
+    processCmnMessage(&msg);
+  }
+  else if (frame->id == CANPT_NODE_UNIQUE_ID) {
+    can_frame_toMsg(frame, &msg);
+    processMessage(&msg);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Handle the nodes whose deadline has passed: remove nodes that haven't
+ *    answered and poll the others. Only the timer wheel slots up to now
+ *    are visited. At most NODE_POLL_BATCH polls are queued, the rest stay
+ *    due for the next call.
  *
  *****************************************************************************/
 static void checkIfNodesAlive(void)
 {
-  int i = 0;
-  uint32_t time = 0;
+  node_t* n = NULL;
+  uint32_t now = time_get();
+  uint8_t idx = 0;
+  uint8_t next = 0;
+  uint8_t batch = 0;
 
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId != 0) {
+  while ((int32_t)(now / WHEEL_TICK_MS - wheelTick) >= 0) {
 
-      time = time_get();
+    for (idx = wheel[wheelTick & WHEEL_MASK]; idx != NODE_NIL; idx = next) {
+      n = &nodes[idx];
+      next = n->next;
 
-      if ((nodes[i].aliveTime + NODE_ALIVE_TIME + NODE_POLL_TIME) < time) {
-        // remove the node
-        if (_cb != NULL && _cb->nodeDetached != NULL) {
-          _cb->nodeDetached(nodes[i].reqId);
-        }
-        nodes[i].reqId = 0;
+      if ((int32_t)(now - n->due) < 0) {
+        continue;
+      }
 
+      if ((int32_t)(now - (n->aliveTime + NODE_ALIVE_TIME + NODE_POLL_TIME)) > 0) {
+        detachNode(idx);
         continue;
       }
 
-      if ((nodes[i].lastPoll + NODE_POLL_TIME) < time) {
-        nodes[i].lastPoll = time;
-        canpt_poll(nodes[i].reqId);
+      if (batch >= NODE_POLL_BATCH
+          || can_tx_pending(buses[NODE_BUS]) >= CAN_TX_QUEUE_SIZE) {
+        return;
       }
 
+      canpt_poll(n->reqId);
+      batch++;
+
+      n->lastPoll = now;
+      unscheduleNode(idx);
+      scheduleNode(idx, nextDeadline(n));
     }
+
+    wheelTick++;
   }
 }
 
@@ -462,10 +758,14 @@ static error_t canpt_getValue(uint8_t reqId, uint8_t periphId)
  *   [in] callbacks: callback functions
  *
  *****************************************************************************/
-//void canpt_init(canpt_callb_t* callbacks)
-void canpt_init()
+void canpt_init(canpt_callb_t* callbacks)
 {
-//  _cb = callbacks;
+  int i = 0;
+#if CANPT_AUTOBAUD
+  uint32_t bitrate = 0;
+#endif
+
+  _cb = callbacks;
 
   can1_pinConfig();
   can2_pinConfig();
@@ -476,34 +776,40 @@ void canpt_init()
   CAN_Init(LPC_CAN1, CANPT_CAN1_BAUDRATE);
   CAN_Init(LPC_CAN2, CANPT_CAN2_BAUDRATE);
 
-  // set filter to bypass mode (except all)
-  ///  CAN_LoadExplicitEntry(LPC_CAN1, CANPT_NODE_UNIQUE_ID, STD_ID_FORMAT);
-
-
-  CAN_LoadExplicitEntry(LPC_CAN2, CANPT_CAN2_ID, STD_ID_FORMAT);
-  CAN_LoadGroupEntry(LPC_CAN2, 0x000, 0x00F, STD_ID_FORMAT);
-//  CAN_LoadExplicitEntry(LPC_CAN2, CANPT_CAN2_ID, EXT_ID_FORMAT);
-//  CAN_LoadGroupEntry(LPC_CAN2, 0x00000000, 0x1FFFFFFF, EXT_ID_FORMAT);
-//  CAN_LoadGroupEntry(LPC_CAN2, 0x00000000, 0x0000000F, EXT_ID_FORMAT);
+  // CAN_Init always uses 12 quanta per bit, solve the timing for the
+  // requested sample point
+  can_setBitrate(LPC_CAN1, CANPT_CAN1_BAUDRATE, CANPT_SAMPLE_POINT);
+  can_setBitrate(LPC_CAN2, CANPT_CAN2_BAUDRATE, CANPT_SAMPLE_POINT);
 
-//  CAN_LoadExplicitEntry(LPC_CAN1, CANPT_CAN1_ID, STD_ID_FORMAT);
-//  CAN_LoadGroupEntry(LPC_CAN1, 0x000, 0x00F, STD_ID_FORMAT);
-  CAN_LoadExplicitEntry(LPC_CAN1, 0x20000, EXT_ID_FORMAT);
-  CAN_LoadGroupEntry(LPC_CAN1, 0x1FFFF, 0x20001, EXT_ID_FORMAT);
+#if CANPT_AUTOBAUD
+  // all frames must be received while probing, loadFilters sets the
+  // filter mode again
+  CAN_SetAFMode(LPC_CANAF, CAN_AccBP);
+  canbaud_detect(LPC_CAN1, NULL, 0, CANPT_SAMPLE_POINT, &bitrate);
+  canbaud_detect(LPC_CAN2, NULL, 0, CANPT_SAMPLE_POINT, &bitrate);
+#endif
 
-
-  LPC_CANAF->AFMR = 0x04;
+  // only frames with a route are accepted. If the filter table can't hold
+  // the routes all frames are accepted and canroute_lookup drops them.
+  canroute_compile(routes, numRoutes);
+  loadFilters();
 
   txMsg.format = STD_ID_FORMAT;
 //  txMsg.format = EXT_ID_FORMAT;
   txMsg.type = DATA_FRAME;
 
-  rxMsg.id = 0;
-  rxMsg.format = 0;
-  rxMsg.type = 0;
-  rxMsg.len = 0;
+  memset(nodeIdx, NODE_NIL, sizeof(nodeIdx));
+  memset(wheel, NODE_NIL, sizeof(wheel));
+  for (i = 0; i < NODE_MAX_NUM; i++) {
+    nodes[i].reqId = 0;
+    nodes[i].next = (i + 1 < NODE_MAX_NUM ? i + 1 : NODE_NIL);
+  }
+  freeNodes = 0;
+  numNodes = 0;
+  capUsed = 0;
+  wheelTick = time_get() / WHEEL_TICK_MS;
 
-  CAN_IRQCmd (LPC_CAN1, CANINT_RIE, ENABLE);
+  can_rx_init(LPC_CAN1);
 
 //  txMsg.format = STD_ID_FORMAT;
 //  txMsg.type = DATA_FRAME;
@@ -513,13 +819,46 @@ void canpt_init()
 //  rxMsg.type = 0;
 //  rxMsg.len = 0;
 
-  CAN_IRQCmd (LPC_CAN2, CANINT_RIE, ENABLE);
+  can_rx_init(LPC_CAN2);
+
+  can_tx_init(LPC_CAN1);
+  can_tx_init(LPC_CAN2);
+
+  can_err_init(LPC_CAN1);
+  can_err_init(LPC_CAN2);
 
   /* Enable the CAN Interrupt */
   NVIC_EnableIRQ(CAN_IRQn);
 
 }
 
+/******************************************************************************
+ *
+ * Description:
+ *    Set the routing table of the gateway. Must be called before
+ *    canpt_init, otherwise a default table is used. The routes are not
+ *    copied and must stay valid.
+ *
+ * Params:
+ *   [in] table: the routes
+ *   [in] num: number of routes
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT if the table is invalid (see canroute_compile)
+ *
+ *****************************************************************************/
+error_t canpt_setRoutes(const canroute_t* table, uint16_t num)
+{
+  error_t err = canroute_compile(table, num);
+
+  if (err == ERR_OK) {
+    routes = table;
+    numRoutes = num;
+  }
+
+  return err;
+}
+
 /******************************************************************************
  *
  * Description:
@@ -540,8 +879,8 @@ error_t canpt_getNodes(uint8_t* nodeIdBuf, uint8_t len, uint8_t* numNodes)
     return ERR_ARGUMENT;
   }
 
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId != 0 && pos < len) {
+  for (i = 0; i < NODE_MAX_NUM && pos < len; i++) {
+    if (nodes[i].reqId != 0) {
       nodeIdBuf[pos++] = nodes[i].reqId;
     }
   }
@@ -569,6 +908,8 @@ error_t canpt_getNodeCaps(uint8_t nodeId, uint8_t* nodeCapBuf, uint8_t len,
   int i = 0;
   int pos = 0;
   node_t* node = NULL;
+  uint8_t* caps = NULL;
+  uint8_t cap = 0;
 
   if (numCaps == NULL || nodeCapBuf == NULL || len == 0) {
     return ERR_ARGUMENT;
@@ -576,27 +917,21 @@ error_t canpt_getNodeCaps(uint8_t nodeId, uint8_t* nodeCapBuf, uint8_t len,
 
   *numCaps = 0;
 
-  for (i = 0; i < NODE_MAX_NUM; i++) {
-    if (nodes[i].reqId ==  nodeId ) {
-      node = &nodes[i];
-      break;
-    }
-  }
-
-  if (node == NULL) {
+  if (nodeIdx[nodeId] == NODE_NIL) {
     return ERR_ARGUMENT;
   }
 
-  for (i = 0; i < NODE_MAX_CAPS; i++) {
-    if (pos >= len) {
-      break;
-    }
+  node = &nodes[nodeIdx[nodeId]];
+  caps = &capPool[node->capOfs];
 
-    if (node->caps[i] == 0) {
+  // each byte holds two capabilities (peripheral ID >> 4), 0 ends the list
+  for (i = 0; i < node->capLen * 2 && pos < len; i++) {
+    cap = ((i & 1) == 0 ? (caps[i/2] & 0xF0) : ((caps[i/2] & 0x0F) << 4));
+    if (cap == 0) {
       break;
     }
 
-    nodeCapBuf[pos++] = node->caps[i];
+    nodeCapBuf[pos++] = cap;
   }
 
   *numCaps = pos;
@@ -699,21 +1034,26 @@ error_t canpt_setLed(uint8_t reqId, uint8_t on)
 /******************************************************************************
  *
  * Description:
- *    Subscribe to value changes for a specific peripheral on a node
+ *    Queue a subscribe message for a node. The node answers with the
+ *    subscription ID, see canpt_callb_t.subStarted.
  *
  * Params:
  *    [in] reqId - ID of the CAN node
  *    [in] periphId - peripheral ID
  *    [in] subAct - subscribe action
+ *    [in] valBuf - value of the action
+ *    [in] len - length of the value, at most 4
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT or the error of can_tx_enqueue, e.g. if the
+ *   queue is full
  *
  *****************************************************************************/
 error_t canpt_subscribe(uint8_t reqId, uint8_t periphId, uint8_t subAct,
     uint8_t* valBuf, uint8_t len)
 {
+  CAN_MSG_Type msg;
   int i = 0;
-  uint8_t* d = NULL;
-  uint8_t pos = 0;
-  uint8_t l = 2;
 
   if (periphId < CANPT_MSG_DEV_TEMP || periphId > CANPT_MSG_DEV_LED) {
     return ERR_ARGUMENT;
@@ -723,110 +1063,149 @@ error_t canpt_subscribe(uint8_t reqId, uint8_t periphId, uint8_t subAct,
     return ERR_ARGUMENT;
   }
 
-  if (len > 4) {
+  if (len > 4 || (valBuf == NULL && len > 0)) {
     return ERR_ARGUMENT;
   }
 
-  txMsg.dataA[1] = (CANPT_MSG_SUB|subAct);
-  txMsg.dataA[2] = periphId;
+  msg.id = reqId;
+  msg.format = STD_ID_FORMAT;
+  msg.type = DATA_FRAME;
+  msg.len = 3 + len;
+  msg.dataA[0] = CANPT_NODE_UNIQUE_ID;
+  msg.dataA[1] = (CANPT_MSG_SUB|subAct);
+  msg.dataA[2] = periphId;
 
-  d = &txMsg.dataA[0];
-  pos = 3;
+  // the value starts in the last byte of dataA
   for (i = 0; i < len; i++) {
-
-    if (pos > 3) {
-      pos = 0;
-      d = &txMsg.dataB[0];
+    if (i == 0) {
+      msg.dataA[3] = valBuf[i];
+    }
+    else {
+      msg.dataB[i - 1] = valBuf[i];
     }
-
-    d[pos++] = valBuf[i];
   }
-  l += len;
 
-
-//  return sendMessage(reqId, l);
+  return can_tx_enqueue(buses[NODE_BUS], &msg);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Unsubscribe
+ *    Queue an unsubscribe message for a node
  *
  * Params:
  *    [in] reqId - ID of the CAN node
  *    [in] subId - subscription ID
  *
+ * Returns:
+ *   ERR_OK or the error of can_tx_enqueue, e.g. if the queue is full
+ *
  *****************************************************************************/
 error_t canpt_unsubscribe(uint8_t reqId, uint8_t subId)
 {
-  txMsg.dataA[1] = (CANPT_MSG_UNSUB);
-  txMsg.dataA[2] = subId;
+  CAN_MSG_Type msg;
 
-//  return sendMessage(reqId, 2);
+  msg.id = reqId;
+  msg.format = STD_ID_FORMAT;
+  msg.type = DATA_FRAME;
+  msg.len = 3;
+  msg.dataA[0] = CANPT_NODE_UNIQUE_ID;
+  msg.dataA[1] = CANPT_MSG_UNSUB;
+  msg.dataA[2] = subId;
+
+  return can_tx_enqueue(buses[NODE_BUS], &msg);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Call this function regularly to handle e.g. subscriptions.
+ *    Cancel several subscriptions of a node with one call, the requests
+ *    are queued back to back
+ *
+ * Params:
+ *    [in] reqId - ID of the CAN node
+ *    [in] subIds - subscription IDs
+ *    [in] num - number of subscription IDs
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT or the first error of canpt_unsubscribe. The
+ *   requests after a failed one are still tried.
  *
  *****************************************************************************/
-void canpt_task(void)
+error_t canpt_unsubscribeList(uint8_t reqId, const uint8_t* subIds, uint8_t num)
 {
-  CAN_MSG_Type *msg;
-  Status status;
   error_t err = ERR_OK;
-  uint32_t s = 0;
-  uint32_t to = 0;
-
-  if (!q_isEmpty())
-  {
-
-    msg = q_get();
-
-//////    msg->id = msg->id + 1;
-////    msg->id = 0x20000;
-////    msg->format = EXT_ID_FORMAT;
-    to = time_get() + 500;
+  error_t e = ERR_OK;
+  int i = 0;
 
-    status = CAN_SendMsg(LPC_CAN2, msg);
+  if (subIds == NULL && num > 0) {
+    return ERR_ARGUMENT;
+  }
 
-    if (status != SUCCESS)
-    {
-      err = ERR_CAN_SEND;
+  for (i = 0; i < num; i++) {
+    e = canpt_unsubscribe(reqId, subIds[i]);
+    if (err == ERR_OK) {
+      err = e;
     }
-    else
-    {
-      do
-      {
-          s = CAN_GetCTRLStatus(LPC_CAN2, CANCTRL_GLOBAL_STS);
+  }
 
-      } while ((s & CAN_GSR_TCS) == 0 && to > time_get());
+  return err;
+}
 
-      if (to <= time_get())
-      {
-        err = ERR_TIMEOUT;
-      }
-    }
+/******************************************************************************
+ *
+ * Description:
+ *    Call this function regularly to handle e.g. subscriptions.
+ *
+ *****************************************************************************/
+void canpt_task(void)
+{
+  uint8_t n = 0;
 
+  // route everything received, alternating between the controllers, the
+  // protocol frames are processed on the way
+  do
+  {
+    n = forwardFullCan() + forwardFrame(CANROUTE_BUS1)
+        + forwardFrame(CANROUTE_BUS2);
+  } while (n > 0);
 
+  can_err_task();
 
-//    if ((msg->id & ~CANPT_MSG_CMN_MASK) != 0) {
-//      processCmnMessage(msg);
-//    }
-//    else {
-//      processMessage(msg);
-//    }
+  checkIfNodesAlive();
 
-  }
+}
 
-//  if (numNodes > 0) {
-//    checkIfNodesAlive();
-//  }
 
+/******************************************************************************
+ *
+ * Description:
+ *    Log the statistics of both controllers
+ *
+ *****************************************************************************/
+void canpt_printStats(void)
+{
+  static const char* const stateNames[] = {"active", "passive", "bus-off"};
+  can_stats_t s;
+  uint8_t bus = 0;
+
+  for (bus = 0; bus < CANROUTE_NUM_BUSES; bus++) {
+    can_getStats(buses[bus], &s);
+
+    DLOG_INFO("CAN%d %s load %d%% rxerr %d txerr %d\r\n", bus + 1,
+        stateNames[s.state], s.busLoad, s.rxErr, s.txErr);
+    DLOG_INFO("  rx %u (%u B) drop %u max %u, tx %u (%u B) drop %u\r\n",
+        s.rxFrames, s.rxBytes, s.rxDropped, s.rxHighWater, s.txFrames,
+        s.txBytes, s.txDropped);
+    DLOG_INFO("  passive %u busoff %u overrun %u\r\n",
+        s.errPassive, s.busOff, s.overruns);
+    DLOG_INFO("  arblost %u (alc %d) buserr %u (ecc %02X)\r\n",
+        s.arbLost, s.lastAlc, s.busErrors, s.lastEcc);
+    DLOG_INFO("  latency avg %u us max %u us\r\n",
+        s.latencyAvg, s.latencyMax);
+  }
 }
 
-
 /******************************************************************************
  *
  * Description:
@@ -835,31 +1214,22 @@ void canpt_task(void)
  *****************************************************************************/
 void CAN_IRQHandler (void)
 {
-	uint32_t intStatus1 = 0;
-	uint32_t intStatus2 = 0;
+  uint32_t intStatus1 = 0;
+  uint32_t intStatus2 = 0;
 
+  // ICR is cleared when read, both controllers are serviced on every
+  // interrupt so a busy CAN1 can't starve CAN2
   intStatus1 = LPC_CAN1->ICR;
   intStatus2 = LPC_CAN2->ICR;
 
-//  if (intStatus & 0x01) {
-////    CAN_ReceiveMsg(LPC_CAN1, &rxMsg);
-//    CAN_ReceiveMsg(LPC_CAN2, &rxMsg);
-//    q_put(&rxMsg);
-//  }
+  can_rx_isr(LPC_CAN1, intStatus1);
+  can_rx_isr(LPC_CAN2, intStatus2);
 
-  if (intStatus1 & 0x01) {
-    CAN_ReceiveMsg(LPC_CAN1, &rxMsg);
-    q_put(&rxMsg);
-  }
-  else
-  {
-	  if (intStatus2 & 0x01) {
-	    CAN_ReceiveMsg(LPC_CAN2, &rxMsg);
-	    q_put(&rxMsg);
-	  }
-
-  }
+  can_tx_isr(LPC_CAN1, intStatus1);
+  can_tx_isr(LPC_CAN2, intStatus2);
 
+  can_err_isr(LPC_CAN1, intStatus1);
+  can_err_isr(LPC_CAN2, intStatus2);
 }
 
 /********************************************************************************************************
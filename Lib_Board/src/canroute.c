@@ -0,0 +1,297 @@
+/****************************************************************************************************//**
+*
+* @file		canroute.c
+* @brief	Routing table for the CAN1/CAN2 gateway
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * The routing table is compiled into an array sorted on a 32-bit key
+ * (bus << 30 | format << 29 | id) so a lookup is a binary search. Routes
+ * for the same bus and ID format may not overlap.
+ *
+ * This file doesn't access any peripheral and can be built on a host.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include "lpc17xx_can.h"
+#include "board.h"
+#include "canbus.h"
+#include "canroute.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define STD_ID_MAX (0x7FF)
+#define EXT_ID_MAX (0x1FFFFFFF)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define ROUTE_KEY(bus, format, id) \
+  (((uint32_t)(bus) << 30) | ((uint32_t)(format) << 29) | (id))
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  uint32_t keyLow;
+  uint32_t keyHigh;
+  const canroute_t* route;
+} entry_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static entry_t table[CANROUTE_MAX_ROUTES];
+static uint16_t numEntries = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Compile a routing table. The routes are referenced (not copied) and
+ *    must stay valid as long as the table is used. On error the previous
+ *    table is kept.
+ *
+ * Params:
+ *   [in] routes: the routes
+ *   [in] num: number of routes
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT if a route is invalid, routes overlap or there
+ *   are more than CANROUTE_MAX_ROUTES routes
+ *
+ *****************************************************************************/
+error_t canroute_compile(const canroute_t* routes, uint16_t num)
+{
+  entry_t sorted[CANROUTE_MAX_ROUTES];
+  entry_t e;
+  const canroute_t* r = NULL;
+  uint32_t idMax = 0;
+  int i = 0;
+  int j = 0;
+
+  if (num > CANROUTE_MAX_ROUTES || (routes == NULL && num > 0)) {
+    return ERR_ARGUMENT;
+  }
+
+  for (i = 0; i < num; i++) {
+    r = &routes[i];
+    idMax = (r->format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+
+    if (r->srcBus >= CANROUTE_NUM_BUSES || r->format > EXT_ID_FORMAT
+        || r->idLow > r->idHigh || r->idHigh > idMax
+        || (r->dstMask & ~(CANROUTE_DST(CANROUTE_NUM_BUSES) - 1)) != 0) {
+      return ERR_ARGUMENT;
+    }
+
+    if (r->fullCan && (r->format != STD_ID_FORMAT || r->idLow != r->idHigh
+        || r->mask != 0)) {
+      return ERR_ARGUMENT;
+    }
+
+    if (r->newId != CANROUTE_ID_KEEP
+        && r->newId + (r->idHigh - r->idLow) > idMax) {
+      return ERR_ARGUMENT;
+    }
+
+    e.keyLow = ROUTE_KEY(r->srcBus, r->format, r->idLow);
+    e.keyHigh = ROUTE_KEY(r->srcBus, r->format, r->idHigh);
+    e.route = r;
+
+    // insertion sort, the table is only compiled at init
+    for (j = i; j > 0 && sorted[j-1].keyLow > e.keyLow; j--) {
+      sorted[j] = sorted[j-1];
+    }
+    sorted[j] = e;
+  }
+
+  for (i = 1; i < num; i++) {
+    if (sorted[i].keyLow <= sorted[i-1].keyHigh) {
+      return ERR_ARGUMENT;
+    }
+  }
+
+  for (i = 0; i < num; i++) {
+    table[i] = sorted[i];
+  }
+  numEntries = num;
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get number of routes in the compiled table
+ *
+ *****************************************************************************/
+uint16_t canroute_count(void)
+{
+  return numEntries;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get a route from the compiled table. Routes are returned in ascending
+ *    (bus, format, idLow) order, which is also the order required by the
+ *    acceptance filter.
+ *
+ * Params:
+ *   [in] idx: index, 0 to canroute_count()-1
+ *
+ *****************************************************************************/
+const canroute_t* canroute_get(uint16_t idx)
+{
+  if (idx >= numEntries) {
+    return NULL;
+  }
+
+  return table[idx].route;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Find the route for a received frame
+ *
+ * Params:
+ *   [in] bus: bus the frame was received on
+ *   [in] format: STD_ID_FORMAT or EXT_ID_FORMAT
+ *   [in] id: frame ID
+ *
+ * Returns:
+ *   The route or NULL if the frame isn't routed
+ *
+ *****************************************************************************/
+const canroute_t* canroute_lookup(uint8_t bus, uint8_t format, uint32_t id)
+{
+  uint32_t key = ROUTE_KEY(bus, format, id);
+  const canroute_t* r = NULL;
+  int lo = 0;
+  int hi = numEntries;
+  int mid = 0;
+
+  // find the last entry with keyLow <= key
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (table[mid].keyLow <= key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  if (lo == 0 || key > table[lo-1].keyHigh) {
+    return NULL;
+  }
+
+  r = table[lo-1].route;
+  if (r->mask != 0 && (id & r->mask) != (r->idLow & r->mask)) {
+    return NULL;
+  }
+
+  return r;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the ID range the acceptance filter must pass for a route. All IDs
+ *    matched by the route are in the range. For a masked route the range
+ *    is narrowed to the highest ID that can still match the mask.
+ *
+ * Params:
+ *   [in] route: the route
+ *   [out] low: lowest ID
+ *   [out] high: highest ID
+ *
+ *****************************************************************************/
+void canroute_range(const canroute_t* route, uint32_t* low, uint32_t* high)
+{
+  uint32_t idMax = (route->format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+  uint32_t top = 0;
+
+  *low = route->idLow;
+  *high = route->idHigh;
+
+  if (route->mask != 0) {
+    top = (route->idLow & route->mask) | (~route->mask & idMax);
+    if (top < *high) {
+      *high = top;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Apply ID rewrite and payload transform of a route to a frame
+ *
+ * Params:
+ *   [in] route: the route returned by canroute_lookup
+ *   [in/out] frame: copy of the received frame
+ *
+ * Returns:
+ *   Destination mask, 0 if the frame should be dropped
+ *
+ *****************************************************************************/
+uint8_t canroute_apply(const canroute_t* route, can_frame_t* frame)
+{
+  if (route->newId != CANROUTE_ID_KEEP) {
+    frame->id = route->newId + (frame->id - route->idLow);
+  }
+
+  if (route->transform != NULL && route->transform(frame) == 0) {
+    return 0;
+  }
+
+  return route->dstMask;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,553 @@
+/****************************************************************************************************//**
+*
+* @file		dlog.c
+* @brief	Deferred binary logging to the console
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Log calls only copy the format string address, a timestamp and the raw
+ * arguments into a ring of 32-bit words, nothing is formatted on target.
+ * dlog_task moves the records to the console transmit ring, from where
+ * the UART interrupt sends them, and the host decoder formats them.
+ *
+ * Any context, including interrupts, may write records. A writer reserves
+ * its words by moving 'head' with LDREX/STREX, fills them and writes the
+ * header word last. The reader stops at the first header that is still
+ * zero, clears the words it has taken and then moves 'tail'. A record that
+ * doesn't fit is dropped and counted.
+ *
+ * Record words: header, timestamp in us, arguments. A data record has the
+ * length in bytes followed by the data instead of the arguments.
+ *
+ *   header: [31:28] number of arguments, DATA_RECORD or STRING_RECORD
+ *           [27:24] level
+ *           [23:0]  address of the format string
+ *
+ * Arguments of %s conversions that point into RAM may change before the
+ * record is decoded, they are copied. Such a record is a STRING_RECORD,
+ * the timestamp is followed by
+ *
+ *   info:   [23:16] bit n set if argument n is a copied string
+ *           [15:8]  number of string words
+ *           [7:0]   number of arguments
+ *
+ * then the arguments, a copied string has its length in [7:0] and bit 8
+ * set if it was cut, then the strings, each padded to whole words. The
+ * format is only scanned for %s when an argument looks like a RAM address.
+ *
+ * On the console each record is DLOG_SYNC followed by its words, least
+ * significant byte first.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "LPC17xx.h"
+#include "lpc17xx_uart.h"
+#include "board.h"
+#include "time.h"
+#include "dlog.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define RING_MASK (DLOG_RING_WORDS - 1)
+
+#define DATA_RECORD (0x0F)
+#define STRING_RECORD (0x0E)
+
+// header and timestamp
+#define HEADER_WORDS (2)
+
+#define DATA_RECORD_WORDS (HEADER_WORDS + 1 + DLOG_MAX_DATA / 4)
+#define STRING_RECORD_WORDS (HEADER_WORDS + 1 + DLOG_MAX_ARGS * (1 + (DLOG_MAX_STR + 3) / 4))
+#define MAX_RECORD_WORDS (DATA_RECORD_WORDS > STRING_RECORD_WORDS ? \
+    DATA_RECORD_WORDS : STRING_RECORD_WORDS)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define HEADER(n, level, fmt) \
+  (((uint32_t)(n) << 28) | ((uint32_t)((level) & 0x0F) << 24) | ((uint32_t)(uintptr_t)(fmt) & 0x00FFFFFF))
+
+#define HEADER_NARGS(hdr) ((hdr) >> 28)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const char droppedFmt[] = "dlog: %d records dropped\r\n";
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static volatile uint32_t ring[DLOG_RING_WORDS];
+
+// free running word counters, 'head' is moved by writers and 'tail' by
+// dlog_task
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+
+// record being sent
+static uint8_t txBuf[1 + MAX_RECORD_WORDS * 4];
+static uint16_t txLen = 0;
+static uint16_t txPos = 0;
+
+static volatile dlog_stats_t stats;
+static uint32_t droppedReported = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static int32_t reserve(uint32_t words);
+static void writeStrings(uint8_t level, const char* fmt, uint8_t nargs,
+    const uint32_t* args, uint8_t strArgs);
+static uint8_t stringArgs(const char* fmt, uint8_t nargs);
+static void putBytes(uint32_t pos, const uint8_t* p, uint32_t len);
+static uint8_t takeRecord(void);
+static void atomicInc(volatile uint32_t* p);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if (DLOG_RING_WORDS & (DLOG_RING_WORDS - 1)) != 0
+#error "DLOG_RING_WORDS must be a power of two"
+#endif
+
+#if DLOG_RING_WORDS < 2 * MAX_RECORD_WORDS
+#error "DLOG_RING_WORDS is too small"
+#endif
+
+#if DLOG_MAX_ARGS > 8
+#error "DLOG_MAX_ARGS can't be more than 8"
+#endif
+
+#if DLOG_MAX_STR < 1 || DLOG_MAX_STR > 255
+#error "DLOG_MAX_STR must be 1 to 255"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Put a record in the ring, use the DLOG_ macros instead of calling this
+ *    function directly. May be called from interrupts.
+ *
+ * Params:
+ *   [in] level: DLOG_LEVEL_ERR .. DLOG_LEVEL_DBG
+ *   [in] fmt: printf style format string in flash
+ *   [in] nargs: number of arguments
+ *   [in] args: arguments
+ *
+ *****************************************************************************/
+void dlog_write(uint8_t level, const char* fmt, uint8_t nargs, const uint32_t* args)
+{
+  int32_t pos = 0;
+  uint32_t i = 0;
+  uint8_t strArgs = 0;
+
+  if (nargs > DLOG_MAX_ARGS) {
+    nargs = DLOG_MAX_ARGS;
+  }
+
+  for (i = 0; i < nargs; i++) {
+    if (DLOG_IS_RAM(args[i])) {
+      strArgs = stringArgs(fmt, nargs);
+      break;
+    }
+  }
+
+  for (i = 0; i < nargs; i++) {
+    if ((strArgs & (1 << i)) && !DLOG_IS_RAM(args[i])) {
+      strArgs &= ~(1 << i);
+    }
+  }
+
+  if (strArgs != 0) {
+    writeStrings(level, fmt, nargs, args, strArgs);
+    return;
+  }
+
+  pos = reserve(HEADER_WORDS + nargs);
+  if (pos < 0) {
+    return;
+  }
+
+  ring[(pos + 1) & RING_MASK] = time_getUs();
+  for (i = 0; i < nargs; i++) {
+    ring[(pos + HEADER_WORDS + i) & RING_MASK] = args[i];
+  }
+
+  // the header must be the last word the reader sees
+  __DMB();
+  ring[pos & RING_MASK] = HEADER(nargs, level, fmt);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Put a data record in the ring, the host decoder prints the format
+ *    string followed by the data as hex bytes. May be called from interrupts.
+ *
+ * Params:
+ *   [in] level: DLOG_LEVEL_ERR .. DLOG_LEVEL_DBG
+ *   [in] fmt: string in flash
+ *   [in] data: data to log
+ *   [in] len: length of data, at most DLOG_MAX_DATA bytes are logged
+ *
+ *****************************************************************************/
+void dlog_writeData(uint8_t level, const char* fmt, const void* data, uint32_t len)
+{
+  int32_t pos = 0;
+
+  if (len > DLOG_MAX_DATA) {
+    len = DLOG_MAX_DATA;
+  }
+
+  pos = reserve(HEADER_WORDS + 1 + (len + 3) / 4);
+  if (pos < 0) {
+    return;
+  }
+
+  ring[(pos + 1) & RING_MASK] = time_getUs();
+  ring[(pos + 2) & RING_MASK] = len;
+  putBytes(pos + 3, (const uint8_t*)data, len);
+
+  __DMB();
+  ring[pos & RING_MASK] = HEADER(DATA_RECORD, level, fmt);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send records to the console as long as its transmit ring has room.
+ *    Never waits, call this function regularly from the main loop.
+ *
+ *****************************************************************************/
+void dlog_task(void)
+{
+  uint32_t dropped = stats.dropped;
+  uint32_t n = 0;
+
+  if (dropped != droppedReported) {
+    n = dropped - droppedReported;
+    droppedReported = dropped;
+    dlog_write(DLOG_LEVEL_WARN, droppedFmt, 1, &n);
+  }
+
+  while (1) {
+    if (txPos == txLen && !takeRecord()) {
+      return;
+    }
+
+    n = console_send(&txBuf[txPos], txLen - txPos, NONE_BLOCKING);
+    txPos += n;
+
+    if (txPos < txLen) {
+      return;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send all records in the ring, e.g. before a reset. Waits for room in
+ *    the console transmit ring, must not be called from interrupts.
+ *
+ *****************************************************************************/
+void dlog_flush(void)
+{
+  while (txPos < txLen || ring[tail & RING_MASK] != 0) {
+    dlog_task();
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get logging statistics
+ *
+ * Params:
+ *   [out] s: statistics
+ *
+ *****************************************************************************/
+void dlog_getStats(dlog_stats_t* s)
+{
+  s->written = stats.written;
+  s->dropped = stats.dropped;
+  s->sent = stats.sent;
+  s->maxUsed = stats.maxUsed;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Reserve words in the ring
+ *
+ * Returns:
+ *   Position of the first word or -1 if the ring is full
+ *
+ *****************************************************************************/
+static int32_t reserve(uint32_t words)
+{
+  uint32_t h = 0;
+  uint32_t used = 0;
+
+  do {
+    h = __LDREXW((uint32_t*)&head);
+
+    // 'tail' only grows, an old value only makes the check stricter
+    used = h - tail + words;
+    if (used > DLOG_RING_WORDS) {
+      __CLREX();
+      atomicInc(&stats.dropped);
+      return -1;
+    }
+  } while (__STREXW(h + words, (uint32_t*)&head) != 0);
+
+  atomicInc(&stats.written);
+
+  // not exact when writers race, only used as a hint for the ring size
+  if (used > stats.maxUsed) {
+    stats.maxUsed = used;
+  }
+
+  return (int32_t)(h & RING_MASK);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Put a record with copies of the strings in RAM in the ring
+ *
+ * Params:
+ *   [in] strArgs: bit n set if argument n is a string to copy
+ *
+ *****************************************************************************/
+static void writeStrings(uint8_t level, const char* fmt, uint8_t nargs,
+    const uint32_t* args, uint8_t strArgs)
+{
+  uint8_t lens[DLOG_MAX_ARGS];
+  const char* str = NULL;
+  uint32_t strWords = 0;
+  uint32_t arg = 0;
+  uint32_t i = 0;
+  int32_t pos = 0;
+
+  for (i = 0; i < nargs; i++) {
+    if (strArgs & (1 << i)) {
+      str = (const char*)(uintptr_t)args[i];
+      for (lens[i] = 0; lens[i] < DLOG_MAX_STR && str[lens[i]] != '\0'; lens[i]++) {
+      }
+      strWords += (lens[i] + 3) / 4;
+    }
+  }
+
+  pos = reserve(HEADER_WORDS + 1 + nargs + strWords);
+  if (pos < 0) {
+    return;
+  }
+
+  ring[(pos + 1) & RING_MASK] = time_getUs();
+  ring[(pos + 2) & RING_MASK] = ((uint32_t)strArgs << 16) | (strWords << 8) | nargs;
+
+  strWords = 0;
+  for (i = 0; i < nargs; i++) {
+    arg = args[i];
+    if (strArgs & (1 << i)) {
+      // the string may have changed since it was measured, the decoder
+      // stops at a NUL
+      str = (const char*)(uintptr_t)args[i];
+      putBytes(pos + 3 + nargs + strWords, (const uint8_t*)str, lens[i]);
+      strWords += (lens[i] + 3) / 4;
+      arg = lens[i] | (lens[i] == DLOG_MAX_STR && str[lens[i]] != '\0' ? 0x100 : 0);
+    }
+    ring[(pos + 3 + i) & RING_MASK] = arg;
+  }
+
+  __DMB();
+  ring[pos & RING_MASK] = HEADER(STRING_RECORD, level, fmt);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Find the arguments of the %s conversions of a format
+ *
+ * Returns:
+ *   Bit n set if argument n is a string
+ *
+ *****************************************************************************/
+static uint8_t stringArgs(const char* fmt, uint8_t nargs)
+{
+  uint8_t mask = 0;
+  uint8_t n = 0;
+
+  while (*fmt != '\0' && n < nargs) {
+    if (*fmt++ != '%') {
+      continue;
+    }
+    if (*fmt == '%') {
+      fmt++;
+      continue;
+    }
+
+    // flags, width, precision and length, a '*' width is an argument
+    while (*fmt != '\0' && strchr("-+ #0123456789.*hlzjt", *fmt) != NULL) {
+      if (*fmt == '*') {
+        n++;
+      }
+      fmt++;
+    }
+
+    if (*fmt == '\0') {
+      break;
+    }
+    if (*fmt == 's' && n < nargs) {
+      mask |= (1 << n);
+    }
+    fmt++;
+    n++;
+  }
+
+  return mask;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Put bytes in the ring words from 'pos' on, least significant byte
+ *    first
+ *
+ *****************************************************************************/
+static void putBytes(uint32_t pos, const uint8_t* p, uint32_t len)
+{
+  uint32_t i = 0;
+  uint32_t w = 0;
+
+  for (i = 0; i < len; i++) {
+    w |= (uint32_t)p[i] << (8 * (i & 3));
+    if ((i & 3) == 3 || i == len - 1) {
+      ring[(pos + i / 4) & RING_MASK] = w;
+      w = 0;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Move the next committed record from the ring to the send buffer
+ *
+ * Returns:
+ *   1 if a record was taken, 0 if there is none
+ *
+ *****************************************************************************/
+static uint8_t takeRecord(void)
+{
+  uint32_t t = tail;
+  uint32_t hdr = ring[t & RING_MASK];
+  uint32_t words = 0;
+  uint32_t w = 0;
+  uint32_t i = 0;
+
+  if (hdr == 0) {
+    return 0;
+  }
+
+  // read the other words only after the header
+  __DMB();
+
+  if (HEADER_NARGS(hdr) == DATA_RECORD) {
+    words = HEADER_WORDS + 1 + (ring[(t + 2) & RING_MASK] + 3) / 4;
+  }
+  else if (HEADER_NARGS(hdr) == STRING_RECORD) {
+    w = ring[(t + 2) & RING_MASK];
+    words = HEADER_WORDS + 1 + (w & 0xFF) + ((w >> 8) & 0xFF);
+  }
+  else {
+    words = HEADER_WORDS + HEADER_NARGS(hdr);
+  }
+
+  txBuf[0] = DLOG_SYNC;
+  txLen = 1;
+
+  for (i = 0; i < words; i++) {
+    w = ring[(t + i) & RING_MASK];
+    ring[(t + i) & RING_MASK] = 0;
+
+    txBuf[txLen++] = (w & 0xFF);
+    txBuf[txLen++] = ((w >> 8) & 0xFF);
+    txBuf[txLen++] = ((w >> 16) & 0xFF);
+    txBuf[txLen++] = ((w >> 24) & 0xFF);
+  }
+
+  // the words must be cleared before writers can reuse them
+  __DMB();
+  tail = t + words;
+
+  txPos = 0;
+  stats.sent++;
+
+  return 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Increment a counter shared with interrupts
+ *
+ *****************************************************************************/
+static void atomicInc(volatile uint32_t* p)
+{
+  uint32_t v = 0;
+
+  do {
+    v = __LDREXW((uint32_t*)p);
+  } while (__STREXW(v + 1, (uint32_t*)p) != 0);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
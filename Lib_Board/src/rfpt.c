@@ -588,7 +588,7 @@ static void getValue(uint32_t addrHi, uint32_t addrLo, uint8_t periphId)
     sendBtn(addrHi, addrLo);
     break;
   default:
-    dbg("RF: Unknown peripheral %d\r\n", periphId)
+    dbg("RF: Unknown peripheral %d\r\n", periphId);
     break;
   }
 }
@@ -0,0 +1,227 @@
+/****************************************************************************************************//**
+*
+* @file		sdbench.c
+* @brief	Throughput measurement of the SD card driver
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Sectors are read one at a time and in multi-block runs of
+ * SDBENCH_MULTI_SECTORS, directly through the card driver below the sector
+ * cache. The cache is written back first.
+ * The write test writes back the data just read, so the content of the
+ * card is kept, but the card must not be in use by the file system while
+ * the test runs. The time of a write includes waiting for the card to
+ * finish programming (CTRL_SYNC).
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include "board.h"
+#include "time.h"
+#include "dlog.h"
+#include "diskio.h"
+#include "sdbench.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SECTOR_SIZE (512)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static uint8_t buf[SDBENCH_MULTI_SECTORS * SECTOR_SIZE] __attribute__ ((aligned(4)));
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static uint32_t rate(uint32_t sectors, uint32_t us);
+static void report(const char* name, uint32_t kBps);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if SDBENCH_MULTI_SECTORS < 2 || SDBENCH_MULTI_SECTORS > 255
+#error "SDBENCH_MULTI_SECTORS must be 2..255"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Measure read and optionally write throughput of the card and log the
+ *    results. Initializes the card if needed.
+ *
+ * Params:
+ *   [in] sector: first sector of the test area
+ *   [in] count: number of sectors in the test area
+ *   [in] write: 1 to also measure writes
+ *   [out] res: results, may be NULL
+ *
+ * Returns:
+ *   ERR_OK, ERR_ARGUMENT, ERR_NOT_INIT if there is no card or ERR_FILE on
+ *   a disk error
+ *
+ *****************************************************************************/
+error_t sdbench_run(uint32_t sector, uint32_t count, uint8_t write, sdbench_result_t* res)
+{
+  uint32_t tSingleRd = 0;
+  uint32_t tMultiRd = 0;
+  uint32_t tSingleWr = 0;
+  uint32_t tMultiWr = 0;
+  uint32_t end = sector + count;
+  uint32_t n = 0;
+  uint32_t i = 0;
+  uint32_t t = 0;
+  sdbench_result_t r;
+
+  if (count == 0) {
+    return ERR_ARGUMENT;
+  }
+
+  if ((disk_status(0) & STA_NOINIT) && (disk_initialize(0) & STA_NOINIT)) {
+    return ERR_NOT_INIT;
+  }
+
+  if (disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) {
+    return ERR_FILE;
+  }
+
+  for (; sector < end; sector += n) {
+    n = end - sector;
+    if (n > SDBENCH_MULTI_SECTORS) {
+      n = SDBENCH_MULTI_SECTORS;
+    }
+
+    t = time_getUs();
+    for (i = 0; i < n; i++) {
+      if (mmc_disk_read(0, &buf[i * SECTOR_SIZE], sector + i, 1) != RES_OK) {
+        return ERR_FILE;
+      }
+    }
+    tSingleRd += time_getUs() - t;
+
+    t = time_getUs();
+    if (mmc_disk_read(0, buf, sector, n) != RES_OK) {
+      return ERR_FILE;
+    }
+    tMultiRd += time_getUs() - t;
+
+    if (!write) {
+      continue;
+    }
+
+    t = time_getUs();
+    for (i = 0; i < n; i++) {
+      if (mmc_disk_write(0, &buf[i * SECTOR_SIZE], sector + i, 1) != RES_OK
+          || mmc_disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) {
+        return ERR_FILE;
+      }
+    }
+    tSingleWr += time_getUs() - t;
+
+    t = time_getUs();
+    if (mmc_disk_write(0, buf, sector, n) != RES_OK
+        || mmc_disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) {
+      return ERR_FILE;
+    }
+    tMultiWr += time_getUs() - t;
+  }
+
+  r.singleRead = rate(count, tSingleRd);
+  r.multiRead = rate(count, tMultiRd);
+  r.singleWrite = (write ? rate(count, tSingleWr) : 0);
+  r.multiWrite = (write ? rate(count, tMultiWr) : 0);
+
+  report("single block read ", r.singleRead);
+  report("multi block read  ", r.multiRead);
+  if (write) {
+    report("single block write", r.singleWrite);
+    report("multi block write ", r.multiWrite);
+  }
+
+  if (res != NULL) {
+    *res = r;
+  }
+
+  return ERR_OK;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Throughput in kB/s
+ *
+ *****************************************************************************/
+static uint32_t rate(uint32_t sectors, uint32_t us)
+{
+  if (us == 0) {
+    us = 1;
+  }
+
+  return (uint32_t)((uint64_t)sectors * SECTOR_SIZE * 1000 / us);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Log a result in MB/s
+ *
+ *****************************************************************************/
+static void report(const char* name, uint32_t kBps)
+{
+  DLOG_INFO("sdbench: %s %u.%03u MB/s\r\n", name, kBps / 1000, kBps % 1000);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
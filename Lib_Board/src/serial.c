@@ -0,0 +1,474 @@
+/****************************************************************************************************//**
+*
+* @file		serial.c
+* @brief	Interrupt driven UART transmit and receive through ring buffers
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * serial_write only copies the data to the transmit ring. The THRE
+ * interrupt refills the 16 byte transmit FIFO from the ring every time it
+ * runs empty. If the transmitter is idle, serial_write fills the FIFO
+ * itself to start it.
+ *
+ * The receive interrupt fires when the receive FIFO reaches the trigger
+ * level, or on character time-out for the last bytes, and moves everything
+ * in the FIFO to the receive ring. serial_read takes bytes from the ring.
+ *
+ * The rings are single producer / single consumer: serial_write and
+ * serial_read must only be called from one context (the main loop), the
+ * other side is the UART interrupt.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "LPC17xx.h"
+#include "lpc17xx_uart.h"
+#include "board.h"
+#include "serial.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define LSR_ERRORS (UART_LSR_OE | UART_LSR_PE | UART_LSR_FE | UART_LSR_BI)
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+#define IS_POW2(n) ((n) != 0 && ((n) & ((n) - 1)) == 0)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  uint8_t* buf;
+  uint16_t mask;
+
+  // free running, 'head' is only written by the producer and 'tail' only
+  // by the consumer
+  volatile uint16_t head;
+  volatile uint16_t tail;
+} ring_t;
+
+typedef struct
+{
+  ring_t tx;
+  ring_t rx;
+
+  // set while the THRE interrupt keeps the transmitter going
+  volatile uint8_t txActive;
+  uint8_t init;
+
+  serial_stats_t stats;
+} port_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const IRQn_Type portIrq[SERIAL_NUM_PORTS] = {
+    UART0_IRQn, UART1_IRQn, UART2_IRQn, UART3_IRQn
+};
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static port_t ports[SERIAL_NUM_PORTS];
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+static void fillTxFifo(LPC_UART_TypeDef* UARTx, port_t* p);
+static void drainRxFifo(LPC_UART_TypeDef* UARTx, port_t* p);
+static uint32_t ringCount(const ring_t* r);
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Enable the FIFOs and interrupts of a UART and start buffered transfers.
+ *    The UART must have been initialized with UART_Init. The UARTx interrupt
+ *    handler must call serial_isr.
+ *
+ * Params:
+ *   [in] UARTx: the UART
+ *   [in] txBuf: transmit ring
+ *   [in] txSize: size of txBuf, a power of two
+ *   [in] rxBuf: receive ring
+ *   [in] rxSize: size of rxBuf, a power of two
+ *   [in] rxTrigger: receive FIFO level that raises the receive interrupt
+ *
+ * Returns:
+ *   ERR_OK or ERR_ARGUMENT
+ *
+ *****************************************************************************/
+error_t serial_init(LPC_UART_TypeDef* UARTx, uint8_t* txBuf, uint16_t txSize,
+    uint8_t* rxBuf, uint16_t rxSize, UART_FITO_LEVEL_Type rxTrigger)
+{
+  port_t* p = &ports[SERIAL_PORT_IDX(UARTx)];
+  UART_FIFO_CFG_Type fifoCfg;
+
+  if (txBuf == NULL || rxBuf == NULL || !IS_POW2(txSize) || !IS_POW2(rxSize)) {
+    return ERR_ARGUMENT;
+  }
+
+  NVIC_DisableIRQ(portIrq[SERIAL_PORT_IDX(UARTx)]);
+
+  memset(p, 0, sizeof(port_t));
+  p->tx.buf = txBuf;
+  p->tx.mask = txSize - 1;
+  p->rx.buf = rxBuf;
+  p->rx.mask = rxSize - 1;
+
+  // UART_Init leaves the FIFOs disabled
+  UART_FIFOConfigStructInit(&fifoCfg);
+  fifoCfg.FIFO_Level = rxTrigger;
+  UART_FIFOConfig(UARTx, &fifoCfg);
+
+  UART_TxCmd(UARTx, ENABLE);
+
+  UART_IntConfig(UARTx, UART_INTCFG_RBR, ENABLE);
+  UART_IntConfig(UARTx, UART_INTCFG_RLS, ENABLE);
+  UART_IntConfig(UARTx, UART_INTCFG_THRE, ENABLE);
+
+  p->init = 1;
+
+  NVIC_EnableIRQ(portIrq[SERIAL_PORT_IDX(UARTx)]);
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Queue data for transmission. Never waits: what doesn't fit in the
+ *    transmit ring is not queued.
+ *
+ * Params:
+ *   [in] UARTx: the UART
+ *   [in] data: data to send
+ *   [in] len: number of bytes
+ *
+ * Returns:
+ *   Number of bytes queued
+ *
+ *****************************************************************************/
+uint32_t serial_write(LPC_UART_TypeDef* UARTx, const uint8_t* data, uint32_t len)
+{
+  uint8_t idx = SERIAL_PORT_IDX(UARTx);
+  port_t* p = &ports[idx];
+  ring_t* r = &p->tx;
+  uint32_t space = 0;
+  uint32_t pos = 0;
+  uint32_t n = 0;
+
+  if (!p->init) {
+    return 0;
+  }
+
+  space = (uint32_t)r->mask + 1 - ringCount(r);
+  if (len > space) {
+    p->stats.txDropped += len - space;
+    len = space;
+  }
+
+  // at most two copies, up to the end of the ring and from its start
+  pos = r->head & r->mask;
+  n = r->mask + 1 - pos;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(&r->buf[pos], data, n);
+  memcpy(r->buf, &data[n], len - n);
+
+  // the data must be in the ring before the interrupt can see it
+  __DMB();
+  r->head += len;
+
+  if (len > 0 && !p->txActive) {
+    NVIC_DisableIRQ(portIrq[idx]);
+    p->txActive = 1;
+    if ((UARTx->LSR & UART_LSR_THRE) != 0) {
+      fillTxFifo(UARTx, p);
+    }
+    NVIC_EnableIRQ(portIrq[idx]);
+  }
+
+  return len;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Take received data from the receive ring. Never waits.
+ *
+ * Params:
+ *   [in] UARTx: the UART
+ *   [out] buf: buffer for the data
+ *   [in] len: size of buf
+ *
+ * Returns:
+ *   Number of bytes read
+ *
+ *****************************************************************************/
+uint32_t serial_read(LPC_UART_TypeDef* UARTx, uint8_t* buf, uint32_t len)
+{
+  port_t* p = &ports[SERIAL_PORT_IDX(UARTx)];
+  ring_t* r = &p->rx;
+  uint32_t avail = 0;
+  uint32_t pos = 0;
+  uint32_t n = 0;
+
+  if (!p->init) {
+    return 0;
+  }
+
+  avail = ringCount(r);
+  if (len > avail) {
+    len = avail;
+  }
+
+  __DMB();
+
+  pos = r->tail & r->mask;
+  n = r->mask + 1 - pos;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(buf, &r->buf[pos], n);
+  memcpy(&buf[n], r->buf, len - n);
+
+  // the data must be read before the interrupt can overwrite it
+  __DMB();
+  r->tail += len;
+
+  return len;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the number of bytes that can be queued for transmission
+ *
+ *****************************************************************************/
+uint32_t serial_txFree(LPC_UART_TypeDef* UARTx)
+{
+  port_t* p = &ports[SERIAL_PORT_IDX(UARTx)];
+
+  if (!p->init) {
+    return 0;
+  }
+
+  return (p->tx.mask + 1 - ringCount(&p->tx));
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the number of bytes in the transmit ring, bytes already in the
+ *    transmit FIFO are not counted
+ *
+ *****************************************************************************/
+uint32_t serial_txPending(LPC_UART_TypeDef* UARTx)
+{
+  return ringCount(&ports[SERIAL_PORT_IDX(UARTx)].tx);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the number of received bytes waiting in the receive ring
+ *
+ *****************************************************************************/
+uint32_t serial_rxPending(LPC_UART_TypeDef* UARTx)
+{
+  return ringCount(&ports[SERIAL_PORT_IDX(UARTx)].rx);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Handle all pending interrupts of a UART, called from the UARTx
+ *    interrupt handler
+ *
+ *****************************************************************************/
+void serial_isr(LPC_UART_TypeDef* UARTx)
+{
+  port_t* p = &ports[SERIAL_PORT_IDX(UARTx)];
+  uint32_t iir = 0;
+
+  // reading IIR clears a pending THRE interrupt
+  while (((iir = UARTx->IIR) & UART_IIR_INTSTAT_PEND) == 0) {
+
+    switch (iir & UART_IIR_INTID_MASK) {
+    case UART_IIR_INTID_RLS:
+    case UART_IIR_INTID_RDA:
+    case UART_IIR_INTID_CTI:
+      drainRxFifo(UARTx, p);
+      break;
+
+    case UART_IIR_INTID_THRE:
+      fillTxFifo(UARTx, p);
+      break;
+
+    default:
+      // modem status (UART1), cleared by reading MSR
+      if (UARTx == (LPC_UART_TypeDef*)LPC_UART1) {
+        (void)LPC_UART1->MSR;
+      }
+      break;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get statistics of a UART
+ *
+ * Params:
+ *   [in] UARTx: the UART
+ *   [out] stats: statistics
+ *
+ *****************************************************************************/
+void serial_getStats(LPC_UART_TypeDef* UARTx, serial_stats_t* stats)
+{
+  uint8_t idx = SERIAL_PORT_IDX(UARTx);
+
+  NVIC_DisableIRQ(portIrq[idx]);
+  *stats = ports[idx].stats;
+  NVIC_EnableIRQ(portIrq[idx]);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Move up to a FIFO full of data from the transmit ring to the UART. The
+ *    transmit FIFO must be empty. Stops the transmitter when the ring is
+ *    empty.
+ *
+ *****************************************************************************/
+static void fillTxFifo(LPC_UART_TypeDef* UARTx, port_t* p)
+{
+  ring_t* r = &p->tx;
+  uint16_t tail = r->tail;
+  uint16_t n = r->head - tail;
+
+  if (n == 0) {
+    p->txActive = 0;
+    return;
+  }
+
+  if (n > UART_TX_FIFO_SIZE) {
+    n = UART_TX_FIFO_SIZE;
+  }
+
+  p->stats.txBytes += n;
+
+  while (n-- > 0) {
+    UARTx->THR = r->buf[tail & r->mask];
+    tail++;
+  }
+
+  r->tail = tail;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Move everything in the receive FIFO to the receive ring
+ *
+ *****************************************************************************/
+static void drainRxFifo(LPC_UART_TypeDef* UARTx, port_t* p)
+{
+  ring_t* r = &p->rx;
+  uint16_t head = r->head;
+  uint32_t count = 0;
+  uint8_t lsr = 0;
+  uint8_t data = 0;
+
+  // reading LSR also clears a receive line status interrupt
+  while (((lsr = UARTx->LSR) & UART_LSR_RDR) != 0 || (lsr & LSR_ERRORS) != 0) {
+    if ((lsr & LSR_ERRORS) != 0) {
+      p->stats.lineErrors++;
+    }
+
+    if ((lsr & UART_LSR_RDR) == 0) {
+      continue;
+    }
+
+    data = UARTx->RBR;
+
+    if ((uint16_t)(head - r->tail) > r->mask) {
+      p->stats.rxDropped++;
+      continue;
+    }
+
+    r->buf[head & r->mask] = data;
+    head++;
+    p->stats.rxBytes++;
+  }
+
+  __DMB();
+  r->head = head;
+
+  count = (uint16_t)(head - r->tail);
+  if (count > p->stats.rxHighWater) {
+    p->stats.rxHighWater = count;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Number of bytes in a ring
+ *
+ *****************************************************************************/
+static uint32_t ringCount(const ring_t* r)
+{
+  return (uint16_t)(r->head - r->tail);
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -21,12 +21,19 @@
  *****************************************************************************/
 
 #include "lpc17xx_timer.h"
+#include "diskio.h"
 #include "time.h"
 
 /******************************************************************************
  * Defines and typedefs
  *****************************************************************************/
 
+// timer counts in us and is reset every ms
+#define TICK_US (1000)
+
+// period of the SD card driver timers in ms
+#define DISK_TICK_MS (10)
+
 /******************************************************************************
  * External global variables
  *****************************************************************************/
@@ -35,12 +42,34 @@
  * Local variables
  *****************************************************************************/
 
-static uint32_t timeMs = 0;
+static volatile uint32_t timeMs = 0;
 
 /******************************************************************************
  * Local Functions
  *****************************************************************************/
 
+/******************************************************************************
+ *
+ * Description:
+ *    Read the ms counter and the us within the current ms
+ *
+ *****************************************************************************/
+static void readTime (uint32_t* ms, uint32_t* us)
+{
+  uint32_t ir = 0;
+
+  do {
+    *ms = timeMs;
+    *us = LPC_TIM1->TC;
+    ir = LPC_TIM1->IR;
+  } while (*ms != timeMs);
+
+  // counter has been reset but the tick hasn't been counted yet
+  if ((ir & TIM_IR_CLR(TIM_MR0_INT)) != 0 && *us < (TICK_US / 2)) {
+    (*ms)++;
+  }
+}
+
 /******************************************************************************
  * Public Functions
  *****************************************************************************/
@@ -56,9 +85,9 @@ void time_init (void)
   TIM_TIMERCFG_Type TIM_ConfigStruct;
   TIM_MATCHCFG_Type TIM_MatchConfigStruct ;
 
-  // Initialize timer 0, prescale count time of 100uS
+  // Initialize timer 1, prescale count time of 1uS
   TIM_ConfigStruct.PrescaleOption = TIM_PRESCALE_USVAL;
-  TIM_ConfigStruct.PrescaleValue  = 100;
+  TIM_ConfigStruct.PrescaleValue  = 1;
 
   // use channel 0, MR0
   TIM_MatchConfigStruct.MatchChannel = 0;
@@ -70,8 +99,8 @@ void time_init (void)
   TIM_MatchConfigStruct.StopOnMatch  = FALSE;
   //Toggle MR0.0 pin if MR0 matches it
   TIM_MatchConfigStruct.ExtMatchOutputType =TIM_EXTMATCH_NOTHING;
-  // Set Match value, count value of 10 (10 * 100uS = 1000uS = 1ms --> 1000 Hz)
-  TIM_MatchConfigStruct.MatchValue   = 10;
+  // Set Match value, count value of 1000 (1000 * 1uS = 1ms --> 1000 Hz)
+  TIM_MatchConfigStruct.MatchValue   = TICK_US;
 
   TIM_Init(LPC_TIM1, TIM_TIMER_MODE,&TIM_ConfigStruct);
   TIM_ConfigMatch(LPC_TIM1,&TIM_MatchConfigStruct);
@@ -98,6 +127,48 @@ uint32_t time_get (void)
 }
 
 
+/******************************************************************************
+ *
+ * Description:
+ *    Get time in us since startup. Wraps after about 71 minutes. Can be
+ *    called from interrupt handlers, also when the timer interrupt is
+ *    pending.
+ *
+ * Returns:
+ *    time in us
+ *
+ *****************************************************************************/
+uint32_t time_getUs (void)
+{
+  uint32_t ms = 0;
+  uint32_t us = 0;
+
+  readTime(&ms, &us);
+
+  return (ms * TICK_US + us);
+}
+
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get time in us since startup, see time_getUs.
+ *
+ * Returns:
+ *    time in us
+ *
+ *****************************************************************************/
+uint64_t time_getUs64 (void)
+{
+  uint32_t ms = 0;
+  uint32_t us = 0;
+
+  readTime(&ms, &us);
+
+  return ((uint64_t)ms * TICK_US + us);
+}
+
+
 /******************************************************************************
  *
  * Description:
@@ -108,4 +179,8 @@ void TIMER1_IRQHandler(void)
 {
   timeMs++;
   TIM_ClearIntPending(LPC_TIM1, TIM_MR0_INT);
+
+  if ((timeMs % DISK_TICK_MS) == 0) {
+    disk_timerproc();
+  }
 }
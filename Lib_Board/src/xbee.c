@@ -239,7 +239,10 @@ static error_t apiAtCmd(uint8_t* atCmd, uint32_t param, uint8_t setParam)
   buf[pos] = checksum(&buf[3], pos-3);
   pos++;
 
-  rf_uart_send(buf, pos, BLOCKING);
+  // the frame is queued whole or not at all
+  if (rf_uart_send(buf, pos, BLOCKING) != pos) {
+    return ERR_RF_CMD_ERROR;
+  }
 
   return ERR_OK;
 }
@@ -303,7 +306,9 @@ static error_t apiTx64(uint32_t addrHi, uint32_t addrLo, uint8_t* data,
     *frameId = buf[4];
   }
 
-  rf_uart_send(buf, 15+len, BLOCKING);
+  if (rf_uart_send(buf, 15+len, BLOCKING) != 15+len) {
+    return ERR_RF_CMD_ERROR;
+  }
 
   return ERR_OK;
 }
@@ -339,7 +344,7 @@ static void handleTxStatus(uint8_t frameId, uint8_t status)
   }
 #ifdef DEBUG
   else {
-    dbg("Xbee: Tx status = %d\r\n", status)
+    dbg("Xbee: Tx status = %d\r\n", status);
   }
 #endif
 }
@@ -365,20 +370,11 @@ static void processData(uint32_t addrHi, uint32_t addrLo, uint8_t rssi,
   if (_cb->data != NULL) {
     _cb->data(addrHi, addrLo, rssi, buf, len);
   }
-#ifdef DEBUG
   else {
-    int i = 0;
-    sprintf((char*)g_dbbuf, "data: %x:%x, rssi=%d, opt=%d, len=%d\r\n",
+    dbg("data: %x:%x, rssi=%d, opt=%d, len=%d\r\n",
         addrHi, addrLo, rssi, opt, len);
-    console_sendString(g_dbbuf);
-
-    for (i = 0; i < len; i++) {
-      sprintf((char*)g_dbbuf, "%x ", buf[i]);
-      console_sendString(g_dbbuf);
-    }
-    console_sendString((uint8_t*)"\r\n");
+    DLOG_DBG_DATA("    ", buf, len);
   }
-#endif
 
 
 }
@@ -430,21 +426,11 @@ static void handleAtResponse(uint8_t frameId, uint8_t* atBuf, uint8_t status,
   if (strncmp("ND", (char*)atBuf, 2) == 0) {
     handleDiscovery(status, valueBuf, valueLen);
   }
-#ifdef DEBUG
   else {
-    int i = 0;
-
-    dbg("Xbee: AT response %x, %c%c, stat=%d, len=%d\r\n    ",
+    dbg("Xbee: AT response %x, %c%c, stat=%d, len=%d\r\n",
         frameId, atBuf[0], atBuf[1], status, valueLen);
-
-    for (i = 0; i < valueLen; i++) {
-      sprintf((char*)g_dbbuf, "%x ",
-          valueBuf[i]);
-      console_sendString(g_dbbuf);
-    }
-    console_sendString((uint8_t*)"\r\n");
+    DLOG_DBG_DATA("    ", valueBuf, valueLen);
   }
-#endif
 
 }
 
@@ -459,7 +445,7 @@ static void handleAtResponse(uint8_t frameId, uint8_t* atBuf, uint8_t status,
  *****************************************************************************/
 static void handleModemStatus(uint8_t status)
 {
-  dbg("Xbee: Modem status %d\r\n", status)
+  dbg("Xbee: Modem status %d\r\n", status);
 
   if (isCoordinator && status == XBEE_MOD_STAT_COORD_START) {
     initialized = 1;
@@ -494,10 +480,6 @@ static void handleModemStatus(uint8_t status)
  *****************************************************************************/
 static void processFrame(uint8_t* buf, uint32_t len)
 {
-#ifdef DEBUG
-  int i = 0;
-#endif
-
   uint32_t addrLo = 0;
   uint32_t addrHi = 0;
   uint8_t* b = NULL;
@@ -549,14 +531,8 @@ static void processFrame(uint8_t* buf, uint32_t len)
     handleModemStatus(buf[1]);
     break;
   default:
-    dbg("Xbee: Unhandled API ID: %x\r\n ", buf[0]);
-#ifdef DEBUG
-    for (i = 1; i < len-1; i++) {
-      sprintf((char*)g_dbbuf, "%x ", buf[i]);
-      console_sendString(g_dbbuf);
-    }
-    console_sendString((uint8_t*)"\r\n");
-#endif
+    dbg("Xbee: Unhandled API ID: %x\r\n", buf[0]);
+    DLOG_DBG_DATA("    ", &buf[1], len - 2);
     break;
   }
 
@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+#
+# Decode the deferred log records written by dlog.c
+#
+# Format strings and %s arguments in flash are read from the .axf file of
+# the build that produced the log, %s arguments in RAM are copied into the
+# record. Console text that isn't part of a record is passed through
+# unchanged.
+#
+#   dlog_decode.py demo_aoa_can.axf capture.bin
+#   dlog_decode.py demo_aoa_can.axf /dev/ttyUSB0     (needs pyserial)
+#
+
+import re
+import struct
+import sys
+
+DLOG_SYNC = 0x1E
+DATA_RECORD = 0x0F
+STRING_RECORD = 0x0E
+MAX_ARGS = 8
+MAX_DATA = 64
+
+LEVELS = {1: 'E', 2: 'W', 3: 'I', 4: 'D'}
+
+CONV = re.compile(r'%([-+ #0]*)(\d*|\*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])')
+
+
+class Image:
+    """Loadable segments of an ELF32 little endian file"""
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            elf = f.read()
+
+        if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+            raise ValueError('%s: not an ELF32 little endian file' % path)
+
+        phoff, = struct.unpack_from('<I', elf, 28)
+        phentsize, phnum = struct.unpack_from('<HH', elf, 42)
+
+        self.segments = []
+        for i in range(phnum):
+            (ptype, offset, vaddr, paddr, filesz, memsz, flags, align) = \
+                struct.unpack_from('<8I', elf, phoff + i * phentsize)
+            if ptype == 1 and filesz > 0:
+                data = elf[offset:offset + filesz]
+                # initialised data is found at its load address in flash
+                self.segments.append((paddr, data))
+                if vaddr != paddr:
+                    self.segments.append((vaddr, data))
+
+    def read(self, addr, size):
+        for base, data in self.segments:
+            if base <= addr and addr + size <= base + len(data):
+                return data[addr - base:addr - base + size]
+        return None
+
+    def string(self, addr):
+        for base, data in self.segments:
+            if base <= addr < base + len(data):
+                end = data.find(b'\0', addr - base)
+                if end < 0:
+                    end = len(data)
+                return data[addr - base:end].decode('latin-1')
+        return None
+
+
+def format_record(image, fmt, args):
+    out = []
+    pos = 0
+    n = 0
+
+    for m in CONV.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+
+        flags, width, prec, _, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+
+        if width == '*':
+            width = str(args[n] if n < len(args) else 0)
+            n += 1
+
+        arg = args[n] if n < len(args) else 0
+        n += 1
+
+        spec = '%' + flags + width + ('.' + prec if prec else '')
+        if conv in 'di':
+            out.append((spec + 'd') % (arg - (1 << 32) if arg & 0x80000000 else arg))
+        elif conv == 'u':
+            out.append((spec + 'd') % arg)
+        elif conv in 'oxX':
+            out.append((spec + conv) % arg)
+        elif conv == 'p':
+            out.append('0x%08x' % arg)
+        elif conv == 'c':
+            out.append((spec + 'c') % chr(arg & 0xFF))
+        elif isinstance(arg, str):
+            out.append((spec + 's') % arg)
+        else:
+            s = image.string(arg)
+            out.append((spec + 's') % (s if s is not None else '<%08x>' % arg))
+
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(image, stream, out):
+    buf = b''
+
+    def fill(n):
+        nonlocal buf
+        while len(buf) < n:
+            chunk = stream.read(max(1, n - len(buf)))
+            if not chunk:
+                return False
+            buf += chunk
+        return True
+
+    while fill(1):
+        if buf[0] != DLOG_SYNC:
+            out.write(buf[:1].decode('latin-1'))
+            buf = buf[1:]
+            continue
+
+        if not fill(9):
+            break
+
+        hdr, ts = struct.unpack_from('<II', buf, 1)
+        nargs = hdr >> 28
+        level = (hdr >> 24) & 0x0F
+        fmt = image.string(hdr & 0x00FFFFFF)
+
+        if fmt is None or level not in LEVELS or \
+                (nargs > MAX_ARGS and nargs not in (DATA_RECORD, STRING_RECORD)):
+            # not a record, e.g. the sync byte in console text
+            out.write(buf[:1].decode('latin-1'))
+            buf = buf[1:]
+            continue
+
+        prefix = '[%10.6f] %s ' % (ts / 1e6, LEVELS[level])
+
+        if nargs == DATA_RECORD:
+            if not fill(13):
+                break
+            length, = struct.unpack_from('<I', buf, 9)
+            length = min(length, MAX_DATA)
+            size = 13 + (length + 3) // 4 * 4
+            if not fill(size):
+                break
+            data = buf[13:13 + length]
+            text = fmt + ' '.join('%02x' % b for b in data) + '\n'
+        elif nargs == STRING_RECORD:
+            if not fill(13):
+                break
+            info, = struct.unpack_from('<I', buf, 9)
+            nargs = min(info & 0xFF, MAX_ARGS)
+            size = 13 + 4 * (nargs + ((info >> 8) & 0xFF))
+            if not fill(size):
+                break
+            args = list(struct.unpack_from('<%dI' % nargs, buf, 13))
+            pos = 13 + 4 * nargs
+            for i in range(nargs):
+                if info & (1 << (16 + i)):
+                    length = args[i] & 0xFF
+                    s = buf[pos:pos + length].split(b'\0')[0].decode('latin-1')
+                    args[i] = s + ('...' if args[i] & 0x100 else '')
+                    pos += (length + 3) // 4 * 4
+            text = format_record(image, fmt, args)
+        else:
+            size = 9 + 4 * nargs
+            if not fill(size):
+                break
+            args = list(struct.unpack_from('<%dI' % nargs, buf, 9))
+            text = format_record(image, fmt, args)
+
+        out.write(prefix + text.replace('\r\n', '\n'))
+        out.flush()
+        buf = buf[size:]
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: %s <file.axf> <log file | serial port>\n' % sys.argv[0])
+        return 2
+
+    image = Image(sys.argv[1])
+
+    if sys.argv[2].startswith('/dev/') or sys.argv[2].upper().startswith('COM'):
+        import serial
+        stream = serial.Serial(sys.argv[2], 115200)
+    else:
+        stream = open(sys.argv[2], 'rb')
+
+    try:
+        decode(image, stream, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
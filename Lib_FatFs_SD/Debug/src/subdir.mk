@@ -4,14 +4,17 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../src/diskio.c \
 ../src/ff.c \
 ../src/mmc.c 
 
 OBJS += \
+./src/diskio.o \
 ./src/ff.o \
 ./src/mmc.o 
 
 C_DEPS += \
+./src/diskio.d \
 ./src/ff.d \
 ./src/mmc.d 
 
@@ -35,6 +35,39 @@ DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 void	disk_timerproc (void);
 
+/* Disk driver below the sector cache (mmc.c) */
+DSTATUS mmc_disk_initialize (BYTE);
+DSTATUS mmc_disk_status (BYTE);
+DRESULT mmc_disk_read (BYTE, BYTE*, DWORD, BYTE);
+#if	_READONLY == 0
+DRESULT mmc_disk_write (BYTE, const BYTE*, DWORD, BYTE);
+#endif
+DRESULT mmc_disk_ioctl (BYTE, BYTE, void*);
+
+
+
+/* Sector cache (diskio.c) */
+
+#ifndef _CACHE_SETS
+#define _CACHE_SETS		4	/* Number of sets (power of 2) */
+#endif
+#ifndef _CACHE_WAYS
+#define _CACHE_WAYS		2	/* Number of sectors in a set */
+#endif
+#ifndef _CACHE_RUN
+#define _CACHE_RUN		4	/* Sectors of a read-ahead or write-back run, 0:Disable both */
+#endif
+
+typedef struct {
+	DWORD	hits;		/* Single sector reads/writes found in the cache */
+	DWORD	misses;		/* Single sector reads/writes not found in the cache */
+	DWORD	ra_hits;	/* Single sector reads found in the read-ahead run */
+	DWORD	ra_fills;	/* Read-ahead runs read from the disk */
+	DWORD	wb_sectors;	/* Dirty sectors written back */
+	DWORD	wb_runs;	/* Write-back runs, one multiple block write each */
+	DWORD	direct;		/* Multiple sector reads/writes passed to the disk */
+} CACHE_STAT;
+
 
 
 
@@ -66,6 +99,8 @@ void	disk_timerproc (void);
 #define ATA_GET_REV			20
 #define ATA_GET_MODEL		21
 #define ATA_GET_SN			22
+/* Sector cache command */
+#define CACHE_GET_STAT		30	/* Get CACHE_STAT */
 
 
 
@@ -319,6 +319,19 @@ typedef struct _FATFS_ {
 #endif
 #if _FS_RPATH
 	DWORD	cdir;		/* Current directory (0:root)*/
+#endif
+#if _USE_FMAP && !_FS_READONLY
+	DWORD	fm_scan;	/* Next cluster to be scanned into the maps */
+	DWORD	fm_nfree;	/* Number of free clusters below fm_scan */
+	BYTE	fm_shift;	/* Cluster group size in the maps (1 << fm_shift clusters) */
+	BYTE	fm_valid;	/* Maps are complete */
+	BYTE	fm_gstat;	/* Group being scanned (bit0:free cluster found, bit1:used cluster found) */
+	BYTE	fmap[_FMAP_SIZE];/* Free map, bit set:the whole cluster group is free */
+	BYTE	umap[_FMAP_SIZE];/* Full map, bit set:no free cluster in the group */
+#endif
+#if _USE_STREAM && !_FS_READONLY
+	DWORD	rsv_clust;	/* First cluster of the area reserved for a stream (0:None) */
+	DWORD	rsv_end;	/* Cluster next to the reserved area */
 #endif
 	DWORD	sects_fat;	/* Sectors per fat */
 	DWORD	max_clust;	/* Maximum cluster# + 1. Number of clusters is max_clust - 2 */
@@ -366,6 +379,11 @@ typedef struct _FIL_ {
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Ponter to the directory entry in the window */
 #endif
+#if _USE_STREAM && !_FS_READONLY
+	DWORD	rsv_next;	/* Next cluster to take from the stream area */
+	DWORD	rsv_end;	/* Cluster next to the stream area (0:Not streaming) */
+	DWORD	rsv_tail;	/* Last cluster of the file linked in the FAT (0:None) */
+#endif
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];/* File R/W buffer */
 #endif
@@ -436,6 +454,8 @@ FRESULT f_forward (FIL*, UINT(*)(const BYTE*,UINT), UINT, UINT*);	/* Forward dat
 FRESULT f_mkfs (BYTE, BYTE, WORD);					/* Create a file system on the drive */
 FRESULT f_chdir (const XCHAR*);						/* Change current directory */
 FRESULT f_chdrive (BYTE);							/* Change current drive */
+FRESULT f_stream (FIL*, DWORD);						/* Reserve contiguous space for appending */
+FRESULT f_mapfree (const XCHAR*, UINT);				/* Build the free cluster map in slices */
 
 #if _USE_STRFUNC
 int f_putc (int, FIL*);								/* Put a character to the file */
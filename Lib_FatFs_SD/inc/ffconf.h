@@ -48,6 +48,20 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#define	_USE_FMAP	1	/* 0 or 1 */
+#define	_FMAP_SIZE	256	/* Size of each cluster group map in bytes */
+/* To enable the free cluster map and f_mapfree function, set _USE_FMAP to 1
+/  and set _FS_READONLY to 0. Each file system object holds two maps of
+/  _FMAP_SIZE * 8 cluster groups, free groups and full groups. The maps are
+/  built by f_mapfree in slices after mounting. Cluster allocation skips the
+/  full groups and f_getfree returns the count of the map without FAT scan. */
+
+
+#define	_USE_STREAM	1	/* 0 or 1 */
+/* To enable f_stream function, set _USE_STREAM to 1 and set _USE_FMAP to 1.
+/  f_stream only finds space in the part of the map f_mapfree has built. */
+
+
 
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
@@ -0,0 +1,480 @@
+/*-----------------------------------------------------------------------*/
+/* Low level disk I/O module with a sector cache                         */
+/*-----------------------------------------------------------------------*/
+/* FatFs calls the disk_* functions of this module, which keep recently  */
+/* used sectors in a set-associative cache in front of the disk driver   */
+/* (mmc_disk_*). Only drive 0 is cached.                                 */
+/*                                                                       */
+/* Single sector writes are kept dirty in the cache until the sector is  */
+/* evicted or CTRL_SYNC is issued. A dirty sector is written back        */
+/* together with its dirty neighbours in one multiple block write of up  */
+/* to _CACHE_RUN sectors.                                                */
+/*                                                                       */
+/* A single sector read that follows the previous read starts a          */
+/* read-ahead of _CACHE_RUN sectors into the run buffer, which also      */
+/* gathers the sectors of a write-back run.                              */
+/*                                                                       */
+/* Multiple sector reads and writes (whole clusters from f_read and      */
+/* f_write) go straight to the disk. The cache is kept coherent with     */
+/* them.                                                                 */
+/*                                                                       */
+/* This module doesn't depend on the hardware. It can be built on a host */
+/* against a file-backed mmc_disk_* for testing.                         */
+/*-----------------------------------------------------------------------*/
+
+
+#include <string.h>
+#include "diskio.h"
+
+
+#define SS			512		/* Sector size */
+
+#define CF_VALID	0x01	/* Entry holds a sector */
+#define CF_DIRTY	0x02	/* Sector differs from the disk */
+
+#define SET(sect)	((UINT)(sect) & (_CACHE_SETS - 1))
+
+#if (_CACHE_SETS & (_CACHE_SETS - 1)) != 0
+#error _CACHE_SETS must be a power of 2
+#endif
+#if _CACHE_WAYS < 1 || _CACHE_RUN > 255
+#error Wrong cache configuration
+#endif
+
+
+
+/*--------------------------------------------------------------------------
+
+   Module Private Functions
+
+---------------------------------------------------------------------------*/
+
+typedef struct {
+  DWORD sector;			/* Sector number */
+  DWORD stamp;			/* Time of the last access (LRU) */
+  BYTE flags;			/* CF_VALID, CF_DIRTY */
+} CENTRY;
+
+static
+CENTRY Entry[_CACHE_SETS][_CACHE_WAYS];
+
+static
+BYTE Data[_CACHE_SETS][_CACHE_WAYS][SS];
+
+static
+DWORD Stamp;			/* Access counter */
+
+static
+DWORD NextSector;		/* Sector after the last read, read-ahead when it comes next */
+
+static
+CACHE_STAT CStat;		/* Statistics */
+
+#if _CACHE_RUN
+static
+BYTE Run[_CACHE_RUN][SS];	/* Read-ahead run, also used to gather write-back runs */
+
+static
+DWORD RunSector;		/* First sector in Run[] */
+
+static
+BYTE RunCount;			/* Number of valid sectors in Run[], 0:None */
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Find a sector in the cache                                            */
+/*-----------------------------------------------------------------------*/
+
+static
+int find (			/* Way of the sector, -1:Not cached */
+    DWORD sect
+)
+{
+  CENTRY *e = Entry[SET(sect)];
+  int w;
+
+
+  for (w = 0; w < _CACHE_WAYS; w++) {
+    if ((e[w].flags & CF_VALID) && e[w].sector == sect) return w;
+  }
+  return -1;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Check if a sector is dirty in the cache                               */
+/*-----------------------------------------------------------------------*/
+
+#if _READONLY == 0
+#if _CACHE_RUN > 1
+static
+BOOL is_dirty (
+    DWORD sect
+)
+{
+  int w = find(sect);
+
+
+  return (w >= 0 && (Entry[SET(sect)][w].flags & CF_DIRTY)) ? TRUE : FALSE;
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write back a dirty sector together with its dirty neighbours          */
+/*-----------------------------------------------------------------------*/
+
+static
+DRESULT write_back (
+    DWORD sect		/* A dirty sector in the cache */
+)
+{
+  DRESULT res;
+  DWORD first = sect, last = sect;
+  UINT n, i;
+
+
+#if _CACHE_RUN > 1
+  while (last - first + 1 < _CACHE_RUN && first > 0 && is_dirty(first - 1)) first--;
+  while (last - first + 1 < _CACHE_RUN && is_dirty(last + 1)) last++;
+#endif
+  n = (UINT)(last - first + 1);
+
+#if _CACHE_RUN > 1
+  if (n > 1) {
+    RunCount = 0;		/* The read-ahead run is overwritten */
+    for (i = 0; i < n; i++)
+      memcpy(Run[i], Data[SET(first + i)][find(first + i)], SS);
+    res = mmc_disk_write(0, Run[0], first, (BYTE)n);
+  } else
+#endif
+  res = mmc_disk_write(0, Data[SET(sect)][find(sect)], sect, 1);
+  if (res != RES_OK) return res;
+
+  for (i = 0; i < n; i++)
+    Entry[SET(first + i)][find(first + i)].flags &= ~CF_DIRTY;
+  CStat.wb_sectors += n;
+  CStat.wb_runs++;
+
+  return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write back all dirty sectors                                          */
+/*-----------------------------------------------------------------------*/
+
+static
+DRESULT write_back_all (void)
+{
+  UINT s;
+  int w;
+
+
+  for (s = 0; s < _CACHE_SETS; s++) {
+    for (w = 0; w < _CACHE_WAYS; w++) {
+      if ((Entry[s][w].flags & CF_DIRTY) && write_back(Entry[s][w].sector) != RES_OK)
+        return RES_ERROR;
+    }
+  }
+  return RES_OK;
+}
+#endif /* _READONLY == 0 */
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get an entry for a sector, evicting the least recently used one       */
+/*-----------------------------------------------------------------------*/
+
+static
+int alloc (			/* Way for the sector, -1:Write back failed */
+    DWORD sect
+)
+{
+  CENTRY *e = Entry[SET(sect)];
+  int w, v = 0;
+
+
+  for (w = 0; w < _CACHE_WAYS; w++) {
+    if (!(e[w].flags & CF_VALID)) {
+      v = w;
+      break;
+    }
+    if (Stamp - e[w].stamp > Stamp - e[v].stamp) v = w;
+  }
+
+#if _READONLY == 0
+  if ((e[v].flags & CF_DIRTY) && write_back(e[v].sector) != RES_OK)
+    return -1;
+#endif
+
+  e[v].sector = sect;
+  e[v].flags = 0;
+  return v;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Mark an entry as most recently used                                   */
+/*-----------------------------------------------------------------------*/
+
+static
+void touch (
+    DWORD sect,
+    int w
+)
+{
+  Entry[SET(sect)][w].stamp = ++Stamp;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read ahead into the run buffer                                        */
+/*-----------------------------------------------------------------------*/
+
+#if _CACHE_RUN
+static
+DRESULT fill_run (
+    DWORD sect		/* First sector of the run */
+)
+{
+  DRESULT res;
+  UINT i;
+  int w;
+
+
+  RunCount = 0;
+  res = mmc_disk_read(0, Run[0], sect, _CACHE_RUN);	/* Fails past the end of the disk */
+  if (res != RES_OK) return res;
+
+  for (i = 0; i < _CACHE_RUN; i++) {	/* Sectors in the cache may be newer */
+    w = find(sect + i);
+    if (w >= 0) memcpy(Run[i], Data[SET(sect + i)][w], SS);
+  }
+  RunSector = sect;
+  RunCount = _CACHE_RUN;
+  CStat.ra_fills++;
+
+  return RES_OK;
+}
+
+#define IN_RUN(sect)	(RunCount && (DWORD)((sect) - RunSector) < RunCount)
+#endif
+
+
+
+/*--------------------------------------------------------------------------
+
+   Public Functions
+
+---------------------------------------------------------------------------*/
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize Disk Drive                                                 */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_initialize (
+    BYTE drv		/* Physical drive nmuber (0) */
+)
+{
+  if (!drv) {		/* The card may have been changed, drop the cache */
+    memset(Entry, 0, sizeof(Entry));
+#if _CACHE_RUN
+    RunCount = 0;
+#endif
+  }
+
+  return mmc_disk_initialize(drv);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Disk Status                                                       */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (
+    BYTE drv		/* Physical drive nmuber (0) */
+)
+{
+  return mmc_disk_status(drv);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+    BYTE drv,			/* Physical drive nmuber (0) */
+    BYTE *buff,			/* Pointer to the data buffer to store read data */
+    DWORD sector,		/* Start sector number (LBA) */
+    BYTE count			/* Sector count (1..255) */
+)
+{
+  DRESULT res;
+  UINT i;
+  int w;
+
+
+  if (drv || !count) return mmc_disk_read(drv, buff, sector, count);
+  if (mmc_disk_status(0) & STA_NOINIT) return RES_NOTRDY;
+
+  if (count > 1) {		/* Multiple sectors go straight to the disk */
+    CStat.direct++;
+    res = mmc_disk_read(0, buff, sector, count);
+    if (res != RES_OK) return res;
+    for (i = 0; i < count; i++) {	/* Sectors in the cache may be newer */
+      w = find(sector + i);
+      if (w >= 0) memcpy(buff + i * SS, Data[SET(sector + i)][w], SS);
+    }
+    NextSector = sector + count;
+    return RES_OK;
+  }
+
+  w = find(sector);
+  if (w >= 0) {					/* Cache hit */
+    CStat.hits++;
+    touch(sector, w);
+    memcpy(buff, Data[SET(sector)][w], SS);
+  }
+#if _CACHE_RUN
+  else if (IN_RUN(sector)) {	/* Read-ahead hit */
+    CStat.ra_hits++;
+    memcpy(buff, Run[sector - RunSector], SS);
+  }
+  else if (sector == NextSector && fill_run(sector) == RES_OK) {	/* Sequential, read ahead */
+    CStat.misses++;
+    memcpy(buff, Run[0], SS);
+  }
+#endif
+  else {						/* Cache miss */
+    CStat.misses++;
+    w = alloc(sector);
+    if (w < 0) return RES_ERROR;
+    res = mmc_disk_read(0, Data[SET(sector)][w], sector, 1);
+    if (res != RES_OK) return res;
+    Entry[SET(sector)][w].flags = CF_VALID;
+    touch(sector, w);
+    memcpy(buff, Data[SET(sector)][w], SS);
+  }
+
+  NextSector = sector + 1;
+  return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if _READONLY == 0
+DRESULT disk_write (
+    BYTE drv,			/* Physical drive nmuber (0) */
+    const BYTE *buff,	/* Pointer to the data to be written */
+    DWORD sector,		/* Start sector number (LBA) */
+    BYTE count			/* Sector count (1..255) */
+)
+{
+  DRESULT res;
+  DSTATUS stat;
+  UINT i;
+  int w;
+
+
+  if (drv || !count) return mmc_disk_write(drv, buff, sector, count);
+  stat = mmc_disk_status(0);
+  if (stat & STA_NOINIT) return RES_NOTRDY;
+  if (stat & STA_PROTECT) return RES_WRPRT;
+
+  if (count > 1) {		/* Multiple sectors go straight to the disk */
+    CStat.direct++;
+    res = mmc_disk_write(0, buff, sector, count);
+    for (i = 0; i < count; i++) {	/* Update or drop the copies */
+      w = find(sector + i);
+      if (w >= 0) {
+        if (res == RES_OK) {
+          memcpy(Data[SET(sector + i)][w], buff + i * SS, SS);
+          Entry[SET(sector + i)][w].flags = CF_VALID;
+        } else {
+          Entry[SET(sector + i)][w].flags = 0;
+        }
+      }
+#if _CACHE_RUN
+      if (IN_RUN(sector + i)) {
+        if (res == RES_OK)
+          memcpy(Run[sector + i - RunSector], buff + i * SS, SS);
+        else
+          RunCount = 0;
+      }
+#endif
+    }
+    return res;
+  }
+
+  w = find(sector);
+  if (w >= 0) {					/* Cache hit */
+    CStat.hits++;
+  } else {						/* Cache miss, the whole sector is replaced */
+    CStat.misses++;
+    w = alloc(sector);
+    if (w < 0) return RES_ERROR;
+  }
+  memcpy(Data[SET(sector)][w], buff, SS);
+  Entry[SET(sector)][w].flags = CF_VALID | CF_DIRTY;
+  touch(sector, w);
+
+#if _CACHE_RUN
+  if (IN_RUN(sector))
+    memcpy(Run[sector - RunSector], buff, SS);
+#endif
+
+  return RES_OK;
+}
+#endif /* _READONLY == 0 */
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ioctl (
+    BYTE drv,		/* Physical drive nmuber (0) */
+    BYTE ctrl,		/* Control code */
+    void *buff		/* Buffer to send/receive control data */
+)
+{
+  if (drv) return mmc_disk_ioctl(drv, ctrl, buff);
+
+  switch (ctrl) {
+#if _READONLY == 0
+  case CTRL_SYNC :		/* Write back the cache, then wait for the disk */
+    if (!(mmc_disk_status(0) & STA_NOINIT) && write_back_all() != RES_OK)
+      return RES_ERROR;
+    break;
+
+  case CTRL_POWER :		/* Write back the cache before power off */
+    if (*(BYTE*)buff == 0 && !(mmc_disk_status(0) & STA_NOINIT))
+      write_back_all();
+    break;
+#endif
+
+  case CACHE_GET_STAT :	/* Get cache statistics */
+    memcpy(buff, &CStat, sizeof(CStat));
+    return RES_OK;
+  }
+
+  return mmc_disk_ioctl(drv, ctrl, buff);
+}
@@ -129,6 +129,9 @@
 #if _DRIVES < 1 || _DRIVES > 9
 #error Number of drives must be 1-9.
 #endif
+#if _USE_STREAM && !_USE_FMAP
+#error _USE_STREAM needs _USE_FMAP.
+#endif
 static
 FATFS *FatFs[_DRIVES];	/* Pointer to the file system objects (logical drives) */
 
@@ -410,6 +413,17 @@ FRESULT put_fat (
 			res = FR_INT_ERR;
 		}
 		fs->wflag = 1;
+#if _USE_FMAP
+		if (res == FR_OK) {
+			bc = clst >> fs->fm_shift;
+			if (val)					/* The group is no longer entirely free */
+				fs->fmap[bc / 8] &= ~(1 << (bc % 8));
+			else						/* The group is no longer full */
+				fs->umap[bc / 8] &= ~(1 << (bc % 8));
+			if (clst < fs->fm_scan && bc == (fs->fm_scan >> fs->fm_shift))
+				fs->fm_gstat |= val ? 2 : 1;	/* Change in the part of the group already scanned */
+		}
+#endif
 	}
 
 	return res;
@@ -449,6 +463,9 @@ FRESULT remove_chain (
 				fs->free_clust++;
 				fs->fsi_flag = 1;
 			}
+#if _USE_FMAP
+			if (clst < fs->fm_scan) fs->fm_nfree++;	/* Update the count of the map */
+#endif
 			clst = nxt;	/* Next cluster */
 		}
 	}
@@ -471,6 +488,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 )
 {
 	DWORD cs, ncl, scl, mcl;
+#if _USE_FMAP
+	DWORD g, ucl = 0;
+#endif
 
 
 	mcl = fs->max_clust;
@@ -491,11 +511,36 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		if (ncl >= mcl) {				/* Wrap around */
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free custer */
+#if _USE_FMAP
+			ucl = 0;
+#endif
+		}
+#if _USE_STREAM
+		if (ncl - fs->rsv_clust < fs->rsv_end - fs->rsv_clust) {	/* Skip the area reserved for a stream */
+			if (ncl == scl) return 0;
+			ucl = 0;
+			continue;
 		}
+#endif
+#if _USE_FMAP
+		g = ncl >> fs->fm_shift;
+		if (!(ncl & ((1UL << fs->fm_shift) - 1)) && (fs->umap[g / 8] & (1 << (g % 8)))) {	/* Skip a full group */
+			cs = (g + 1) << fs->fm_shift;
+			if (cs > mcl) cs = mcl;
+			if (scl - ncl < cs - ncl) return 0;	/* No free custer */
+			ncl = cs - 1;
+			continue;
+		}
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occured */
 			return cs;
+#if _USE_FMAP
+		if (!ucl) ucl = ncl;			/* Start of the used clusters */
+		if (ucl <= (g << fs->fm_shift) && (!((ncl + 1) & ((1UL << fs->fm_shift) - 1)) || ncl + 1 == mcl))
+			fs->umap[g / 8] |= 1 << (g % 8);	/* The whole group is used */
+#endif
 		if (ncl == scl) return 0;		/* No free custer */
 	}
 
@@ -511,6 +556,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		fs->free_clust--;
 		fs->fsi_flag = 1;
 	}
+#if _USE_FMAP
+	if (ncl < fs->fm_scan) fs->fm_nfree--;	/* Update the count of the map */
+#endif
 
 	return ncl;		/* Return new cluster number */
 }
@@ -519,6 +567,161 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 
 
+#if _USE_FMAP && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Free map - Clear the maps to be built                                 */
+/*-----------------------------------------------------------------------*/
+
+static
+void init_fmap (
+	FATFS *fs			/* File system object */
+)
+{
+	BYTE sh;
+
+
+	for (sh = 0; ((fs->max_clust - 1) >> sh) >= _FMAP_SIZE * 8; sh++) ;
+	fs->fm_shift = sh;
+	fs->fm_scan = 2;
+	fs->fm_nfree = 0;
+	fs->fm_gstat = 0;
+	fs->fm_valid = 0;
+	mem_set(fs->fmap, 0, _FMAP_SIZE);
+	mem_set(fs->umap, 0, _FMAP_SIZE);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Free map - Scan FAT entries into the maps                             */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT scan_fat (
+	FATFS *fs,			/* File system object */
+	DWORD nent			/* Number of FAT entries to scan */
+)
+{
+	DWORD c, cs, g;
+
+
+	for (c = fs->fm_scan; nent && c < fs->max_clust; nent--) {
+		cs = get_fat(fs, c);
+		if (cs == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (cs == 1) return FR_INT_ERR;
+		if (cs == 0) {
+			fs->fm_gstat |= 1;
+			fs->fm_nfree++;
+			if (fs->last_clust < 2 || fs->last_clust >= fs->max_clust)
+				fs->last_clust = c - 1;	/* Allocation hint for no FSInfo */
+		} else {
+			fs->fm_gstat |= 2;
+		}
+		fs->fm_scan = ++c;
+		if (!(c & ((1UL << fs->fm_shift) - 1)) || c == fs->max_clust) {	/* End of a group */
+			g = (c - 1) >> fs->fm_shift;
+			if (!(fs->fm_gstat & 2)) fs->fmap[g / 8] |= 1 << (g % 8);
+			if (!(fs->fm_gstat & 1)) fs->umap[g / 8] |= 1 << (g % 8);
+			fs->fm_gstat = 0;
+		}
+	}
+
+	if (c >= fs->max_clust && !fs->fm_valid) {	/* Maps completed */
+		fs->fm_valid = 1;
+		if (fs->free_clust != fs->fm_nfree) {	/* Correct FSInfo */
+			fs->free_clust = fs->fm_nfree;
+			fs->fsi_flag = 1;
+		}
+	}
+
+	return FR_OK;
+}
+#endif /* _USE_FMAP && !_FS_READONLY */
+
+
+
+
+#if _USE_STREAM && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Stream - Find contiguous free clusters                                */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD find_run (	/* 0:Not found, >=2:First cluster# of the run */
+	FATFS *fs,		/* File system object */
+	DWORD ncl		/* Number of clusters needed */
+)
+{
+	DWORD g, scl, ecl;
+	BYTE sh = fs->fm_shift;
+
+
+	scl = 0;
+	for (g = 0; (g << sh) < fs->max_clust; g++) {
+		if (!(fs->fmap[g / 8] & (1 << (g % 8)))) {	/* Group in use, restart */
+			scl = 0;
+			continue;
+		}
+		ecl = (g + 1) << sh;
+		if (ecl <= 2) continue;			/* No data cluster in the group */
+		if (ecl > fs->max_clust) ecl = fs->max_clust;
+		if (!scl) scl = (g << sh < 2) ? 2 : g << sh;
+		if (ecl - scl >= ncl) return scl;
+	}
+
+	return 0;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Stream - Link the clusters taken from the area into the FAT           */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT commit_stream (
+	FIL *fp,		/* Pointer to the streaming file object */
+	BYTE end		/* 1:End streaming and release the rest of the area */
+)
+{
+	FATFS *fs = fp->fs;
+	DWORD c, scl;
+	FRESULT res = FR_OK;
+
+
+	scl = (fp->rsv_tail >= fs->rsv_clust && fp->rsv_tail < fs->rsv_end) ?
+		fp->rsv_tail + 1 : fs->rsv_clust;		/* First cluster not linked yet */
+	if (scl < fp->rsv_next) {
+		if (fp->rsv_tail)
+			res = put_fat(fs, fp->rsv_tail, scl);
+		for (c = scl; res == FR_OK && c < fp->rsv_next - 1; c++)
+			res = put_fat(fs, c, c + 1);
+		if (res == FR_OK)
+			res = put_fat(fs, fp->rsv_next - 1, 0x0FFFFFFF);
+		if (res != FR_OK) return res;
+		fp->rsv_tail = fp->rsv_next - 1;
+		fs->last_clust = fp->rsv_tail;	/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= fp->rsv_next - scl;
+			fs->fsi_flag = 1;
+		}
+		if (scl < fs->fm_scan)			/* Update the count of the map */
+			fs->fm_nfree -= (fp->rsv_next < fs->fm_scan ? fp->rsv_next : fs->fm_scan) - scl;
+	}
+	if (end) {
+		fs->rsv_clust = fs->rsv_end = 0;
+		fp->rsv_end = 0;
+	}
+
+	return res;
+}
+#endif /* _USE_STREAM && !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get sector# from cluster#                                             */
 /*-----------------------------------------------------------------------*/
@@ -1561,7 +1764,7 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occured */
 
 #if !_FS_READONLY
 	/* Initialize allocation information */
-	fs->free_clust = 0xFFFFFFFF;
+	fs->last_clust = fs->free_clust = 0xFFFFFFFF;
 	fs->wflag = 0;
 	/* Get fsinfo if needed */
 	if (fmt == FS_FAT32) {
@@ -1575,6 +1778,12 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occured */
 			fs->free_clust = LD_DWORD(fs->win+FSI_Free_Count);
 		}
 	}
+#endif
+#if _USE_FMAP && !_FS_READONLY
+	init_fmap(fs);			/* Free map to be built by f_mapfree */
+#endif
+#if _USE_STREAM && !_FS_READONLY
+	fs->rsv_clust = fs->rsv_end = 0;	/* No stream */
 #endif
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->winsect = 0;		/* Invalidate sector cache */
@@ -1748,6 +1957,9 @@ FRESULT f_open (
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 	fp->fptr = 0; fp->csect = 255;		/* File pointer */
 	fp->dsect = 0;
+#if _USE_STREAM && !_FS_READONLY
+	fp->rsv_end = 0;					/* Not streaming */
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
 
 	LEAVE_FF(dj.fs, FR_OK);
@@ -1781,6 +1993,10 @@ FRESULT f_read (
 		LEAVE_FF(fp->fs, FR_INT_ERR);
 	if (!(fp->flag & FA_READ)) 						/* Check access mode */
 		LEAVE_FF(fp->fs, FR_DENIED);
+#if _USE_STREAM && !_FS_READONLY
+	if (fp->rsv_end && commit_stream(fp, 0) != FR_OK)	/* Link the streamed clusters to follow them */
+		ABORT(fp->fs, FR_DISK_ERR);
+#endif
 	remain = fp->fsize - fp->fptr;
 	if (btr > remain) btr = (UINT)remain;			/* Truncate btr by remaining bytes */
 
@@ -1882,6 +2098,15 @@ FRESULT f_write (
 		wbuff += wcnt, fp->fptr += wcnt, *bw += wcnt, btw -= wcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
+#if _USE_STREAM
+				if (fp->rsv_end && fp->rsv_next >= fp->rsv_end) {	/* Stream area used up, continue with FAT allocation */
+					if (commit_stream(fp, 1) != FR_OK) ABORT(fp->fs, FR_DISK_ERR);
+				}
+				if (fp->rsv_end && (fp->fptr || !fp->org_clust)) {	/* Streaming, take the next cluster of the area */
+					clst = fp->rsv_next++;
+					if (fp->fptr == 0) fp->org_clust = clst;
+				} else
+#endif
 				if (fp->fptr == 0) {				/* On the top of the file? */
 					clst = fp->org_clust;			/* Follow from the origin */
 					if (clst == 0)					/* When there is no cluster chain, */
@@ -1910,6 +2135,13 @@ FRESULT f_write (
 			sect += fp->csect;
 			cc = btw / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Write maximum contiguous sectors directly */
+#if _USE_STREAM
+				if (fp->rsv_end && fp->curr_clust - fp->fs->rsv_clust < fp->rsv_end - fp->fs->rsv_clust) {
+					clst = (fp->rsv_end - fp->curr_clust) * fp->fs->csize - fp->csect;
+					if (cc > clst) cc = clst;		/* Clip at the end of the stream area */
+					if (cc > 255) cc = 255;
+				} else
+#endif
 				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - fp->csect;
 				if (disk_write(fp->fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
@@ -1924,6 +2156,13 @@ FRESULT f_write (
 					mem_cpy(fp->buf, wbuff + ((fp->dsect - sect) * SS(fp->fs)), SS(fp->fs));
 					fp->flag &= ~FA__DIRTY;
 				}
+#endif
+#if _USE_STREAM
+				if (fp->csect + cc > fp->fs->csize) {	/* Crossed clusters in the stream area */
+					fp->curr_clust += (fp->csect + cc - 1) / fp->fs->csize;
+					fp->rsv_next = fp->curr_clust + 1;
+					fp->csect = (BYTE)((fp->csect + cc - 1) % fp->fs->csize + 1);
+				} else
 #endif
 				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
 				wcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
@@ -1988,6 +2227,12 @@ FRESULT f_sync (
 					LEAVE_FF(fp->fs, FR_DISK_ERR);
 				fp->flag &= ~FA__DIRTY;
 			}
+#endif
+#if _USE_STREAM
+			if (fp->rsv_end) {			/* Link the streamed clusters */
+				res = commit_stream(fp, 0);
+				if (res != FR_OK) LEAVE_FF(fp->fs, res);
+			}
 #endif
 			/* Update the directory entry */
 			res = move_window(fp->fs, fp->dir_sect);
@@ -2031,6 +2276,10 @@ FRESULT f_close (
 	LEAVE_FF(fp->fs, res);
 #else
 	res = f_sync(fp);
+#if _USE_STREAM
+	if (res == FR_OK && fp->rsv_end)	/* Release the rest of the stream area */
+		res = commit_stream(fp, 1);
+#endif
 	if (res == FR_OK) fp->fs = NULL;
 	return res;
 #endif
@@ -2112,6 +2361,10 @@ FRESULT f_lseek (
 	if (res != FR_OK) LEAVE_FF(fp->fs, res);
 	if (fp->flag & FA__ERROR)			/* Check abort flag */
 		LEAVE_FF(fp->fs, FR_INT_ERR);
+#if _USE_STREAM && !_FS_READONLY
+	if (fp->rsv_end && commit_stream(fp, 1) != FR_OK)	/* End streaming */
+		ABORT(fp->fs, FR_DISK_ERR);
+#endif
 	if (ofs > fp->fsize					/* In read-only mode, clip offset with the file size */
 #if !_FS_READONLY
 		 && !(fp->flag & FA_WRITE)
@@ -2334,6 +2587,13 @@ FRESULT f_getfree (
 		LEAVE_FF(*fatfs, FR_OK);
 	}
 
+#if _USE_FMAP && !_FS_READONLY
+	/* Complete the free map, it counts the free clusters */
+	res = scan_fat(*fatfs, (*fatfs)->max_clust);
+	*nclst = (*fatfs)->free_clust;
+	LEAVE_FF(*fatfs, res);
+#endif
+
 	/* Get number of free clusters */
 	fat = (*fatfs)->fs_type;
 	n = 0;
@@ -2394,6 +2654,10 @@ FRESULT f_truncate (
 		LEAVE_FF(fp->fs, FR_INT_ERR);
 	if (!(fp->flag & FA_WRITE))			/* Check access mode */
 		LEAVE_FF(fp->fs, FR_DENIED);
+#if _USE_STREAM
+	if (fp->rsv_end && commit_stream(fp, 1) != FR_OK)	/* End streaming */
+		ABORT(fp->fs, FR_DISK_ERR);
+#endif
 
 	if (fp->fsize > fp->fptr) {
 		fp->fsize = fp->fptr;	/* Set file size to current R/W point */
@@ -2707,6 +2971,84 @@ FRESULT f_rename (
 
 
 
+#if _USE_FMAP && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Build the Free Cluster Map in Slices                                  */
+/*-----------------------------------------------------------------------*/
+/* Call it from an idle loop after mounting, it scans nent FAT entries per
+/  call and returns at once when the map is complete. Until then, cluster
+/  allocation doesn't skip the full groups that are not scanned yet,
+/  f_stream finds no space in them and f_getfree without FSInfo completes
+/  the map itself (as long as the FAT scan it replaces). */
+
+FRESULT f_mapfree (
+	const XCHAR *path,	/* Pointer to the logical drive number (root dir) */
+	UINT nent			/* Number of FAT entries to scan */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = chk_mounted(&path, &fs, 0);
+	if (res == FR_OK && !fs->fm_valid)
+		res = scan_fat(fs, nent);
+
+	LEAVE_FF(fs, res);
+}
+#endif /* _USE_FMAP && !_FS_READONLY */
+
+
+
+#if _USE_STREAM && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Reserve Contiguous Space for Streaming Appends                        */
+/*-----------------------------------------------------------------------*/
+/* The following f_write calls take clusters from the reserved area
+/  without accessing the FAT and write across cluster boundaries in one
+/  transfer. The clusters are linked into the FAT by f_sync or f_close;
+/  data written after the last f_sync is lost on power failure. Only one
+/  file per volume can stream at a time. The FAT is not scanned here, the
+/  space is searched in the part of the free map f_mapfree has built. */
+
+FRESULT f_stream (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to be appended */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, ncl, scl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE) || fp->fptr != fp->fsize)	/* Check access mode and the file pointer at the end */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+	if (fp->rsv_end && commit_stream(fp, 1) != FR_OK)	/* End the previous stream of the file */
+		ABORT(fs, FR_DISK_ERR);
+	if (fs->rsv_end)					/* Another file is streaming */
+		LEAVE_FF(fs, FR_DENIED);
+
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+	ncl = fsz / bcs + (fsz % bcs ? 1 : 0);
+	if (!ncl) LEAVE_FF(fs, FR_OK);
+	scl = find_run(fs, ncl);			/* Only in the part of the map built so far */
+	if (!scl) LEAVE_FF(fs, FR_DENIED);	/* No contiguous space */
+
+	fs->rsv_clust = fp->rsv_next = scl;
+	fs->rsv_end = fp->rsv_end = scl + ncl;
+	fp->rsv_tail = fp->fsize ? fp->curr_clust : fp->org_clust;	/* Current end of the chain */
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif /* _USE_STREAM && !_FS_READONLY */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Forward data to the stream directly (Available on only _FS_TINY cfg)  */
 /*-----------------------------------------------------------------------*/
@@ -6,8 +6,10 @@
 /*-----------------------------------------------------------------------*/
 
 
+#include "LPC17xx.h"
 #include "lpc17xx_ssp.h"
 #include "lpc17xx_gpio.h"
+#include "lpc17xx_gpdma.h"
 #include "diskio.h"
 
 
@@ -16,6 +18,7 @@
 #define CMD0	(0x40+0)	/* GO_IDLE_STATE */
 #define CMD1	(0x40+1)	/* SEND_OP_COND (MMC) */
 #define	ACMD41	(0xC0+41)	/* SEND_OP_COND (SDC) */
+#define CMD6	(0x40+6)	/* SWITCH_FUNC (SDC) */
 #define CMD8	(0x40+8)	/* SEND_IF_COND */
 #define CMD9	(0x40+9)	/* SEND_CSD */
 #define CMD10	(0x40+10)	/* SEND_CID */
@@ -36,10 +39,27 @@
 #define CS_LOW()    GPIO_ClearValue( 0, 1<<6 )
 #define CS_HIGH()   GPIO_SetValue(0, 1<<6)
 
+#define SSPx		LPC_SSP1
 
+/* GPDMA channels used for data blocks. The receive channel has the higher
+   priority so that the receive FIFO never overruns. */
+#define DMA_CH_RX	0
+#define DMA_CH_TX	1
 
-#define	FCLK_SLOW()					/* Set slow clock (100k-400k) */
-#define	FCLK_FAST()					/* Set fast clock (depends on the CSD) */
+
+/* SPI clock. The fast clock is taken from TRAN_SPEED in the CSD, limited to
+   MMC_SCLK_MAX. SDv2 cards are switched to high speed mode (50MHz) only when
+   MMC_SCLK_MAX is above the 25MHz of the default mode. */
+#ifndef MMC_SCLK_SLOW
+#define MMC_SCLK_SLOW	400000UL	/* Clock during initialization (100k-400k) */
+#endif
+#ifndef MMC_SCLK_MAX
+#define MMC_SCLK_MAX	25000000UL	/* Highest clock of the board (at most PCLK_SSP1/2) */
+#endif
+#define MMC_SCLK_SAFE	10000000UL	/* Clock when the CSD can't be read */
+
+#define	FCLK_SLOW()	SSP_SetClock(SSPx, MMC_SCLK_SLOW)	/* Set slow clock (100k-400k) */
+#define	FCLK_FAST()	SSP_SetClock(SSPx, SpiClock)		/* Set fast clock (depends on the CSD) */
 
 
 /*--------------------------------------------------------------------------
@@ -57,62 +77,114 @@ BYTE Timer1, Timer2;	/* 100Hz decrement timer */
 static
 BYTE CardType;			/* Card type flags */
 
-static void SSPSend(uint8_t *buf, uint32_t Length)
-{
-  SSP_DATA_SETUP_Type xferConfig;
+static
+DWORD SpiClock = MMC_SCLK_SAFE;	/* Fast SPI clock */
 
-  xferConfig.tx_data = buf;
-  xferConfig.rx_data = NULL;
-  xferConfig.length  = Length;
+static volatile
+uint32_t DmaStat;		/* GPDMA_STAT_INTTC/INTERR of the last transfer, 0 while busy */
 
-  SSP_ReadWrite(LPC_SSP1, &xferConfig, SSP_TRANSFER_POLLING);
-}
+static
+BYTE DmaDummy;			/* 0xFF source for reads, sink for writes */
 
-void SSPReceive( uint8_t *buf, uint32_t Length )
-{
-  SSP_DATA_SETUP_Type xferConfig;
 
-  xferConfig.tx_data = NULL;
-  xferConfig.rx_data = buf;
-  xferConfig.length  = Length;
+/*-----------------------------------------------------------------------*/
+/* Exchange a byte with MMC via SPI  (Platform dependent)                */
+/*-----------------------------------------------------------------------*/
 
-  SSP_ReadWrite(LPC_SSP1, &xferConfig, SSP_TRANSFER_POLLING);
+static
+BYTE xchg_spi (BYTE dat)
+{
+  SSPx->DR = dat;
+  while (!(SSPx->SR & SSP_SR_RNE)) ;
+  return (BYTE)SSPx->DR;
 }
 
+#define xmit_spi(dat)	xchg_spi(dat)
+#define rcvr_spi()		xchg_spi(0xFF)
+
+
 
 /*-----------------------------------------------------------------------*/
-/* Transmit a byte to MMC via SPI  (Platform dependent)                  */
+/* GPDMA transfer complete callbacks  (Platform dependent)               */
 /*-----------------------------------------------------------------------*/
 
-//#define xmit_spi(dat) (SSPSend((uint8_t*)&(dat), 1))
-static void xmit_spi(BYTE dat)
+static
+void dma_rx_done (uint32_t status)
+{
+  DmaStat = status;		/* All bytes are in once the receive channel is done */
+}
+
+static
+void dma_tx_done (uint32_t status)
 {
-  SSPSend((uint8_t*) &dat, 1);
+  if (status == GPDMA_STAT_INTERR) DmaStat = status;
 }
 
 
+
 /*-----------------------------------------------------------------------*/
-/* Receive a byte from MMC via SPI  (Platform dependent)                 */
+/* Exchange a block with MMC via SPI and GPDMA  (Platform dependent)     */
 /*-----------------------------------------------------------------------*/
+/* The CPU sleeps until the receive channel is done. Buffers must be in  */
+/* RAM the GPDMA can reach.                                              */
 
 static
-BYTE rcvr_spi (void)
+BOOL xchg_spi_dma (
+    const BYTE *tx,		/* Data to send, NULL to send 0xFF */
+    BYTE *rx,			/* Buffer for received data, NULL to discard it */
+    UINT len			/* Byte count (1..4095) */
+)
 {
-  BYTE data = 0;
+  GPDMA_Channel_CFG_Type cfg;
+
+
+  DmaDummy = 0xFF;
+  DmaStat = 0;
+
+  cfg.ChannelNum = DMA_CH_RX;
+  cfg.TransferSize = len;
+  cfg.TransferWidth = 0;
+  cfg.SrcMemAddr = 0;
+  cfg.DstMemAddr = (uint32_t)(rx ? rx : &DmaDummy);
+  cfg.TransferType = GPDMA_TRANSFERTYPE_P2M;
+  cfg.SrcConn = GPDMA_CONN_SSP1_Rx;
+  cfg.DstConn = 0;
+  cfg.DMALLI = 0;
+  if (GPDMA_Setup(&cfg, dma_rx_done) != SUCCESS) return FALSE;
+  if (!rx) LPC_GPDMACH0->DMACCControl &= ~GPDMA_DMACCxControl_DI;
+
+  cfg.ChannelNum = DMA_CH_TX;
+  cfg.SrcMemAddr = (uint32_t)(tx ? tx : &DmaDummy);
+  cfg.DstMemAddr = 0;
+  cfg.TransferType = GPDMA_TRANSFERTYPE_M2P;
+  cfg.SrcConn = 0;
+  cfg.DstConn = GPDMA_CONN_SSP1_Tx;
+  if (GPDMA_Setup(&cfg, dma_tx_done) != SUCCESS) return FALSE;
+  if (!tx) LPC_GPDMACH1->DMACCControl &= ~GPDMA_DMACCxControl_SI;
+
+  GPDMA_ChannelCmd(DMA_CH_RX, ENABLE);
+  GPDMA_ChannelCmd(DMA_CH_TX, ENABLE);
+
+  Timer1 = 10;					/* Wait for the transfer in timeout of 100ms */
+  __disable_irq();
+  while (!DmaStat && Timer1) {
+    __WFI();					/* A pending interrupt wakes up the core even when masked */
+    __enable_irq();
+    __disable_irq();
+  }
+  __enable_irq();
 
-  SSPReceive(&data, 1);
+  if (DmaStat != GPDMA_STAT_INTTC) {	/* Timeout or bus error */
+    GPDMA_ChannelCmd(DMA_CH_TX, DISABLE);
+    GPDMA_ChannelCmd(DMA_CH_RX, DISABLE);
+    while (SSPx->SR & SSP_SR_BSY) ;
+    while (SSPx->SR & SSP_SR_RNE) (void)SSPx->DR;	/* Purge the receive FIFO */
+    return FALSE;
+  }
 
-  return data;
+  return TRUE;
 }
 
-/* Alternative macro to receive data fast */
-
-#define rcvr_spi_m(dst) \
-    do { \
-      SSPReceive((uint8_t*)(dst), 1); \
-    } while(0)
-
-
 
 
 /*-----------------------------------------------------------------------*/
@@ -211,12 +283,8 @@ BOOL rcvr_datablock (
   } while ((token == 0xFF) && Timer1);
   if(token != 0xFE) return FALSE;	/* If not valid data token, retutn with error */
 
-  do {							/* Receive the data block into buffer */
-    rcvr_spi_m(buff++);
-    rcvr_spi_m(buff++);
-    rcvr_spi_m(buff++);
-    rcvr_spi_m(buff++);
-  } while (btr -= 4);
+  if (!xchg_spi_dma(0, buff, btr))	/* Receive the data block into buffer */
+    return FALSE;
   rcvr_spi();						/* Discard CRC */
   rcvr_spi();
 
@@ -236,18 +304,15 @@ BOOL xmit_datablock (
     BYTE token			/* Data/Stop token */
 )
 {
-  BYTE resp, wc;
+  BYTE resp;
 
 
   if (wait_ready() != 0xFF) return FALSE;
 
   xmit_spi(token);					/* Xmit data token */
   if (token != 0xFD) {	/* Is data token */
-    wc = 0;
-    do {							/* Xmit the 512 byte data block to MMC */
-      xmit_spi(*buff++);
-      xmit_spi(*buff++);
-    } while (--wc);
+    if (!xchg_spi_dma(buff, 0, 512))	/* Xmit the 512 byte data block to MMC */
+      return FALSE;
     xmit_spi(0xFF);					/* CRC (Dummy) */
     xmit_spi(0xFF);
     resp = rcvr_spi();				/* Reveive data response */
@@ -307,6 +372,46 @@ BYTE send_cmd (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Get the SPI clock for data transfers                                  */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD get_clock (void)
+{
+  static const BYTE tv[16] = {	/* TRAN_SPEED time value x10 */
+    0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
+  };
+  static const DWORD tu[4] = {	/* TRAN_SPEED rate unit / 10 */
+    10000, 100000, 1000000, 10000000
+  };
+  BYTE buf[64];
+  DWORD clk = MMC_SCLK_SAFE;
+
+
+#if MMC_SCLK_MAX > 25000000UL
+  if (CardType & CT_SD2) {	/* Switch to high speed mode (function 1 of group 1) */
+    if (send_cmd(CMD6, 0x80FFFFF1) == 0 && rcvr_datablock(buf, 64)) {
+      rcvr_spi();				/* The switch completes within 8 clocks */
+    }
+    deselect();
+  }
+#endif
+
+  /* TRAN_SPEED tells 50MHz (0x5A) once the card is in high speed mode */
+  if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(buf, 16)) {
+    if ((buf[3] & 7) < 4 && tv[(buf[3] >> 3) & 15])
+      clk = tu[buf[3] & 7] * tv[(buf[3] >> 3) & 15];
+  }
+  deselect();
+
+  if (clk > MMC_SCLK_MAX) clk = MMC_SCLK_MAX;
+
+  return clk;
+}
+
+
+
 /*--------------------------------------------------------------------------
 
    Public Functions
@@ -318,7 +423,7 @@ BYTE send_cmd (
 /* Initialize Disk Drive                                                 */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_initialize (
+DSTATUS mmc_disk_initialize (
     BYTE drv		/* Physical drive nmuber (0) */
 )
 {
@@ -331,6 +436,10 @@ DSTATUS disk_initialize (
   if (drv) return STA_NOINIT;			/* Supports only single drive */
   if (Stat & STA_NODISK) return Stat;	/* No card in the socket */
 
+  GPDMA_Init();						/* Data blocks are moved by GPDMA */
+  NVIC_EnableIRQ(DMA_IRQn);
+  SSPx->DMACR = SSP_DMA_RXDMA_EN | SSP_DMA_TXDMA_EN;
+
   power_on();							/* Force socket power on */
   FCLK_SLOW();
   for (n = 10; n; n--) rcvr_spi();	/* 80 dummy clocks */
@@ -363,6 +472,7 @@ DSTATUS disk_initialize (
 
   if (ty) {			/* Initialization succeded */
     Stat &= ~STA_NOINIT;		/* Clear STA_NOINIT */
+    SpiClock = get_clock();
     FCLK_FAST();
   } else {			/* Initialization failed */
     power_off();
@@ -377,7 +487,7 @@ DSTATUS disk_initialize (
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
 
-DSTATUS disk_status (
+DSTATUS mmc_disk_status (
     BYTE drv		/* Physical drive nmuber (0) */
 )
 {
@@ -391,7 +501,7 @@ DSTATUS disk_status (
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
+DRESULT mmc_disk_read (
     BYTE drv,			/* Physical drive nmuber (0) */
     BYTE *buff,			/* Pointer to the data buffer to store read data */
     DWORD sector,		/* Start sector number (LBA) */
@@ -429,7 +539,7 @@ DRESULT disk_read (
 /*-----------------------------------------------------------------------*/
 
 #if _READONLY == 0
-DRESULT disk_write (
+DRESULT mmc_disk_write (
     BYTE drv,			/* Physical drive nmuber (0) */
     const BYTE *buff,	/* Pointer to the data to be written */
     DWORD sector,		/* Start sector number (LBA) */
@@ -471,7 +581,7 @@ DRESULT disk_write (
 /*-----------------------------------------------------------------------*/
 
 #if _USE_IOCTL != 0
-DRESULT disk_ioctl (
+DRESULT mmc_disk_ioctl (
     BYTE drv,		/* Physical drive nmuber (0) */
     BYTE ctrl,		/* Control code */
     void *buff		/* Buffer to send/receive control data */
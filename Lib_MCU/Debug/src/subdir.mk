@@ -9,6 +9,7 @@ C_SRCS += \
 ../src/lpc17xx_clkpwr.c \
 ../src/lpc17xx_dac.c \
 ../src/lpc17xx_emac.c \
+../src/lpc17xx_gpdma.c \
 ../src/lpc17xx_gpio.c \
 ../src/lpc17xx_i2c.c \
 ../src/lpc17xx_i2s.c \
@@ -32,6 +33,7 @@ OBJS += \
 ./src/lpc17xx_clkpwr.o \
 ./src/lpc17xx_dac.o \
 ./src/lpc17xx_emac.o \
+./src/lpc17xx_gpdma.o \
 ./src/lpc17xx_gpio.o \
 ./src/lpc17xx_i2c.o \
 ./src/lpc17xx_i2s.o \
@@ -55,6 +57,7 @@ C_DEPS += \
 ./src/lpc17xx_clkpwr.d \
 ./src/lpc17xx_dac.d \
 ./src/lpc17xx_emac.d \
+./src/lpc17xx_gpdma.d \
 ./src/lpc17xx_gpio.d \
 ./src/lpc17xx_i2c.d \
 ./src/lpc17xx_i2s.d \
@@ -1352,7 +1352,7 @@ Status CAN_SendMsg (LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg)
 	CHECK_PARAM(PARAM_FRAME_TYPE(CAN_Msg->type));
 
 	//Check status of Transmit Buffer 1
-	if ((CANx->SR & 0x00000004)>>2)
+	if (CANx->SR & CAN_SR_TBS1)
 	{
 		/* Transmit Channel 1 is available */
 		/* Write frame informations and frame data into its CANxTFI1,
@@ -1396,7 +1396,7 @@ Status CAN_SendMsg (LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg)
 		 return SUCCESS;
 	}
 	//check status of Transmit Buffer 2
-	else if((CANx->SR & 0x00000004)>>10)
+	else if (CANx->SR & CAN_SR_TBS2)
 	{
 		/* Transmit Channel 2 is available */
 		/* Write frame informations and frame data into its CANxTFI2,
@@ -1440,7 +1440,7 @@ Status CAN_SendMsg (LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg)
 		return SUCCESS;
 	}
 	//check status of Transmit Buffer 3
-	else if ((CANx->SR & 0x00000004)>>18)
+	else if (CANx->SR & CAN_SR_TBS3)
 	{
 		/* Transmit Channel 3 is available */
 		/* Write frame informations and frame data into its CANxTFI3,
@@ -1537,16 +1537,11 @@ Status CAN_ReceiveMsg (LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg)
 			*((uint8_t *) &CAN_Msg->dataB[1])= (data & 0x0000FF00)>>8;
 			*((uint8_t *) &CAN_Msg->dataB[2])= (data & 0x00FF0000)>>16;
 			*((uint8_t *) &CAN_Msg->dataB[3])= (data & 0xFF000000)>>24;
+		}
+		/* A Remote Frame has no data, only the message information is read */
 
 		/*release receive buffer*/
 		CANx->CMR = 0x04;
-		}
-		else
-		{
-			/* Received Frame is a Remote Frame, not have data, we just receive
-			 * message information only */
-			return SUCCESS;
-		}
 	}
 	else
 	{
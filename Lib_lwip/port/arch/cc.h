@@ -52,7 +52,8 @@ typedef unsigned long mem_ptr_t;
 #include <stdlib.h>
 #include "eadebug.h"
 /* Plaform specific diagnostic output */
-#define LWIP_PLATFORM_DIAG(x) do {dbg("%8d: ", time_get());/*dbg("%s:%d\r\n", __FILE__, __LINE__);*/ dbg x; /*dbg("\r\n")*/}while(0)
+/* dbg records are time stamped, see dlog.h */
+#define LWIP_PLATFORM_DIAG(x) do {/*dbg("%s:%d\r\n", __FILE__, __LINE__);*/ dbg x; /*dbg("\r\n")*/}while(0)
 
 #define LWIP_PLATFORM_ASSERT(x) do {dbg("Assertion \"%s\" failed at line %d in %s\r\n", x, __LINE__, __FILE__);} while(0)
 
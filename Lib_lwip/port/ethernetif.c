@@ -56,7 +56,6 @@
 
 
 #include "lpc17xx_emac.h"
-#include "lpc17xx_timer.h"
 
 /* Define those to better describe your network interface. */
 #define IFNAME0 'e'
@@ -64,6 +63,85 @@
 
 #define LINK_CHECK_MS (2000)
 
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "ethernetif.c needs custom pbufs (IP_FRAG in lwipopts.h)"
+#endif
+
+#if USE_AHB_BANK0
+#error "ethernetif.c keeps the lwIP heap in AHB SRAM bank 0"
+#endif
+
+/*
+ * The EMAC can only reach the AHB SRAM. The descriptors, status words and
+ * receive buffers are laid out from RX_DESC_BASE (bank 1) in the same way
+ * as lpc17xx_emac.c does it, but with the ring sizes from lwipopts.h.
+ * Received frames are handed to lwIP in their DMA buffer as custom pbufs,
+ * so there is one buffer more than descriptors for each frame lwIP may
+ * hold while the ring is still kept full.
+ */
+#define ETH_RXD_BASE    RX_DESC_BASE
+#define ETH_RXS_BASE    (ETH_RXD_BASE + ETH_NUM_RX_DESC*8)
+#define ETH_TXD_BASE    (ETH_RXS_BASE + ETH_NUM_RX_DESC*8)
+#define ETH_TXS_BASE    (ETH_TXD_BASE + ETH_NUM_TX_DESC*8)
+#define ETH_RXBUF_BASE  (ETH_TXS_BASE + ETH_NUM_TX_DESC*4)
+#define ETH_RAM_END     (ETH_RXBUF_BASE + ETH_NUM_RX_BUF*EMAC_ETH_MAX_FLEN)
+
+#define ETH_RX_PACKET(i)  (*(volatile u32_t *)(ETH_RXD_BASE   + 8*(i)))
+#define ETH_RX_CTRL(i)    (*(volatile u32_t *)(ETH_RXD_BASE+4 + 8*(i)))
+#define ETH_RX_INFO(i)    (*(volatile u32_t *)(ETH_RXS_BASE   + 8*(i)))
+#define ETH_RX_HASHCRC(i) (*(volatile u32_t *)(ETH_RXS_BASE+4 + 8*(i)))
+#define ETH_TX_PACKET(i)  (*(volatile u32_t *)(ETH_TXD_BASE   + 8*(i)))
+#define ETH_TX_CTRL(i)    (*(volatile u32_t *)(ETH_TXD_BASE+4 + 8*(i)))
+#define ETH_TX_INFO(i)    (*(volatile u32_t *)(ETH_TXS_BASE   + 4*(i)))
+
+/* AHB SRAM, the memory the EMAC DMA can read */
+#define ETH_AHB_START   0x2007C000UL
+#define ETH_AHB_END     0x20084000UL
+
+#if ETH_NUM_RX_BUF <= ETH_NUM_RX_DESC
+#error "ETH_NUM_RX_BUF must be larger than ETH_NUM_RX_DESC"
+#endif
+#if ETH_NUM_TX_DESC < 2
+#error "ETH_NUM_TX_DESC must be at least 2"
+#endif
+#if ETH_RAM_END > ETH_AHB_END
+#error "EMAC descriptors and receive buffers do not fit in AHB SRAM bank 1"
+#endif
+
+/* frame check sequence, counted in the received size */
+#define ETH_FCS_LEN     4
+
+/* receive status bits of frames that are dropped */
+#define ETH_RINFO_DROP  (EMAC_RINFO_CRC_ERR | EMAC_RINFO_SYM_ERR | \
+                         EMAC_RINFO_ALIGN_ERR | EMAC_RINFO_OVERRUN | \
+                         EMAC_RINFO_NO_DESCR)
+
+/** A receive buffer, passed to lwIP as a custom pbuf */
+struct eth_rxbuf {
+  struct pbuf_custom pc;      /* must be first */
+  struct eth_rxbuf *next;     /* free list */
+  u8_t *data;                 /* EMAC_ETH_MAX_FLEN bytes in AHB SRAM */
+};
+
+/*
+ * The lwIP heap lives in AHB SRAM bank 0 (see LWIP_RAM_HEAP_POINTER in
+ * lwipopts.h) so that PBUF_RAM pbufs can be sent without a copy. The
+ * sizing matches mem.c, with room for a struct mem of up to 16 bytes.
+ */
+u8_t lwip_ram_heap[LWIP_MEM_ALIGN_SIZE(MEM_SIZE) + 2*LWIP_MEM_ALIGN_SIZE(16) +
+                   MEM_ALIGNMENT] __attribute__ ((section(".bss.$RamAHB32")));
+
+static struct eth_rxbuf rxBufs[ETH_NUM_RX_BUF];
+/* buffer owned by each receive descriptor */
+static struct eth_rxbuf *rxDescBuf[ETH_NUM_RX_DESC];
+/* buffers neither in the ring nor held by lwIP */
+static struct eth_rxbuf *rxFree = NULL;
+
+/* frame to release when the descriptor has been sent, at its last one */
+static struct pbuf *txPbuf[ETH_NUM_TX_DESC];
+/* next transmit descriptor to reclaim */
+static u32_t txDone = 0;
+
 static u32_t lastLinkCheck = 0;
 
 // only supports one interface
@@ -75,6 +153,96 @@ struct netif *eth0Netif = NULL;
 /* Forward declarations. */
 static void  ethernetif_input(struct netif *netif);
 
+/**
+ * Returns a receive buffer to the free list once lwIP is done with it.
+ *
+ * @param p the custom pbuf of the buffer
+ */
+static void
+rx_buf_free(struct pbuf *p)
+{
+  struct eth_rxbuf *b = (struct eth_rxbuf *)p;
+
+  b->next = rxFree;
+  rxFree = b;
+}
+
+/**
+ * Fills the receive ring with buffers and hands it to the EMAC.
+ */
+static void
+rx_init(void)
+{
+  u32_t i;
+
+  rxFree = NULL;
+  for (i = 0; i < ETH_NUM_RX_BUF; i++) {
+    rxBufs[i].pc.custom_free_function = rx_buf_free;
+    rxBufs[i].data = (u8_t *)(ETH_RXBUF_BASE + i*EMAC_ETH_MAX_FLEN);
+    if (i < ETH_NUM_RX_DESC) {
+      rxDescBuf[i] = &rxBufs[i];
+    } else {
+      rxBufs[i].next = rxFree;
+      rxFree = &rxBufs[i];
+    }
+  }
+
+  for (i = 0; i < ETH_NUM_RX_DESC; i++) {
+    ETH_RX_PACKET(i) = (u32_t)rxDescBuf[i]->data + ETH_PAD_SIZE;
+    ETH_RX_CTRL(i) = EMAC_RCTRL_INT | (EMAC_ETH_MAX_FLEN - ETH_PAD_SIZE - 1);
+    ETH_RX_INFO(i) = 0;
+    ETH_RX_HASHCRC(i) = 0;
+  }
+
+  LPC_EMAC->RxDescriptor = ETH_RXD_BASE;
+  LPC_EMAC->RxStatus = ETH_RXS_BASE;
+  LPC_EMAC->RxDescriptorNumber = ETH_NUM_RX_DESC - 1;
+}
+
+/**
+ * Hands the empty transmit ring to the EMAC.
+ */
+static void
+tx_init(void)
+{
+  u32_t i;
+
+  for (i = 0; i < ETH_NUM_TX_DESC; i++) {
+    ETH_TX_PACKET(i) = 0;
+    ETH_TX_CTRL(i) = 0;
+    ETH_TX_INFO(i) = 0;
+    txPbuf[i] = NULL;
+  }
+  txDone = 0;
+
+  LPC_EMAC->TxDescriptor = ETH_TXD_BASE;
+  LPC_EMAC->TxStatus = ETH_TXS_BASE;
+  LPC_EMAC->TxDescriptorNumber = ETH_NUM_TX_DESC - 1;
+}
+
+/**
+ * Releases the frames the EMAC has sent.
+ *
+ * @return number of free transmit descriptors
+ */
+static u32_t
+tx_reclaim(void)
+{
+  u32_t ci = LPC_EMAC->TxConsumeIndex;
+
+  while (txDone != ci) {
+    if (txPbuf[txDone] != NULL) {
+      pbuf_free(txPbuf[txDone]);
+      txPbuf[txDone] = NULL;
+    }
+    txDone = (txDone + 1) % ETH_NUM_TX_DESC;
+  }
+
+  /* one descriptor is always left unused to tell a full ring from empty */
+  return (txDone + ETH_NUM_TX_DESC - LPC_EMAC->TxProduceIndex - 1) %
+    ETH_NUM_TX_DESC;
+}
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -115,6 +283,24 @@ low_level_init(struct netif *netif)
     return ERR_IF;
   }
 
+  /*
+   * EMAC_Init sets up its own copying rings. Stop the datapaths and
+   * replace them with the rings of this driver.
+   */
+  LPC_EMAC->MAC1 &= ~EMAC_MAC1_REC_EN;
+  LPC_EMAC->Command &= ~(EMAC_CR_RX_EN | EMAC_CR_TX_EN);
+
+  rx_init();
+  tx_init();
+
+  /* resetting the datapaths clears the produce indexes */
+  LPC_EMAC->Command |= (EMAC_CR_RX_RES | EMAC_CR_TX_RES);
+  LPC_EMAC->RxConsumeIndex = 0;
+  LPC_EMAC->TxProduceIndex = 0;
+
+  LPC_EMAC->Command |= (EMAC_CR_RX_EN | EMAC_CR_TX_EN);
+  LPC_EMAC->MAC1 |= EMAC_MAC1_REC_EN;
+
   if (status == EMAC_SUCCESS) {
     netif_set_link_up(netif);
   }
@@ -127,6 +313,11 @@ low_level_init(struct netif *netif)
  * contained in the pbuf that is passed to the function. This pbuf
  * might be chained.
  *
+ * Each pbuf of the chain gets its own descriptor and the frame is held
+ * with pbuf_ref() until the EMAC has sent it. Frames with data outside
+ * AHB SRAM (pool pbufs, ROM or REF data) or with more pbufs than the ring
+ * has descriptors are copied to a single PBUF_RAM pbuf first.
+ *
  * @param netif the lwip network interface structure for this ethernetif
  * @param p the MAC packet to send (e.g. IP packet including MAC addresses and type)
  * @return ERR_OK if the packet could be sent
@@ -140,71 +331,73 @@ low_level_init(struct netif *netif)
 static err_t
 low_level_output(struct netif *netif, struct pbuf *p)
 {
-  struct pbuf *q;
-  u8_t* dst;
-  u32_t idx, sz = 0;
+  struct pbuf *q, *f;
+  u32_t idx, n = 0, start;
+  u8_t copy = 0;
 
-
-  if (EMAC_CheckTransmitIndex() == FALSE) {
-    return ERR_IF;
-  }
-
-  
 #if ETH_PAD_SIZE
   pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
 #endif
 
-  idx = LPC_EMAC->TxProduceIndex;
-  dst  = (u8_t*)TX_DESC_PACKET(idx);
-
   for(q = p; q != NULL; q = q->next) {
-    MEMCPY(dst, (u8_t*) q->payload, q->len);
-    dst += q->len;
-    sz += q->len;
+    if (q->len == 0) {
+      continue;
+    }
+    if (q->type == PBUF_ROM || q->type == PBUF_REF ||
+        (u32_t)q->payload < ETH_AHB_START ||
+        (u32_t)q->payload + q->len > ETH_AHB_END) {
+      copy = 1;
+    }
+    n++;
   }
 
-  TX_DESC_CTRL(idx) = (sz - 1) | (EMAC_TCTRL_INT | EMAC_TCTRL_LAST);
-  EMAC_UpdateTxProduceIndex();
+  if (copy || n > ETH_NUM_TX_DESC - 1) {
+    f = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+    if (f == NULL) {
+#if ETH_PAD_SIZE
+      pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      return ERR_MEM;
+    }
+    pbuf_copy(f, p);
+    n = 1;
+  } else {
+    f = p;
+    pbuf_ref(f);
+  }
 
-  /*
-   * TODO: Investigate why this delay is needed. Without it a large file
-   * transfer takes significantly longer time.
-   *
-   * Below is a part of a network capture. One can clearly see that without
-   * a delay the transfer is driven by the ACKs which come at about 200 ms
-   * delays (Delayed ACK?). With a delay, two data packets are usually sent
-   * before an ACK is received and as seen at the end of the excerpt there
-   * is no long delay between the sent data and received ACK.
-   *
-   * Are outgoing packets discarded by the EMAC when there isn't a delay
-   * meaning that they will be retransmitted by TCP protocol?
-   *
-   * Without delay                 With delay
-   * --------------------          -------------------
-   * > 0.000 GET request           > 0.000 GET request
-   * < 0.080 1460 b data           < 0.009 1460 b data
-   * > 0.273 TCP ACK               > 0.287 TCP ACK
-   * < 0.274 1460 b data           < 0.314 1460 b data
-   * > 0.474 TCP ACK               < 0.316 1318 b data
-   * < 0.499 1460 b data           > 0.316 TCP ACK
-   * > 0.693 TCP ACK               < 0.318 1460 b data
-   * < 0.694 1460 b data           > 0.517 TCP ACK
-   * > 0.894 TCP ACK               < 0.546 1460 b data
-   * < 0.921 1460 b data           < 0.547 142 b data
-   * > 1.103 TCP ACK               > 0.547 TCP ACK
-   * < 1.104 1460 b data           < 0.549 1460 b data
-   * > 1.313 TCP ACK               > 0.747 TCP ACK
-   * < 1.336 1460 b data           < 0.771 1460 b data
-   * > 1.533 TCP ACK               < 0.772 1460 b data
-   * < 1.534 1460 b data           > 0.772 TCP ACK
-   * > 1.733 TCP ACK               < 0.802 1460 b data
-   * < 1.762 1460 b data           < 0.803 1460 b data
-   * > 1.953 TCP ACK               > 0.804 TCP ACK
-   * ...
-   * ...
-   */
-  Timer0_Wait(1);
+  /* wait for the EMAC to free enough descriptors */
+  start = sys_now();
+  while (tx_reclaim() < n) {
+    if (sys_now() - start > ETH_TX_WAIT_MS) {
+#if ETH_PAD_SIZE
+      pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+      pbuf_free(f);
+      LINK_STATS_INC(link.drop);
+      return ERR_IF;
+    }
+  }
+
+  idx = LPC_EMAC->TxProduceIndex;
+  for(q = f; q != NULL; q = q->next) {
+    if (q->len == 0) {
+      continue;
+    }
+    ETH_TX_PACKET(idx) = (u32_t)q->payload;
+    if (--n == 0) {
+      ETH_TX_CTRL(idx) = (q->len - 1) | (EMAC_TCTRL_INT | EMAC_TCTRL_LAST);
+      txPbuf[idx] = f;
+    } else {
+      ETH_TX_CTRL(idx) = q->len - 1;
+    }
+    idx = (idx + 1) % ETH_NUM_TX_DESC;
+  }
+  LPC_EMAC->TxProduceIndex = idx;
 
+  /* the descriptors of a zero-copy frame point past the padding word */
 #if ETH_PAD_SIZE
   pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
 #endif
@@ -215,71 +408,56 @@ low_level_output(struct netif *netif, struct pbuf *p)
 }
 
 /**
- * Should allocate a pbuf and transfer the bytes of the incoming
- * packet from the interface into the pbuf.
+ * Takes the next received frame from the ring. The frame is passed on in
+ * its DMA buffer and a free buffer takes its place in the descriptor. If
+ * no buffer is free or the frame is bad it is dropped and the descriptor
+ * keeps its buffer.
  *
  * @param netif the lwip network interface structure for this ethernetif
  * @return a pbuf filled with the received packet (including MAC header)
- *         NULL on memory error
+ *         NULL if there is no packet
  */
 static struct pbuf *
 low_level_input(struct netif *netif)
 {
-  struct pbuf *p, *q;
-  u16_t len;
-  EMAC_PACKETBUF_Type RxPack;
-
-  if (EMAC_CheckReceiveIndex() == FALSE){
-    return (NULL);
-  }
-
-  /* Obtain the size of the packet and put it into the "len"
-     variable. */
-  len = EMAC_GetReceiveDataSize();
-
-#if ETH_PAD_SIZE
-  len += ETH_PAD_SIZE; /* allow room for Ethernet padding */
-#endif
-
-  /* We allocate a pbuf chain of pbufs from the pool. */
-  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
-  
-  if (p != NULL) {
-
-#if ETH_PAD_SIZE
-    pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
-#endif
-
-    /* We iterate over the pbuf chain until we have read the entire
-     * packet into the pbuf. */
-    for(q = p; q != NULL; q = q->next) {
-      /* Read enough bytes to fill this pbuf in the chain. The
-       * available data in the pbuf is given by the q->len
-       * variable.
-       * This does not necessarily have to be a memcpy, you can also preallocate
-       * pbufs for a DMA-enabled MAC and after receiving truncate it to the
-       * actually received size. In this case, ensure the tot_len member of the
-       * pbuf is the sum of the chained pbuf len members.
+  struct pbuf *p = NULL;
+  struct eth_rxbuf *b;
+  u32_t idx, info, len;
+
+  while (p == NULL && EMAC_CheckReceiveIndex() == TRUE) {
+    idx = LPC_EMAC->RxConsumeIndex;
+    info = ETH_RX_INFO(idx);
+    /* the size is stored minus one and includes the FCS */
+    len = (info & EMAC_RINFO_SIZE) + 1;
+
+    if ((info & ETH_RINFO_DROP) || !(info & EMAC_RINFO_LAST_FLAG) ||
+        len < SIZEOF_ETH_HDR - ETH_PAD_SIZE + ETH_FCS_LEN) {
+      LINK_STATS_INC(link.err);
+      LINK_STATS_INC(link.drop);
+    } else if (rxFree == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+    } else {
+      b = rxDescBuf[idx];
+      len = len - ETH_FCS_LEN + ETH_PAD_SIZE;
+      /*
+       * pbuf_alloced_custom() of lwIP 1.4.0 refuses buffers larger than
+       * the frame, so only the used part of the buffer is given.
        */
-
-      RxPack.pbDataBuf = (uint32_t *)q->payload;
-      RxPack.ulDataLen = q->len;
-      EMAC_ReadPacketBuffer(&RxPack);
-
+      p = pbuf_alloced_custom(PBUF_RAW, (u16_t)len, PBUF_REF, &b->pc,
+                              b->data, (u16_t)len);
+      if (p != NULL) {
+        rxDescBuf[idx] = rxFree;
+        rxFree = rxFree->next;
+        ETH_RX_PACKET(idx) = (u32_t)rxDescBuf[idx]->data + ETH_PAD_SIZE;
+        LINK_STATS_INC(link.recv);
+      } else {
+        LINK_STATS_INC(link.memerr);
+        LINK_STATS_INC(link.drop);
+      }
     }
-    //acknowledge that packet has been read();
-    EMAC_UpdateRxConsumeIndex();
-
-#if ETH_PAD_SIZE
-    pbuf_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
-#endif
 
-    LINK_STATS_INC(link.recv);
-  } else {
-    //drop packet();
-    EMAC_UpdateRxConsumeIndex();
-    LINK_STATS_INC(link.memerr);
-    LINK_STATS_INC(link.drop);
+    LPC_EMAC->RxConsumeIndex = (idx + 1) % ETH_NUM_RX_DESC;
   }
 
   return p;  
@@ -377,6 +555,8 @@ void ethernetif_poll(void)
     }
   }
 
+  tx_reclaim();
+
   sys_check_timeouts();
   if (netif_is_link_up(eth0Netif)) {
     ethernetif_input(eth0Netif);
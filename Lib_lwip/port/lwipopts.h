@@ -62,6 +62,13 @@
  */
 #define MEM_SIZE                        7300
 
+/**
+ * LWIP_RAM_HEAP_POINTER: the heap is placed in AHB SRAM by ethernetif.c,
+ * where the EMAC can send PBUF_RAM pbufs without copying them.
+ */
+extern unsigned char lwip_ram_heap[];
+#define LWIP_RAM_HEAP_POINTER           lwip_ram_heap
+
 /*
    ------------------------------------------------
    ---------- Internal Memory Pool Sizes ----------
@@ -208,8 +215,9 @@
  * IP_FRAG==1: Fragment outgoing IP packets if their size exceeds MTU. Note
  * that this option does not affect incoming packet sizes, which can be
  * controlled via IP_REASSEMBLY.
+ * Needed for the custom pbufs that carry received frames in ethernetif.c.
  */
-#define IP_FRAG                         0
+#define IP_FRAG                         1
 
 /**
  * IP_REASS_MAXAGE: Maximum time (in multiples of IP_TMR_INTERVAL - so seconds, normally)
@@ -411,6 +419,37 @@
  */
 #define PPP_SUPPORT                     0
 
+/*
+   -----------------------------------------
+   ---------- EMAC driver options ----------
+   -----------------------------------------
+*/
+/**
+ * ETH_NUM_RX_DESC: number of receive descriptors. Each one holds a receive
+ * buffer of EMAC_ETH_MAX_FLEN bytes.
+ */
+#define ETH_NUM_RX_DESC                 6
+
+/**
+ * ETH_NUM_RX_BUF: number of receive buffers. Frames are passed to lwIP in
+ * their buffer, the buffers above ETH_NUM_RX_DESC refill the descriptors
+ * while lwIP holds frames. The descriptors and buffers must fit in the
+ * 16K AHB SRAM bank of the EMAC.
+ */
+#define ETH_NUM_RX_BUF                  9
+
+/**
+ * ETH_NUM_TX_DESC: number of transmit descriptors, one is used for each
+ * pbuf of a frame.
+ */
+#define ETH_NUM_TX_DESC                 16
+
+/**
+ * ETH_TX_WAIT_MS: time to wait for free transmit descriptors before a
+ * frame is dropped.
+ */
+#define ETH_TX_WAIT_MS                  10
+
 
 /* Misc */
 
@@ -6,6 +6,8 @@
 C_SRCS += \
 ../src/AndroidAccessoryHost.c \
 ../src/GPIO.c \
+../src/aoaframe.c \
+../src/aoanode.c \
 ../src/cr_startup_lpc17.c \
 ../src/main.c \
 ../src/pwm.c \
@@ -14,6 +16,8 @@ C_SRCS += \
 OBJS += \
 ./src/AndroidAccessoryHost.o \
 ./src/GPIO.o \
+./src/aoaframe.o \
+./src/aoanode.o \
 ./src/cr_startup_lpc17.o \
 ./src/main.o \
 ./src/pwm.o \
@@ -22,6 +26,8 @@ OBJS += \
 C_DEPS += \
 ./src/AndroidAccessoryHost.d \
 ./src/GPIO.d \
+./src/aoaframe.d \
+./src/aoanode.d \
 ./src/cr_startup_lpc17.d \
 ./src/main.d \
 ./src/pwm.d \
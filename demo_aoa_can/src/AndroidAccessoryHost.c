@@ -42,6 +42,8 @@
 
 #include "AndroidAccessoryHost.h"
 
+#include <string.h>
+
 #include "lpc_types.h"
 #include "lpc17xx_uart.h"
 #include "lpc17xx_pinsel.h"
@@ -50,6 +52,10 @@
 
 #include "board.h"
 #include "canpt.h"
+#include "dlog.h"
+
+#include "aoaframe.h"
+#include "aoanode.h"
 
 #include "rgb.h"
 #include "btn.h"
@@ -63,7 +69,23 @@ static void nodeDetached(uint8_t reqId);
 static void valueUpdate(uint8_t reqId, uint8_t periphId, uint8_t* buf,
     uint8_t len);
 static void subStarted(uint8_t reqId, uint8_t subId);
-static void handleDeviceConnected(uint8_t attachedCoreNum);
+static void resendAttached(void* ctx, uint8_t nodeId, const uint8_t* caps,
+    uint8_t numCaps);
+static void resendValue(void* ctx, uint8_t nodeId, uint8_t periphId,
+    const uint8_t* value);
+struct aoa_session;
+static void handleDeviceConnected(struct aoa_session* s);
+static void flushSession(struct aoa_session* s);
+static void dispatchCommand(void* ctx, uint8_t cmd, const uint8_t* data,
+    uint8_t len);
+static void rxDone(uint32_t pipeHandle, HCD_STATUS status, uint16_t len,
+    void* context);
+static void receivePolled(struct aoa_session* s);
+static void clearInHalt(struct aoa_session* s);
+static void cmdSetValue(struct aoa_session* s, const uint8_t* data, uint8_t len);
+static void cmdGetCanStats(struct aoa_session* s, const uint8_t* data, uint8_t len);
+static void cmdConnect(struct aoa_session* s, const uint8_t* data, uint8_t len);
+static void cmdDisconnect(struct aoa_session* s, const uint8_t* data, uint8_t len);
 uint32_t getMsTicks(void);
 
 /******************************************************************************
@@ -77,34 +99,144 @@ uint32_t getMsTicks(void);
 #define CMD_NODE_ADD    (0)
 #define CMD_NODE_REMOVE (1)
 #define CMD_NODE_VALUE  (2)
+#define CMD_CAN_STATS   (3)
 
 /*
  * Message indexes for messages sent from the device
  */
 #define CMD_SET_VALUE   (10)
+#define CMD_GET_CAN_STATS (11)
 #define CMD_CONNECT     (98)
 #define CMD_DISCONNECT  (99)
 
-#define MAX_NUM_SUBSCRIPTIONS  (50)
+/*
+ * Subscriptions and the last value of every node peripheral (see
+ * aoanode.c) are kept for SUBS_HOLD_MS after the device has been
+ * detached. When a device connects the cached nodes are announced with
+ * their values right away, only nodes that aren't cached are subscribed.
+ */
+#define SUBS_HOLD_MS    (30000)
+
+// Max packet size of the full speed bulk pipes
+#define BULK_PACKET_SIZE (64)
+
+/*
+ * The state of the Android device is kept in a session. Messages to the
+ * device are collected and sent as one bulk transfer of length prefixed
+ * records (see aoaframe.c) when a full packet is waiting or when the
+ * oldest message has waited UPLINK_LATENCY_MS. While the previous
+ * transfer is still in progress messages are collected until full.
+ *
+ * One device is served, on the first USB core it is attached to. Devices
+ * attached to other cores are left alone.
+ */
+#define UPLINK_BUF_SIZE    (4 * BULK_PACKET_SIZE)
+#define UPLINK_LATENCY_MS  (10)
+
+// a transfer is written to the pipe buffer in one go
+#if (UPLINK_BUF_SIZE + 1) > PIPE_MAX_SIZE
+#error "UPLINK_BUF_SIZE must be less than PIPE_MAX_SIZE"
+#endif
+
+// aoa_session_t.corenum when no device is attached
+#define NO_CORE (0xFF)
+
+/*
+ * Messages from the device use the same record format. Received data is
+ * collected until a record is complete, the buffer holds the longest
+ * record plus one packet.
+ *
+ * DOWNLINK_XFERS packet sized IN transfers are kept queued in the host
+ * controller so the next packet is received while the task handles the
+ * previous one. With a host controller driver that can't queue transfers
+ * the pipe is polled instead.
+ *
+ * Records have no sync marker, but every transfer from the device starts
+ * with a record and ends with a short packet. After a failed IN transfer
+ * the packets up to the next short packet are dropped, and a record left
+ * incomplete at a short packet (a corrupt length) is dropped as well.
+ */
+#define DOWNLINK_BUF_SIZE  (AOAFRAME_RECORD_SIZE(AOAFRAME_MAX_DATA) + BULK_PACKET_SIZE)
+#define DOWNLINK_XFERS     (2)   // power of two
+
+// rx_xfer_t.state
+#define RX_IDLE   (0)
+#define RX_QUEUED (1)
+#define RX_DONE   (2)
+
+// command_t.len for commands with any amount of data
+#define CMD_LEN_ANY (0xFF)
 
 typedef struct
 {
-  uint8_t reqId;
-  uint8_t subId;
-} subscription_t;
+  uint32_t records;      // messages sent
+  uint32_t transfers;    // bulk transfers
+  uint32_t bytes;        // bytes sent, including record headers
+  uint32_t fullFlushes;  // transfers started because a packet was full
+  uint32_t timedFlushes; // transfers started by the latency deadline
+  uint32_t dropped;      // messages lost, buffer full and pipe busy
+} uplink_stats_t;
+
+typedef struct
+{
+  volatile uint8_t state;
+  volatile uint8_t status;
+  volatile uint16_t len;
+} rx_xfer_t;
+
+typedef struct aoa_session
+{
+  uint8_t corenum;       // core of the device or NO_CORE
+  uint8_t accessory;     // accessory mode device configured
+  uint8_t connected;     // CMD_CONNECT received
+  uint8_t doDisconnect;
+
+  uint8_t uplinkBuf[UPLINK_BUF_SIZE];
+  aoaframe_enc_t uplink;
+  uint8_t pending;       // messages waiting, 'deadline' is valid
+  uint32_t deadline;
+  uplink_stats_t stats;
+
+  uint8_t downlinkBuf[DOWNLINK_BUF_SIZE];
+  aoaframe_dec_t downlink;
+  rx_xfer_t rxXfers[DOWNLINK_XFERS];
+  uint8_t rxSubmit;
+  uint8_t rxComplete;
+  uint8_t rxPolled;      // transfers can't be queued, poll the pipe
+} aoa_session_t;
+
+typedef struct
+{
+  uint8_t cmd;
+  uint8_t len;   // required data length or CMD_LEN_ANY
+  void (*handler)(aoa_session_t* s, const uint8_t* data, uint8_t len);
+} command_t;
 
 
 /******************************************************************************
- * Local variables
+ * Local tables
  *****************************************************************************/
 
+/*
+ * Messages from the device
+ */
+static const command_t commands[] = {
+    {CMD_SET_VALUE,     4,           cmdSetValue},
+    {CMD_GET_CAN_STATS, CMD_LEN_ANY, cmdGetCanStats},
+    {CMD_CONNECT,       CMD_LEN_ANY, cmdConnect},
+    {CMD_DISCONNECT,    CMD_LEN_ANY, cmdDisconnect},
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+
+/******************************************************************************
+ * Local variables
+ *****************************************************************************/
 
-static uint8_t connected = 0;
-static uint8_t doDisconnect = 0;
-static uint32_t scheduleDisconnect = 0;
 
+static uint32_t holdExpires = 0;
 
-static uint8_t sbuf[250];
 
 static canpt_callb_t callbacks = {
     nodeAttached,
@@ -113,9 +245,15 @@ static canpt_callb_t callbacks = {
     subStarted
 };
 
-static subscription_t subs[MAX_NUM_SUBSCRIPTIONS];
+// announces cached nodes to a connecting device, see handleDeviceConnected
+static const aoanode_sink_t resendSink = {
+    resendAttached,
+    resendValue
+};
+
+static aoa_session_t session;
 
-static uint8_t attachedCoreNum = -1;
+static uint8_t rxPackets[DOWNLINK_XFERS][BULK_PACKET_SIZE] ATTR_ALIGNED(4) __DATA(USBRAM_SECTION);
 
 /******************************************************************************
  * Local functions
@@ -124,31 +262,178 @@ static uint8_t attachedCoreNum = -1;
 /******************************************************************************
  *
  * Description:
- *    Send a command/message to the attached Android device
+ *    A message has been queued for a device, send it when a packet is full
+ *    or start the latency deadline
+ *
+ *****************************************************************************/
+static void messageQueued(aoa_session_t* s)
+{
+  s->stats.records++;
+
+  if (!s->pending) {
+    s->pending = 1;
+    s->deadline = getMsTicks() + UPLINK_LATENCY_MS;
+  }
+
+  if (s->uplink.used >= BULK_PACKET_SIZE) {
+    s->stats.fullFlushes++;
+    flushSession(s);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send a command/message to an Android device. The message is queued
+ *    and sent together with other messages, see UPLINK_*.
  *
  * Params:
+ *    [in] s - session of the device
  *    [in] cmd - command
  *    [in] data - message data
  *    [in] len - length of data
  *
  *****************************************************************************/
-static void sendCommand(uint8_t corenum, uint8_t cmd, uint8_t* data, uint8_t len)
+static void sendCommand(aoa_session_t* s, uint8_t cmd, uint8_t* data, uint8_t len)
+{
+  if (!s->accessory || USB_HostState[s->corenum] != HOST_STATE_Configured)
+    return;
+
+  if (!aoaframe_put(&s->uplink, cmd, data, len)) {
+
+    // buffer full, make room if the pipe is free
+    flushSession(s);
+
+    if (!aoaframe_put(&s->uplink, cmd, data, len)) {
+      s->stats.dropped++;
+      return;
+    }
+  }
+
+  messageQueued(s);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send all messages waiting for a device as one bulk transfer. Nothing
+ *    is sent if the previous transfer is still in progress.
+ *
+ *****************************************************************************/
+static void flushSession(aoa_session_t* s)
 {
-  if (USB_HostState[corenum] != HOST_STATE_Configured)
+  uint8_t corenum = s->corenum;
+  uint8_t pad = 0;
+  uint16_t len = 0;
+
+  if (s->uplink.used == 0) {
+    s->pending = 0;
     return;
+  }
 
   /* Select the data OUT pipe */
   Pipe_SelectPipe(corenum, ANDROID_DATA_OUT_PIPE);
   Pipe_Unfreeze();
 
   if (Pipe_IsReadWriteAllowed(corenum)) {
-    Pipe_Write_8(corenum, cmd);
-    Pipe_Write_Stream_LE(corenum, data, len, NULL);
+    Pipe_Write_Stream_LE(corenum, s->uplink.buf, s->uplink.used, NULL);
+
+    // the device only sees the end of a transfer at a short packet
+    len = s->uplink.used;
+    if ((len % BULK_PACKET_SIZE) == 0) {
+      Pipe_Write_Stream_LE(corenum, &pad, 1, NULL);
+      len++;
+    }
+
     Pipe_ClearOUT(corenum);
+
+    s->stats.transfers++;
+    s->stats.bytes += len;
+
+    aoaframe_clear(&s->uplink);
+    s->pending = 0;
   }
 
   Pipe_Freeze();
+}
 
+/******************************************************************************
+ *
+ * Description:
+ *    Send waiting messages when the oldest one has waited long enough
+ *
+ *****************************************************************************/
+static void uplink_task(aoa_session_t* s)
+{
+  if (!s->pending || (int32_t)(getMsTicks() - s->deadline) < 0) {
+    return;
+  }
+
+  s->stats.timedFlushes++;
+  flushSession(s);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Write a 32-bit value little endian
+ *
+ *****************************************************************************/
+static uint8_t* putU32(uint8_t* p, uint32_t val)
+{
+  p[0] = val;
+  p[1] = val >> 8;
+  p[2] = val >> 16;
+  p[3] = val >> 24;
+
+  return p + 4;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send the statistics of both CAN controllers to a device,
+ *    one CMD_CAN_STATS message per controller: bus (0 = CAN1), state,
+ *    bus load, RXERR, TXERR, ALC, ECC followed by the counters of
+ *    can_stats_t as 32-bit little endian values
+ *
+ *****************************************************************************/
+static void sendCanStats(aoa_session_t* session)
+{
+  LPC_CAN_TypeDef* const ctrls[2] = {LPC_CAN1, LPC_CAN2};
+  uint8_t data[7 + 14 * 4];
+  uint8_t* p = NULL;
+  can_stats_t s;
+  uint8_t i = 0;
+
+  for (i = 0; i < 2; i++) {
+    can_getStats(ctrls[i], &s);
+
+    p = data;
+    *p++ = i;
+    *p++ = s.state;
+    *p++ = s.busLoad;
+    *p++ = s.rxErr;
+    *p++ = s.txErr;
+    *p++ = s.lastAlc;
+    *p++ = s.lastEcc;
+    p = putU32(p, s.rxFrames);
+    p = putU32(p, s.rxBytes);
+    p = putU32(p, s.rxDropped);
+    p = putU32(p, s.rxHighWater);
+    p = putU32(p, s.txFrames);
+    p = putU32(p, s.txBytes);
+    p = putU32(p, s.txDropped);
+    p = putU32(p, s.overruns);
+    p = putU32(p, s.errPassive);
+    p = putU32(p, s.busOff);
+    p = putU32(p, s.arbLost);
+    p = putU32(p, s.busErrors);
+    p = putU32(p, s.latencyMax);
+    p = putU32(p, s.latencyAvg);
+
+    sendCommand(session, CMD_CAN_STATS, data, p - data);
+  }
 }
 
 /******************************************************************************
@@ -168,7 +453,7 @@ static void setNodeValue(uint8_t nodeId, uint8_t devId, uint8_t d0, uint8_t d1)
 
   switch (devId) {
   case CANPT_MSG_DEV_RGB:
-    console_sendString((uint8_t*)"setNodeValue: RGB\r\n");
+    DLOG_DBG("setNodeValue: RGB\r\n");
     if (d1) {
       // on
       canpt_setRgb(nodeId, d0, 1);
@@ -180,7 +465,7 @@ static void setNodeValue(uint8_t nodeId, uint8_t devId, uint8_t d0, uint8_t d1)
     break;
 
   case CANPT_MSG_DEV_LED:
-    console_sendString((uint8_t*)"setNodeValue: LED\r\n");
+    DLOG_DBG("setNodeValue: LED\r\n");
     canpt_setLed(nodeId, d1);
     break;
   }
@@ -198,7 +483,7 @@ static void setNodeValue(uint8_t nodeId, uint8_t devId, uint8_t d0, uint8_t d1)
  *    [in] numCaps - number of capabilities
  *
  *****************************************************************************/
-static void sendNodeAttached(uint8_t corenum, uint8_t reqId, uint8_t* caps, uint8_t numCaps)
+static void sendNodeAttached(aoa_session_t* s, uint8_t reqId, const uint8_t* caps, uint8_t numCaps)
 {
   uint8_t data[14];
 
@@ -215,7 +500,7 @@ static void sendNodeAttached(uint8_t corenum, uint8_t reqId, uint8_t* caps, uint
     data[2+i] = caps[i];
   }
 
-  sendCommand(corenum, CMD_NODE_ADD, data, 2+numCaps);
+  sendCommand(s, CMD_NODE_ADD, data, 2+numCaps);
 
 }
 
@@ -228,73 +513,35 @@ static void sendNodeAttached(uint8_t corenum, uint8_t reqId, uint8_t* caps, uint
  *    [in] reqId - Node ID
  *
  *****************************************************************************/
-static void sendNodeDetached(uint8_t corenum, uint8_t reqId)
+static void sendNodeDetached(aoa_session_t* s, uint8_t reqId)
 {
-  sendCommand(corenum, CMD_NODE_REMOVE, &reqId, 1);
+  sendCommand(s, CMD_NODE_REMOVE, &reqId, 1);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Handle that a Node has attached to this gateway.
+ *    Handle that a Node has attached to this gateway. The node is only
+ *    announced if it can be cached (and subscribed), see aoanode_attach.
  *
  * Params:
+ *    [in] s - session to announce the node to
  *    [in] reqId - Node ID
  *
  *****************************************************************************/
-static void handleNodeAttached(uint8_t corenum, uint8_t reqId)
+static void handleNodeAttached(aoa_session_t* s, uint8_t reqId)
 {
-  uint8_t buf[12];
-  uint8_t data[2];
-  uint8_t numCaps;
-
-  error_t err = ERR_OK;
-  int i = 0;
-
-  err = canpt_getNodeCaps(reqId, buf, 12, &numCaps);
-
-  if (err == ERR_OK && numCaps > 0 && numCaps <= 12) {
-
-    /*
-     * Start subscriptions on value changes
-     */
-    for (i = 0; i < numCaps; i++) {
-      switch (buf[i]) {
-      case CANPT_MSG_DEV_TEMP:
-
-        canpt_getTemperature(reqId);
-
-        // subscribe to 0.5 degrees changes
-        data[0] = 0;
-        data[1] = 50;
-        canpt_subscribe(reqId, buf[i], CANPT_MSG_SUB_DIF, data, 2);
-        break;
-      case CANPT_MSG_DEV_LIGHT:
-
-        canpt_getLight(reqId);
+  uint8_t buf[AOANODE_MAX_CAPS];
+  uint8_t numCaps = 0;
 
-        // subscribe to changes of 10 units
-        data[0] = 0;
-        data[1] = 10;
-        canpt_subscribe(reqId, buf[i], CANPT_MSG_SUB_DIF, data, 2);
-
-        break;
-      case CANPT_MSG_DEV_BTN:
-
-        canpt_getButton(reqId);
-
-        // subscribe to all changes (on/off)
-        data[0] = 0;
-        canpt_subscribe(reqId, buf[i], CANPT_MSG_SUB_DIF, data, 1);
-
-        break;
-      }
-    }
-
-    // notify Android device
-    sendNodeAttached(corenum, reqId, buf, numCaps);
+  if (canpt_getNodeCaps(reqId, buf, AOANODE_MAX_CAPS, &numCaps) != ERR_OK) {
+    numCaps = 0;
   }
 
+  // notify Android device
+  if (aoanode_attach(reqId, buf, numCaps) != NULL) {
+    sendNodeAttached(s, reqId, buf, numCaps);
+  }
 }
 
 /******************************************************************************
@@ -306,19 +553,43 @@ static void handleNodeAttached(uint8_t corenum, uint8_t reqId)
  *    [in] reqId - Node ID
  *
  *****************************************************************************/
-static void handleNodeDetached(uint8_t corenum, uint8_t reqId)
+static void handleNodeDetached(uint8_t reqId)
 {
-  int i = 0;
+  aoanode_detach(reqId);
 
-  // clear any active subscriptions
-  for (i = 0; i < MAX_NUM_SUBSCRIPTIONS; i++) {
-    if (subs[i].reqId != 0) {
-      subs[i].reqId = 0;
-      subs[i].subId = 0;
-    }
+  if (session.connected) {
+    sendNodeDetached(&session, reqId);
   }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Announce a cached node to the device of a session (aoanode_sink_t)
+ *
+ *****************************************************************************/
+static void resendAttached(void* ctx, uint8_t nodeId, const uint8_t* caps,
+    uint8_t numCaps)
+{
+  sendNodeAttached((aoa_session_t*)ctx, nodeId, caps, numCaps);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Send a cached value to the device of a session (aoanode_sink_t)
+ *
+ *****************************************************************************/
+static void resendValue(void* ctx, uint8_t nodeId, uint8_t periphId,
+    const uint8_t* value)
+{
+  uint8_t data[4];
 
-  sendNodeDetached(corenum, reqId);
+  data[0] = nodeId;
+  data[1] = periphId;
+  data[2] = value[0];
+  data[3] = value[1];
+  sendCommand((aoa_session_t*)ctx, CMD_NODE_VALUE, data, 4);
 }
 
 /******************************************************************************
@@ -332,13 +603,12 @@ static void handleNodeDetached(uint8_t corenum, uint8_t reqId)
  *****************************************************************************/
 static void nodeAttached(uint8_t reqId)
 {
-  console_sendString((uint8_t*)"nodeAttached\r\n");
-  if (!connected) {
+  DLOG_DBG("nodeAttached %d\r\n", reqId);
+  if (!session.connected) {
     return;
   }
 
-
-  handleNodeAttached(attachedCoreNum, reqId);
+  handleNodeAttached(&session, reqId);
 
 }
 
@@ -353,12 +623,10 @@ static void nodeAttached(uint8_t reqId)
  *****************************************************************************/
 static void nodeDetached(uint8_t reqId)
 {
-  console_sendString((uint8_t*)"nodeDetached\r\n");
-  if (!connected) {
-    return;
-  }
+  DLOG_DBG("nodeDetached %d\r\n", reqId);
 
-  handleNodeDetached(attachedCoreNum, reqId);
+  // also while detached, the node must not be resumed
+  handleNodeDetached(reqId);
 }
 
 /******************************************************************************
@@ -378,11 +646,6 @@ static void valueUpdate(uint8_t reqId, uint8_t periphId, uint8_t* buf,
 {
   uint8_t data[4];
 
-  if (!connected) {
-    return;
-  }
-
-
   data[0] = reqId;
   data[1] = periphId;
 
@@ -396,7 +659,11 @@ static void valueUpdate(uint8_t reqId, uint8_t periphId, uint8_t* buf,
     data[3] = buf[1];
   }
 
-  sendCommand(attachedCoreNum, CMD_NODE_VALUE, data, 4);
+  aoanode_storeValue(reqId, periphId, &data[2]);
+
+  if (session.connected) {
+    sendCommand(&session, CMD_NODE_VALUE, data, 4);
+  }
 }
 
 /******************************************************************************
@@ -411,35 +678,46 @@ static void valueUpdate(uint8_t reqId, uint8_t periphId, uint8_t* buf,
  *****************************************************************************/
 static void subStarted(uint8_t reqId, uint8_t subId)
 {
-  int i = 0;
-
-  for (i = 0; i < MAX_NUM_SUBSCRIPTIONS; i++) {
-    if (subs[i].reqId == 0) {
-      subs[i].reqId = reqId;
-      subs[i].subId = subId;
-      break;
-    }
-  }
+  aoanode_subStarted(reqId, subId);
 }
 
 /******************************************************************************
  *
  * Description:
- *    Handle that an Android device has been connected
+ *    Handle that an Android device has been connected. Nodes kept from
+ *    an earlier connection are only announced, other nodes are subscribed.
  *
  *****************************************************************************/
-static void handleDeviceConnected(uint8_t corenum)
+static void handleDeviceConnected(aoa_session_t* s)
 {
   int i = 0;
   error_t err = ERR_OK;
-  uint8_t nodeIds[10];
+  uint8_t nodeIds[AOANODE_MAX_CACHED];
   uint8_t numNodes = 0;
+  aoanode_t* n = NULL;
+
+  holdExpires = 0;
+
+  err = canpt_getNodes(nodeIds, AOANODE_MAX_CACHED, &numNodes);
+  if (err != ERR_OK) {
+    numNodes = 0;
+  }
 
-  err = canpt_getNodes(nodeIds, 10, &numNodes);
+  // nodes that have gone without being reported
+  for (i = 0; i < AOANODE_MAX_CACHED; i++) {
+    n = aoanode_get(i);
+    if (n->nodeId != 0 && memchr(nodeIds, n->nodeId, numNodes) == NULL) {
+      handleNodeDetached(n->nodeId);
+    }
+  }
 
-  if (err == ERR_OK && numNodes > 0) {
-    for (i = 0; i < numNodes; i++) {
-      handleNodeAttached(corenum, nodeIds[i]);
+  for (i = 0; i < numNodes; i++) {
+    n = aoanode_find(nodeIds[i]);
+    if (n != NULL && nodeIds[i] != 0) {
+      aoanode_resend(n, &resendSink, s);
+    }
+    else {
+      handleNodeAttached(s, nodeIds[i]);
     }
   }
 
@@ -448,152 +726,350 @@ static void handleDeviceConnected(uint8_t corenum)
 /******************************************************************************
  *
  * Description:
- *    Handle that an Android device is no longer attached to this gateway
+ *    Handle that no Android device has been attached to this gateway for
+ *    SUBS_HOLD_MS, subscriptions are cancelled
  *
  *****************************************************************************/
 static void handleDeviceDisconnected(void)
 {
-  int i = 0;
+  DLOG_DBG("handleDeviceDisconnected\r\n");
 
-  console_sendString((uint8_t*)"handleDeviceDisconnected\r\n");
-
-  // cancel all subscriptions
-  for (i = 0; i < MAX_NUM_SUBSCRIPTIONS; i++) {
-    if (subs[i].reqId != 0) {
-
-      canpt_unsubscribe(subs[i].reqId, subs[i].subId);
-
-      subs[i].reqId = 0;
-      subs[i].subId = 0;
-    }
-  }
+  aoanode_releaseAll();
 }
 
 /******************************************************************************
  *
  * Description:
- *
+ *    End the subscriptions when no device has come back and acknowledge
+ *    disconnect requests
  *
  *****************************************************************************/
 static void monitor_task(void)
 {
+  aoa_session_t* s = &session;
 
-  if (scheduleDisconnect > 0 && scheduleDisconnect < getMsTicks()) {
-    scheduleDisconnect = 0;
+  if (holdExpires > 0 && holdExpires < getMsTicks()) {
+    holdExpires = 0;
     handleDeviceDisconnected();
   }
 
-  if (!connected) {
-    return;
+  if (s->connected && s->doDisconnect) {
+    s->doDisconnect = 0;
+    sendCommand(s, CMD_DISCONNECT, 0, 0);
+    flushSession(s);
+    s->connected = 0;
   }
 
-  if (doDisconnect) {
-    doDisconnect = 0;
-    sendCommand(attachedCoreNum, CMD_DISCONNECT, 0, 0);
-    connected = 0;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Handle all packets received on the data IN pipe, in order, and queue
+ *    new IN transfers. A command split over several packets is kept in
+ *    downlinkBuf until the rest has been received (see aoaframe_receive).
+ *
+ *****************************************************************************/
+static void receive_task(aoa_session_t* s)
+{
+  rx_xfer_t* x = NULL;
+  uint8_t corenum = s->corenum;
+  uint8_t idx = 0;
+  uint8_t stalled = 0;
+  HCD_STATUS status = HCD_STATUS_OK;
+
+  if (s->rxPolled) {
+    receivePolled(s);
     return;
   }
 
+  for (;;) {
+    idx = s->rxComplete % DOWNLINK_XFERS;
+    x = &s->rxXfers[idx];
+
+    if (x->state != RX_DONE) {
+      break;
+    }
+
+    if (x->status != HCD_STATUS_OK) {
+      // the rest of the record being received is lost
+      aoaframe_resync(&s->downlink);
+      stalled |= (x->status == HCD_STATUS_TRANSFER_Stall);
+    }
+    else {
+      aoaframe_receive(&s->downlink, rxPackets[idx], x->len,
+          x->len < BULK_PACKET_SIZE);
+    }
+
+    x->state = RX_IDLE;
+    s->rxComplete++;
+  }
+
+  if (stalled) {
+    clearInHalt(s);
+  }
+
+  // keep all transfers queued
+  while ((uint8_t)(s->rxSubmit - s->rxComplete) < DOWNLINK_XFERS) {
+    idx = s->rxSubmit % DOWNLINK_XFERS;
+
+    s->rxXfers[idx].state = RX_QUEUED;
+    status = HcdSubmitTransfer(PipeInfo[corenum][ANDROID_DATA_IN_PIPE].PipeHandle,
+        rxPackets[idx], BULK_PACKET_SIZE, rxDone, &s->rxXfers[idx]);
+    if (status != HCD_STATUS_OK) {
+      s->rxXfers[idx].state = RX_IDLE;
+
+      // nothing is queued yet when the driver doesn't support it
+      if (status == HCD_STATUS_TRANSFER_TYPE_NOT_SUPPORTED) {
+        DLOG_INFO("Core %d: IN transfers not queued, polling\r\n", corenum);
+        s->rxPolled = 1;
+      }
+      break;
+    }
+
+    s->rxSubmit++;
+  }
 }
 
 /******************************************************************************
- * Public functions
+ *
+ * Description:
+ *    Read all packets received on the data IN pipe, used when IN transfers
+ *    can't be queued
+ *
  *****************************************************************************/
+static void receivePolled(aoa_session_t* s)
+{
+  uint8_t corenum = s->corenum;
+  uint8_t packet[BULK_PACKET_SIZE];
+  uint16_t num = 0;
+
+  for (;;) {
+
+    /* Select the data IN pipe, a command handler may have changed it */
+    Pipe_SelectPipe(corenum, ANDROID_DATA_IN_PIPE);
+    Pipe_Unfreeze();
+
+    if (Pipe_IsStalled(corenum)) {
+      Pipe_Freeze();
+      aoaframe_resync(&s->downlink);
+      clearInHalt(s);
+      break;
+    }
+
+    /* Check to see if a packet has been received */
+    if (!Pipe_IsINReceived(corenum)) {
+      break;
+    }
+
+    /* Re-freeze IN pipe after the packet has been received */
+    Pipe_Freeze();
+
+    num = Pipe_BytesInPipe(corenum);
+    if (num > sizeof(packet)) {
+      num = sizeof(packet);
+    }
+
+    Pipe_Read_Stream_LE(corenum, packet, num, NULL);
+    Pipe_ClearIN(corenum);
+
+    aoaframe_receive(&s->downlink, packet, num, num < BULK_PACKET_SIZE);
+  }
+
+  /* Re-freeze IN pipe after use */
+  Pipe_Freeze();
+}
 
 /******************************************************************************
  *
  * Description:
- *    Initialize the AOA functionality
+ *    Recover the data IN pipe after the device has stalled it: the queued
+ *    transfers are cancelled (their callbacks aren't called), the halt is
+ *    cleared on the device and the data toggle reset on the host. The
+ *    transfers are queued again by receive_task.
  *
  *****************************************************************************/
-void androidHost_init(void)
+static void clearInHalt(aoa_session_t* s)
 {
-  int i = 0;
+  uint8_t corenum = s->corenum;
+  uint32_t pipe = PipeInfo[corenum][ANDROID_DATA_IN_PIPE].PipeHandle;
+  uint8_t i = 0;
 
-  canpt_init(&callbacks);
+  HcdCancelTransfer(pipe);
 
-  for (i = 0; i < MAX_NUM_SUBSCRIPTIONS; i++) {
-    subs[i].reqId = 0;
+  for (i = 0; i < DOWNLINK_XFERS; i++) {
+    s->rxXfers[i].state = RX_IDLE;
   }
+  s->rxSubmit = 0;
+  s->rxComplete = 0;
 
+  if (USB_Host_ClearEndpointStall(corenum,
+      PipeInfo[corenum][ANDROID_DATA_IN_PIPE].EndponitAddress) != HOST_SENDCONTROL_Successful) {
+    DLOG_WARN("Core %d: clear halt of data IN failed\r\n", corenum);
+  }
+
+  HcdClearEndpointHalt(pipe);
 }
 
 /******************************************************************************
  *
  * Description:
- *    AOA receive task
+ *    Completion of an IN transfer, called from the USB interrupt
  *
  *****************************************************************************/
-void androidHost_task(void)
+static void rxDone(uint32_t pipeHandle, HCD_STATUS status, uint16_t len,
+    void* context)
 {
-  int i = 0;
+  rx_xfer_t* x = (rx_xfer_t*)context;
 
-  monitor_task();
+  x->status = status;
+  x->len = len;
+  x->state = RX_DONE;
+}
 
-  if (attachedCoreNum == -1) return;
+/******************************************************************************
+ *
+ * Description:
+ *    Forget the state and data of a previous device. Queued transfers are
+ *    cancelled when the pipes are closed.
+ *
+ *****************************************************************************/
+static void resetSession(aoa_session_t* s)
+{
+  uint8_t i = 0;
 
-  if (USB_HostState[attachedCoreNum] != HOST_STATE_Configured)
-    return;
+  s->accessory = 0;
+  s->connected = 0;
+  s->doDisconnect = 0;
 
-  /* Select the data IN pipe */
-  Pipe_SelectPipe(attachedCoreNum, ANDROID_DATA_IN_PIPE);
-  Pipe_Unfreeze();
+  aoaframe_clear(&s->uplink);
+  s->pending = 0;
 
-  /* Check to see if a packet has been received */
-  if (Pipe_IsINReceived(attachedCoreNum))
-  {
-    /* Re-freeze IN pipe after the packet has been received */
-    Pipe_Freeze();
+  for (i = 0; i < DOWNLINK_XFERS; i++) {
+    s->rxXfers[i].state = RX_IDLE;
+  }
 
+  s->rxSubmit = 0;
+  s->rxComplete = 0;
+  s->rxPolled = 0;
 
-    /* Check if data is in the pipe */
-    if (Pipe_IsReadWriteAllowed(attachedCoreNum))
-    {
-      uint8_t numBytes = Pipe_BytesInPipe(attachedCoreNum);
+  aoaframe_decInit(&s->downlink, s->downlinkBuf, DOWNLINK_BUF_SIZE,
+      dispatchCommand, s);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Execute a command received from the device. Commands with an
+ *    unexpected length or unknown commands are ignored.
+ *
+ *****************************************************************************/
+static void dispatchCommand(void* ctx, uint8_t cmd, const uint8_t* data,
+    uint8_t len)
+{
+  const command_t* c = NULL;
+  uint8_t i = 0;
+
+  for (i = 0; i < NUM_COMMANDS; i++) {
+    c = &commands[i];
+
+    if (c->cmd == cmd) {
+      if (c->len == CMD_LEN_ANY || c->len == len) {
+        c->handler((aoa_session_t*)ctx, data, len);
+      }
+      break;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    CMD_SET_VALUE: node ID, peripheral ID, 2 value bytes
+ *
+ *****************************************************************************/
+static void cmdSetValue(aoa_session_t* s, const uint8_t* data, uint8_t len)
+{
+  setNodeValue(data[0], data[1], data[2], data[3]);
+}
 
-      if (numBytes > 0) {
+/******************************************************************************
+ *
+ * Description:
+ *    CMD_GET_CAN_STATS: no data
+ *
+ *****************************************************************************/
+static void cmdGetCanStats(aoa_session_t* s, const uint8_t* data, uint8_t len)
+{
+  sendCanStats(s);
+}
 
-        uint8_t c = Pipe_Read_8(attachedCoreNum);
-        numBytes--;
+/******************************************************************************
+ *
+ * Description:
+ *    CMD_CONNECT: no data
+ *
+ *****************************************************************************/
+static void cmdConnect(aoa_session_t* s, const uint8_t* data, uint8_t len)
+{
+  s->connected = 1;
 
-        switch (c) {
+  handleDeviceConnected(s);
+}
 
-        case CMD_SET_VALUE:
+/******************************************************************************
+ *
+ * Description:
+ *    CMD_DISCONNECT: no data
+ *
+ *****************************************************************************/
+static void cmdDisconnect(aoa_session_t* s, const uint8_t* data, uint8_t len)
+{
+  s->doDisconnect = 1;
+}
 
-          if (numBytes == 4) {
-            setNodeValue(Pipe_Read_8(attachedCoreNum), Pipe_Read_8(attachedCoreNum),
-                Pipe_Read_8(attachedCoreNum), Pipe_Read_8(attachedCoreNum));
-          }
+/******************************************************************************
+ * Public functions
+ *****************************************************************************/
 
-          break;
+/******************************************************************************
+ *
+ * Description:
+ *    Initialize the AOA functionality
+ *
+ *****************************************************************************/
+void androidHost_init(void)
+{
+  canpt_init(&callbacks);
 
-        case CMD_CONNECT:
-          connected = 1;
-          handleDeviceConnected(attachedCoreNum);
-          break;
-        case CMD_DISCONNECT:
-          doDisconnect = 1;
-          break;
-        default:
+  session.corenum = NO_CORE;
+  aoaframe_init(&session.uplink, session.uplinkBuf, UPLINK_BUF_SIZE);
+  memset(&session.stats, 0, sizeof(uplink_stats_t));
+  resetSession(&session);
 
-          for (i = 0; i < numBytes; i++) {
-            c = Pipe_Read_8(attachedCoreNum);
-          }
-          break;
-        }
+  aoanode_init();
 
+}
 
+/******************************************************************************
+ *
+ * Description:
+ *    AOA task, serves the Android device
+ *
+ *****************************************************************************/
+void androidHost_task(void)
+{
+  aoa_session_t* s = &session;
 
-      }
+  monitor_task();
 
-    }
+  if (s->accessory && USB_HostState[s->corenum] == HOST_STATE_Configured) {
+    uplink_task(s);
 
-    /* Clear the pipe after all data in the packet has been read, ready for the next packet */
-    Pipe_ClearIN(attachedCoreNum);
+    receive_task(s);
   }
 
-  /* Re-freeze IN pipe after use */
-  Pipe_Freeze();
+  dlog_task();
 }
 
 
@@ -603,10 +1079,14 @@ void androidHost_task(void)
  */
 void EVENT_USB_Host_DeviceAttached(const uint8_t corenum)
 {
-	//	console_sendString((uint8_t*)"Device Attached.\r\n");
-	sprintf((char*)sbuf, "Device Attached %d\r\n", corenum);
-	console_sendString(sbuf);
-	attachedCoreNum = corenum;
+	DLOG_INFO("Device Attached %d\r\n", corenum);
+
+	// only one device is served
+	if (session.corenum != NO_CORE && session.corenum != corenum)
+	  return;
+
+	resetSession(&session);
+	session.corenum = corenum;
 }
 
 /** Event handler for the USB_DeviceUnattached event. This indicates that a device has been removed from the host, and
@@ -614,13 +1094,24 @@ void EVENT_USB_Host_DeviceAttached(const uint8_t corenum)
  */
 void EVENT_USB_Host_DeviceUnattached(const uint8_t corenum)
 {
-  //  console_sendString((uint8_t*)"\r\nDevice Unattached.\r\n");
-  sprintf((char*)sbuf, "\r\nDevice Unattached %d\r\n", corenum);
-  console_sendString(sbuf);
-  connected = 0;
+  aoa_session_t* s = NULL;
+
+  DLOG_INFO("Device Unattached %d\r\n", corenum);
+
+  s = &session;
+  if (s->corenum != corenum)
+    return;
+
+  DLOG_INFO("Uplink %d: %u msgs, %u transfers, %u bytes, "
+      "%u full, %u timed, %u dropped\r\n", corenum,
+      s->stats.records, s->stats.transfers, s->stats.bytes,
+      s->stats.fullFlushes, s->stats.timedFlushes, s->stats.dropped);
+
+  resetSession(s);
+  s->corenum = NO_CORE;
 
-  //handleDeviceDisconnected();
-  scheduleDisconnect = getMsTicks() + 1000;
+  // keep the subscriptions in case a device is attached again
+  holdExpires = getMsTicks() + SUBS_HOLD_MS;
 }
 
 /** Event handler for the USB_DeviceEnumerationComplete event. This indicates that a device has been successfully
@@ -628,9 +1119,7 @@ void EVENT_USB_Host_DeviceUnattached(const uint8_t corenum)
  */
 void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
 {
-  //  console_sendString((uint8_t*)"Getting Device Data.\r\n");
-  sprintf((char*)sbuf, "Getting Device Data %d\r\n", corenum);
-  console_sendString(sbuf);
+  DLOG_INFO("Getting Device Data %d\r\n", corenum);
 
   /* Get and process the configuration descriptor data */
   uint8_t ErrorCode = ProcessDeviceDescriptor(corenum);
@@ -641,17 +1130,15 @@ void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
   if ((ErrorCode != AccessoryModeAndroidDevice) && (ErrorCode != NonAccessoryModeAndroidDevice))
   {
     if (ErrorCode == ControlError)
-      console_sendString((uint8_t*)"Control Error (Get Device).\r\n");
+      DLOG_ERR("Control Error (Get Device).\r\n");
     else
-      console_sendString((uint8_t*)"Invalid Device.\r\n");
+      DLOG_ERR("Invalid Device.\r\n");
 
-    sprintf((char*)sbuf, " -- Error Code: %d\r\n", ErrorCode);
-    console_sendString(sbuf);
+    DLOG_ERR(" -- Error Code: %d\r\n", ErrorCode);
     return;
   }
 
-  sprintf((char*)sbuf, "Android Device Detected - %sAccessory mode.\r\n", (RequiresModeSwitch ? "Non-" : ""));
-  console_sendString(sbuf);
+  DLOG_INFO("Android Device Detected - %sAccessory mode.\r\n", (RequiresModeSwitch ? "Non-" : ""));
 
   /* Check if a valid Android device was attached, but it is not current in Accessory mode */
   if (RequiresModeSwitch)
@@ -662,10 +1149,9 @@ void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
     if ((ErrorCode = Android_GetAccessoryProtocol(corenum, &AndroidProtocol)) != HOST_SENDCONTROL_Successful)
     {
 
-      sprintf((char*)sbuf, "Control Error (Get Protocol).\r\n"
+      DLOG_ERR("Control Error (Get Protocol).\r\n"
           " -- Error Code: %d\r\n"
           ,ErrorCode);
-      console_sendString(sbuf);
       return;
     }
 
@@ -673,8 +1159,7 @@ void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
     if (AndroidProtocol == 0 || AndroidProtocol >  ANDROID_PROTOCOL_Accessory)
     {
 
-      sprintf((char*)sbuf, "Unsupported AOA protocol version: %d\r\n" ,AndroidProtocol);
-      console_sendString(sbuf);
+      DLOG_ERR("Unsupported AOA protocol version: %d\r\n" ,AndroidProtocol);
       return;
     }
 
@@ -699,18 +1184,17 @@ void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
     return;
   }
 
-  console_sendString((uint8_t*)"Getting Config Data.\r\n");
+  DLOG_INFO("Getting Config Data.\r\n");
 
   /* Get and process the configuration descriptor data */
   if ((ErrorCode = ProcessConfigurationDescriptor(corenum)) != SuccessfulConfigRead)
   {
     if (ErrorCode == ControlError)
-      console_sendString((uint8_t*)"Control Error (Get Configuration).\r\n");
+      DLOG_ERR("Control Error (Get Configuration).\r\n");
     else
-      console_sendString((uint8_t*)"Invalid Device.\r\n");
+      DLOG_ERR("Invalid Device.\r\n");
 
-    sprintf((char*)sbuf, " -- Error Code: %d\r\n", ErrorCode);
-    console_sendString(sbuf);
+    DLOG_ERR(" -- Error Code: %d\r\n", ErrorCode);
 
     return;
   }
@@ -719,13 +1203,18 @@ void EVENT_USB_Host_DeviceEnumerationComplete(const uint8_t corenum)
   if ((ErrorCode = USB_Host_SetDeviceConfiguration(corenum, 1)) != HOST_SENDCONTROL_Successful)
   {
 
-    sprintf((char*)sbuf, "Control Error (Set Configuration).\r\n"
+    DLOG_ERR("Control Error (Set Configuration).\r\n"
         " -- Error Code: %d\r\n", ErrorCode);
-    console_sendString(sbuf);
+
+    // read the descriptors again next time
+    InvalidateConfigurationCache(corenum);
     return;
   }
 
-  console_sendString((uint8_t*)"Accessory Mode Android Enumerated.\r\n");
+  DLOG_INFO("Accessory Mode Android Enumerated.\r\n");
+
+  if (session.corenum == corenum)
+    session.accessory = 1;
 }
 
 /** Event handler for the USB_HostError event. This indicates that a hardware error occurred while in host mode. */
@@ -733,9 +1222,9 @@ void EVENT_USB_Host_HostError(const uint8_t corenum, const uint8_t ErrorCode)
 {
   USB_Disable();
 
-  sprintf((char*)sbuf, "Host Mode Error\r\n"
+  DLOG_ERR("Host Mode Error\r\n"
       " -- Error Code %d\r\n", ErrorCode);
-  console_sendString(sbuf);
+  dlog_flush();
 
   for(;;);
 }
@@ -747,11 +1236,10 @@ void EVENT_USB_Host_DeviceEnumerationFailed(const uint8_t corenum,
     const uint8_t ErrorCode,
     const uint8_t SubErrorCode)
 {
-  sprintf((char*)sbuf, "Dev Enum Error\r\n"
+  DLOG_ERR("Dev Enum Error\r\n"
       " -- Error Code %d\r\n"
       " -- Sub Error Code %d\r\n"
-      " -- In State %d\r\n", ErrorCode, SubErrorCode, USB_HostState);
-  console_sendString(sbuf);
+      " -- In State %d\r\n", ErrorCode, SubErrorCode, USB_HostState[corenum]);
 
 }
 
@@ -0,0 +1,303 @@
+/****************************************************************************************************//**
+*
+* @file		aoaframe.c
+* @brief	Record framing for the Android accessory link
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * A bulk transfer to the Android device holds any number of records:
+ *
+ *   [len] [cmd] [data 0] ... [data len-2]
+ *
+ * 'len' counts the command and data bytes. A 'len' of 0 is a single
+ * padding byte, it is added when a transfer would otherwise end on a
+ * packet boundary (the device only sees the end of a transfer at a short
+ * packet).
+ *
+ * A record never spans two transfers. Bytes left over at the end of a
+ * received transfer come from a corrupt length and are dropped, the next
+ * transfer is decoded from its first byte again.
+ *
+ * This file doesn't depend on the USB stack and can be built on a host.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "aoaframe.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Initialize an encoder. One byte of the buffer is kept for padding.
+ *
+ * Params:
+ *   [in] enc: the encoder
+ *   [in] buf: transfer buffer
+ *   [in] size: size of the buffer
+ *
+ *****************************************************************************/
+void aoaframe_init(aoaframe_enc_t* enc, uint8_t* buf, uint16_t size)
+{
+  enc->buf = buf;
+  enc->size = size;
+  enc->used = 0;
+  enc->records = 0;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Remove all records from an encoder
+ *
+ *****************************************************************************/
+void aoaframe_clear(aoaframe_enc_t* enc)
+{
+  enc->used = 0;
+  enc->records = 0;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Append a record
+ *
+ * Params:
+ *   [in] enc: the encoder
+ *   [in] cmd: command
+ *   [in] data: data of the record
+ *   [in] len: number of data bytes, at most AOAFRAME_MAX_DATA
+ *
+ * Returns:
+ *   1 if appended, 0 if the record doesn't fit
+ *
+ *****************************************************************************/
+uint8_t aoaframe_put(aoaframe_enc_t* enc, uint8_t cmd, const uint8_t* data,
+    uint8_t len)
+{
+  uint8_t* p = NULL;
+
+  if (len > AOAFRAME_MAX_DATA
+      || enc->used + AOAFRAME_RECORD_SIZE(len) > enc->size - 1) {
+    return 0;
+  }
+
+  p = &enc->buf[enc->used];
+  p[0] = len + 1;
+  p[1] = cmd;
+  if (len > 0) {
+    memcpy(&p[2], data, len);
+  }
+
+  enc->used += AOAFRAME_RECORD_SIZE(len);
+  enc->records++;
+
+  return 1;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Complete the transfer, padding it so it ends with a short packet
+ *
+ * Params:
+ *   [in] enc: the encoder
+ *   [in] packetSize: max packet size of the bulk pipe
+ *
+ * Returns:
+ *   Number of bytes to send, 0 if there are no records
+ *
+ *****************************************************************************/
+uint16_t aoaframe_finish(aoaframe_enc_t* enc, uint16_t packetSize)
+{
+  if (enc->used > 0 && (enc->used % packetSize) == 0) {
+    enc->buf[enc->used++] = 0;
+  }
+
+  return enc->used;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Split a received transfer into records
+ *
+ * Params:
+ *   [in] buf: the transfer
+ *   [in] len: number of bytes
+ *   [in] handler: called for every record
+ *   [in] ctx: passed to the handler
+ *
+ * Returns:
+ *   Number of bytes used. Less than 'len' if the transfer ends with an
+ *   incomplete record.
+ *
+ *****************************************************************************/
+uint16_t aoaframe_decode(const uint8_t* buf, uint16_t len,
+    aoaframe_handler_t handler, void* ctx)
+{
+  uint16_t pos = 0;
+  uint8_t recLen = 0;
+
+  while (pos < len) {
+    recLen = buf[pos];
+
+    if (recLen == 0) {
+      pos++;
+      continue;
+    }
+
+    if (pos + 1 + recLen > len) {
+      break;
+    }
+
+    handler(ctx, buf[pos+1], &buf[pos+2], recLen - 1);
+    pos += 1 + recLen;
+  }
+
+  return pos;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Initialize a decoder for received transfers
+ *
+ * Params:
+ *   [in] dec: the decoder
+ *   [in] buf: buffer for an incomplete record
+ *   [in] size: size of the buffer, the longest record plus one packet
+ *   [in] handler: called for every record
+ *   [in] ctx: passed to the handler
+ *
+ *****************************************************************************/
+void aoaframe_decInit(aoaframe_dec_t* dec, uint8_t* buf, uint16_t size,
+    aoaframe_handler_t handler, void* ctx)
+{
+  dec->buf = buf;
+  dec->size = size;
+  dec->len = 0;
+  dec->resync = 0;
+  dec->handler = handler;
+  dec->ctx = ctx;
+  dec->dropped = 0;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Decode a received packet. The complete records are passed to the
+ *    handler, the start of a record split over packets is kept until the
+ *    rest has been received.
+ *
+ * Params:
+ *   [in] dec: the decoder
+ *   [in] data: the packet
+ *   [in] len: number of bytes
+ *   [in] last: the packet ends the transfer (a short packet)
+ *
+ *****************************************************************************/
+void aoaframe_receive(aoaframe_dec_t* dec, const uint8_t* data, uint16_t len,
+    uint8_t last)
+{
+  uint16_t num = 0;
+
+  if (dec->resync || len > dec->size - dec->len) {
+    aoaframe_resync(dec);
+    dec->dropped += len;
+    dec->resync = !last;
+    return;
+  }
+
+  memcpy(&dec->buf[dec->len], data, len);
+  dec->len += len;
+
+  num = aoaframe_decode(dec->buf, dec->len, dec->handler, dec->ctx);
+  dec->len -= num;
+
+  if (last) {
+    // a record can't continue in the next transfer
+    dec->dropped += dec->len;
+    dec->len = 0;
+  }
+  else if (num > 0) {
+    memmove(dec->buf, &dec->buf[num], dec->len);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Drop the incomplete record and the rest of the transfer being
+ *    received, e.g. after a failed packet
+ *
+ * Params:
+ *   [in] dec: the decoder
+ *
+ *****************************************************************************/
+void aoaframe_resync(aoaframe_dec_t* dec)
+{
+  dec->dropped += dec->len;
+  dec->len = 0;
+  dec->resync = 1;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,106 @@
+/****************************************************************************************************//**
+*
+* @file		aoaframe.h
+* @brief	Record framing for the Android accessory link
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __AOAFRAME_H
+#define __AOAFRAME_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stdint.h>
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Largest data part of a record
+#define AOAFRAME_MAX_DATA (254)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+// Bytes a record with 'len' data bytes takes in a transfer
+#define AOAFRAME_RECORD_SIZE(len) ((len) + 2)
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+/*
+ * Records are appended to 'buf' until it is full. The caller sends the
+ * 'used' bytes returned by aoaframe_finish as one bulk transfer.
+ */
+typedef struct {
+  uint8_t* buf;
+  uint16_t size;
+  uint16_t used;
+  uint16_t records;
+} aoaframe_enc_t;
+
+// Called by aoaframe_decode for every record, 'ctx' as passed to it
+typedef void (*aoaframe_handler_t)(void* ctx, uint8_t cmd,
+    const uint8_t* data, uint8_t len);
+
+/*
+ * Collects the packets of received transfers until records are complete.
+ * 'buf' must hold the longest record plus one packet.
+ */
+typedef struct {
+  uint8_t* buf;
+  uint16_t size;
+  uint16_t len;
+  uint8_t resync;        // drop packets up to the end of a transfer
+  aoaframe_handler_t handler;
+  void* ctx;
+  uint32_t dropped;      // bytes dropped to find the next record
+} aoaframe_dec_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+void aoaframe_init(aoaframe_enc_t* enc, uint8_t* buf, uint16_t size);
+void aoaframe_clear(aoaframe_enc_t* enc);
+uint8_t aoaframe_put(aoaframe_enc_t* enc, uint8_t cmd, const uint8_t* data,
+    uint8_t len);
+uint16_t aoaframe_finish(aoaframe_enc_t* enc, uint16_t packetSize);
+uint16_t aoaframe_decode(const uint8_t* buf, uint16_t len,
+    aoaframe_handler_t handler, void* ctx);
+
+void aoaframe_decInit(aoaframe_dec_t* dec, uint8_t* buf, uint16_t size,
+    aoaframe_handler_t handler, void* ctx);
+void aoaframe_receive(aoaframe_dec_t* dec, const uint8_t* data, uint16_t len,
+    uint8_t last);
+void aoaframe_resync(aoaframe_dec_t* dec);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
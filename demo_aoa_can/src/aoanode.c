@@ -0,0 +1,465 @@
+/****************************************************************************************************//**
+*
+* @file		aoanode.c
+* @brief	Node cache and subscriptions of the Android accessory demo
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * A node announced to a device is cached with its capabilities and the
+ * last value of each of them, and subscribed to value changes. The cache
+ * outlives the connection of the device so that a device connecting again
+ * gets the nodes and values at once (aoanode_resend) while the nodes keep
+ * publishing. A node that can't be cached isn't subscribed, its
+ * subscriptions couldn't be cancelled later.
+ *
+ * Subscriptions are kept in a list per node, indexed by node ID, so those
+ * of a node are found and released without searching the table. Unused
+ * entries are linked in a free list.
+ *
+ * This file doesn't depend on the USB stack and can be built on a host.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "board.h"
+#include "canpt.h"
+#include "dlog.h"
+#include "aoanode.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+// no subscription (list end)
+#define SUB_NIL (0xFF)
+
+
+/********************************************************************************************************
+*** PRIVATE MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct
+{
+  uint8_t reqId;
+  uint8_t subId;
+  uint8_t next;          // next of the same node or next free entry
+} subscription_t;
+
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static subscription_t subs[AOANODE_MAX_SUBS];
+
+// first subscription of each node ID, SUB_NIL if none
+static uint8_t nodeSubs[256];
+static uint8_t freeSubs = SUB_NIL;
+
+static aoanode_t nodeCache[AOANODE_MAX_CACHED];
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** CONFIGURATION ERRORS
+********************************************************************************************************/
+
+#if AOANODE_MAX_SUBS > 255
+#error "AOANODE_MAX_SUBS must be at most 255"
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------------*/
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Release all subscriptions of a node
+ *
+ * Params:
+ *    [in] reqId - Node ID
+ *    [in] cancel - 1 to send unsubscribe requests to the node, 0 if the
+ *                  node is gone
+ *
+ *****************************************************************************/
+static void releaseNodeSubs(uint8_t reqId, uint8_t cancel)
+{
+  uint8_t subIds[AOANODE_MAX_SUBS];
+  uint8_t num = 0;
+  uint8_t idx = nodeSubs[reqId];
+  uint8_t last = SUB_NIL;
+
+  if (idx == SUB_NIL) {
+    return;
+  }
+
+  for (; idx != SUB_NIL; idx = subs[idx].next) {
+    subIds[num++] = subs[idx].subId;
+    last = idx;
+  }
+
+  // the node keeps publishing the subscriptions that couldn't be queued
+  if (cancel && canpt_unsubscribeList(reqId, subIds, num) != ERR_OK) {
+    DLOG_WARN("Node %d: unsubscribe not sent\r\n", reqId);
+  }
+
+  // hand the whole list to the free list
+  subs[last].next = freeSubs;
+  freeSubs = nodeSubs[reqId];
+  nodeSubs[reqId] = SUB_NIL;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Request the values of a node and subscribe to their changes
+ *
+ *****************************************************************************/
+static void subscribeNode(aoanode_t* n)
+{
+  uint8_t data[2];
+  int i = 0;
+
+  for (i = 0; i < n->numCaps; i++) {
+    switch (n->caps[i]) {
+    case CANPT_MSG_DEV_TEMP:
+
+      canpt_getTemperature(n->nodeId);
+
+      // subscribe to 0.5 degrees changes
+      data[0] = 0;
+      data[1] = 50;
+      canpt_subscribe(n->nodeId, n->caps[i], CANPT_MSG_SUB_DIF, data, 2);
+      break;
+    case CANPT_MSG_DEV_LIGHT:
+
+      canpt_getLight(n->nodeId);
+
+      // subscribe to changes of 10 units
+      data[0] = 0;
+      data[1] = 10;
+      canpt_subscribe(n->nodeId, n->caps[i], CANPT_MSG_SUB_DIF, data, 2);
+
+      break;
+    case CANPT_MSG_DEV_BTN:
+
+      canpt_getButton(n->nodeId);
+
+      // subscribe to all changes (on/off)
+      data[0] = 0;
+      canpt_subscribe(n->nodeId, n->caps[i], CANPT_MSG_SUB_DIF, data, 1);
+
+      break;
+    }
+  }
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+/******************************************************************************
+ *
+ * Description:
+ *    Forget all nodes and subscriptions, without cancelling them
+ *
+ *****************************************************************************/
+void aoanode_init(void)
+{
+  int i = 0;
+
+  memset(nodeSubs, SUB_NIL, sizeof(nodeSubs));
+
+  freeSubs = SUB_NIL;
+  for (i = AOANODE_MAX_SUBS - 1; i >= 0; i--) {
+    subs[i].next = freeSubs;
+    freeSubs = i;
+  }
+
+  for (i = 0; i < AOANODE_MAX_CACHED; i++) {
+    nodeCache[i].nodeId = 0;
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get a cache entry by index, to go through the cached nodes
+ *
+ * Params:
+ *    [in] i - index, less than AOANODE_MAX_CACHED
+ *
+ * Returns:
+ *    The entry (nodeId 0 if unused) or NULL if the index is out of range
+ *
+ *****************************************************************************/
+aoanode_t* aoanode_get(uint8_t i)
+{
+  return (i < AOANODE_MAX_CACHED ? &nodeCache[i] : NULL);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Find the cache entry of a node
+ *
+ * Params:
+ *    [in] nodeId - Node ID, 0 to find an unused entry
+ *
+ * Returns:
+ *    The entry or NULL if not found
+ *
+ *****************************************************************************/
+aoanode_t* aoanode_find(uint8_t nodeId)
+{
+  int i = 0;
+
+  for (i = 0; i < AOANODE_MAX_CACHED; i++) {
+    if (nodeCache[i].nodeId == nodeId) {
+      return &nodeCache[i];
+    }
+  }
+
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Cache a node that has been attached and subscribe to its values. A
+ *    node attached again has lost its earlier subscriptions, they are
+ *    released without cancelling them.
+ *
+ * Params:
+ *    [in] nodeId - Node ID
+ *    [in] caps - capability IDs of the node
+ *    [in] numCaps - number of capabilities, at most AOANODE_MAX_CAPS
+ *
+ * Returns:
+ *    The cache entry, NULL if the cache is full or the arguments are
+ *    invalid. The node isn't subscribed then.
+ *
+ *****************************************************************************/
+aoanode_t* aoanode_attach(uint8_t nodeId, const uint8_t* caps, uint8_t numCaps)
+{
+  aoanode_t* n = NULL;
+
+  releaseNodeSubs(nodeId, 0);
+
+  if (nodeId == 0 || caps == NULL || numCaps == 0
+      || numCaps > AOANODE_MAX_CAPS) {
+    return NULL;
+  }
+
+  // values received for the subscriptions are kept in the cache
+  n = aoanode_find(nodeId);
+  if (n == NULL) {
+    n = aoanode_find(0);
+  }
+  if (n == NULL) {
+    DLOG_WARN("Node cache full, node %d ignored\r\n", nodeId);
+    return NULL;
+  }
+
+  n->nodeId = nodeId;
+  n->numCaps = numCaps;
+  n->valid = 0;
+  memcpy(n->caps, caps, numCaps);
+
+  subscribeNode(n);
+
+  return n;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Forget a node and its subscriptions. The subscriptions are not
+ *    cancelled, the node is gone.
+ *
+ * Params:
+ *    [in] nodeId - Node ID
+ *
+ *****************************************************************************/
+void aoanode_detach(uint8_t nodeId)
+{
+  aoanode_t* n = aoanode_find(nodeId);
+
+  if (n != NULL && nodeId != 0) {
+    n->nodeId = 0;
+  }
+
+  releaseNodeSubs(nodeId, 0);
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Forget all nodes and cancel all subscriptions, one request batch per
+ *    node. Used when no device has come back.
+ *
+ *****************************************************************************/
+void aoanode_releaseAll(void)
+{
+  int i = 0;
+
+  for (i = 0; i < AOANODE_MAX_CACHED; i++) {
+    nodeCache[i].nodeId = 0;
+  }
+
+  for (i = 0; i < 256; i++) {
+    releaseNodeSubs(i, 1);
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Register a started subscription
+ *
+ * Params:
+ *    [in] nodeId - Node ID
+ *    [in] subId - subscription ID
+ *
+ *****************************************************************************/
+void aoanode_subStarted(uint8_t nodeId, uint8_t subId)
+{
+  uint8_t idx = freeSubs;
+
+  if (idx == SUB_NIL) {
+    DLOG_WARN("Subscription table full\r\n");
+    return;
+  }
+
+  freeSubs = subs[idx].next;
+
+  subs[idx].reqId = nodeId;
+  subs[idx].subId = subId;
+  subs[idx].next = nodeSubs[nodeId];
+  nodeSubs[nodeId] = idx;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Get the subscriptions of a node, the latest first
+ *
+ * Params:
+ *    [in] nodeId - Node ID
+ *    [in] subIds - subscription IDs will be written to this buffer
+ *    [in] len - length of buffer
+ *    [out] num - number of copied subscription IDs
+ *
+ *****************************************************************************/
+error_t aoanode_getSubs(uint8_t nodeId, uint8_t* subIds, uint8_t len,
+    uint8_t* num)
+{
+  uint8_t idx = nodeSubs[nodeId];
+  uint8_t pos = 0;
+
+  if (num == NULL || (subIds == NULL && len > 0)) {
+    return ERR_ARGUMENT;
+  }
+
+  for (; idx != SUB_NIL && pos < len; idx = subs[idx].next) {
+    subIds[pos++] = subs[idx].subId;
+  }
+
+  *num = pos;
+
+  return ERR_OK;
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Remember the last value of a node peripheral
+ *
+ * Params:
+ *    [in] nodeId - Node ID
+ *    [in] periphId - peripheral/capability ID
+ *    [in] value - 2 value bytes as sent to the device
+ *
+ *****************************************************************************/
+void aoanode_storeValue(uint8_t nodeId, uint8_t periphId, const uint8_t* value)
+{
+  aoanode_t* n = aoanode_find(nodeId);
+  int i = 0;
+
+  if (n == NULL || nodeId == 0) {
+    return;
+  }
+
+  for (i = 0; i < n->numCaps; i++) {
+    if (n->caps[i] == periphId) {
+      n->values[i][0] = value[0];
+      n->values[i][1] = value[1];
+      n->valid |= (1 << i);
+      break;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * Description:
+ *    Announce a node that is still subscribed from an earlier connection,
+ *    together with its last known values
+ *
+ * Params:
+ *    [in] n - the cache entry
+ *    [in] sink - called for the node and each value
+ *    [in] ctx - passed to the sink
+ *
+ *****************************************************************************/
+void aoanode_resend(const aoanode_t* n, const aoanode_sink_t* sink, void* ctx)
+{
+  int i = 0;
+
+  sink->attached(ctx, n->nodeId, n->caps, n->numCaps);
+
+  for (i = 0; i < n->numCaps; i++) {
+    if (n->valid & (1 << i)) {
+      sink->value(ctx, n->nodeId, n->caps[i], n->values[i]);
+    }
+  }
+}
+
+
+/*-----------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,100 @@
+/****************************************************************************************************//**
+*
+* @file		aoanode.h
+* @brief	Node cache and subscriptions of the Android accessory demo
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __AOANODE_H
+#define __AOANODE_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stdint.h>
+#include "board.h"
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// Subscriptions of all nodes, at most 255
+#ifndef AOANODE_MAX_SUBS
+#define AOANODE_MAX_SUBS   (128)
+#endif
+
+// Nodes whose subscriptions and values are kept
+#ifndef AOANODE_MAX_CACHED
+#define AOANODE_MAX_CACHED (10)
+#endif
+
+// Capabilities of a node, at most 16 (aoanode_t.valid)
+#define AOANODE_MAX_CAPS   (12)
+
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint8_t nodeId;        // 0 for an unused entry
+  uint8_t numCaps;
+  uint8_t caps[AOANODE_MAX_CAPS];
+  uint8_t values[AOANODE_MAX_CAPS][2];
+  uint16_t valid;        // bit per capability that has a value
+} aoanode_t;
+
+// Called by aoanode_resend for the node and each of its values, 'ctx' as
+// passed to it
+typedef struct {
+  void (*attached)(void* ctx, uint8_t nodeId, const uint8_t* caps,
+      uint8_t numCaps);
+  void (*value)(void* ctx, uint8_t nodeId, uint8_t periphId,
+      const uint8_t* value);
+} aoanode_sink_t;
+
+
+/********************************************************************************************************
+*** PUBLIC GLOBAL VARIABLES
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTION PROTOTYPES
+********************************************************************************************************/
+
+void aoanode_init(void);
+aoanode_t* aoanode_get(uint8_t i);
+aoanode_t* aoanode_find(uint8_t nodeId);
+aoanode_t* aoanode_attach(uint8_t nodeId, const uint8_t* caps, uint8_t numCaps);
+void aoanode_detach(uint8_t nodeId);
+void aoanode_releaseAll(void);
+void aoanode_subStarted(uint8_t nodeId, uint8_t subId);
+error_t aoanode_getSubs(uint8_t nodeId, uint8_t* subIds, uint8_t len,
+    uint8_t* num);
+void aoanode_storeValue(uint8_t nodeId, uint8_t periphId, const uint8_t* value);
+void aoanode_resend(const aoanode_t* n, const aoanode_sink_t* sink, void* ctx);
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
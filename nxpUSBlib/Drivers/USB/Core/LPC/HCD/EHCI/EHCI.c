@@ -411,6 +411,19 @@ HCD_STATUS HcdDataTransfer(uint32_t PipeHandle, uint8_t* const buffer, uint32_t
 	return HCD_STATUS_OK;
 }
 
+/*********************************************************************//**
+ * @brief		Queued transfers are not supported by the EHCI driver
+ * @return 		HCD_STATUS_TRANSFER_TYPE_NOT_SUPPORTED, nothing is queued
+ * Note: Callers fall back to HcdDataTransfer (the Pipe_* functions), see the OHCI
+ *		driver for the queued transfer interface.
+ **********************************************************************/
+HCD_STATUS HcdSubmitTransfer(uint32_t PipeHandle, uint8_t* const buffer, uint32_t const length,
+							 HCD_TRANSFER_CALLBACK Callback, void* Context)
+{
+	(void) PipeHandle; (void) buffer; (void) length; (void) Callback; (void) Context;
+	return HCD_STATUS_TRANSFER_TYPE_NOT_SUPPORTED;
+}
+
 HCD_STATUS HcdGetPipeStatus(uint32_t PipeHandle) /* TODO can be implemented based on overlay */
 {
 	uint8_t HostID, HeadIdx;
@@ -164,6 +164,19 @@ HCD_STATUS HcdControlTransfer(uint32_t PipeHandle, const USB_Request_Header_t* c
 HCD_STATUS HcdDataTransfer(uint32_t PipeHandle, uint8_t* const buffer, uint32_t const length, uint16_t* const pActualTransferred);
 HCD_STATUS HcdGetPipeStatus(uint32_t PipeHandle);
 
+/************************************************************************/
+/* Queued Transfer API                                                  */
+/************************************************************************/
+/** Called from the host interrupt when a transfer queued with HcdSubmitTransfer is retired.
+ *  ActualLength is the number of bytes transferred, Context is the value passed to HcdSubmitTransfer.
+ *  Must not call any HCD function. */
+typedef void (*HCD_TRANSFER_CALLBACK)(uint32_t PipeHandle, HCD_STATUS Status, uint16_t ActualLength, void* Context);
+
+/** Only implemented by the OHCI driver, the EHCI driver returns HCD_STATUS_TRANSFER_TYPE_NOT_SUPPORTED. */
+
+HCD_STATUS HcdSubmitTransfer(uint32_t PipeHandle, uint8_t* const buffer, uint32_t const length,
+							 HCD_TRANSFER_CALLBACK Callback, void* Context);
+
 #ifdef LPCUSBlib_DEBUG
 	#define hcd_printf			printf
 	void assert_status_ok_message(HCD_STATUS status, char const * mess, char const * func, char const * file, uint32_t const line);
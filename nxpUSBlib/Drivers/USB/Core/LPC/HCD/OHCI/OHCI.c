@@ -429,6 +429,65 @@ HCD_STATUS HcdDataTransfer( uint32_t PipeHandle, uint8_t* const buffer, uint32_t
 	return HCD_STATUS_OK;
 }
 
+/*********************************************************************//**
+ * @brief		Queue a transfer on a bulk or interrupt pipe without waiting for it
+ * @param[in]	PipeHandle	Handler of target pipe
+ * @param[in]	buffer		Data buffer in USB RAM, must stay valid until the callback
+ * @param[in]	length		Number of bytes, the buffer may not cross more than one 4K page
+ * @param[in]	Callback	Called from the host interrupt when the transfer is retired
+ * @param[in]	Context		Passed to Callback
+ * @return 		HCD_STATUS
+ *				- HCD_STATUS_OK	: transfer is queued
+ *				- Others		: Error occurs
+ * Note: Several transfers may be queued on the same pipe, they complete in order. An IN
+ *		transfer completes on a short packet or when the buffer is full. Transfers
+ *		cancelled by HcdCancelTransfer/HcdClosePipe don't invoke their callback.
+ **********************************************************************/
+HCD_STATUS HcdSubmitTransfer(uint32_t PipeHandle, uint8_t* const buffer, uint32_t const length,
+							 HCD_TRANSFER_CALLBACK Callback, void* Context)
+{
+	uint8_t HostID, EdIdx;
+	PHCD_GeneralTransferDescriptor TailP;
+
+	if (buffer == NULL || length == 0 || Callback == NULL)
+	{
+		ASSERT_STATUS_OK_MESSAGE(HCD_STATUS_PARAMETER_INVALID, "Data Buffer or Callback is NULL or Transfer Length is 0");
+	}
+
+	if (length > TD_MAX_XFER_LENGTH - Offset4k((uint32_t)buffer))
+	{
+		ASSERT_STATUS_OK_MESSAGE(HCD_STATUS_PARAMETER_INVALID, "Transfer does not fit in one TD");
+	}
+
+	ASSERT_STATUS_OK ( PipehandleParse(PipeHandle, &HostID, &EdIdx) );
+	ASSERT_STATUS_OK ( HcdED(EdIdx)->hcED.HeadP.Halted ? HCD_STATUS_TRANSFER_Stall : HCD_STATUS_OK  );
+
+	if (IsIsoEndpoint(EdIdx) || HcdED(EdIdx)->ListIndex == CONTROL_LIST_HEAD)
+	{
+		ASSERT_STATUS_OK_MESSAGE(HCD_STATUS_TRANSFER_TYPE_NOT_SUPPORTED, "Only bulk and interrupt transfers can be queued");
+	}
+
+	/* The place holder TD becomes the new TD, the HC doesn't access it before TailP moves */
+	TailP = (PHCD_GeneralTransferDescriptor) HcdED(EdIdx)->hcED.TailP;
+	TailP->Callback = Callback;
+	TailP->CallbackContext = Context;
+
+	if (QueueOneGTD(EdIdx, buffer, length, 0, 0, 1) != HCD_STATUS_OK)
+	{
+		TailP->Callback = NULL;
+		return HCD_STATUS_NOT_ENOUGH_GTD;
+	}
+
+	HcdED(EdIdx)->status = HCD_STATUS_TRANSFER_QUEUED;
+
+	if (HcdED(EdIdx)->ListIndex == BULK_LIST_HEAD)
+	{
+		OHCI_REG(HostID)->HcCommandStatus |= HC_COMMAND_STATUS_BulkListFilled;
+	}
+
+	return HCD_STATUS_OK;
+}
+
 HCD_STATUS HcdGetPipeStatus(uint32_t PipeHandle)
 {
 	uint8_t HostID, EdIdx;
@@ -511,7 +570,7 @@ static void ProcessDoneQueue(uint8_t HostID, uint32_t donehead)
 				pGtd->TransferCount -= ( Align4k( ((uint32_t)pGtd->hcGTD.BufferEnd) ^ ((uint32_t)pGtd->hcGTD.CurrentBufferPointer) ) ? 0x00001000 : 0 ) +
 										Offset4k((uint32_t)pGtd->hcGTD.BufferEnd) - Offset4k((uint32_t)pGtd->hcGTD.CurrentBufferPointer) + 1;
 			}
-			if (HcdED(EdIdx)->pActualTransferCount)
+			if (pGtd->Callback == NULL && HcdED(EdIdx)->pActualTransferCount)
 				*(HcdED(EdIdx)->pActualTransferCount) = pGtd->TransferCount; /* increase usb request transfer count */
 			
 		}
@@ -536,7 +595,22 @@ static void ProcessDoneQueue(uint8_t HostID, uint32_t donehead)
 			FreeItd( (PHCD_IsoTransferDescriptor) pCurTD );
 		}else
 		{
-			FreeGtd( (PHCD_GeneralTransferDescriptor) pCurTD );
+			PHCD_GeneralTransferDescriptor pGtd = (PHCD_GeneralTransferDescriptor) pCurTD;
+			HCD_TRANSFER_CALLBACK Callback = pGtd->Callback;
+			void* Context = pGtd->CallbackContext;
+			uint16_t Count = pGtd->TransferCount;
+			HCD_STATUS Status = pCurTD->ConditionCode ? (HCD_STATUS) HcdED(EdIdx)->status : HCD_STATUS_OK;
+
+			FreeGtd(pGtd);
+
+			/* Complete a transfer queued by HcdSubmitTransfer, its TD is already free */
+			if (Callback != NULL)
+			{
+				uint32_t PipeHandle;
+
+				PipehandleCreate(&PipeHandle, HostID, EdIdx);
+				Callback(PipeHandle, Status, Count, Context);
+			}
 		}
 
 		/* Post Semaphore to signal TDs are transfer */
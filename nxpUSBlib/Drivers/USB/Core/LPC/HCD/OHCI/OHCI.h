@@ -41,7 +41,8 @@
 /*  OHCI C O N F I G U R A T I O N                        */
 /*=======================================================================*/
 #define MAX_ED								HCD_MAX_ENDPOINT
-#define MAX_GTD								(MAX_ED + 3)
+#define MAX_GTD								(MAX_ED + 3 + MAX_QUEUED_GTD)
+#define MAX_QUEUED_GTD						4 /* Extra TDs for transfers queued with HcdSubmitTransfer */
 #define MAX_STATIC_ED						3 /* Serve as list head, fixed, not configurable */
 
 #if ISO_LIST_ENABLE
@@ -275,8 +276,8 @@ typedef struct st_HCD_GeneralTransferDescriptor {	// 32 byte align
 	uint16_t EdIdx;
 	uint16_t TransferCount;
 	
-	uint32_t reserved2;
-	uint32_t reserved3;
+	HCD_TRANSFER_CALLBACK Callback;	/* Set for transfers queued with HcdSubmitTransfer */
+	void* CallbackContext;
 } HCD_GeneralTransferDescriptor, *PHCD_GeneralTransferDescriptor;
 
 typedef struct st_HCD_IsoTransferDescriptor {	// 64 byte align
@@ -29,64 +29,45 @@
 
 #if defined(USB_CAN_BE_HOST)
 
+#include <string.h>
 #include "../PipeStream.h"
 
-uint8_t Pipe_Discard_Stream(const uint8_t corenum,
-							uint16_t Length,
-                            uint16_t* const BytesProcessed)
-{
-	uint8_t  ErrorCode;
-	uint16_t BytesInTransfer = 0;
-	
-//	Pipe_SetPipeToken(PIPE_TOKEN_IN);
+/* Stream data is copied block wise between the caller's buffer and the transfer buffer of the
+ * selected pipe (PipeInfo[corenum][pipe].Buffer). When the transfer buffer of an OUT pipe is
+ * full it is sent and the copy continues when the pipe is ready again. When the transfer buffer
+ * of an IN pipe is empty a new transfer is started. With BytesProcessed != NULL the functions
+ * return PIPE_RWSTREAM_IncompleteTransfer at these points instead of waiting.
+ *
+ * On the LPC targets EEPROM and FLASH data are memory mapped, the _EStream and _PStream
+ * functions are the same as the RAM versions.
+ */
 
-	if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
-	  return ErrorCode;
-
-	if (BytesProcessed != NULL)
-	  Length -= *BytesProcessed;
+/* Copy direction of Pipe_Copy_Stream */
+#define PIPE_COPY_WRITE    0x01
+#define PIPE_COPY_REVERSE  0x02
 
-	while (Length)
-	{
-		if (!(Pipe_IsReadWriteAllowed(corenum)))
-		{
-			Pipe_ClearIN(corenum);
-				
-			if (BytesProcessed != NULL)
-			{
-				*BytesProcessed += BytesInTransfer;
-				return PIPE_RWSTREAM_IncompleteTransfer;
-			}
+static uint8_t Pipe_Copy_Stream(const uint8_t corenum,
+								uint8_t* DataStream,
+								uint16_t Length,
+								uint16_t* const BytesProcessed,
+								const uint8_t Flags);
 
-			if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
-			  return ErrorCode;
-		}
-		else
-		{
-			Pipe_Discard_8();
-			
-			Length--;
-			BytesInTransfer++;
-		}
-	}
+static void Pipe_Copy_Reversed(uint8_t* Dest,
+							   const uint8_t* Source,
+							   uint16_t Length);
 
-	return PIPE_RWSTREAM_NoError;
+uint8_t Pipe_Discard_Stream(const uint8_t corenum,
+							uint16_t Length,
+                            uint16_t* const BytesProcessed)
+{
+	return Pipe_Copy_Stream(corenum, NULL, Length, BytesProcessed, 0);
 }
 
 uint8_t Pipe_Null_Stream(const uint8_t corenum,
 						 uint16_t Length,
                          uint16_t* const BytesProcessed)
 {
-	if (BytesProcessed != NULL)
-	  Length -= *BytesProcessed;
-
-	while (Length)
-	{
-		Pipe_Write_8(corenum, 0);
-		Length--;
-	}
-
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Copy_Stream(corenum, NULL, Length, BytesProcessed, PIPE_COPY_WRITE);
 }
 
 uint8_t Pipe_Write_Stream_LE(const uint8_t corenum,
@@ -94,116 +75,198 @@ uint8_t Pipe_Write_Stream_LE(const uint8_t corenum,
 			                 uint16_t Length,
 			                 uint16_t* const BytesProcessed)
 {
-	uint8_t* DataStream = (uint8_t*) Buffer;
-	if(BytesProcessed != NULL)
-	{
-		Length -= *BytesProcessed;
-		DataStream += *BytesProcessed;
-	}
-
-	while(Length)
-	{
-		Pipe_Write_8(corenum, *DataStream);
-		DataStream++;
-		Length--;
-	}
-
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Copy_Stream(corenum, (uint8_t*) Buffer, Length, BytesProcessed, PIPE_COPY_WRITE);
 }
 
 uint8_t Pipe_Read_Stream_LE(const uint8_t corenum,
 							void* const Buffer,
 			                uint16_t Length,
-			                uint16_t* const BytesProcessed) /* TODO Blocking due to Pipe_WaitUntilReady */
+			                uint16_t* const BytesProcessed)
 {
-	uint8_t* DataStream = (uint8_t *) Buffer;
-	uint8_t ErrorCode;
-
-	if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
-	  return ErrorCode;
-
-	if(BytesProcessed != NULL)
-	{
-		Length -= *BytesProcessed;
-		DataStream += *BytesProcessed;
-	}
+	return Pipe_Copy_Stream(corenum, (uint8_t*) Buffer, Length, BytesProcessed, 0);
+}
 
-	while(Length)
-	{
-		if (Pipe_IsReadWriteAllowed(corenum))
-		{
-			*DataStream = Pipe_Read_8(corenum);
-			DataStream++;
-			Length--;
-		}else
-		{
-			Pipe_ClearIN(corenum);
-			HcdDataTransfer(PipeInfo[corenum][pipeselected[corenum]].PipeHandle,
-							PipeInfo[corenum][pipeselected[corenum]].Buffer,
-							MIN(Length,	PipeInfo[corenum][pipeselected[corenum]].BufferSize),
-							&PipeInfo[corenum][pipeselected[corenum]].ByteTransfered);
-			if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
-				return ErrorCode;
-		}
-	}
+uint8_t Pipe_Write_Stream_BE(const uint8_t corenum,
+							 const void* const Buffer,
+			                 uint16_t Length,
+			                 uint16_t* const BytesProcessed)
+{
+	return Pipe_Copy_Stream(corenum, (uint8_t*) Buffer, Length, BytesProcessed,
+							PIPE_COPY_WRITE | PIPE_COPY_REVERSE);
+}
 
-	return PIPE_RWSTREAM_NoError;
+uint8_t Pipe_Read_Stream_BE(const uint8_t corenum,
+							void* const Buffer,
+			                uint16_t Length,
+			                uint16_t* const BytesProcessed)
+{
+	return Pipe_Copy_Stream(corenum, (uint8_t*) Buffer, Length, BytesProcessed, PIPE_COPY_REVERSE);
 }
-uint8_t Pipe_Write_Stream_BE(const void* const Buffer,
-			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed)
+
+uint8_t Pipe_Write_PStream_LE(const uint8_t corenum,
+							  const void* const Buffer,
+			                  uint16_t Length,
+			                  uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Write_Stream_LE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Read_Stream_BE(void* const Buffer,
-			                            uint16_t Length,
-			                            uint16_t* const BytesProcessed)
+uint8_t Pipe_Write_PStream_BE(const uint8_t corenum,
+							  const void* const Buffer,
+			                  uint16_t Length,
+			                  uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Write_Stream_BE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Write_PStream_LE(const void* const Buffer,
-			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed)
+uint8_t Pipe_Write_EStream_LE(const uint8_t corenum,
+							  const void* const Buffer,
+			                  uint16_t Length,
+			                  uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Write_Stream_LE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Write_PStream_BE(const void* const Buffer,
-			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed)
+uint8_t Pipe_Write_EStream_BE(const uint8_t corenum,
+							  const void* const Buffer,
+			                  uint16_t Length,
+			                  uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Write_Stream_BE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Write_EStream_LE(const void* const Buffer,
-			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed)
+uint8_t Pipe_Read_EStream_LE(const uint8_t corenum,
+							 void* const Buffer,
+			                 uint16_t Length,
+			                 uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Read_Stream_LE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Write_EStream_BE(const void* const Buffer,
-			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed)
+uint8_t Pipe_Read_EStream_BE(const uint8_t corenum,
+							 void* const Buffer,
+			                 uint16_t Length,
+			                 uint16_t* const BytesProcessed)
 {
-	return PIPE_RWSTREAM_NoError;
+	return Pipe_Read_Stream_BE(corenum, Buffer, Length, BytesProcessed);
 }
 
-uint8_t Pipe_Read_EStream_LE(void* const Buffer,
-			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed)
+/* Common implementation of the stream functions. DataStream == NULL writes zeros (OUT) or
+ * discards the data (IN). With PIPE_COPY_REVERSE the caller's buffer is processed from the
+ * end, i.e. the stream is big endian.
+ */
+static uint8_t Pipe_Copy_Stream(const uint8_t corenum,
+								uint8_t* DataStream,
+								uint16_t Length,
+								uint16_t* const BytesProcessed,
+								const uint8_t Flags)
 {
+	USB_Pipe_Data_t* const Pipe = &PipeInfo[corenum][pipeselected[corenum]];
+	uint16_t BytesInTransfer = 0;
+	uint16_t Done = 0;
+	uint16_t Chunk;
+	uint8_t  ErrorCode;
+
+	if (BytesProcessed != NULL)
+	{
+		Done = *BytesProcessed;
+		Length -= Done;
+	}
+
+	if (Length == 0)
+	  return PIPE_RWSTREAM_NoError;
+
+	/* An empty IN buffer is only refilled by a new transfer (as in Pipe_IsINReceived) */
+	if (!(Flags & PIPE_COPY_WRITE) && Pipe->ByteTransfered == Pipe->StartIdx
+		&& HcdGetPipeStatus(Pipe->PipeHandle) == HCD_STATUS_OK)
+	{
+		Pipe_ClearIN(corenum);
+		HcdDataTransfer(Pipe->PipeHandle, Pipe->Buffer, MIN(Length, Pipe->BufferSize),
+						&Pipe->ByteTransfered);
+	}
+
+	/* A full OUT buffer is sent below, the pipe isn't "ready" before that */
+	if (!(Flags & PIPE_COPY_WRITE) || Pipe->ByteTransfered < Pipe->BufferSize)
+	{
+		if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
+		  return ErrorCode;
+	}
+
+	while (Length)
+	{
+		if (Flags & PIPE_COPY_WRITE)
+		  Chunk = Pipe->BufferSize - Pipe->ByteTransfered;
+		else
+		  Chunk = Pipe->ByteTransfered - Pipe->StartIdx;
+
+		if (Chunk == 0)
+		{
+			/* Transfer buffer full (OUT) or empty (IN) */
+			if (Flags & PIPE_COPY_WRITE)
+			{
+				Pipe_ClearOUT(corenum);
+			}
+			else
+			{
+				Pipe_ClearIN(corenum);
+				HcdDataTransfer(Pipe->PipeHandle, Pipe->Buffer, MIN(Length, Pipe->BufferSize),
+								&Pipe->ByteTransfered);
+			}
+
+			if (BytesProcessed != NULL)
+			{
+				*BytesProcessed = Done + BytesInTransfer;
+				return PIPE_RWSTREAM_IncompleteTransfer;
+			}
+
+			if ((ErrorCode = Pipe_WaitUntilReady(corenum)))
+			  return ErrorCode;
+
+			continue;
+		}
+
+		if (Chunk > Length)
+		  Chunk = Length;
+
+		if (Flags & PIPE_COPY_WRITE)
+		{
+			if (DataStream == NULL)
+			  memset(&Pipe->Buffer[Pipe->ByteTransfered], 0, Chunk);
+			else if (Flags & PIPE_COPY_REVERSE)
+			  Pipe_Copy_Reversed(&Pipe->Buffer[Pipe->ByteTransfered], &DataStream[Length - Chunk], Chunk);
+			else
+			  memcpy(&Pipe->Buffer[Pipe->ByteTransfered], &DataStream[Done + BytesInTransfer], Chunk);
+
+			Pipe->ByteTransfered += Chunk;
+		}
+		else
+		{
+			if (DataStream == NULL)
+			  ; /* discard */
+			else if (Flags & PIPE_COPY_REVERSE)
+			  Pipe_Copy_Reversed(&DataStream[Length - Chunk], &Pipe->Buffer[Pipe->StartIdx], Chunk);
+			else
+			  memcpy(&DataStream[Done + BytesInTransfer], &Pipe->Buffer[Pipe->StartIdx], Chunk);
+
+			Pipe->StartIdx += Chunk;
+		}
+
+		BytesInTransfer += Chunk;
+		Length          -= Chunk;
+	}
+
 	return PIPE_RWSTREAM_NoError;
 }
 
-uint8_t Pipe_Read_EStream_BE(void* const Buffer,
-			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed)
+/* Copy Length bytes, Dest[0] = Source[Length - 1] */
+static void Pipe_Copy_Reversed(uint8_t* Dest,
+							   const uint8_t* Source,
+							   uint16_t Length)
 {
-	return PIPE_RWSTREAM_NoError;
+	Source += Length;
+
+	while (Length--)
+	  *Dest++ = *--Source;
 }
 
 #endif
-
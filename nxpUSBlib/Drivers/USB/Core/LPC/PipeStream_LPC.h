@@ -255,9 +255,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Write_Stream_BE(const void* const Buffer,
+			uint8_t Pipe_Write_Stream_BE(const uint8_t corenum,
+			                             const void* const Buffer,
 			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 
 			/** Reads the given number of bytes from the pipe into the given buffer in little endian,
 			 *  sending full packets to the device as needed. The last packet filled is not automatically sent;
@@ -337,9 +338,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Read_Stream_BE(void* const Buffer,
+			uint8_t Pipe_Read_Stream_BE(const uint8_t corenum,
+			                            void* const Buffer,
 			                            uint16_t Length,
-			                            uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                            uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			//@}
 
 			/** \name Stream functions for EEPROM source/destination data */
@@ -354,9 +356,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Write_EStream_LE(const void* const Buffer,
+			uint8_t Pipe_Write_EStream_LE(const uint8_t corenum,
+			                              const void* const Buffer,
 			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			
 			/** EEPROM buffer source version of \ref Pipe_Write_Stream_BE().
 			 *
@@ -367,9 +370,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Write_EStream_BE(const void* const Buffer,
+			uint8_t Pipe_Write_EStream_BE(const uint8_t corenum,
+			                              const void* const Buffer,
 			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 
 			/** EEPROM buffer source version of \ref Pipe_Read_Stream_LE().
 			 *
@@ -380,9 +384,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Read_EStream_LE(void* const Buffer,
+			uint8_t Pipe_Read_EStream_LE(const uint8_t corenum,
+			                             void* const Buffer,
 			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			
 			/** EEPROM buffer source version of \ref Pipe_Read_Stream_BE().
 			 *
@@ -393,9 +398,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Read_EStream_BE(void* const Buffer,
+			uint8_t Pipe_Read_EStream_BE(const uint8_t corenum,
+			                             void* const Buffer,
 			                             uint16_t Length,
-			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                             uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			//@}
 
 			/** \name Stream functions for PROGMEM source/destination data */
@@ -412,9 +418,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Write_PStream_LE(const void* const Buffer,
+			uint8_t Pipe_Write_PStream_LE(const uint8_t corenum,
+			                              const void* const Buffer,
 			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1) ATTR_ERROR("Function is not implemented yet");
+			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			
 			/** FLASH buffer source version of \ref Pipe_Write_Stream_BE().
 			 *
@@ -427,9 +434,10 @@
 			 *
 			 *  \return A value from the \ref Pipe_Stream_RW_ErrorCodes_t enum.
 			 */
-			uint8_t Pipe_Write_PStream_BE(const void* const Buffer,
+			uint8_t Pipe_Write_PStream_BE(const uint8_t corenum,
+			                              const void* const Buffer,
 			                              uint16_t Length,
-			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1)ATTR_ERROR("Function is not implemented yet");
+			                              uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(2);
 			//@}
 
 	/* Disable C linkage for C++ Compilers: */
@@ -100,13 +100,14 @@ bool Pipe_IsEndpointBound(const uint8_t EndpointAddress)
 
 uint8_t Pipe_WaitUntilReady(const uint8_t corenum)
 {
-/*	#if (USB_STREAM_TIMEOUT_MS < 0xFF)
+	#if (USB_STREAM_TIMEOUT_MS < 0xFF)
 	uint8_t  TimeoutMSRem = USB_STREAM_TIMEOUT_MS;
 	#else
 	uint16_t TimeoutMSRem = USB_STREAM_TIMEOUT_MS;
 	#endif
 
-	uint16_t PreviousFrameNumber = USB_Host_GetFrameNumber();*/
+	/* The frame number of the core's own host controller, corenum is the HostID */
+	uint16_t PreviousFrameNumber = (uint16_t) HcdGetFrameNumber(corenum);
 
 	for (;;)
 	{
@@ -120,8 +121,7 @@ uint8_t Pipe_WaitUntilReady(const uint8_t corenum)
 		else if (USB_HostState[corenum] == HOST_STATE_Unattached)
 		  return PIPE_READYWAIT_DeviceDisconnected;
 
-		/*TODO no timeout yet */
-		/* uint16_t CurrentFrameNumber = USB_Host_GetFrameNumber();
+		uint16_t CurrentFrameNumber = (uint16_t) HcdGetFrameNumber(corenum);
 
 		if (CurrentFrameNumber != PreviousFrameNumber)
 		{
@@ -129,7 +129,7 @@ uint8_t Pipe_WaitUntilReady(const uint8_t corenum)
 
 			if (!(TimeoutMSRem--))
 			  return PIPE_READYWAIT_Timeout;
-		}*/
+		}
 	}
 }
 
@@ -33,6 +33,17 @@
 #include "LPC/HAL/HAL_LPC.h"
 #include "USBMemory.h"
 
+/*
+ * The pool is split at init into one region per size class and an arena:
+ *
+ *   | 64 byte blocks | 512 byte blocks | arena (first fit) |
+ *
+ * Free blocks of a class are kept in a singly linked list through their first
+ * word, so allocating and freeing a block is O(1) and the classes never
+ * fragment. The class of a pointer is found from the region it is in.
+ * Requests that don't fit a class with a free block are served from the arena.
+ */
+
 /************************************************************************/
 /* LOCAL SYMBOL DECLARATIION                                            */
 /************************************************************************/
@@ -42,21 +53,41 @@ typedef struct MemBlockInfo_t {
 	uint32_t next :16; // offset (from head address) to the next block
 } sMemBlockInfo, *PMemBlockInfo;
 
+typedef struct MemFreeBlock_t {
+	struct MemFreeBlock_t* next;
+} sMemFreeBlock;
+
+typedef struct MemClass_t {
+	uint8_t* start;			// first block of the region
+	uint8_t* end;			// end of the region
+	sMemFreeBlock* free;	// free list
+	uint8_t numFree;
+	uint8_t minFree;
+} sMemClass;
+
 /************************************************************************/
 /* LOCAL DEFINE                                                         */
 /************************************************************************/
 #define ALIGN_FOUR_BYTES    (4) // FIXME only m3 is 1 byte alignment
 
-/* FIXME the following dynamic allocation is temporarly */
-
 #define  HEADER_SIZE                (sizeof(sMemBlockInfo))
 #define  HEADER_POINTER(x)          ((uint8_t *)x - sizeof(sMemBlockInfo))
 #define  NEXT_BLOCK(x)            ( ((PMemBlockInfo) ( ((x)->next==0) ? NULL : head + (x)->next )) )
 #define  LINK_TO_THIS_BLOCK(x)    ( ((uint32_t) ((x)-head)) )
 
+static const uint16_t ClassSize[USB_MEMORY_NUM_CLASSES] = {64, 512};
+static const uint8_t ClassBlocks[USB_MEMORY_NUM_CLASSES] = {USB_MEMORY_BLOCKS_64, USB_MEMORY_BLOCKS_512};
+
 PRAGMA_ALIGN_4
 static uint8_t USB_Mem_Buffer[USBRAM_BUFFER_SIZE] ATTR_ALIGNED(4) __DATA(USBRAM_SECTION);
 
+static sMemClass Classes[USB_MEMORY_NUM_CLASSES];
+static PMemBlockInfo Arena;		// NULL if there is no room for an arena
+static USB_Memory_Stats_t Stats;
+
+static uint8_t* Arena_Alloc(uint32_t size);
+static void Arena_Free(uint8_t *ptr);
+
 /************************************************************************
  Function    : lpc_memory_init
  Parameters  : void
@@ -65,11 +96,47 @@ static uint8_t USB_Mem_Buffer[USBRAM_BUFFER_SIZE] ATTR_ALIGNED(4) __DATA(USBRAM_
  ************************************************************************/
 void USB_Memory_Init(uint32_t Memory_Pool_Size)
 {
-	PMemBlockInfo head = (PMemBlockInfo) USB_Mem_Buffer;
+	uint8_t* p = USB_Mem_Buffer;
+	uint8_t* end;
+	uint32_t i, n;
+
+	if (Memory_Pool_Size > sizeof(USB_Mem_Buffer))
+	{
+		Memory_Pool_Size = sizeof(USB_Mem_Buffer);
+	}
+	end = USB_Mem_Buffer + (Memory_Pool_Size & 0xfffffffc);
 
-	head->next = 0;
-	head->size = (Memory_Pool_Size & 0xfffffffc) - HEADER_SIZE ;// align memory size
-	head->isFree = 1;
+	memset(&Stats, 0, sizeof(Stats));
+
+	for (i = 0; i < USB_MEMORY_NUM_CLASSES; i++)
+	{
+		Classes[i].start = p;
+		Classes[i].free = NULL;
+		Classes[i].numFree = 0;
+
+		for (n = 0; n < ClassBlocks[i] && p + ClassSize[i] <= end; n++)
+		{
+			((sMemFreeBlock*) p)->next = Classes[i].free;
+			Classes[i].free = (sMemFreeBlock*) p;
+			Classes[i].numFree++;
+			p += ClassSize[i];
+		}
+
+		Classes[i].end = p;
+		Classes[i].minFree = Classes[i].numFree;
+	}
+
+	if (end - p > HEADER_SIZE + ALIGN_FOUR_BYTES)
+	{
+		Arena = (PMemBlockInfo) p;
+		Arena->next = 0;
+		Arena->size = (end - p) - HEADER_SIZE;
+		Arena->isFree = 1;
+	}
+	else
+	{
+		Arena = NULL;
+	}
 }
 
 /************************************************************************
@@ -77,12 +144,136 @@ void USB_Memory_Init(uint32_t Memory_Pool_Size)
  Parameters  : unsigned int    - memory block size
  Returns     : uint8_t *  - Pointer to memory block or NULL
  Description : This function allocates a memory block for the given size
- from memory pool segment
+ from the smallest size class with a free block, or from the arena
  ************************************************************************/
 uint8_t* USB_Memory_Alloc(uint32_t size)
+{
+	sMemClass* c;
+	uint8_t* ptr = NULL;
+	uint32_t i;
+
+	for (i = 0; i < USB_MEMORY_NUM_CLASSES; i++)
+	{
+		c = &Classes[i];
+
+		if (size <= ClassSize[i] && c->free != NULL)
+		{
+			ptr = (uint8_t*) c->free;
+			c->free = c->free->next;
+
+			if (--c->numFree < c->minFree)
+			{
+				c->minFree = c->numFree;
+			}
+
+			Stats.InUse += ClassSize[i];
+			break;
+		}
+	}
+
+	if (ptr == NULL)
+	{
+		ptr = Arena_Alloc(size);
+	}
+
+	if (ptr == NULL)
+	{
+		Stats.Failures++;
+		return NULL;
+	}
+
+	Stats.Allocs++;
+	if (Stats.InUse > Stats.HighWater)
+	{
+		Stats.HighWater = Stats.InUse;
+	}
+
+	return ptr;
+}
+
+/************************************************************************
+ Function    : lpc_free
+ Parameters  : uint8_t *  - Pointer to memory block
+ Returns     : None
+ Description : This function frees up the given memory block
+ ************************************************************************/
+void USB_Memory_Free(uint8_t *ptr)
+{
+	uint32_t i;
+
+	if (ptr == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < USB_MEMORY_NUM_CLASSES; i++)
+	{
+		sMemClass* c = &Classes[i];
+
+		if (ptr >= c->start && ptr < c->end)
+		{
+			((sMemFreeBlock*) ptr)->next = c->free;
+			c->free = (sMemFreeBlock*) ptr;
+			c->numFree++;
+			Stats.InUse -= ClassSize[i];
+			return;
+		}
+	}
+
+	Arena_Free(ptr);
+}
+
+/************************************************************************
+ Function    : USB_Memory_GetStats
+ Parameters  : USB_Memory_Stats_t *  - statistics
+ Returns     : None
+ Description : Get usage and fragmentation of the memory pool
+ ************************************************************************/
+void USB_Memory_GetStats(USB_Memory_Stats_t* stats)
+{
+	PMemBlockInfo head = Arena;
+	PMemBlockInfo blk;
+	uint32_t i;
+
+	*stats = Stats;
+	stats->ArenaFree = 0;
+	stats->ArenaLargest = 0;
+	stats->Fragmentation = 0;
+
+	for (i = 0; i < USB_MEMORY_NUM_CLASSES; i++)
+	{
+		stats->BlocksFree[i] = Classes[i].numFree;
+		stats->BlocksMin[i] = Classes[i].minFree;
+	}
+
+	for (blk = head; blk != NULL; blk = NEXT_BLOCK(blk))
+	{
+		if (blk->isFree)
+		{
+			stats->ArenaFree += blk->size;
+			if (blk->size > stats->ArenaLargest)
+			{
+				stats->ArenaLargest = blk->size;
+			}
+		}
+	}
+
+	if (stats->ArenaFree > 0)
+	{
+		stats->Fragmentation = 100 - (stats->ArenaLargest * 100) / stats->ArenaFree;
+	}
+}
+
+/************************************************************************
+ Function    : Arena_Alloc
+ Parameters  : unsigned int    - memory block size
+ Returns     : uint8_t *  - Pointer to memory block or NULL
+ Description : First fit allocation from the arena
+ ************************************************************************/
+static uint8_t* Arena_Alloc(uint32_t size)
 {
 	PMemBlockInfo freeBlock, newBlock, blk_ptr = NULL;
-	PMemBlockInfo head = (PMemBlockInfo) USB_Mem_Buffer;
+	PMemBlockInfo head = Arena;
 
 	/* Align the requested size by 4 bytes */
 	if ((size % ALIGN_FOUR_BYTES) != 0) {
@@ -105,8 +296,6 @@ uint8_t* USB_Memory_Alloc(uint32_t size)
 	if (blk_ptr->size <= HEADER_SIZE + size) // where (blk_size=size | blk_size=size+HEAD) then allocate whole block & do not create freeBlock
 	{
 		newBlock = blk_ptr;
-		//newBlock->size    = blk_ptr->size;
-		//newBlock->next    = blk_ptr->next;
 		newBlock->isFree = 0;
 	} else {
 		/* Locate empty block at end of found block */
@@ -122,29 +311,27 @@ uint8_t* USB_Memory_Alloc(uint32_t size)
 		newBlock->isFree = 0;
 	}
 
+	Stats.InUse += newBlock->size + HEADER_SIZE;
+
 	return (((uint8_t *) newBlock) + HEADER_SIZE);
 }
 
 /************************************************************************
- Function    : lpc_free
+ Function    : Arena_Free
  Parameters  : uint8_t *  - Pointer to memory block
  Returns     : None
- Description : This function frees up the given memory block and does
- packing of fragmented blocks
+ Description : Free an arena block and merge it with free neighbours
  ************************************************************************/
-void USB_Memory_Free(uint8_t *ptr)
+static void Arena_Free(uint8_t *ptr)
 {
 	PMemBlockInfo prev;
-	PMemBlockInfo head = (PMemBlockInfo) USB_Mem_Buffer;
+	PMemBlockInfo head = Arena;
 	PMemBlockInfo blk_ptr;
 
-	if (ptr == NULL)
-	{
-		return;
-	}
-
 	blk_ptr = (PMemBlockInfo) HEADER_POINTER(ptr);
 
+	Stats.InUse -= blk_ptr->size + HEADER_SIZE;
+
 	if (blk_ptr->next != 0) // merge with next free block
 	{
 		if (NEXT_BLOCK(blk_ptr)->isFree == 1)
@@ -169,8 +356,6 @@ void USB_Memory_Free(uint8_t *ptr)
 	}
 
 	blk_ptr->isFree = 1;
-
-	return;
 }
 
 #endif
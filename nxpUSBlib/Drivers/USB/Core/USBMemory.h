@@ -35,9 +35,38 @@
 #include "lpc_types.h"
 #include "../../../Common/Common.h"
 
+/* Defines: */
+/** Number of 512 byte blocks (bulk and control pipe buffers) */
+#ifndef USB_MEMORY_BLOCKS_512
+#define USB_MEMORY_BLOCKS_512		3
+#endif
+
+/** Number of 64 byte blocks (interrupt pipe buffers) */
+#ifndef USB_MEMORY_BLOCKS_64
+#define USB_MEMORY_BLOCKS_64		4
+#endif
+
+/** Number of block size classes */
+#define USB_MEMORY_NUM_CLASSES		2
+
+/* Type Defines: */
+/** Usage of the USB RAM pool, see \ref USB_Memory_GetStats() */
+typedef struct {
+	uint32_t InUse;			/**< Bytes allocated, blocks count with their full size */
+	uint32_t HighWater;		/**< Largest InUse value */
+	uint32_t Allocs;		/**< Successful allocations */
+	uint32_t Failures;		/**< Failed allocations */
+	uint32_t ArenaFree;		/**< Free bytes in the arena for other sizes */
+	uint32_t ArenaLargest;	/**< Largest free block in the arena */
+	uint8_t  Fragmentation;	/**< Arena fragmentation in %, 0 when all free bytes are in one block */
+	uint8_t  BlocksFree[USB_MEMORY_NUM_CLASSES];	/**< Free blocks per size class, smallest first */
+	uint8_t  BlocksMin[USB_MEMORY_NUM_CLASSES];		/**< Lowest BlocksFree value */
+} USB_Memory_Stats_t;
+
 /* Function Prototypes: */
 void USB_Memory_Init(uint32_t Memory_Pool_Size);
 uint8_t* USB_Memory_Alloc(uint32_t size);
 void USB_Memory_Free(uint8_t *ptr);
+void USB_Memory_GetStats(USB_Memory_Stats_t* stats);
 
 #endif /* __USBMEMORY_H__ */
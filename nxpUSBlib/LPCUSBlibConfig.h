@@ -55,6 +55,8 @@
 
 /** Size of share memory that a device uses to store data transfer to/ receive from host
  *  or a host uses to store data transfer to/ receive from device.
+ *  In host mode it is split into USB_MEMORY_BLOCKS_64 and USB_MEMORY_BLOCKS_512
+ *  pipe buffers (see USBMemory.h), the rest is used for other sizes.
  */
 #define USBRAM_BUFFER_SIZE  (2*1024)
 
@@ -0,0 +1,452 @@
+/****************************************************************************************************//**
+*
+* @file		aoaframe_test.c
+* @brief	Host test of the record framing of the Android accessory link
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Encodes random records into transfers and decodes them again, from the
+ * whole transfer, from random splits and from the packets of the
+ * transfers, where records are split over packets and many records share
+ * one packet. Then a length byte is corrupted or a packet is lost: the
+ * records of the other transfers must still come out intact.
+ *
+ * Last, node values arriving at a fixed rate are sent with a few flush
+ * policies (when a transfer is started). Reported are the records/s the
+ * host encodes and decodes, the USB packets and bytes per record and the
+ * mean time a record waits for its transfer. The time on the bus isn't
+ * modelled.
+ *
+ * Usage: aoaframe_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "aoaframe.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define PACKET_SIZE   (64)
+#define BUF_SIZE      (4 * PACKET_SIZE)
+#define DEC_BUF_SIZE  (AOAFRAME_RECORD_SIZE(AOAFRAME_MAX_DATA) + PACKET_SIZE)
+
+#define MAX_RECORDS   (BUF_SIZE / 2)
+#define TRANSFERS     (20000)
+
+// node values (CMD_NODE_VALUE with 4 data bytes) for the flush policies
+#define VALUE_LEN     (4)
+#define VALUES        (200000)
+#define VALUE_US      (500)   // one value every VALUE_US
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint8_t cmd;
+  uint8_t len;
+  uint8_t data[AOAFRAME_MAX_DATA];
+} record_t;
+
+// transfers a stream of records was encoded into
+typedef struct {
+  uint8_t buf[BUF_SIZE];
+  uint16_t len;
+  uint16_t first;        // index of the first record
+  uint16_t records;
+} transfer_t;
+
+typedef struct {
+  const char* name;
+  uint16_t flushBytes;   // start a transfer when this many bytes wait
+  uint32_t latencyUs;    // or when the oldest record has waited this long
+} policy_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const policy_t policies[] = {
+  {"each record",           1,           0},
+  {"full packet or 1 ms",   PACKET_SIZE, 1000},
+  {"full packet or 10 ms",  PACKET_SIZE, 10000},
+  {"full buffer or 10 ms",  BUF_SIZE,    10000},
+};
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static record_t sent[4 * MAX_RECORDS];
+static uint16_t numSent = 0;
+
+static record_t received[8 * MAX_RECORDS];
+static uint16_t numReceived = 0;
+
+static transfer_t xfers[4];
+static uint8_t decBuf[DEC_BUF_SIZE];
+
+// flush policy run: sequence number expected by the receiver, arrival
+// time of the queued values and totals
+static uint32_t nextValue = 0;
+static uint32_t arrival[MAX_RECORDS];
+static uint64_t waited = 0;
+static uint32_t transfers = 0;
+static uint32_t packets = 0;
+static uint32_t bytes = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void storeRecord(void* ctx, uint8_t cmd, const uint8_t* data, uint8_t len)
+{
+  record_t* r = &received[numReceived++];
+
+  CHECK(numReceived <= sizeof(received) / sizeof(received[0]));
+  CHECK(ctx == received);
+  r->cmd = cmd;
+  r->len = len;
+  memcpy(r->data, data, len);
+}
+
+static uint8_t sameRecord(const record_t* a, const record_t* b)
+{
+  return (a->cmd == b->cmd && a->len == b->len
+      && memcmp(a->data, b->data, a->len) == 0);
+}
+
+static void randomRecord(record_t* r)
+{
+  uint8_t i = 0;
+
+  r->cmd = rand();
+  // mostly short records like the node values, some up to the limit
+  r->len = (rand() % 4 ? rand() % 9 : rand() % (AOAFRAME_MAX_DATA + 1));
+  for (i = 0; i < r->len; i++) {
+    r->data[i] = rand();
+  }
+}
+
+// Encode random records into a transfer, as many as fit
+static void encodeTransfer(transfer_t* x)
+{
+  aoaframe_enc_t enc;
+  record_t* r = NULL;
+
+  aoaframe_init(&enc, x->buf, BUF_SIZE);
+  x->first = numSent;
+
+  for (;;) {
+    r = &sent[numSent];
+    randomRecord(r);
+    if (!aoaframe_put(&enc, r->cmd, r->data, r->len)) {
+      // the longest records don't fit even in an empty buffer
+      CHECK(AOAFRAME_RECORD_SIZE(r->len) > BUF_SIZE - 1 - enc.used);
+      if (enc.records > 0) {
+        break;
+      }
+      continue;
+    }
+    numSent++;
+    CHECK(enc.records == numSent - x->first);
+    CHECK(enc.used < BUF_SIZE);
+  }
+
+  x->records = numSent - x->first;
+  x->len = aoaframe_finish(&enc, PACKET_SIZE);
+  CHECK(x->len > 0 && x->len <= BUF_SIZE);
+  CHECK((x->len % PACKET_SIZE) != 0);
+}
+
+// Pass a transfer to the decoder in packets
+static void receiveTransfer(aoaframe_dec_t* dec, const transfer_t* x)
+{
+  uint16_t pos = 0;
+  uint16_t n = 0;
+
+  for (pos = 0; pos < x->len; pos += n) {
+    n = (x->len - pos > PACKET_SIZE ? PACKET_SIZE : x->len - pos);
+    aoaframe_receive(dec, &x->buf[pos], n, n < PACKET_SIZE);
+  }
+}
+
+static void testRoundTrip(void)
+{
+  aoaframe_enc_t enc;
+  uint8_t buf[BUF_SIZE];
+  uint16_t used = 0;
+  uint16_t cut = 0;
+  uint16_t pos = 0;
+  uint32_t records = 0;
+  int t = 0;
+  int i = 0;
+
+  for (t = 0; t < TRANSFERS; t++) {
+    numSent = 0;
+    encodeTransfer(&xfers[0]);
+    records += numSent;
+
+    // the whole transfer
+    numReceived = 0;
+    CHECK(aoaframe_decode(xfers[0].buf, xfers[0].len, storeRecord, received)
+        == xfers[0].len);
+    CHECK(numReceived == numSent);
+    for (i = 0; i < numSent; i++) {
+      CHECK(sameRecord(&received[i], &sent[i]));
+    }
+
+    // in two parts split anywhere, only complete records are decoded
+    numReceived = 0;
+    cut = rand() % (xfers[0].len + 1);
+    pos = aoaframe_decode(xfers[0].buf, cut, storeRecord, received);
+    CHECK(pos <= cut);
+    pos += aoaframe_decode(&xfers[0].buf[pos], xfers[0].len - pos, storeRecord,
+        received);
+    CHECK(pos == xfers[0].len && numReceived == numSent);
+    for (i = 0; i < numSent; i++) {
+      CHECK(sameRecord(&received[i], &sent[i]));
+    }
+  }
+
+  // a record that doesn't fit is refused, one byte is kept for padding
+  aoaframe_init(&enc, buf, BUF_SIZE);
+  CHECK(aoaframe_put(&enc, 1, buf, AOAFRAME_MAX_DATA + 1) == 0);
+  used = 0;
+  while (aoaframe_put(&enc, 1, buf, PACKET_SIZE - 2)) {
+    used += PACKET_SIZE;
+  }
+  CHECK(used == BUF_SIZE - PACKET_SIZE && enc.used == used);
+  CHECK(aoaframe_finish(&enc, PACKET_SIZE) == used + 1 && buf[used] == 0);
+  aoaframe_clear(&enc);
+  CHECK(aoaframe_finish(&enc, PACKET_SIZE) == 0);
+
+  printf("round trip: %u records in %u transfers\n", records, TRANSFERS);
+}
+
+// Records split over packets and many records in one packet
+static void testPackets(void)
+{
+  aoaframe_dec_t dec;
+  uint32_t records = 0;
+  int t = 0;
+  int i = 0;
+  int k = 0;
+
+  aoaframe_decInit(&dec, decBuf, DEC_BUF_SIZE, storeRecord, received);
+
+  for (t = 0; t < TRANSFERS / 4; t++) {
+    numSent = 0;
+    numReceived = 0;
+    for (k = 0; k < 4; k++) {
+      encodeTransfer(&xfers[k]);
+      receiveTransfer(&dec, &xfers[k]);
+    }
+
+    CHECK(numReceived == numSent && dec.len == 0 && dec.dropped == 0);
+    for (i = 0; i < numSent; i++) {
+      CHECK(sameRecord(&received[i], &sent[i]));
+    }
+    records += numSent;
+  }
+
+  printf("packets: %u records\n", records);
+}
+
+// A corrupt length or a lost packet only loses the rest of its transfer
+static void testResync(void)
+{
+  aoaframe_dec_t dec;
+  transfer_t* bad = NULL;
+  uint16_t pos = 0;
+  uint16_t lost = 0;
+  uint16_t rec = 0;
+  uint32_t dropped = 0;
+  int t = 0;
+  int i = 0;
+  int k = 0;
+
+  for (t = 0; t < TRANSFERS / 4; t++) {
+    aoaframe_decInit(&dec, decBuf, DEC_BUF_SIZE, storeRecord, received);
+    numSent = 0;
+    numReceived = 0;
+    for (k = 0; k < 4; k++) {
+      encodeTransfer(&xfers[k]);
+    }
+
+    // a random length byte of the second transfer, the records before it
+    // come out as they are
+    bad = &xfers[1];
+    rec = rand() % bad->records;
+    pos = 0;
+    for (i = 0; i < rec; i++) {
+      pos += AOAFRAME_RECORD_SIZE(sent[bad->first + i].len);
+    }
+    bad->buf[pos] = (rand() % 2 ? 0xFF - rand() % 32 : rand());
+
+    if (t % 2 == 0 || bad->len <= 2 * PACKET_SIZE) {
+      for (k = 0; k < 4; k++) {
+        receiveTransfer(&dec, &xfers[k]);
+      }
+    }
+    else {
+      // instead the second packet of the transfer is lost
+      receiveTransfer(&dec, &xfers[0]);
+      aoaframe_receive(&dec, bad->buf, PACKET_SIZE, 0);
+      aoaframe_resync(&dec);
+      for (pos = 2 * PACKET_SIZE; pos < bad->len; pos += PACKET_SIZE) {
+        lost = (bad->len - pos > PACKET_SIZE ? PACKET_SIZE : bad->len - pos);
+        aoaframe_receive(&dec, &bad->buf[pos], lost, lost < PACKET_SIZE);
+      }
+      receiveTransfer(&dec, &xfers[2]);
+      receiveTransfer(&dec, &xfers[3]);
+      rec = 0;
+    }
+
+    // the first transfer and the part of the second before the error
+    for (i = 0; i < xfers[0].records + rec; i++) {
+      CHECK(i < numReceived && sameRecord(&received[i], &sent[i]));
+    }
+
+    // whatever the corrupt part decodes to, the last transfers are intact
+    k = xfers[2].records + xfers[3].records;
+    CHECK(numReceived >= xfers[0].records + rec + k);
+    for (i = 0; i < k; i++) {
+      CHECK(sameRecord(&received[numReceived - k + i], &sent[xfers[2].first + i]));
+    }
+
+    CHECK(dec.len == 0 && dec.resync == 0);
+    dropped += dec.dropped;
+  }
+
+  printf("resync: %u bytes dropped in %u broken transfers\n", dropped, TRANSFERS / 4);
+}
+
+static void checkValue(void* ctx, uint8_t cmd, const uint8_t* data, uint8_t len)
+{
+  uint32_t seq = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+  CHECK(cmd == 2 && len == VALUE_LEN && seq == nextValue);
+  nextValue++;
+}
+
+// Send the queued values as one transfer at time 'now' (us)
+static void sendValues(aoaframe_enc_t* enc, aoaframe_dec_t* dec, uint32_t now)
+{
+  uint16_t len = aoaframe_finish(enc, PACKET_SIZE);
+  uint16_t pos = 0;
+  uint16_t n = 0;
+  uint16_t k = 0;
+
+  for (k = 0; k < enc->records; k++) {
+    waited += now - arrival[k];
+  }
+
+  transfers++;
+  bytes += len;
+  packets += len / PACKET_SIZE + 1;
+
+  for (pos = 0; pos < len; pos += n) {
+    n = (len - pos > PACKET_SIZE ? PACKET_SIZE : len - pos);
+    aoaframe_receive(dec, &enc->buf[pos], n, n < PACKET_SIZE);
+  }
+
+  aoaframe_clear(enc);
+}
+
+static void runPolicy(const policy_t* p)
+{
+  aoaframe_enc_t enc;
+  aoaframe_dec_t dec;
+  uint8_t buf[BUF_SIZE];
+  uint8_t data[VALUE_LEN];
+  uint32_t now = 0;
+  uint32_t i = 0;
+  double start = 0;
+  double secs = 0;
+
+  aoaframe_init(&enc, buf, BUF_SIZE);
+  aoaframe_decInit(&dec, decBuf, DEC_BUF_SIZE, checkValue, NULL);
+  nextValue = 0;
+  waited = 0;
+  transfers = 0;
+  packets = 0;
+  bytes = 0;
+
+  start = test_seconds();
+
+  for (i = 0; i < VALUES; i++) {
+    now = i * VALUE_US;
+
+    // the deadline of the oldest value has passed before this one arrives
+    if (enc.records > 0 && now - arrival[0] >= p->latencyUs) {
+      sendValues(&enc, &dec, arrival[0] + p->latencyUs);
+    }
+
+    data[0] = i;
+    data[1] = i >> 8;
+    data[2] = i >> 16;
+    data[3] = i >> 24;
+    CHECK(aoaframe_put(&enc, 2, data, VALUE_LEN));
+    arrival[enc.records - 1] = now;
+
+    // enough bytes are waiting or the next value wouldn't fit
+    if (enc.used >= p->flushBytes
+        || enc.used + AOAFRAME_RECORD_SIZE(VALUE_LEN) > BUF_SIZE - 1) {
+      sendValues(&enc, &dec, now);
+    }
+  }
+
+  if (enc.records > 0) {
+    sendValues(&enc, &dec, arrival[0] + p->latencyUs);
+  }
+
+  secs = test_seconds() - start;
+  CHECK(nextValue == VALUES && dec.dropped == 0);
+
+  printf("%-22s %9.0f records/s, %6u transfers, %.3f packets/record, "
+      "%.2f bytes/record, wait %.2f ms\n", p->name, VALUES / secs, transfers,
+      (double)packets / VALUES, (double)bytes / VALUES,
+      (double)waited / VALUES / 1000);
+}
+
+static void testPolicies(void)
+{
+  uint32_t i = 0;
+
+  printf("%u node values, one every %u us, %u byte buffer:\n", VALUES, VALUE_US, BUF_SIZE);
+  for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    runPolicy(&policies[i]);
+  }
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testRoundTrip();
+  testPackets();
+  testResync();
+  testPolicies();
+
+  printf("aoaframe_test ok\n");
+  return 0;
+}
@@ -0,0 +1,577 @@
+/****************************************************************************************************//**
+*
+* @file		aoanode_test.c
+* @brief	Host test of the node cache and subscriptions of the AOA demo
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs aoanode.c with the canpt requests it sends recorded by the stubs
+ * below. A session is followed through node attach, subscription answers,
+ * values, a device that disconnects and connects again (the cached nodes
+ * and values are sent again, nothing is subscribed) and the end of the
+ * hold time (all subscriptions are cancelled, once). Then random
+ * operations on many nodes are checked against a model of the cache and
+ * of the subscription lists, and no subscription entry may be lost.
+ *
+ * Usage: aoanode_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "board.h"
+#include "canpt.h"
+#include "aoanode.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define NUM_NODES   (20)
+#define ITERATIONS  (200000)
+
+#define MAX_CALLS   (64)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+// a request sent to a node through canpt
+typedef struct {
+  uint8_t type;          // CANPT_MSG_GET, CANPT_MSG_SUB or CANPT_MSG_UNSUB
+  uint8_t reqId;
+  uint8_t periphId;
+  uint8_t subAct;
+  uint8_t len;
+  uint8_t data[AOANODE_MAX_SUBS];
+} request_t;
+
+typedef struct {
+  uint8_t cached;
+  uint8_t numCaps;
+  uint8_t caps[AOANODE_MAX_CAPS];
+  uint8_t values[AOANODE_MAX_CAPS][2];
+  uint16_t valid;
+  uint8_t numSubs;
+  uint8_t subs[AOANODE_MAX_SUBS];    // latest first
+} model_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const uint8_t allCaps[] = {
+  CANPT_MSG_DEV_TEMP, CANPT_MSG_DEV_LIGHT, CANPT_MSG_DEV_BTN,
+  CANPT_MSG_DEV_RGB, CANPT_MSG_DEV_LED
+};
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static request_t calls[MAX_CALLS];
+static uint32_t numCalls = 0;
+
+// canpt_unsubscribeList fails, e.g. the transmit queue is full
+static uint8_t failUnsub = 0;
+
+// what aoanode_resend reported
+static uint8_t sentCaps[AOANODE_MAX_CAPS];
+static uint8_t sentNumCaps = 0;
+static uint8_t sentNode = 0;
+static uint8_t sentValues[AOANODE_MAX_CAPS][3];
+static uint8_t numSentValues = 0;
+
+static model_t model[256];
+static uint32_t totalSubs = 0;
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+static request_t* newCall(uint8_t type, uint8_t reqId)
+{
+  request_t* r = &calls[numCalls++];
+
+  CHECK(numCalls <= MAX_CALLS);
+  memset(r, 0, sizeof(*r));
+  r->type = type;
+  r->reqId = reqId;
+  return r;
+}
+
+static error_t getValue(uint8_t reqId, uint8_t periphId)
+{
+  newCall(CANPT_MSG_GET, reqId)->periphId = periphId;
+  return ERR_OK;
+}
+
+error_t canpt_getTemperature(uint8_t reqId)
+{
+  return getValue(reqId, CANPT_MSG_DEV_TEMP);
+}
+
+error_t canpt_getLight(uint8_t reqId)
+{
+  return getValue(reqId, CANPT_MSG_DEV_LIGHT);
+}
+
+error_t canpt_getButton(uint8_t reqId)
+{
+  return getValue(reqId, CANPT_MSG_DEV_BTN);
+}
+
+error_t canpt_subscribe(uint8_t reqId, uint8_t periphId, uint8_t subAct,
+    uint8_t* valBuf, uint8_t len)
+{
+  request_t* r = newCall(CANPT_MSG_SUB, reqId);
+
+  r->periphId = periphId;
+  r->subAct = subAct;
+  r->len = len;
+  memcpy(r->data, valBuf, len);
+  return ERR_OK;
+}
+
+error_t canpt_unsubscribeList(uint8_t reqId, const uint8_t* subIds, uint8_t num)
+{
+  request_t* r = newCall(CANPT_MSG_UNSUB, reqId);
+
+  r->len = num;
+  memcpy(r->data, subIds, num);
+  return (failUnsub ? ERR_CAN_SEND : ERR_OK);
+}
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void sinkAttached(void* ctx, uint8_t nodeId, const uint8_t* caps,
+    uint8_t numCaps)
+{
+  CHECK(ctx == (void*)sentValues && sentNode == 0);
+  sentNode = nodeId;
+  sentNumCaps = numCaps;
+  memcpy(sentCaps, caps, numCaps);
+}
+
+static void sinkValue(void* ctx, uint8_t nodeId, uint8_t periphId,
+    const uint8_t* value)
+{
+  CHECK(ctx == (void*)sentValues && nodeId == sentNode);
+  CHECK(numSentValues < AOANODE_MAX_CAPS);
+  sentValues[numSentValues][0] = periphId;
+  sentValues[numSentValues][1] = value[0];
+  sentValues[numSentValues][2] = value[1];
+  numSentValues++;
+}
+
+static const aoanode_sink_t sink = {sinkAttached, sinkValue};
+
+// Resend a cached node, it must come out as attached with its values in
+// the order of its capabilities
+static void checkResend(uint8_t nodeId)
+{
+  const model_t* m = &model[nodeId];
+  const aoanode_t* n = aoanode_find(nodeId);
+  uint32_t v = 0;
+  int i = 0;
+
+  CHECK(n != NULL && n->nodeId == nodeId);
+
+  sentNode = 0;
+  numSentValues = 0;
+  numCalls = 0;
+  aoanode_resend(n, &sink, sentValues);
+  CHECK(numCalls == 0);
+
+  CHECK(sentNode == nodeId && sentNumCaps == m->numCaps);
+  CHECK(memcmp(sentCaps, m->caps, m->numCaps) == 0);
+  for (i = 0; i < m->numCaps; i++) {
+    if (m->valid & (1 << i)) {
+      CHECK(v < numSentValues && sentValues[v][0] == m->caps[i]);
+      CHECK(sentValues[v][1] == m->values[i][0] && sentValues[v][2] == m->values[i][1]);
+      v++;
+    }
+  }
+  CHECK(v == numSentValues);
+}
+
+// The requests of an attach: a value request and a subscription for each
+// capability that publishes values
+static void checkSubscribed(uint8_t nodeId, const uint8_t* caps, uint8_t numCaps)
+{
+  const request_t* r = calls;
+  int i = 0;
+
+  for (i = 0; i < numCaps; i++) {
+    if (caps[i] != CANPT_MSG_DEV_TEMP && caps[i] != CANPT_MSG_DEV_LIGHT
+        && caps[i] != CANPT_MSG_DEV_BTN) {
+      continue;
+    }
+
+    CHECK(r + 2 <= &calls[numCalls]);
+    CHECK(r->type == CANPT_MSG_GET && r->reqId == nodeId && r->periphId == caps[i]);
+    r++;
+    CHECK(r->type == CANPT_MSG_SUB && r->reqId == nodeId && r->periphId == caps[i]);
+    CHECK(r->subAct == CANPT_MSG_SUB_DIF && r->data[0] == 0);
+    if (caps[i] == CANPT_MSG_DEV_BTN) {
+      CHECK(r->len == 1);
+    }
+    else {
+      CHECK(r->len == 2 && r->data[1] == (caps[i] == CANPT_MSG_DEV_TEMP ? 50 : 10));
+    }
+    r++;
+  }
+  CHECK(r == &calls[numCalls]);
+}
+
+// The subscriptions of every node must be those of the model, the latest
+// first
+static void checkSubs(void)
+{
+  uint8_t subIds[AOANODE_MAX_SUBS];
+  uint8_t num = 0;
+  uint32_t total = 0;
+  int i = 0;
+
+  for (i = 0; i < 256; i++) {
+    CHECK(aoanode_getSubs(i, subIds, AOANODE_MAX_SUBS, &num) == ERR_OK);
+    CHECK(num == model[i].numSubs);
+    CHECK(memcmp(subIds, model[i].subs, num) == 0);
+    total += num;
+  }
+  CHECK(total == totalSubs);
+}
+
+static void modelRelease(uint8_t nodeId)
+{
+  totalSubs -= model[nodeId].numSubs;
+  model[nodeId].numSubs = 0;
+}
+
+static void modelSubStarted(uint8_t nodeId, uint8_t subId)
+{
+  model_t* m = &model[nodeId];
+
+  // the answer is dropped when the table is full
+  if (totalSubs < AOANODE_MAX_SUBS) {
+    memmove(&m->subs[1], &m->subs[0], m->numSubs);
+    m->subs[0] = subId;
+    m->numSubs++;
+    totalSubs++;
+  }
+  aoanode_subStarted(nodeId, subId);
+}
+
+static uint8_t numCached(void)
+{
+  uint8_t n = 0;
+  int i = 0;
+
+  for (i = 0; i < 256; i++) {
+    n += model[i].cached;
+  }
+
+  return n;
+}
+
+static void reset(void)
+{
+  aoanode_init();
+  memset(model, 0, sizeof(model));
+  totalSubs = 0;
+  failUnsub = 0;
+}
+
+// One node through a connection, a reconnection and the end of the hold
+// time
+static void testSession(void)
+{
+  static const uint8_t caps[] = {CANPT_MSG_DEV_TEMP, CANPT_MSG_DEV_BTN, CANPT_MSG_DEV_LED};
+  static const uint8_t temp[] = {0x01, 0x2C};
+  static const uint8_t btn[] = {0x00, 0x01};
+  aoanode_t* n = NULL;
+  model_t* m = &model[5];
+
+  reset();
+
+  numCalls = 0;
+  n = aoanode_attach(5, caps, sizeof(caps));
+  CHECK(n != NULL && n->nodeId == 5 && n->numCaps == 3 && n->valid == 0);
+  CHECK(aoanode_find(5) == n);
+  checkSubscribed(5, caps, sizeof(caps));
+  CHECK(numCalls == 4);
+
+  m->cached = 1;
+  m->numCaps = sizeof(caps);
+  memcpy(m->caps, caps, sizeof(caps));
+  modelSubStarted(5, 7);
+  modelSubStarted(5, 8);
+  checkSubs();
+
+  // a value of an unknown node or peripheral isn't kept
+  aoanode_storeValue(5, CANPT_MSG_DEV_BTN, btn);
+  aoanode_storeValue(5, CANPT_MSG_DEV_TEMP, temp);
+  aoanode_storeValue(6, CANPT_MSG_DEV_TEMP, temp);
+  aoanode_storeValue(5, CANPT_MSG_DEV_LIGHT, temp);
+  CHECK(n->valid == 3 && aoanode_find(6) == NULL);
+  memcpy(m->values[0], temp, 2);
+  memcpy(m->values[1], btn, 2);
+  m->valid = 3;
+
+  // the device disconnects and connects again within the hold time: the
+  // node is announced with its values, nothing is sent to it
+  checkResend(5);
+  checkSubs();
+
+  // the hold time ends: one request cancels all subscriptions of the node
+  numCalls = 0;
+  aoanode_releaseAll();
+  CHECK(numCalls == 1 && calls[0].type == CANPT_MSG_UNSUB && calls[0].reqId == 5);
+  CHECK(calls[0].len == 2 && calls[0].data[0] == 8 && calls[0].data[1] == 7);
+  CHECK(aoanode_find(5) == NULL);
+  modelRelease(5);
+  checkSubs();
+
+  // nothing is left to cancel
+  numCalls = 0;
+  aoanode_releaseAll();
+  CHECK(numCalls == 0);
+
+  // a node attached again has lost its subscriptions, they aren't
+  // cancelled
+  n = aoanode_attach(5, caps, sizeof(caps));
+  modelSubStarted(5, 9);
+  numCalls = 0;
+  n = aoanode_attach(5, caps, 1);
+  CHECK(n != NULL && n->numCaps == 1 && n->valid == 0);
+  CHECK(numCalls == 2 && calls[1].type == CANPT_MSG_SUB);
+  modelRelease(5);
+  checkSubs();
+
+  // a detached node is forgotten without cancelling its subscriptions
+  modelSubStarted(5, 10);
+  numCalls = 0;
+  aoanode_detach(5);
+  CHECK(numCalls == 0 && aoanode_find(5) == NULL);
+  modelRelease(5);
+  checkSubs();
+
+  // invalid capabilities, nothing is cached or subscribed
+  numCalls = 0;
+  CHECK(aoanode_attach(5, caps, 0) == NULL);
+  CHECK(aoanode_attach(5, caps, AOANODE_MAX_CAPS + 1) == NULL);
+  CHECK(aoanode_attach(0, caps, 1) == NULL);
+  CHECK(numCalls == 0 && aoanode_find(5) == NULL);
+}
+
+// The cache is full: a node is neither cached nor subscribed, so that its
+// subscriptions can always be cancelled
+static void testCacheFull(void)
+{
+  static const uint8_t caps[] = {CANPT_MSG_DEV_LIGHT};
+  int i = 0;
+
+  reset();
+
+  for (i = 1; i <= AOANODE_MAX_CACHED; i++) {
+    CHECK(aoanode_attach(i, caps, 1) != NULL);
+  }
+  numCalls = 0;
+  CHECK(aoanode_attach(100, caps, 1) == NULL);
+  CHECK(numCalls == 0 && aoanode_find(100) == NULL);
+
+  // an entry is free again after a detach
+  aoanode_detach(3);
+  CHECK(aoanode_attach(100, caps, 1) == aoanode_find(100));
+}
+
+// Random operations on more nodes than the cache holds
+static void testRandom(void)
+{
+  uint8_t caps[AOANODE_MAX_CAPS];
+  uint8_t value[2];
+  uint8_t subIds[AOANODE_MAX_SUBS];
+  uint8_t num = 0;
+  uint8_t numCaps = 0;
+  uint8_t nodeId = 0;
+  uint8_t subId = 0;
+  uint8_t periphId = 0;
+  aoanode_t* n = NULL;
+  model_t* m = NULL;
+  uint32_t unsubs = 0;
+  uint32_t i = 0;
+  int j = 0;
+
+  reset();
+
+  for (i = 0; i < ITERATIONS; i++) {
+    nodeId = 1 + rand() % NUM_NODES;
+    m = &model[nodeId];
+    numCalls = 0;
+
+    switch (rand() % 16) {
+    case 0:
+    case 1:
+      numCaps = 1 + rand() % AOANODE_MAX_CAPS;
+      for (j = 0; j < numCaps; j++) {
+        caps[j] = allCaps[rand() % sizeof(allCaps)];
+      }
+
+      n = aoanode_attach(nodeId, caps, numCaps);
+      modelRelease(nodeId);
+      if (!m->cached && numCached() >= AOANODE_MAX_CACHED) {
+        CHECK(n == NULL && numCalls == 0);
+        break;
+      }
+
+      CHECK(n != NULL && n->nodeId == nodeId && n->numCaps == numCaps);
+      checkSubscribed(nodeId, caps, numCaps);
+      m->cached = 1;
+      m->numCaps = numCaps;
+      m->valid = 0;
+      memcpy(m->caps, caps, numCaps);
+      break;
+
+    case 2:
+      aoanode_detach(nodeId);
+      CHECK(numCalls == 0);
+      m->cached = 0;
+      modelRelease(nodeId);
+      break;
+
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+      // a node answers the subscriptions even if it isn't cached
+      modelSubStarted(nodeId, subId++);
+      break;
+
+    case 7:
+    case 8:
+    case 9:
+    case 10:
+    case 11:
+      value[0] = rand();
+      value[1] = rand();
+      periphId = allCaps[rand() % sizeof(allCaps)];
+      aoanode_storeValue(nodeId, periphId, value);
+
+      // kept for the first capability of that ID
+      for (j = 0; m->cached && j < m->numCaps; j++) {
+        if (m->caps[j] == periphId) {
+          memcpy(m->values[j], value, 2);
+          m->valid |= (1 << j);
+          break;
+        }
+      }
+      break;
+
+    case 12:
+    case 13:
+      if (m->cached) {
+        checkResend(nodeId);
+      }
+      else {
+        CHECK(aoanode_find(nodeId) == NULL);
+      }
+      break;
+
+    case 14:
+      if (rand() % 32) {
+        break;
+      }
+      // one request per node with subscriptions, in node order, even if
+      // some fail
+      failUnsub = rand() % 2;
+      aoanode_releaseAll();
+      num = 0;
+      for (j = 0; j < 256; j++) {
+        m = &model[j];
+        if (m->numSubs > 0) {
+          CHECK(num < numCalls && calls[num].type == CANPT_MSG_UNSUB);
+          CHECK(calls[num].reqId == j && calls[num].len == m->numSubs);
+          CHECK(memcmp(calls[num].data, m->subs, m->numSubs) == 0);
+          unsubs += m->numSubs;
+          num++;
+        }
+        m->cached = 0;
+        modelRelease(j);
+      }
+      CHECK(num == numCalls && totalSubs == 0);
+      CHECK(aoanode_find(nodeId) == NULL);
+      failUnsub = 0;
+      break;
+
+    default:
+      CHECK(aoanode_getSubs(nodeId, subIds, AOANODE_MAX_SUBS, &num) == ERR_OK);
+      CHECK(num == m->numSubs && memcmp(subIds, m->subs, num) == 0);
+      break;
+    }
+
+    if (i % 1000 == 0) {
+      checkSubs();
+    }
+  }
+
+  checkSubs();
+  printf("%u subscriptions cancelled\n", unsubs);
+}
+
+// After all that no entry may be lost: the table holds AOANODE_MAX_SUBS
+// subscriptions again, one more is dropped
+static void testNoLeak(void)
+{
+  uint8_t subIds[2];
+  uint8_t num = 0;
+  int i = 0;
+
+  numCalls = 0;
+  aoanode_releaseAll();
+  for (i = 0; i < 256; i++) {
+    model[i].cached = 0;
+    modelRelease(i);
+  }
+
+  for (i = 0; i < AOANODE_MAX_SUBS; i++) {
+    modelSubStarted(1 + i % NUM_NODES, i);
+  }
+  CHECK(totalSubs == AOANODE_MAX_SUBS);
+  aoanode_subStarted(1, 0xEE);
+  checkSubs();
+
+  CHECK(aoanode_getSubs(1, subIds, 2, &num) == ERR_OK && num == 2);
+  CHECK(aoanode_getSubs(1, NULL, 0, &num) == ERR_OK && num == 0);
+  CHECK(aoanode_getSubs(1, NULL, 2, &num) == ERR_ARGUMENT);
+  CHECK(aoanode_getSubs(1, subIds, 2, NULL) == ERR_ARGUMENT);
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testSession();
+  testCacheFull();
+  testRandom();
+  testNoLeak();
+
+  printf("aoanode_test ok\n");
+  return 0;
+}
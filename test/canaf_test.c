@@ -0,0 +1,376 @@
+/****************************************************************************************************//**
+*
+* @file		canaf_test.c
+* @brief	Host test of the CAN acceptance filter compiler
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Compiles random routing tables into acceptance filter tables the way
+ * canpt.c does (canroute_range of every route, FullCAN for the routes
+ * that ask for it) and checks with canaf_match that the table passes
+ * exactly the IDs of the filter ranges, every 11-bit ID and the edges of
+ * the 29-bit ranges plus random 29-bit IDs, and that a routed ID is never
+ * dropped. The merging of ranges, the choice between explicit entries and
+ * ranges and the fallback to bypass mode of canaf_setup are checked with
+ * fixed tables; the acceptance filter registers and RAM are mapped at
+ * their LPC17xx addresses for it.
+ *
+ * Built with a larger CANAF_MAX_FILTERS so that a table can overflow the
+ * filter RAM.
+ *
+ * Usage: canaf_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include <sys/mman.h>
+#include "canroute.h"
+#include "canaf.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define STD_ID_MAX (0x7FF)
+#define EXT_ID_MAX (0x1FFFFFFF)
+
+// acceptance filter RAM and registers
+#define AF_BASE (0x40038000UL)
+#define AF_SIZE (0x5000UL)
+
+// AFMR values
+#define AFMR_ACC_BP (0x02)
+#define AFMR_EFCAN  (0x04)
+
+#define RANDOM_TABLES (2000)
+#define RANDOM_EXT_IDS (2000)
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static canroute_t routes[CANROUTE_MAX_ROUTES];
+static uint16_t numRoutes = 0;
+
+static canaf_filter_t filters[CANAF_MAX_FILTERS];
+static uint32_t ram[CANAF_RAM_WORDS];
+static canaf_layout_t layout;
+
+// 29-bit IDs are drawn near these, so ranges are close to each other
+static const uint32_t extBases[] = {0, 0x18FEF000, EXT_ID_MAX - 0x1000};
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void setFilter(canaf_filter_t* f, uint8_t ctrl, uint8_t format,
+    uint32_t low, uint32_t high, uint8_t fullCan)
+{
+  f->ctrl = ctrl;
+  f->format = format;
+  f->fullCan = fullCan;
+  f->idLow = low;
+  f->idHigh = high;
+}
+
+// The filter range of the route with the ID or NULL
+static const canroute_t* inRange(uint8_t bus, uint8_t format, uint32_t id)
+{
+  uint32_t low = 0;
+  uint32_t high = 0;
+  int i = 0;
+
+  for (i = 0; i < numRoutes; i++) {
+    canroute_range(&routes[i], &low, &high);
+    if (routes[i].srcBus == bus && routes[i].format == format
+        && id >= low && id <= high) {
+      return &routes[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void checkId(uint8_t bus, uint8_t format, uint32_t id)
+{
+  const canroute_t* r = inRange(bus, format, id);
+  uint8_t m = canaf_match(ram, &layout, bus, format, id);
+
+  if (r == NULL) {
+    CHECK(m == CANAF_MATCH_NONE);
+    CHECK(canroute_lookup(bus, format, id) == NULL);
+  }
+  else {
+    CHECK(m == (r->fullCan ? CANAF_MATCH_FULLCAN : CANAF_MATCH_RX));
+  }
+}
+
+// A random route that doesn't overlap the others, often right next to one
+static uint8_t addRoute(void)
+{
+  canroute_t* r = &routes[numRoutes];
+  const canroute_t* prev = NULL;
+  uint32_t idMax = 0;
+  uint32_t len = 0;
+  int i = 0;
+
+  memset(r, 0, sizeof(*r));
+  r->srcBus = rand() % CANROUTE_NUM_BUSES;
+  r->format = (rand() % 3 ? STD_ID_FORMAT : EXT_ID_FORMAT);
+  r->dstMask = CANROUTE_DST(1 - r->srcBus);
+  r->newId = CANROUTE_ID_KEEP;
+  idMax = (r->format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+
+  switch (rand() % 4) {
+  case 0:
+    len = 0;
+    break;
+  case 1:
+    len = 1 + rand() % 2;
+    break;
+  default:
+    len = rand() % 64;
+    break;
+  }
+
+  if (numRoutes > 0 && rand() % 4 == 0) {
+    prev = &routes[rand() % numRoutes];
+    r->srcBus = prev->srcBus;
+    r->format = prev->format;
+    idMax = (r->format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+    if (prev->idHigh == idMax) {
+      return 0;
+    }
+    r->idLow = prev->idHigh + 1;
+  }
+  else if (r->format == STD_ID_FORMAT) {
+    r->idLow = rand() % (STD_ID_MAX + 1);
+  }
+  else {
+    r->idLow = extBases[rand() % 3] + rand() % 0x1000;
+  }
+
+  r->idHigh = (r->idLow + len > idMax ? idMax : r->idLow + len);
+
+  if (r->format == STD_ID_FORMAT && len == 0 && rand() % 2) {
+    r->fullCan = 1;
+  }
+  else if (len > 8 && rand() % 4 == 0) {
+    r->mask = 0x7F0;
+  }
+
+  for (i = 0; i < numRoutes; i++) {
+    if (routes[i].srcBus == r->srcBus && routes[i].format == r->format
+        && r->idLow <= routes[i].idHigh && routes[i].idLow <= r->idHigh) {
+      return 0;
+    }
+  }
+
+  numRoutes++;
+  return 1;
+}
+
+static void testRandom(void)
+{
+  const canroute_t* r = NULL;
+  uint32_t checked = 0;
+  uint32_t words = 0;
+  uint32_t id = 0;
+  uint32_t k = 0;
+  int t = 0;
+  int i = 0;
+  int n = 0;
+
+  for (t = 0; t < RANDOM_TABLES; t++) {
+    numRoutes = 0;
+    n = 1 + rand() % CANROUTE_MAX_ROUTES;
+    for (i = 0; i < 4 * n && numRoutes < n; i++) {
+      addRoute();
+    }
+    CHECK(canroute_compile(routes, numRoutes) == ERR_OK);
+
+    // like loadFilters of canpt.c
+    for (i = 0; i < canroute_count(); i++) {
+      r = canroute_get(i);
+      setFilter(&filters[i], r->srcBus, r->format, 0, 0, r->fullCan);
+      canroute_range(r, &filters[i].idLow, &filters[i].idHigh);
+    }
+
+    memset(ram, 0xA5, sizeof(ram));
+    CHECK(canaf_compile(filters, numRoutes, ram, &layout) == ERR_OK);
+    CHECK(layout.sffSa <= layout.sffGrpSa && layout.sffGrpSa <= layout.effSa);
+    CHECK(layout.effSa <= layout.effGrpSa && layout.effGrpSa <= layout.endOfTable);
+    CHECK((layout.endOfTable >> 2) + layout.numFullCan * 3 <= CANAF_RAM_WORDS);
+    CHECK(layout.sffSa == ((layout.numFullCan + 1) >> 1) << 2);
+    words += (layout.endOfTable >> 2) + layout.numFullCan * 3;
+
+    for (k = 0; k < CANROUTE_NUM_BUSES; k++) {
+      for (id = 0; id <= STD_ID_MAX; id++) {
+        checkId(k, STD_ID_FORMAT, id);
+      }
+    }
+
+    for (i = 0; i < numRoutes; i++) {
+      r = &routes[i];
+      if (r->format == EXT_ID_FORMAT) {
+        if (r->idLow > 0) {
+          checkId(r->srcBus, EXT_ID_FORMAT, r->idLow - 1);
+        }
+        checkId(r->srcBus, EXT_ID_FORMAT, r->idLow);
+        checkId(r->srcBus, EXT_ID_FORMAT, r->idHigh);
+        if (r->idHigh < EXT_ID_MAX) {
+          checkId(r->srcBus, EXT_ID_FORMAT, r->idHigh + 1);
+        }
+        checkId(1 - r->srcBus, EXT_ID_FORMAT, r->idLow);
+      }
+    }
+
+    for (i = 0; i < RANDOM_EXT_IDS; i++) {
+      id = (rand() % 8 ? extBases[rand() % 3] + rand() % 0x1040 : rand()) & EXT_ID_MAX;
+      checkId(rand() % CANROUTE_NUM_BUSES, EXT_ID_FORMAT, id);
+    }
+
+    checked += numRoutes;
+  }
+
+  printf("%u tables, %u routes, %u filter words on average\n",
+      RANDOM_TABLES, checked, words / RANDOM_TABLES);
+}
+
+// Merged ranges and the cost of explicit entries versus ranges
+static void testLayout(void)
+{
+  canaf_filter_t f[8];
+
+  // overlapping and adjacent ranges and a duplicate become one range
+  setFilter(&f[0], CAN1_CTRL, STD_ID_FORMAT, 0x110, 0x11F, 0);
+  setFilter(&f[1], CAN1_CTRL, STD_ID_FORMAT, 0x100, 0x10F, 0);
+  setFilter(&f[2], CAN1_CTRL, STD_ID_FORMAT, 0x118, 0x130, 0);
+  setFilter(&f[3], CAN1_CTRL, STD_ID_FORMAT, 0x118, 0x130, 0);
+  // the same IDs on the other controller are kept apart
+  setFilter(&f[4], CAN2_CTRL, STD_ID_FORMAT, 0x131, 0x140, 0);
+  CHECK(canaf_compile(f, 5, ram, &layout) == ERR_OK);
+  CHECK(layout.sffSa == 0 && layout.sffGrpSa == 0);
+  CHECK(layout.effSa == 2 * 4 && layout.endOfTable == 2 * 4);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x0FF) == CANAF_MATCH_NONE);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x100) == CANAF_MATCH_RX);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x130) == CANAF_MATCH_RX);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x131) == CANAF_MATCH_NONE);
+  CHECK(canaf_match(ram, &layout, CAN2_CTRL, STD_ID_FORMAT, 0x130) == CANAF_MATCH_NONE);
+  CHECK(canaf_match(ram, &layout, CAN2_CTRL, STD_ID_FORMAT, 0x131) == CANAF_MATCH_RX);
+
+  // one or two IDs are explicit entries (two per word for 11-bit IDs),
+  // three or more a range
+  setFilter(&f[0], CAN1_CTRL, STD_ID_FORMAT, 0x010, 0x010, 0);
+  setFilter(&f[1], CAN1_CTRL, STD_ID_FORMAT, 0x020, 0x021, 0);
+  setFilter(&f[2], CAN1_CTRL, STD_ID_FORMAT, 0x030, 0x032, 0);
+  setFilter(&f[3], CAN1_CTRL, EXT_ID_FORMAT, 0x10000, 0x10001, 0);
+  setFilter(&f[4], CAN1_CTRL, EXT_ID_FORMAT, 0x20000, 0x20002, 0);
+  setFilter(&f[5], CAN2_CTRL, EXT_ID_FORMAT, 0x20000, 0x20000, 0);
+  CHECK(canaf_compile(f, 6, ram, &layout) == ERR_OK);
+  CHECK(layout.sffGrpSa - layout.sffSa == 2 * 4);   // three IDs, one padded word
+  CHECK(layout.effSa - layout.sffGrpSa == 1 * 4);
+  CHECK(layout.effGrpSa - layout.effSa == 3 * 4);
+  CHECK(layout.endOfTable - layout.effGrpSa == 2 * 4);
+  CHECK((ram[(layout.sffGrpSa >> 2) - 1] & 0xFFFF) == 0xFFFF);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x021) == CANAF_MATCH_RX);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x022) == CANAF_MATCH_NONE);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, EXT_ID_FORMAT, 0x20001) == CANAF_MATCH_RX);
+  CHECK(canaf_match(ram, &layout, CAN2_CTRL, EXT_ID_FORMAT, 0x20001) == CANAF_MATCH_NONE);
+
+  // FullCAN IDs come first and get a message object each, a FullCAN ID
+  // isn't merged with the same ID in the receive buffer sections
+  setFilter(&f[0], CAN2_CTRL, STD_ID_FORMAT, 0x300, 0x300, 1);
+  setFilter(&f[1], CAN1_CTRL, STD_ID_FORMAT, 0x300, 0x300, 1);
+  setFilter(&f[2], CAN1_CTRL, STD_ID_FORMAT, 0x301, 0x301, 1);
+  setFilter(&f[3], CAN1_CTRL, STD_ID_FORMAT, 0x302, 0x302, 0);
+  CHECK(canaf_compile(f, 4, ram, &layout) == ERR_OK);
+  CHECK(layout.numFullCan == 3 && layout.sffSa == 2 * 4);
+  CHECK(layout.sffGrpSa - layout.sffSa == 1 * 4);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x301) == CANAF_MATCH_FULLCAN);
+  CHECK(canaf_match(ram, &layout, CAN2_CTRL, STD_ID_FORMAT, 0x300) == CANAF_MATCH_FULLCAN);
+  CHECK(canaf_match(ram, &layout, CAN2_CTRL, STD_ID_FORMAT, 0x301) == CANAF_MATCH_NONE);
+  CHECK(canaf_match(ram, &layout, CAN1_CTRL, STD_ID_FORMAT, 0x302) == CANAF_MATCH_RX);
+
+  // invalid filters
+  setFilter(&f[0], CAN1_CTRL, STD_ID_FORMAT, 0x300, 0x301, 1);
+  CHECK(canaf_compile(f, 1, ram, &layout) == ERR_ARGUMENT);
+  setFilter(&f[0], CAN1_CTRL, EXT_ID_FORMAT, 0x300, 0x300, 1);
+  CHECK(canaf_compile(f, 1, ram, &layout) == ERR_ARGUMENT);
+  setFilter(&f[0], CAN1_CTRL, STD_ID_FORMAT, 0x700, 0x800, 0);
+  CHECK(canaf_compile(f, 1, ram, &layout) == ERR_ARGUMENT);
+}
+
+// A table that doesn't fit is rejected and canaf_setup falls back to
+// accepting all frames
+static void testSetup(void)
+{
+  volatile uint32_t* afRam = (volatile uint32_t*)LPC_CANAF_RAM->mask;
+  uint32_t i = 0;
+  void* p = NULL;
+
+  p = mmap((void*)AF_BASE, AF_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  CHECK(p == (void*)AF_BASE);
+
+  // the table is written to the filter RAM and enabled
+  setFilter(&filters[0], CAN1_CTRL, STD_ID_FORMAT, 0x123, 0x123, 1);
+  setFilter(&filters[1], CAN2_CTRL, EXT_ID_FORMAT, 0x1000, 0x2000, 0);
+  CHECK(canaf_setup(filters, 2) == ERR_OK);
+  CHECK(canaf_compile(filters, 2, ram, &layout) == ERR_OK);
+  CHECK(LPC_CANAF->AFMR == AFMR_EFCAN);
+  CHECK(LPC_CANAF->SFF_sa == layout.sffSa && LPC_CANAF->SFF_GRP_sa == layout.sffGrpSa);
+  CHECK(LPC_CANAF->EFF_sa == layout.effSa && LPC_CANAF->EFF_GRP_sa == layout.effGrpSa);
+  CHECK(LPC_CANAF->ENDofTable == layout.endOfTable);
+  for (i = 0; i < (layout.endOfTable >> 2) + layout.numFullCan * 3; i++) {
+    CHECK(afRam[i] == ram[i]);
+  }
+
+  // 29-bit ranges take two words, 300 of them don't fit
+  for (i = 0; i < 300; i++) {
+    setFilter(&filters[i], CAN1_CTRL, EXT_ID_FORMAT, i * 16, i * 16 + 7, 0);
+  }
+  CHECK(canaf_compile(filters, 256, ram, &layout) == ERR_OK);
+  CHECK(canaf_compile(filters, 300, ram, &layout) == ERR_CAN_FILTER);
+  CHECK(canaf_setup(filters, 300) == ERR_CAN_FILTER);
+  CHECK(LPC_CANAF->AFMR == AFMR_ACC_BP);
+  CHECK(LPC_CANAF->SFF_sa == 0 && LPC_CANAF->SFF_GRP_sa == 0);
+  CHECK(LPC_CANAF->EFF_sa == 0 && LPC_CANAF->EFF_GRP_sa == 0);
+  CHECK(LPC_CANAF->ENDofTable == 0);
+
+  // so do more FullCAN IDs than message objects
+  for (i = 0; i <= CANAF_MAX_FULLCAN; i++) {
+    setFilter(&filters[i], i & 1, STD_ID_FORMAT, i, i, 1);
+  }
+  CHECK(canaf_compile(filters, CANAF_MAX_FULLCAN, ram, &layout) == ERR_OK);
+  CHECK(canaf_setup(filters, CANAF_MAX_FULLCAN + 1) == ERR_CAN_FILTER);
+  CHECK(LPC_CANAF->AFMR == AFMR_ACC_BP);
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testLayout();
+  testSetup();
+  testRandom();
+
+  printf("canaf_test ok\n");
+  return 0;
+}
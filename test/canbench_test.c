@@ -0,0 +1,55 @@
+/****************************************************************************************************//**
+*
+* @file		canbench_test.c
+* @brief	Host run of the CAN frame copy benchmark
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs canbench.c with the host cycle counter (test_cycles). The numbers
+ * are host ticks, the Cortex-M3 cycle counts come from canbench_run on the
+ * board.
+ *
+ * Usage: canbench_test
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include "canbench.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define ROUNDS (20000)
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(void)
+{
+  canbench_result_t r;
+
+  CHECK(canbench_run(0, &r) == ERR_ARGUMENT);
+  CHECK(canbench_run(ROUNDS, &r) == ERR_OK);
+
+  printf("rx: CAN_MSG_Type %u, can_frame_t %u ticks/frame\n", r.rxMsg, r.rxFrame);
+  printf("tx: CAN_MSG_Type %u, can_frame_t %u ticks/frame\n", r.txMsg, r.txFrame);
+
+  CHECK(r.rxFrame > 0 && r.rxFrame <= r.rxMsg);
+  CHECK(r.txFrame > 0 && r.txFrame <= r.txMsg);
+
+  printf("canbench_test ok\n");
+  return 0;
+}
@@ -0,0 +1,181 @@
+/****************************************************************************************************//**
+*
+* @file		canbtr_test.c
+* @brief	Host test of the CAN bit timing solver
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Checks canbtr_solve against a table of the usual bit rates at the CAN
+ * clock set up by CAN_Init (30 MHz) and against rates and arguments it
+ * must reject. Every timing found is decoded again from its BTR value,
+ * and for a range of bit rates the solver must agree with the build time
+ * check CANBTR_RATE_VALID.
+ *
+ * Usage: canbtr_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "board.h"
+#include "canbtr.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define PCLK         (30000000)
+#define SAMPLE_POINT (875)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint32_t bitrate;
+  uint16_t brp;
+  uint8_t tseg1;
+  uint8_t tseg2;
+  uint16_t samplePoint;
+} expect_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+// all exact, 15 quanta give 866 when 16 or 8 quanta don't fit the prescaler
+static const expect_t expected[] = {
+  { 125000, 15, 13, 2, 875},
+  { 250000, 15,  6, 1, 875},
+  { 500000,  4, 12, 2, 866},
+  {1000000,  2, 12, 2, 866},
+};
+
+static const uint32_t rejected[] = {
+  0,
+  1000,     // the prescaler would be larger than 1024
+  800000,   // a divider of 37.5, the nearest ones are off by more than 1%
+  3500000,  // less than 9 quanta per bit, off by more than 5%
+  4000000,  // less than 8 quanta per bit
+};
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+// The timing must be consistent and survive a decode of its BTR value
+static void checkTiming(const canbtr_t* t)
+{
+  canbtr_t d;
+  uint8_t tq = 1 + t->tseg1 + t->tseg2;
+
+  CHECK(tq >= CANBTR_TQ_MIN && tq <= CANBTR_TQ_MAX);
+  CHECK(t->brp >= 1 && t->brp <= CANBTR_BRP_MAX);
+  CHECK(t->tseg1 >= 1 && t->tseg1 <= 16 && t->tseg2 >= t->sjw && t->tseg2 <= 8);
+  CHECK(t->bitrate == PCLK / (t->brp * tq));
+  CHECK(t->samplePoint == (1 + t->tseg1) * 1000 / tq);
+  CHECK(t->errorPpm <= CANBTR_MAX_ERROR_PPM);
+
+  CHECK(canbtr_decode(PCLK, t->btr, &d) == ERR_OK);
+  CHECK(d.brp == t->brp && d.tseg1 == t->tseg1 && d.tseg2 == t->tseg2);
+  CHECK(d.sjw == t->sjw && d.bitrate == t->bitrate);
+  CHECK(d.samplePoint == t->samplePoint);
+}
+
+static void testTable(void)
+{
+  canbtr_t t;
+  uint32_t i = 0;
+
+  for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    memset(&t, 0, sizeof(t));
+    CHECK(canbtr_solve(PCLK, expected[i].bitrate, SAMPLE_POINT, 1, &t) == ERR_OK);
+    printf("%7u bit/s: brp %2u tseg1 %2u tseg2 %u sample point %u btr 0x%06x\n",
+        expected[i].bitrate, t.brp, t.tseg1, t.tseg2, t.samplePoint, t.btr);
+
+    CHECK(t.brp == expected[i].brp);
+    CHECK(t.tseg1 == expected[i].tseg1 && t.tseg2 == expected[i].tseg2);
+    CHECK(t.samplePoint == expected[i].samplePoint);
+    CHECK(t.bitrate == expected[i].bitrate && t.errorPpm == 0);
+    checkTiming(&t);
+  }
+
+  // the register value of the first entry, worked out by hand
+  CHECK(canbtr_solve(PCLK, 125000, SAMPLE_POINT, 1, &t) == ERR_OK);
+  CHECK(t.btr == ((15 - 1) | ((13 - 1) << 16) | ((2 - 1) << 20)));
+}
+
+static void testRejected(void)
+{
+  canbtr_t t;
+  uint32_t i = 0;
+
+  for (i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+    CHECK(canbtr_solve(PCLK, rejected[i], SAMPLE_POINT, 1, &t) == ERR_ARGUMENT);
+  }
+
+  CHECK(canbtr_solve(PCLK, 500000, 499, 1, &t) == ERR_ARGUMENT);
+  CHECK(canbtr_solve(PCLK, 500000, 951, 1, &t) == ERR_ARGUMENT);
+  CHECK(canbtr_solve(PCLK, 500000, SAMPLE_POINT, 0, &t) == ERR_ARGUMENT);
+  CHECK(canbtr_solve(PCLK, 500000, SAMPLE_POINT, CANBTR_SJW_MAX + 1, &t) == ERR_ARGUMENT);
+  CHECK(canbtr_solve(PCLK, 500000, SAMPLE_POINT, 1, NULL) == ERR_ARGUMENT);
+  CHECK(canbtr_decode(PCLK, 0, NULL) == ERR_ARGUMENT);
+}
+
+// Random rates, sample points and jump widths: a timing is found exactly
+// when the build time check accepts the rate
+static void testRandom(void)
+{
+  // 64 bit, CANBTR_RATE_VALID is meant for the preprocessor
+  int64_t pclk = PCLK;
+  int64_t rate = 0;
+  canbtr_t t;
+  uint32_t found = 0;
+  uint32_t i = 0;
+  uint16_t sp = 0;
+  uint8_t sjw = 0;
+  error_t err = ERR_OK;
+
+  for (i = 0; i < 100000; i++) {
+    rate = (rand() % 4 ? 1000 + rand() % 1000000 : 1 + rand() % (PCLK / 4));
+    sp = 500 + rand() % 451;
+    sjw = 1 + rand() % CANBTR_SJW_MAX;
+
+    err = canbtr_solve(PCLK, rate, sp, sjw, &t);
+    CHECK((err == ERR_OK) == CANBTR_RATE_VALID(pclk, rate));
+    if (err == ERR_OK) {
+      CHECK(t.sjw == sjw);
+      checkTiming(&t);
+      found++;
+    }
+  }
+
+  printf("%u of %u random rates can be generated\n", found, i);
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testTable();
+  testRejected();
+  testRandom();
+
+  printf("canbtr_test ok\n");
+  return 0;
+}
@@ -0,0 +1,410 @@
+/****************************************************************************************************//**
+*
+* @file		canlog_test.c
+* @brief	Host load test of the CAN capture logger
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs canlog.c against a simulated clock. Both buses send back to back
+ * frames (100% bus load) and the receive hook is called at the end of
+ * each frame. The main loop calls canlog_task every LOOP_US and the file
+ * writes take the time of a card model, while they run the frames that
+ * end in the meantime are delivered as interrupts.
+ *
+ * The log file is then checked record by record (or line by line for
+ * candump text) against the frames sent. The time canlog_task spends
+ * formatting text is not simulated.
+ *
+ * Usage: canlog_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "canbus.h"
+#include "canlog.h"
+#include "time.h"
+#include "ff.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+// time spent by the main loop between two calls of canlog_task
+#define LOOP_US (200)
+
+#define MAX_EVENTS (400000)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint64_t time;
+  uint8_t bus;
+  uint8_t dropped;
+  can_frame_t frame;
+} event_t;
+
+typedef struct {
+  const char* name;
+  uint32_t bitrate[2];    // 0 if the bus is idle
+  uint8_t shortFrames;    // only frames without data (highest frame rate)
+  uint8_t format;
+  uint32_t cardLatencyUs; // per f_write call
+  uint32_t cardKBps;      // transfer rate of the card
+  uint32_t durationMs;
+  uint8_t lossExpected;
+} scenario_t;
+
+/********************************************************************************************************
+*** PRIVATE TABLES
+********************************************************************************************************/
+
+static const scenario_t scenarios[] = {
+  // name, bitrates, short, format, latency, rate, duration, loss
+  {"2x500k mixed binary", {500000, 500000}, 0, CANLOG_FORMAT_BINARY, 1000, 1000, 5000, 0},
+  {"1M mixed binary", {1000000, 0}, 0, CANLOG_FORMAT_BINARY, 1000, 1000, 5000, 0},
+  {"2x250k short binary", {250000, 250000}, 1, CANLOG_FORMAT_BINARY, 1000, 1000, 5000, 0},
+  {"2x250k mixed candump", {250000, 250000}, 0, CANLOG_FORMAT_CANDUMP, 1000, 1000, 5000, 0},
+  {"2x500k mixed slow card", {500000, 500000}, 0, CANLOG_FORMAT_BINARY, 20000, 1000, 2000, 1},
+};
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static event_t events[MAX_EVENTS];
+static uint32_t numEvents = 0;
+static uint32_t nextEvent = 0;
+static uint8_t captured[MAX_EVENTS];
+
+static uint64_t now = 0;
+static can_rx_hook_t hook = NULL;
+static const scenario_t* scenario = NULL;
+
+static uint8_t* fileData = NULL;
+static uint32_t fileSize = 0;
+static uint8_t fileOpen = 0;
+
+static uint32_t mapCalls = 0;
+static FRESULT mapResult = FR_OK;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+// Deliver the frames that end before 'until' and advance the clock to it
+static void runInterrupts(uint64_t until)
+{
+  event_t* e = NULL;
+  canlog_stats_t before;
+  canlog_stats_t after;
+
+  while (nextEvent < numEvents && events[nextEvent].time <= until) {
+    e = &events[nextEvent];
+    now = e->time;
+    if (hook != NULL) {
+      canlog_getStats(&before);
+      hook(e->bus, &e->frame, e->dropped);
+      canlog_getStats(&after);
+      captured[nextEvent] = (after.captured != before.captured);
+    }
+    nextEvent++;
+  }
+
+  now = until;
+}
+
+// Bits of a frame without stuff bits, including the interframe space
+static uint32_t frameBits(const can_frame_t* f)
+{
+  uint32_t len = (CAN_FRAME_IS_RTR(f) ? 0 : CAN_FRAME_LEN(f));
+
+  return (CAN_FRAME_IS_EXT(f) ? 67 : 47) + 8 * len;
+}
+
+static void randomFrame(can_frame_t* f, uint8_t shortFrame)
+{
+  uint32_t len = (shortFrame ? 0 : rand() % 9);
+  uint8_t ext = (!shortFrame && rand() % 4 == 0);
+
+  f->rfs = (len << 16) | (ext ? CAN_RFS_FF : 0);
+  if (!shortFrame && rand() % 16 == 0) {
+    f->rfs |= CAN_RFS_RTR;
+  }
+  f->id = rand() & (ext ? 0x1FFFFFFF : 0x7FF);
+  f->data[0] = ((uint32_t)rand() << 16) ^ rand();
+  f->data[1] = ((uint32_t)rand() << 16) ^ rand();
+}
+
+// Back to back frames on both buses, merged in time order
+static void makeEvents(const scenario_t* s)
+{
+  uint64_t end = (uint64_t)s->durationMs * 1000;
+  uint64_t done[2] = {0, 0};
+  can_frame_t f[2];
+  int bus = 0;
+
+  numEvents = 0;
+  nextEvent = 0;
+
+  // end time of the current frame of each bus
+  for (bus = 0; bus < 2; bus++) {
+    randomFrame(&f[bus], s->shortFrames);
+    done[bus] = (s->bitrate[bus] == 0 ? UINT64_MAX
+        : frameBits(&f[bus]) * 1000000ULL / s->bitrate[bus]);
+  }
+
+  while (1) {
+    bus = (done[0] <= done[1] ? 0 : 1);
+    if (done[bus] > end) {
+      break;
+    }
+
+    CHECK(numEvents < MAX_EVENTS);
+    events[numEvents].time = done[bus];
+    events[numEvents].bus = bus;
+    events[numEvents].dropped = (rand() % 1000 == 0);
+    events[numEvents].frame = f[bus];
+    numEvents++;
+
+    randomFrame(&f[bus], s->shortFrames);
+    done[bus] += frameBits(&f[bus]) * 1000000ULL / s->bitrate[bus];
+  }
+}
+
+static void checkBinary(void)
+{
+  const canlog_rec_t* rec = (const canlog_rec_t*)fileData;
+  const event_t* e = NULL;
+  uint32_t n = fileSize / sizeof(canlog_rec_t);
+  uint32_t i = 0;
+
+  CHECK(fileSize % sizeof(canlog_rec_t) == 0);
+
+  for (i = 0; i < numEvents; i++) {
+    if (!captured[i]) {
+      continue;
+    }
+    e = &events[i];
+    CHECK(n > 0);
+    CHECK(rec->timestamp == e->time);
+    CHECK(rec->bus == e->bus);
+    CHECK(rec->flags == (e->dropped ? CANLOG_FLAG_DROPPED : 0));
+    CHECK(memcmp(&rec->frame, &e->frame, sizeof(can_frame_t)) == 0);
+    rec++;
+    n--;
+  }
+
+  CHECK(n == 0);
+}
+
+static void checkCandump(void)
+{
+  const event_t* e = NULL;
+  const can_frame_t* f = NULL;
+  char line[80];
+  char* p = line;
+  uint32_t ofs = 0;
+  uint32_t len = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+
+  for (i = 0; i < numEvents; i++) {
+    if (!captured[i]) {
+      continue;
+    }
+    e = &events[i];
+    f = &e->frame;
+
+    p = line + sprintf(line, "(%u.%06u) can%u ", (uint32_t)(e->time / 1000000),
+        (uint32_t)(e->time % 1000000), e->bus);
+    p += sprintf(p, CAN_FRAME_IS_EXT(f) ? "%08X#" : "%03X#", f->id);
+    if (CAN_FRAME_IS_RTR(f)) {
+      p += sprintf(p, "R");
+    }
+    else {
+      for (j = 0; j < CAN_FRAME_LEN(f); j++) {
+        p += sprintf(p, "%02X", CAN_FRAME_DATA(f)[j]);
+      }
+    }
+    p += sprintf(p, "\n");
+
+    len = p - line;
+    CHECK(ofs + len <= fileSize);
+    CHECK(memcmp(&fileData[ofs], line, len) == 0);
+    ofs += len;
+  }
+
+  CHECK(ofs == fileSize);
+}
+
+static void runScenario(const scenario_t* s)
+{
+  canlog_stats_t st;
+  uint32_t numCaptured = 0;
+  uint32_t i = 0;
+
+  scenario = s;
+  makeEvents(s);
+  memset(captured, 0, sizeof(captured));
+  now = 0;
+  fileSize = 0;
+
+  CHECK(canlog_start("can.log", s->format) == ERR_OK);
+  CHECK(canlog_start("can.log", s->format) == ERR_ARGUMENT);
+
+  mapCalls = 0;
+  while (nextEvent < numEvents) {
+    canlog_task();
+    runInterrupts(now + LOOP_US);
+  }
+  CHECK(mapCalls == 0);
+
+  CHECK(canlog_stop() == ERR_OK);
+  CHECK(canlog_stop() == ERR_NOT_INIT);
+  CHECK(!fileOpen && hook == NULL);
+
+  for (i = 0; i < numEvents; i++) {
+    numCaptured += captured[i];
+  }
+
+  canlog_getStats(&st);
+  printf("%-24s %7u frames %6u/s, lost %u, file %u kB\n", s->name, numEvents,
+      (uint32_t)((uint64_t)numEvents * 1000 / s->durationMs), st.lost,
+      fileSize / 1024);
+
+  CHECK(st.errors == 0);
+  CHECK(st.captured == numCaptured);
+  CHECK(st.captured + st.lost == numEvents);
+  CHECK(st.written == st.captured);
+  CHECK(s->lossExpected ? st.lost > 0 : st.lost == 0);
+
+  if (s->format == CANLOG_FORMAT_BINARY) {
+    checkBinary();
+  }
+  else {
+    checkCandump();
+  }
+}
+
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+void can_rx_setHook(can_rx_hook_t h)
+{
+  hook = h;
+}
+
+uint64_t time_getUs64(void)
+{
+  return now;
+}
+
+uint32_t time_getUs(void)
+{
+  return (uint32_t)now;
+}
+
+FRESULT f_open(FIL* fp, const XCHAR* path, BYTE mode)
+{
+  CHECK(!fileOpen && (mode & FA_WRITE));
+  fileOpen = 1;
+  fileSize = 0;
+  return FR_OK;
+}
+
+FRESULT f_stream(FIL* fp, DWORD fsz)
+{
+  CHECK(fileOpen);
+  return FR_OK;
+}
+
+FRESULT f_mapfree(const XCHAR* path, UINT nent)
+{
+  CHECK(!fileOpen && nent == CANLOG_MAP_ENTRIES);
+  mapCalls++;
+  return mapResult;
+}
+
+FRESULT f_write(FIL* fp, const void* buf, UINT btw, UINT* bw)
+{
+  uint64_t busy = scenario->cardLatencyUs + (uint64_t)btw * 1000 / scenario->cardKBps;
+
+  CHECK(fileOpen);
+
+  // frames keep arriving while the card is written
+  runInterrupts(now + busy);
+
+  fileData = realloc(fileData, fileSize + btw);
+  CHECK(fileData != NULL);
+  memcpy(&fileData[fileSize], buf, btw);
+  fileSize += btw;
+  *bw = btw;
+
+  return FR_OK;
+}
+
+FRESULT f_close(FIL* fp)
+{
+  CHECK(fileOpen);
+  fileOpen = 0;
+  return FR_OK;
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  uint32_t i = 0;
+
+  test_seed(argc, argv);
+
+  printf("capture buffers 2 x %u sectors, main loop %u us, card %u us + %u kB/s\n",
+      CANLOG_BUF_SECTORS, LOOP_US, scenarios[0].cardLatencyUs, scenarios[0].cardKBps);
+
+  CHECK(canlog_start(NULL, CANLOG_FORMAT_BINARY) == ERR_ARGUMENT);
+  CHECK(canlog_start("can.log", 2) == ERR_ARGUMENT);
+  CHECK(canlog_stop() == ERR_NOT_INIT);
+
+  // the free cluster map is built while idle, also before the volume is
+  // mounted, but not retried after a disk error until the next capture
+  mapResult = FR_NOT_ENABLED;
+  canlog_task();
+  mapResult = FR_OK;
+  canlog_task();
+  CHECK(mapCalls == 2);
+  mapResult = FR_NOT_READY;
+  canlog_task();
+  canlog_task();
+  CHECK(mapCalls == 3);
+  mapResult = FR_OK;
+
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    runScenario(&scenarios[i]);
+  }
+
+  canlog_task();
+  CHECK(mapCalls == 1);
+
+  free(fileData);
+
+  printf("canlog_test ok\n");
+  return 0;
+}
@@ -0,0 +1,340 @@
+/****************************************************************************************************//**
+*
+* @file		canroute_test.c
+* @brief	Host test of the CAN gateway routing table
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Checks lookups, masks, ID rewrite, overlap rejection and the acceptance
+ * filter range of canroute.c against a linear reference, then reports the
+ * lookup rate of a full table.
+ *
+ * Usage: canroute_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "canroute.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define STD_ID_MAX (0x7FF)
+#define EXT_ID_MAX (0x1FFFFFFF)
+
+#define RANDOM_TABLES  (2000)
+#define RANDOM_LOOKUPS (2000)
+#define BENCH_LOOKUPS  (20000000)
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static canroute_t routes[CANROUTE_MAX_ROUTES];
+static uint16_t numRoutes = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static uint8_t invert(can_frame_t* frame)
+{
+  CAN_FRAME_DATA(frame)[0] ^= 0xFF;
+  return frame->id != 0x405;
+}
+
+static void setRoute(canroute_t* r, uint8_t bus, uint8_t format, uint8_t dst,
+    uint32_t low, uint32_t high, uint32_t mask)
+{
+  memset(r, 0, sizeof(*r));
+  r->srcBus = bus;
+  r->format = format;
+  r->dstMask = dst;
+  r->idLow = low;
+  r->idHigh = high;
+  r->mask = mask;
+  r->newId = CANROUTE_ID_KEEP;
+}
+
+// Reference lookup, a linear scan of the uncompiled routes
+static const canroute_t* refLookup(uint8_t bus, uint8_t format, uint32_t id)
+{
+  const canroute_t* r = NULL;
+  int i = 0;
+
+  for (i = 0; i < numRoutes; i++) {
+    r = &routes[i];
+    if (r->srcBus == bus && r->format == format
+        && id >= r->idLow && id <= r->idHigh
+        && (r->mask == 0 || (id & r->mask) == (r->idLow & r->mask))) {
+      return r;
+    }
+  }
+
+  return NULL;
+}
+
+// Check that the filter range of the route covers 'id'
+static void checkCovered(const canroute_t* r, uint32_t id)
+{
+  uint32_t low = 0;
+  uint32_t high = 0;
+
+  canroute_range(r, &low, &high);
+  CHECK(low <= id && id <= high);
+  CHECK(low >= r->idLow && high <= r->idHigh);
+}
+
+static void testLookup(void)
+{
+  can_frame_t frame;
+  canroute_t r[4];
+
+  setRoute(&r[0], CANROUTE_BUS2, STD_ID_FORMAT, 1, 0x20, 0x20, 0);
+  setRoute(&r[1], CANROUTE_BUS1, EXT_ID_FORMAT, 2, 0x1FFFF, 0x20001, 0);
+  setRoute(&r[2], CANROUTE_BUS2, STD_ID_FORMAT, 1, 0x000, 0x00F, 0);
+  setRoute(&r[3], CANROUTE_BUS1, STD_ID_FORMAT, 3, 0x100, 0x1FF, 0x0F0);
+  r[3].newId = 0x400;
+  r[3].transform = invert;
+
+  CHECK(canroute_compile(r, 4) == ERR_OK);
+  CHECK(canroute_count() == 4);
+
+  // sorted on (bus, format, idLow)
+  CHECK(canroute_get(0) == &r[3]);
+  CHECK(canroute_get(1) == &r[1]);
+  CHECK(canroute_get(2) == &r[2]);
+  CHECK(canroute_get(3) == &r[0]);
+  CHECK(canroute_get(4) == NULL);
+
+  CHECK(canroute_lookup(CANROUTE_BUS2, STD_ID_FORMAT, 0x20) == &r[0]);
+  CHECK(canroute_lookup(CANROUTE_BUS2, STD_ID_FORMAT, 0x21) == NULL);
+  CHECK(canroute_lookup(CANROUTE_BUS2, STD_ID_FORMAT, 0x05) == &r[2]);
+  CHECK(canroute_lookup(CANROUTE_BUS1, EXT_ID_FORMAT, 0x20000) == &r[1]);
+  CHECK(canroute_lookup(CANROUTE_BUS2, EXT_ID_FORMAT, 0x20000) == NULL);
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x20000) == NULL);
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x105) == &r[3]);
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x115) == NULL);
+
+  // ID rewrite and transform
+  memset(&frame, 0, sizeof(frame));
+  frame.id = 0x10A;
+  CHECK(canroute_apply(&r[3], &frame) == 3);
+  CHECK(frame.id == 0x40A && CAN_FRAME_DATA(&frame)[0] == 0xFF);
+  // the transform sees the rewritten ID
+  frame.id = 0x105;
+  CHECK(canroute_apply(&r[3], &frame) == 0);
+}
+
+static void testMask(void)
+{
+  canroute_t r[2];
+  uint32_t low = 0;
+  uint32_t high = 0;
+  uint32_t id = 0;
+
+  // the range is wider than the mask pattern allows
+  setRoute(&r[0], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x000, 0x012, 0x002);
+  setRoute(&r[1], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x100, 0x7FF, 0x700);
+
+  CHECK(canroute_compile(r, 2) == ERR_OK);
+
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x11) == &r[0]);
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x12) == NULL);
+  CHECK(canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, 0x13) == NULL);
+
+  canroute_range(&r[0], &low, &high);
+  CHECK(low == 0x000 && high == 0x012);
+  canroute_range(&r[1], &low, &high);
+  CHECK(low == 0x100 && high == 0x1FF);
+
+  for (id = 0; id <= STD_ID_MAX; id++) {
+    const canroute_t* found = canroute_lookup(CANROUTE_BUS1, STD_ID_FORMAT, id);
+    if (found != NULL) {
+      checkCovered(found, id);
+    }
+  }
+}
+
+static void testOverlap(void)
+{
+  canroute_t r[3];
+
+  setRoute(&r[0], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x000, 0x010, 0);
+  setRoute(&r[1], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x011, 0x020, 0);
+  CHECK(canroute_compile(r, 2) == ERR_OK);
+
+  // same range on another bus or ID format is no overlap
+  setRoute(&r[2], CANROUTE_BUS2, STD_ID_FORMAT, 1, 0x000, 0x020, 0);
+  CHECK(canroute_compile(r, 3) == ERR_OK);
+  setRoute(&r[2], CANROUTE_BUS1, EXT_ID_FORMAT, 2, 0x000, 0x020, 0);
+  CHECK(canroute_compile(r, 3) == ERR_OK);
+
+  // the previous table is kept when compiling fails
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x020, 0x030, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  CHECK(canroute_count() == 3);
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x005, 0x005, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+
+  // masks don't make overlapping ranges valid
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x008, 0x018, 0x001);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+
+  // invalid routes
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x030, 0x800, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x031, 0x030, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  setRoute(&r[2], CANROUTE_NUM_BUSES, STD_ID_FORMAT, 2, 0x030, 0x030, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 4, 0x030, 0x030, 0);
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  setRoute(&r[2], CANROUTE_BUS1, STD_ID_FORMAT, 2, 0x030, 0x040, 0);
+  r[2].newId = 0x7F8;
+  CHECK(canroute_compile(r, 3) == ERR_ARGUMENT);
+  CHECK(canroute_count() == 3);
+}
+
+// Build a random table of non-overlapping routes
+static void randomTable(void)
+{
+  uint32_t next[CANROUTE_NUM_BUSES][2];
+  uint32_t idMax = 0;
+  uint32_t span = 0;
+  canroute_t* r = NULL;
+  int num = 1 + rand() % CANROUTE_MAX_ROUTES;
+  int bus = 0;
+  int format = 0;
+
+  memset(next, 0, sizeof(next));
+  numRoutes = 0;
+
+  while (numRoutes < num) {
+    bus = rand() % CANROUTE_NUM_BUSES;
+    format = rand() % 2;
+    idMax = (format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+    span = (format == EXT_ID_FORMAT ? 0x100000 : 0x40);
+
+    r = &routes[numRoutes];
+    setRoute(r, bus, format, 1 + rand() % 3, 0, 0, 0);
+    r->idLow = next[bus][format] + rand() % span;
+    r->idHigh = r->idLow + (rand() % 2 ? 0 : rand() % span);
+    if (r->idHigh > idMax) {
+      continue;
+    }
+    if (rand() % 3 == 0) {
+      r->mask = rand() & idMax;
+    }
+
+    next[bus][format] = r->idHigh + 1;
+    numRoutes++;
+  }
+
+  // compile in random order
+  for (bus = numRoutes - 1; bus > 0; bus--) {
+    canroute_t t = routes[bus];
+    format = rand() % (bus + 1);
+    routes[bus] = routes[format];
+    routes[format] = t;
+  }
+}
+
+static void testRandom(void)
+{
+  const canroute_t* r = NULL;
+  uint32_t id = 0;
+  uint8_t bus = 0;
+  uint8_t format = 0;
+  int t = 0;
+  int i = 0;
+
+  for (t = 0; t < RANDOM_TABLES; t++) {
+    randomTable();
+    CHECK(canroute_compile(routes, numRoutes) == ERR_OK);
+
+    for (i = 0; i < RANDOM_LOOKUPS; i++) {
+      bus = rand() % CANROUTE_NUM_BUSES;
+      format = rand() % 2;
+      if (i & 1) {
+        // near a route boundary
+        r = &routes[rand() % numRoutes];
+        bus = r->srcBus;
+        format = r->format;
+        id = (rand() % 2 ? r->idLow : r->idHigh) + rand() % 5 - 2;
+        id &= (format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+      }
+      else {
+        id = rand() & (format == EXT_ID_FORMAT ? EXT_ID_MAX : STD_ID_MAX);
+      }
+
+      r = canroute_lookup(bus, format, id);
+      CHECK(r == refLookup(bus, format, id));
+      if (r != NULL) {
+        checkCovered(r, id);
+      }
+    }
+  }
+}
+
+static void benchLookup(void)
+{
+  volatile uint32_t hits = 0;
+  uint32_t ids[1024];
+  double t = 0;
+  int i = 0;
+
+  // full table of 11-bit routes on both buses
+  numRoutes = 0;
+  for (i = 0; i < CANROUTE_MAX_ROUTES; i++) {
+    setRoute(&routes[numRoutes++], i & 1, STD_ID_FORMAT, 1, (i >> 1) * 64,
+        (i >> 1) * 64 + 31, 0);
+  }
+  CHECK(canroute_compile(routes, numRoutes) == ERR_OK);
+
+  for (i = 0; i < 1024; i++) {
+    ids[i] = rand() & STD_ID_MAX;
+  }
+
+  t = test_seconds();
+  for (i = 0; i < BENCH_LOOKUPS; i++) {
+    if (canroute_lookup(i & 1, STD_ID_FORMAT, ids[i & 1023]) != NULL) {
+      hits++;
+    }
+  }
+  t = test_seconds() - t;
+
+  printf("%d routes: %.1f M lookups/s (%.1f ns/lookup)\n", numRoutes,
+      BENCH_LOOKUPS / t / 1e6, t / BENCH_LOOKUPS * 1e9);
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testLookup();
+  testMask();
+  testOverlap();
+  testRandom();
+  benchLookup();
+
+  printf("canroute_test ok\n");
+  return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the section macros of the Code Red toolchain, the
+ * data is put in ordinary named sections
+ */
+
+#ifndef __CR_SECTION_MACROS_H
+#define __CR_SECTION_MACROS_H
+
+#define __DATA(bank) __attribute__ ((section(".data.$" #bank)))
+#define __BSS(bank)  __attribute__ ((section(".bss.$" #bank)))
+
+#endif
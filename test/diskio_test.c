@@ -0,0 +1,247 @@
+/****************************************************************************************************//**
+*
+* @file		diskio_test.c
+* @brief	Host model test of the sector cache of diskio.c
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs diskio.c against a RAM disk (the mmc_disk_* functions below) with
+ * random single and multiple sector reads and writes, sequential read
+ * bursts and syncs, some of them around a few hot sectors. A model holds
+ * the data FatFs has written: every read must return it and the disk must
+ * hold it after each CTRL_SYNC.
+ *
+ * Some disk writes fail. A failed single sector write or sync keeps the
+ * data dirty in the cache, so it must still be read back and reach the
+ * disk with a later sync. The content of the sectors of a failed multiple
+ * sector write is undefined until they are written again. A read that
+ * has to write back a dirty sector to make room may fail as well.
+ *
+ * Usage: diskio_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "diskio.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SS          (512)
+#define SECTORS     (4096)
+#define ITERATIONS  (200000)
+
+// one disk write in FAIL_RATE fails
+#define FAIL_RATE   (500)
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static BYTE disk[SECTORS][SS];
+static BYTE model[SECTORS][SS];
+static BYTE unknown[SECTORS];     // content undefined after a failed write
+
+static uint8_t failWrites = 0;
+static uint32_t diskWrites = 0;
+static uint32_t diskReads = 0;
+
+static BYTE buf[255 * SS];
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+DSTATUS mmc_disk_initialize(BYTE drv)
+{
+  return (drv ? STA_NOINIT : 0);
+}
+
+DSTATUS mmc_disk_status(BYTE drv)
+{
+  return (drv ? STA_NOINIT : 0);
+}
+
+DRESULT mmc_disk_read(BYTE drv, BYTE* buff, DWORD sector, BYTE count)
+{
+  if (drv || !count) {
+    return RES_PARERR;
+  }
+  if (sector + count > SECTORS) {
+    return RES_ERROR;
+  }
+
+  memcpy(buff, disk[sector], count * SS);
+  diskReads++;
+  return RES_OK;
+}
+
+DRESULT mmc_disk_write(BYTE drv, const BYTE* buff, DWORD sector, BYTE count)
+{
+  CHECK(drv == 0 && count > 0 && sector + count <= SECTORS);
+
+  if (failWrites && rand() % FAIL_RATE == 0) {
+    return RES_ERROR;
+  }
+
+  memcpy(disk[sector], buff, count * SS);
+  diskWrites++;
+  return RES_OK;
+}
+
+DRESULT mmc_disk_ioctl(BYTE drv, BYTE ctrl, void* buff)
+{
+  return RES_OK;
+}
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void checkRead(DWORD sector, BYTE count)
+{
+  uint32_t i = 0;
+
+  // a miss may have to write back a dirty sector to make room
+  if (disk_read(0, buf, sector, count) != RES_OK) {
+    CHECK(failWrites && count == 1);
+    return;
+  }
+  for (i = 0; i < count; i++) {
+    CHECK(unknown[sector + i] || memcmp(&buf[i * SS], model[sector + i], SS) == 0);
+  }
+}
+
+static void writeSectors(DWORD sector, BYTE count)
+{
+  DRESULT res;
+  uint32_t i = 0;
+
+  for (i = 0; i < count * SS; i++) {
+    buf[i] = rand();
+  }
+
+  res = disk_write(0, buf, sector, count);
+  if (res == RES_OK) {
+    memcpy(model[sector], buf, count * SS);
+    memset(&unknown[sector], 0, count);
+  }
+  else if (count > 1) {
+    memset(&unknown[sector], 1, count);
+  }
+  // a failed single sector write (a write back to make room) changes nothing
+}
+
+static void checkSync(void)
+{
+  uint32_t i = 0;
+
+  if (disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) {
+    CHECK(failWrites);
+    return;
+  }
+
+  for (i = 0; i < SECTORS; i++) {
+    CHECK(unknown[i] || memcmp(disk[i], model[i], SS) == 0);
+  }
+}
+
+static void run(uint8_t fail)
+{
+  CACHE_STAT before;
+  CACHE_STAT cs;
+  DWORD hot = rand() % SECTORS;
+  DWORD sector = 0;
+  BYTE count = 0;
+  uint32_t writes = 0;
+  uint32_t i = 0;
+  uint32_t k = 0;
+  int op = 0;
+
+  for (i = 0; i < SECTORS; i++) {
+    memset(disk[i], i, SS);
+    memcpy(model[i], disk[i], SS);
+  }
+  memset(unknown, 0, sizeof(unknown));
+  failWrites = fail;
+  diskWrites = 0;
+  diskReads = 0;
+
+  CHECK(disk_initialize(0) == 0);
+  CHECK(disk_ioctl(0, CACHE_GET_STAT, &before) == RES_OK);
+
+  for (i = 0; i < ITERATIONS; i++) {
+    op = rand() % 20;
+    sector = (rand() % 3 == 0 ? hot + rand() % 40 : rand() % SECTORS);
+    count = (rand() % 4 == 0 ? 1 + rand() % 16 : 1);
+    if (sector + count > SECTORS) {
+      sector = SECTORS - count;
+    }
+    if (rand() % 50 == 0) {
+      hot = rand() % SECTORS;
+    }
+
+    if (op < 10) {
+      checkRead(sector, count);
+    }
+    else if (op < 18) {
+      writeSectors(sector, count);
+      writes++;
+    }
+    else if (op < 19) {
+      // sequential single sector reads (read-ahead)
+      sector = rand() % (SECTORS - 64);
+      for (k = 0; k < 32; k++) {
+        checkRead(sector + k, 1);
+      }
+    }
+    else if (rand() % 20 == 0) {
+      checkSync();
+    }
+  }
+
+  // retry until the sync succeeds, no data may be lost on the way
+  while (disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) {
+    CHECK(fail);
+  }
+  failWrites = 0;
+  checkSync();
+
+  CHECK(disk_ioctl(0, CACHE_GET_STAT, &cs) == RES_OK);
+  printf("%s: %u writes, %u disk writes, %u disk reads, hits %u misses %u "
+      "ra %u/%u wb %u/%u direct %u\n", fail ? "failing disk" : "disk",
+      writes, diskWrites, diskReads, (uint32_t)(cs.hits - before.hits),
+      (uint32_t)(cs.misses - before.misses), (uint32_t)(cs.ra_hits - before.ra_hits),
+      (uint32_t)(cs.ra_fills - before.ra_fills), (uint32_t)(cs.wb_sectors - before.wb_sectors),
+      (uint32_t)(cs.wb_runs - before.wb_runs), (uint32_t)(cs.direct - before.direct));
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  printf("cache %u sets x %u ways, runs of %u sectors\n", _CACHE_SETS, _CACHE_WAYS, _CACHE_RUN);
+
+  run(0);
+  run(1);
+
+  printf("diskio_test ok\n");
+  return 0;
+}
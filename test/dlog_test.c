@@ -0,0 +1,287 @@
+/****************************************************************************************************//**
+*
+* @file		dlog_test.c
+* @brief	Host test of the record encoding of the deferred log
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Writes records through dlog.c and decodes what dlog_task sends to the
+ * console. Strings that must be copied are put in a page mapped at the
+ * local SRAM address of the LPC17xx, other addresses stand for strings in
+ * flash and are never read.
+ *
+ * Usage: dlog_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include <sys/mman.h>
+#include "board.h"
+#include "dlog.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SRAM_BASE (0x10000000UL)
+#define SRAM_SIZE (0x1000UL)
+
+#define FLASH_STRING (0x00001234UL)
+
+#define STRING_RECORD (0x0E)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint8_t nargs;         // number of arguments, 0x0E for a string record
+  uint8_t level;
+  uint32_t fmt;
+  uint32_t args[DLOG_MAX_ARGS];
+  uint8_t numArgs;
+  uint8_t strArgs;
+  char strs[DLOG_MAX_ARGS][DLOG_MAX_STR + 1];
+} record_t;
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static uint8_t console[4096];
+static uint32_t consoleLen = 0;
+
+static char* sram = NULL;
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+uint32_t time_getUs(void)
+{
+  return 0x12345678;
+}
+
+uint32_t console_send(uint8_t* txbuf, uint32_t buflen, TRANSFER_BLOCK_Type flag)
+{
+  CHECK(consoleLen + buflen <= sizeof(console));
+  memcpy(&console[consoleLen], txbuf, buflen);
+  consoleLen += buflen;
+  return buflen;
+}
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static uint32_t word(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Send the ring to the console and decode the one record in it
+static void takeRecord(record_t* r)
+{
+  const uint8_t* p = console;
+  uint32_t info = 0;
+  uint32_t hdr = 0;
+  uint32_t len = 0;
+  uint32_t i = 0;
+
+  consoleLen = 0;
+  dlog_flush();
+  memset(r, 0, sizeof(*r));
+
+  CHECK(consoleLen >= 9 && *p++ == DLOG_SYNC);
+  hdr = word(p);
+  CHECK(word(p + 4) == 0x12345678);
+  p += 8;
+
+  r->nargs = hdr >> 28;
+  r->level = (hdr >> 24) & 0x0F;
+  r->fmt = hdr & 0x00FFFFFF;
+  r->numArgs = r->nargs;
+
+  if (r->nargs == STRING_RECORD) {
+    info = word(p);
+    p += 4;
+    r->numArgs = info & 0xFF;
+    r->strArgs = (info >> 16) & 0xFF;
+    CHECK(consoleLen == 13 + 4 * (r->numArgs + ((info >> 8) & 0xFF)));
+  }
+  else {
+    CHECK(consoleLen == 9 + 4 * r->numArgs);
+  }
+
+  CHECK(r->numArgs <= DLOG_MAX_ARGS);
+  for (i = 0; i < r->numArgs; i++) {
+    r->args[i] = word(p);
+    p += 4;
+  }
+
+  for (i = 0; i < r->numArgs; i++) {
+    if (r->strArgs & (1 << i)) {
+      len = r->args[i] & 0xFF;
+      CHECK(len <= DLOG_MAX_STR);
+      memcpy(r->strs[i], p, len);
+      p += (len + 3) / 4 * 4;
+    }
+  }
+}
+
+static char* ramString(uint32_t ofs, const char* s)
+{
+  strcpy(&sram[ofs], s);
+  return &sram[ofs];
+}
+
+static void testStrings(void)
+{
+  static const char fmtFlash[] = "flash %s %d\r\n";
+  static const char fmtRam[] = "netif %c%c%d %s up, mtu %d\r\n";
+  static const char fmtNotString[] = "%d %x %s\r\n";
+  static const char fmtWidth[] = "%*s|%% %s|%5.2s\r\n";
+  char* name = ramString(0, "eth0");
+  char* longName = ramString(64, "a string much longer than DLOG_MAX_STR");
+  record_t r;
+  uint32_t args[DLOG_MAX_ARGS];
+
+  // a string in flash is logged by address only
+  args[0] = FLASH_STRING;
+  args[1] = -1;
+  dlog_write(DLOG_LEVEL_INFO, fmtFlash, 2, args);
+  takeRecord(&r);
+  CHECK(r.nargs == 2 && r.level == DLOG_LEVEL_INFO);
+  CHECK(r.fmt == ((uint32_t)(uintptr_t)fmtFlash & 0x00FFFFFF));
+  CHECK(r.args[0] == FLASH_STRING && r.args[1] == 0xFFFFFFFF);
+
+  // a string in RAM is copied, the other arguments are kept
+  args[0] = 'e';
+  args[1] = 't';
+  args[2] = 0;
+  args[3] = (uint32_t)(uintptr_t)name;
+  args[4] = 1500;
+  dlog_write(DLOG_LEVEL_DBG, fmtRam, 5, args);
+  strcpy(name, "XXXX");
+  takeRecord(&r);
+  CHECK(r.nargs == STRING_RECORD && r.level == DLOG_LEVEL_DBG && r.numArgs == 5);
+  CHECK(r.strArgs == (1 << 3));
+  CHECK(r.args[0] == 'e' && r.args[1] == 't' && r.args[2] == 0 && r.args[4] == 1500);
+  CHECK(r.args[3] == 4 && strcmp(r.strs[3], "eth0") == 0);
+
+  // a long string is cut
+  args[0] = (uint32_t)(uintptr_t)longName;
+  dlog_write(DLOG_LEVEL_WARN, fmtFlash, 2, args);
+  takeRecord(&r);
+  CHECK(r.nargs == STRING_RECORD && r.strArgs == 1);
+  CHECK(r.args[0] == (0x100 | DLOG_MAX_STR));
+  CHECK(memcmp(r.strs[0], longName, DLOG_MAX_STR) == 0);
+
+  // a string of exactly DLOG_MAX_STR bytes isn't cut
+  longName[DLOG_MAX_STR] = '\0';
+  dlog_write(DLOG_LEVEL_WARN, fmtFlash, 2, args);
+  takeRecord(&r);
+  CHECK(r.args[0] == DLOG_MAX_STR);
+
+  // an integer that looks like a RAM address is not a string
+  args[0] = (uint32_t)(uintptr_t)name;
+  args[1] = (uint32_t)(uintptr_t)name;
+  args[2] = FLASH_STRING;
+  dlog_write(DLOG_LEVEL_INFO, fmtNotString, 3, args);
+  takeRecord(&r);
+  CHECK(r.nargs == 3 && r.args[0] == args[0] && r.args[2] == FLASH_STRING);
+
+  // '*' widths and "%%" are skipped when the string arguments are found
+  args[0] = 8;
+  args[1] = (uint32_t)(uintptr_t)name;
+  args[2] = FLASH_STRING;
+  args[3] = (uint32_t)(uintptr_t)longName;
+  dlog_write(DLOG_LEVEL_INFO, fmtWidth, 4, args);
+  takeRecord(&r);
+  CHECK(r.nargs == STRING_RECORD && r.strArgs == ((1 << 1) | (1 << 3)));
+  CHECK(r.args[0] == 8 && r.args[2] == FLASH_STRING);
+  CHECK(strcmp(r.strs[1], "XXXX") == 0 && r.args[3] == DLOG_MAX_STR);
+}
+
+// Random records of all kinds must come out in order and intact
+static void testRandom(void)
+{
+  static const char fmt[] = "%s %d %s %s %u %s %s %s\r\n";
+  uint32_t args[DLOG_MAX_ARGS];
+  record_t r;
+  char s[DLOG_MAX_STR + 1];
+  uint32_t len = 0;
+  uint32_t n = 0;
+  uint32_t i = 0;
+  uint32_t j = 0;
+
+  for (i = 0; i < 10000; i++) {
+    n = rand() % (DLOG_MAX_ARGS + 1);
+    for (j = 0; j < n; j++) {
+      len = rand() % (DLOG_MAX_STR + 4);
+      memset(s, 'a' + j, sizeof(s));
+      s[len < DLOG_MAX_STR ? len : DLOG_MAX_STR] = '\0';
+      if (len > DLOG_MAX_STR) {
+        memset(&sram[256 + j * 32], 'a' + j, len);
+        sram[256 + j * 32 + len] = '\0';
+      }
+      else {
+        strcpy(&sram[256 + j * 32], s);
+      }
+      args[j] = (rand() % 2 ? (uint32_t)(uintptr_t)&sram[256 + j * 32] : j);
+    }
+
+    dlog_write(DLOG_LEVEL_INFO, fmt, n, args);
+    takeRecord(&r);
+
+    CHECK(r.numArgs == n);
+    for (j = 0; j < n; j++) {
+      if (j != 1 && j != 4 && args[j] >= SRAM_BASE) {
+        CHECK(r.strArgs & (1 << j));
+        len = strlen(&sram[256 + j * 32]);
+        CHECK((r.args[j] & 0xFF) == (len < DLOG_MAX_STR ? len : DLOG_MAX_STR));
+        CHECK(!(r.args[j] & 0x100) == (len <= DLOG_MAX_STR));
+        CHECK(strncmp(r.strs[j], &sram[256 + j * 32], DLOG_MAX_STR) == 0);
+      }
+      else {
+        CHECK(!(r.strArgs & (1 << j)) && r.args[j] == args[j]);
+      }
+    }
+  }
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  dlog_stats_t st;
+
+  test_seed(argc, argv);
+
+  sram = mmap((void*)SRAM_BASE, SRAM_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  CHECK(sram == (char*)SRAM_BASE);
+
+  testStrings();
+  testRandom();
+
+  dlog_getStats(&st);
+  CHECK(st.dropped == 0 && st.written == st.sent);
+
+  printf("dlog_test ok\n");
+  return 0;
+}
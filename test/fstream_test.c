@@ -0,0 +1,553 @@
+/****************************************************************************************************//**
+*
+* @file		fstream_test.c
+* @brief	Host test of the free cluster map and streaming appends of FatFs
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs ff.c and diskio.c with the configuration of the firmware on a RAM
+ * disk. Each round formats a FAT32 volume with runs of used clusters in
+ * the FAT, builds the free map with f_mapfree and appends to a file
+ * through f_stream, with random write sizes and syncs. The FAT and the
+ * FSInfo sector are then read from the disk: the clusters taken from the
+ * reserved area must be contiguous, no cluster used before may be taken,
+ * the rest of the area must be free again and the free count in FSInfo
+ * must match a scan of the FAT.
+ *
+ * The free and full maps f_mapfree builds in slices, and its count of free
+ * clusters, are compared with a scan of the FAT after each slice, with and
+ * without clusters allocated between the slices.
+ *
+ * The volume is built here since the firmware configuration has neither
+ * f_mkfs nor f_getfree and f_unlink.
+ *
+ * Usage: fstream_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "ff.h"
+#include "diskio.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SECT_SIZE   (512)
+
+// the fewest clusters of a FAT32 volume and some more, one sector each
+#define CLUSTERS    (66000)
+#define RSVD_SECTS  (32)
+#define FAT_SECTS   (((CLUSTERS + 2) * 4 + SECT_SIZE - 1) / SECT_SIZE)
+#define DATABASE    (RSVD_SECTS + 2 * FAT_SECTS)
+#define SECTORS     (DATABASE + CLUSTERS)
+#define MAX_CLUST   (CLUSTERS + 2)
+
+#define ROOT_CLUST  (2)
+#define FSINFO_SECT (1)
+
+// the first part of the volume is fragmented, the rest is free
+#define FRAG_END    (MAX_CLUST * 3 / 4)
+
+// clusters in a group of the free map, 66000 clusters in 2048 bits
+#define GROUP       (64)
+
+#define ROUNDS      (40)
+
+#define EOC         (0x0FFFFFFF)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef enum {
+  FREE_KNOWN,     // FSInfo holds the free count
+  FREE_UNKNOWN,   // FSInfo holds 0xFFFFFFFF
+  FREE_WRONG,     // FSInfo is off, the complete map corrects it
+} fsinfo_t;
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static BYTE disk[SECTORS][SECT_SIZE];
+
+// the FAT entries of the volume as formatted
+static DWORD fat0[MAX_CLUST];
+
+static FATFS fs;
+
+static BYTE buf[4096];
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+DSTATUS mmc_disk_initialize(BYTE drv)
+{
+  return (drv ? STA_NOINIT : 0);
+}
+
+DSTATUS mmc_disk_status(BYTE drv)
+{
+  return (drv ? STA_NOINIT : 0);
+}
+
+DRESULT mmc_disk_read(BYTE drv, BYTE* buff, DWORD sector, BYTE count)
+{
+  if (drv || !count) {
+    return RES_PARERR;
+  }
+  if (sector + count > SECTORS) {
+    return RES_ERROR;
+  }
+
+  memcpy(buff, disk[sector], count * SECT_SIZE);
+  return RES_OK;
+}
+
+DRESULT mmc_disk_write(BYTE drv, const BYTE* buff, DWORD sector, BYTE count)
+{
+  CHECK(drv == 0 && count > 0 && sector + count <= SECTORS);
+
+  memcpy(disk[sector], buff, count * SECT_SIZE);
+  return RES_OK;
+}
+
+DRESULT mmc_disk_ioctl(BYTE drv, BYTE ctrl, void* buff)
+{
+  return RES_OK;
+}
+
+DWORD get_fattime(void)
+{
+  return ((2026UL - 1980) << 25) | (10UL << 21) | (17UL << 16);
+}
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static DWORD getFat(DWORD clst)
+{
+  return LD_DWORD(&disk[RSVD_SECTS + clst / (SECT_SIZE / 4)][clst % (SECT_SIZE / 4) * 4]) & 0x0FFFFFFF;
+}
+
+static void putFat(DWORD clst, DWORD val)
+{
+  ST_DWORD(&disk[RSVD_SECTS + clst / (SECT_SIZE / 4)][clst % (SECT_SIZE / 4) * 4], val);
+  fat0[clst] = val;
+}
+
+// Free clusters in the FAT on the disk, both copies must agree
+static DWORD countFree(void)
+{
+  DWORD n = 0;
+  DWORD c = 0;
+
+  CHECK(memcmp(disk[RSVD_SECTS], disk[RSVD_SECTS + FAT_SECTS], FAT_SECTS * SECT_SIZE) == 0);
+  for (c = 2; c < MAX_CLUST; c++) {
+    n += (getFat(c) == 0);
+  }
+
+  return n;
+}
+
+static BYTE pattern(DWORD ofs, BYTE key)
+{
+  return (BYTE)((ofs >> 9) * 31 + ofs * 7 + key);
+}
+
+// A FAT32 volume with an empty root directory. The first part of the
+// volume alternates between chains of used clusters and free gaps, some
+// of them longer than a cluster group of the free map, or is used but
+// for one hole of holeLen clusters.
+static void format(fsinfo_t info, DWORD hole, DWORD holeLen)
+{
+  BYTE* bs = disk[0];
+  BYTE* fsi = disk[FSINFO_SECT];
+  DWORD c = ROOT_CLUST + 1;
+  DWORD n = 0;
+  DWORD nfree = 0;
+
+  memset(disk, 0, (DATABASE + 1) * SECT_SIZE);
+  memset(fat0, 0, sizeof(fat0));
+
+  bs[BS_jmpBoot] = 0xEB;
+  bs[BS_jmpBoot + 1] = 0x58;
+  bs[BS_jmpBoot + 2] = 0x90;
+  memcpy(&bs[BS_OEMName], "MSDOS5.0", 8);
+  ST_WORD(&bs[BPB_BytsPerSec], SECT_SIZE);
+  bs[BPB_SecPerClus] = 1;
+  ST_WORD(&bs[BPB_RsvdSecCnt], RSVD_SECTS);
+  bs[BPB_NumFATs] = 2;
+  bs[BPB_Media] = 0xF8;
+  ST_DWORD(&bs[BPB_TotSec32], SECTORS);
+  ST_DWORD(&bs[BPB_FATSz32], FAT_SECTS);
+  ST_DWORD(&bs[BPB_RootClus], ROOT_CLUST);
+  ST_WORD(&bs[BPB_FSInfo], FSINFO_SECT);
+  bs[BS_BootSig32] = 0x29;
+  memcpy(&bs[BS_FilSysType32], "FAT32   ", 8);
+  ST_WORD(&bs[BS_55AA], 0xAA55);
+
+  putFat(0, 0x0FFFFFF8);
+  putFat(1, EOC);
+  putFat(ROOT_CLUST, EOC);
+
+  while (!holeLen && c < FRAG_END) {
+    c += (rand() % 4 ? 1 + rand() % 40 : 64 + rand() % 256);
+    for (n = 1 + rand() % 60; n && c < FRAG_END; n--, c++) {
+      putFat(c, (n > 1 && c + 1 < FRAG_END) ? c + 1 : EOC);
+    }
+  }
+  for (c = ROOT_CLUST + 1; holeLen && c < FRAG_END; c++) {
+    if (c - hole >= holeLen) {
+      putFat(c, EOC);
+    }
+  }
+  memcpy(disk[RSVD_SECTS + FAT_SECTS], disk[RSVD_SECTS], FAT_SECTS * SECT_SIZE);
+  nfree = countFree();
+
+  ST_DWORD(&fsi[FSI_LeadSig], 0x41615252);
+  ST_DWORD(&fsi[FSI_StrucSig], 0x61417272);
+  ST_DWORD(&fsi[FSI_Free_Count], info == FREE_KNOWN ? nfree :
+      info == FREE_WRONG ? nfree - 1 - rand() % 1000 : 0xFFFFFFFF);
+  ST_DWORD(&fsi[FSI_Nxt_Free], 0xFFFFFFFF);
+  ST_WORD(&fsi[BS_55AA], 0xAA55);
+}
+
+// Build the free map in slices of random size, or only its first part.
+// The first call mounts the volume and starts a new map.
+static void buildMap(uint8_t complete)
+{
+  DWORD end = (complete ? MAX_CLUST : 2 + rand() % MAX_CLUST);
+
+  do {
+    CHECK(f_mapfree("", 1 + rand() % 20000) == FR_OK);
+  } while (fs.fm_scan < end);
+  CHECK(fs.fm_valid == (fs.fm_scan >= MAX_CLUST));
+}
+
+static void writeData(FIL* fp, DWORD len, BYTE key)
+{
+  UINT bw = 0;
+  UINT n = 0;
+  UINT i = 0;
+
+  while (len) {
+    n = 1 + rand() % sizeof(buf);
+    if (n > len) {
+      n = len;
+    }
+    for (i = 0; i < n; i++) {
+      buf[i] = pattern(fp->fptr + i, key);
+    }
+    CHECK(f_write(fp, buf, n, &bw) == FR_OK && bw == n);
+    len -= n;
+    if (rand() % 8 == 0) {
+      CHECK(f_sync(fp) == FR_OK);
+    }
+  }
+}
+
+// Follow the chain of the file on the disk, check its data and that it
+// only takes clusters that were free
+static DWORD readChain(const char* name, DWORD* chain, DWORD maxLen, DWORD* size, BYTE key)
+{
+  const BYTE* dir = disk[DATABASE + ROOT_CLUST - 2];
+  DWORD clst = 0;
+  DWORD n = 0;
+  DWORD ofs = 0;
+  uint32_t i = 0;
+
+  for (i = 0; i < SECT_SIZE && memcmp(&dir[i + DIR_Name], name, 11) != 0; i += 32) ;
+  CHECK(i < SECT_SIZE);
+  dir += i;
+  clst = ((DWORD)LD_WORD(&dir[DIR_FstClusHI]) << 16) | LD_WORD(&dir[DIR_FstClusLO]);
+  *size = LD_DWORD(&dir[DIR_FileSize]);
+  if (!*size) {
+    CHECK(clst == 0);
+    return 0;
+  }
+
+  for (n = 0; clst != EOC; n++) {
+    CHECK(n < maxLen && clst >= 2 && clst < MAX_CLUST && fat0[clst] == 0);
+    chain[n] = clst;
+    for (i = 0; i < SECT_SIZE && ofs < *size; i++, ofs++) {
+      CHECK(disk[DATABASE + clst - 2][i] == pattern(ofs, key));
+    }
+    clst = getFat(clst);
+  }
+  CHECK(n == (*size + SECT_SIZE - 1) / SECT_SIZE);
+
+  return n;
+}
+
+// The maps must tell the groups scanned so far that are entirely free and
+// full as a scan of the FAT on the disk does. Allocations since the scan
+// may have filled a group without its bit in the full map set. The count
+// is exact for the clusters scanned so far.
+static void checkMap(uint8_t exact)
+{
+  DWORD nfree = 0;
+  DWORD g = 0;
+  DWORD c = 0;
+  uint8_t hasUsed = 0;
+  uint8_t hasFree = 0;
+  uint8_t fbit = 0;
+  uint8_t ubit = 0;
+
+  for (g = 0; g * GROUP < MAX_CLUST; g++) {
+    hasUsed = hasFree = 0;
+    for (c = (g ? g * GROUP : 2); c < (g + 1) * GROUP && c < MAX_CLUST; c++) {
+      if (getFat(c)) {
+        hasUsed = 1;
+      }
+      else {
+        hasFree = 1;
+        nfree += (c < fs.fm_scan);
+      }
+    }
+
+    fbit = (fs.fmap[g / 8] >> (g % 8)) & 1;
+    ubit = (fs.umap[g / 8] >> (g % 8)) & 1;
+    CHECK(!fbit || !hasUsed);
+    CHECK(!ubit || !hasFree);
+    if (c <= fs.fm_scan) {
+      CHECK(fbit == !hasUsed);
+      CHECK(!exact || ubit == !hasFree);
+    }
+    else {
+      CHECK(!fbit);
+    }
+  }
+
+  CHECK(fs.fm_nfree == nfree);
+  if (fs.fm_valid) {
+    CHECK(fs.free_clust == nfree);
+  }
+}
+
+// A file written partly before f_stream, then into the reserved area and
+// sometimes past it
+static void testRound(void)
+{
+  static DWORD chain[MAX_CLUST];
+  fsinfo_t info = (fsinfo_t)(rand() % 3);
+  uint8_t complete = (info == FREE_WRONG || rand() % 2);
+  BYTE key = rand();
+  FIL f;
+  FRESULT res;
+  DWORD pre = (rand() % 2 ? rand() % (8 * SECT_SIZE) : 0);
+  DWORD fsz = (rand() % 4 ? 1 + rand() % (300 * SECT_SIZE) : 1 + rand() % (3000 * SECT_SIZE));
+  DWORD len = (rand() % 2 ? fsz : rand() % (fsz + 2000));
+  DWORD first = (pre + SECT_SIZE - 1) / SECT_SIZE;
+  DWORD ncl = (fsz + SECT_SIZE - 1) / SECT_SIZE;
+  DWORD size = 0;
+  DWORD n = 0;
+  DWORD i = 0;
+
+  format(info, 0, 0);
+  CHECK(f_mount(0, &fs) == FR_OK);
+  CHECK(f_open(&f, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+  buildMap(complete);
+
+  writeData(&f, pre, key);
+  res = f_stream(&f, fsz);
+  if (res == FR_DENIED) {
+    // no run of free groups long enough in the part of the map built
+    CHECK(!fs.fm_valid || ncl > MAX_CLUST - FRAG_END);
+  }
+  else {
+    CHECK(res == FR_OK && fs.rsv_end == fs.rsv_clust + ncl);
+    CHECK(fs.rsv_clust >= 2 && fs.rsv_end <= fs.fm_scan);
+    for (i = fs.rsv_clust; i < fs.rsv_end; i++) {
+      CHECK(fat0[i] == 0);
+    }
+  }
+  writeData(&f, len, key);
+  CHECK(f_close(&f) == FR_OK && fs.rsv_end == 0);
+
+  n = readChain("LOG     BIN", chain, MAX_CLUST, &size, key);
+  CHECK(size == pre + len);
+  checkMap(0);
+
+  // the clusters past the data written before f_stream are contiguous
+  // for the size of the area
+  for (i = first + 1; res == FR_OK && i < n && i < first + ncl; i++) {
+    CHECK(chain[i] == chain[i - 1] + 1);
+  }
+
+  // FSInfo holds the count of the FAT, unless it wasn't known and the
+  // map is not complete
+  CHECK(LD_DWORD(&disk[FSINFO_SECT][FSI_LeadSig]) == 0x41615252);
+  size = LD_DWORD(&disk[FSINFO_SECT][FSI_Free_Count]);
+  if (fs.fm_valid || info == FREE_KNOWN) {
+    CHECK(size == countFree() && fs.free_clust == size);
+  }
+  else {
+    CHECK(size == 0xFFFFFFFF && fs.free_clust == 0xFFFFFFFF);
+  }
+}
+
+// The map is built in slices on a fragmented volume and compared with a
+// scan of the FAT after each, sometimes with clusters allocated between
+// the slices
+static void testMap(void)
+{
+  static DWORD chain[MAX_CLUST];
+  FIL f;
+  uint8_t writes = rand() % 2;
+  BYTE key = rand();
+  DWORD size = 0;
+
+  format((fsinfo_t)(rand() % 3), 0, 0);
+  CHECK(f_mount(0, &fs) == FR_OK);
+  CHECK(f_open(&f, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+  CHECK(fs.fm_shift == 6 && fs.fm_scan == 2 && fs.fm_nfree == 0);
+
+  while (!fs.fm_valid) {
+    CHECK(f_mapfree("", 1 + rand() % 5000) == FR_OK);
+    if (writes) {
+      writeData(&f, rand() % (40 * SECT_SIZE), key);
+      CHECK(f_sync(&f) == FR_OK);
+    }
+    checkMap(!writes);
+  }
+  CHECK(fs.fm_scan == MAX_CLUST);
+
+  // a complete map isn't scanned again
+  CHECK(f_mapfree("", 100) == FR_OK && fs.fm_scan == MAX_CLUST);
+  writeData(&f, rand() % (200 * SECT_SIZE), key);
+  CHECK(f_close(&f) == FR_OK);
+  checkMap(0);
+  CHECK(LD_DWORD(&disk[FSINFO_SECT][FSI_Free_Count]) == countFree());
+  readChain("LOG     BIN", chain, MAX_CLUST, &size, key);
+}
+
+// Clusters taken in the part of a group scanned so far must keep the
+// group out of the free map when its scan completes
+static void testScanned(void)
+{
+  DWORD hole = GROUP * (1 + rand() % (FRAG_END / GROUP - 4));
+  FIL f;
+
+  format(FREE_KNOWN, hole, 3 * GROUP);
+  CHECK(f_mount(0, &fs) == FR_OK);
+  CHECK(f_open(&f, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+  CHECK(f_mapfree("", hole + GROUP / 2 - 2) == FR_OK && fs.fm_scan == hole + GROUP / 2);
+
+  writeData(&f, 5 * SECT_SIZE, 'h');
+  CHECK(f_sync(&f) == FR_OK && f.org_clust == hole);
+  checkMap(1);
+
+  buildMap(1);
+  checkMap(1);
+  CHECK(!(fs.fmap[hole / GROUP / 8] & (1 << (hole / GROUP % 8))));
+  CHECK(f_close(&f) == FR_OK);
+}
+
+// A hole of whole groups is taken when the area fits in it exactly, else
+// the area goes to the free part of the volume
+static void testHole(void)
+{
+  DWORD hole = 0;
+  DWORD k = 0;
+  FIL f;
+
+  for (k = 1; k <= 3; k++) {
+    hole = GROUP * (1 + rand() % (FRAG_END / GROUP - 4));
+
+    format(FREE_KNOWN, hole, k * GROUP);
+    CHECK(f_mount(0, &fs) == FR_OK);
+    buildMap(1);
+    CHECK(fs.fm_shift == 6);
+    CHECK(f_open(&f, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+    CHECK(f_stream(&f, k * GROUP * SECT_SIZE) == FR_OK && fs.rsv_clust == hole);
+    CHECK(f_close(&f) == FR_OK);
+
+    // a hole not aligned to the groups holds fewer whole groups
+    format(FREE_KNOWN, hole + 1, k * GROUP);
+    CHECK(f_mount(0, &fs) == FR_OK);
+    buildMap(1);
+    CHECK(f_open(&f, "LOG.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+    CHECK(f_stream(&f, (k - 1) * GROUP * SECT_SIZE + 1) == FR_OK);
+    CHECK(fs.rsv_clust == (FRAG_END + GROUP - 1) / GROUP * GROUP);
+    CHECK(f_close(&f) == FR_OK);
+    CHECK(LD_DWORD(&disk[FSINFO_SECT][FSI_Free_Count]) == countFree());
+  }
+}
+
+// Only one file of a volume can stream, the others write as usual
+static void testTwoFiles(void)
+{
+  static DWORD chain[MAX_CLUST];
+  FIL a;
+  FIL b;
+  DWORD size = 0;
+  DWORD n = 0;
+  DWORD i = 0;
+
+  format(FREE_KNOWN, 0, 0);
+  CHECK(f_mount(0, &fs) == FR_OK);
+  buildMap(1);
+  CHECK(f_open(&a, "A.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+  CHECK(f_open(&b, "B.BIN", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+
+  CHECK(f_stream(&a, 100 * SECT_SIZE) == FR_OK);
+  CHECK(f_stream(&b, 100 * SECT_SIZE) == FR_DENIED);
+  for (i = 0; i < 20; i++) {
+    writeData(&a, 5 * SECT_SIZE, 'a');
+    writeData(&b, 5 * SECT_SIZE, 'b');
+  }
+
+  // the file pointer must be at the end
+  CHECK(f_lseek(&b, 0) == FR_OK);
+  CHECK(f_stream(&b, SECT_SIZE) == FR_DENIED);
+  CHECK(f_close(&a) == FR_OK && f_close(&b) == FR_OK);
+
+  n = readChain("A       BIN", chain, MAX_CLUST, &size, 'a');
+  CHECK(n == 100);
+  for (i = 1; i < n; i++) {
+    CHECK(chain[i] == chain[i - 1] + 1);
+  }
+  readChain("B       BIN", chain, MAX_CLUST, &size, 'b');
+  CHECK(size == 100 * SECT_SIZE);
+  CHECK(LD_DWORD(&disk[FSINFO_SECT][FSI_Free_Count]) == countFree());
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  uint32_t i = 0;
+
+  test_seed(argc, argv);
+
+  for (i = 0; i < ROUNDS; i++) {
+    testRound();
+  }
+  testHole();
+  testTwoFiles();
+  for (i = 0; i < ROUNDS; i++) {
+    testMap();
+  }
+  testScanned();
+
+  printf("fstream_test ok\n");
+  return 0;
+}
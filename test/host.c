@@ -0,0 +1,49 @@
+/****************************************************************************************************//**
+*
+* @file		host.c
+* @brief	Memory for the Cortex-M3 core peripherals in the host tests
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Maps RAM at the System Control Space so that the NVIC, SCB and
+ * CoreDebug accesses of core_cm3.h (e.g. NVIC_DisableIRQ) work in a host
+ * test. Writes have no effect. Linked into every test.
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SCS_BASE (0xE000E000UL)
+#define SCS_SIZE (0x1000UL)
+
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void __attribute__ ((constructor)) mapCore(void)
+{
+  void* p = mmap((void*)SCS_BASE, SCS_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if (p != (void*)SCS_BASE) {
+    printf("host: can't map the system control space\n");
+    exit(1);
+  }
+}
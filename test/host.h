@@ -0,0 +1,73 @@
+/****************************************************************************************************//**
+*
+* @file		host.h
+* @brief	Host versions of the Cortex-M3 intrinsics for the host tests
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Included before every source file of a test (-include host.h). Replaces
+ * core_cmInstr.h and core_cmFunc.h, whose inline assembly only builds for
+ * ARM. The core peripherals of core_cm3.h (NVIC, SCB, CoreDebug) are
+ * backed by memory that host.c maps at their addresses.
+ */
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __HOST_H
+#define __HOST_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stdint.h>
+
+/********************************************************************************************************
+*** DEFINES
+********************************************************************************************************/
+
+// keep the ARM versions out
+#define __CORE_CMINSTR_H__
+#define __CORE_CMFUNC_H__
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+static inline void __NOP(void) { }
+static inline void __WFI(void) { }
+static inline void __WFE(void) { }
+static inline void __SEV(void) { }
+static inline void __ISB(void) { __sync_synchronize(); }
+static inline void __DSB(void) { __sync_synchronize(); }
+static inline void __DMB(void) { __sync_synchronize(); }
+
+static inline uint32_t __REV(uint32_t value) { return __builtin_bswap32(value); }
+static inline uint8_t __CLZ(uint32_t value) { return (value == 0 ? 32 : __builtin_clz(value)); }
+
+// exclusive accesses always succeed, the tests run in one thread
+static inline uint32_t __LDREXW(volatile uint32_t* addr) { return *addr; }
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t* addr) { *addr = value; return 0; }
+static inline void __CLREX(void) { }
+
+static inline void __enable_irq(void) { }
+static inline void __disable_irq(void) { }
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t priMask) { (void)priMask; }
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
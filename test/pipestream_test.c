@@ -0,0 +1,402 @@
+/****************************************************************************************************//**
+*
+* @file		pipestream_test.c
+* @brief	Host test of the USB host pipe stream functions
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs Pipe_LPC.c and PipeStream_LPC.c against a simulated host controller
+ * driver. A transfer stays queued for a random number of status polls, an
+ * IN transfer returns at most one packet of a known byte stream. Checks
+ * the data of random LE/BE/null/discard streams with and without
+ * BytesProcessed, the errors of a stalled, disconnected and hung pipe,
+ * then reports the time of a 512 byte write through Pipe_Write_8 and
+ * through Pipe_Write_Stream_LE.
+ *
+ * Usage: pipestream_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "Drivers/USB/USB.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define CORE     (0)
+#define OUT_PIPE (1)
+#define IN_PIPE  (2)
+
+#define PACKET_SIZE (64)
+
+// bytes of the simulated device streams
+#define STREAM_SIZE (1 << 20)
+
+#define RANDOM_STREAMS (1000)
+#define BENCH_WRITES   (200000)
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+volatile uint8_t USB_HostState[MAX_USB_CORE];
+
+// status polls a transfer stays queued, the status afterwards
+static uint32_t busy[PIPE_TOTAL_PIPES];
+static uint32_t maxBusy = 0;
+static HCD_STATUS pipeStatus[PIPE_TOTAL_PIPES];
+static uint32_t frame = 0;
+
+// bytes sent on the OUT pipe, bytes the device sends on the IN pipe
+static uint8_t sent[STREAM_SIZE];
+static uint32_t sentLen = 0;
+static uint8_t device[STREAM_SIZE];
+static uint32_t devicePos = 0;
+
+static uint8_t expected[STREAM_SIZE];
+
+/********************************************************************************************************
+*** STUBS
+********************************************************************************************************/
+
+HCD_STATUS HcdOpenPipe(uint8_t HostID, uint8_t DeviceAddr, HCD_USB_SPEED DeviceSpeed,
+    uint8_t EndpointNumber, HCD_TRANSFER_TYPE TransferType, HCD_TRANSFER_DIR TransferDir,
+    uint16_t MaxPacketSize, uint8_t Interval, uint8_t Mult, uint8_t HSHubDevAddr,
+    uint8_t HSHubPortNum, uint32_t* const PipeHandle)
+{
+  *PipeHandle = EndpointNumber & 0x0F;
+  return HCD_STATUS_OK;
+}
+
+HCD_STATUS HcdClosePipe(uint32_t PipeHandle)
+{
+  return HCD_STATUS_OK;
+}
+
+// every call is a new frame, a wait for the pipe times out after
+// USB_STREAM_TIMEOUT_MS calls
+uint32_t HcdGetFrameNumber(uint8_t HostID)
+{
+  return frame++;
+}
+
+HCD_STATUS HcdGetPipeStatus(uint32_t PipeHandle)
+{
+  if (busy[PipeHandle] > 0) {
+    busy[PipeHandle]--;
+    return HCD_STATUS_TRANSFER_QUEUED;
+  }
+
+  return pipeStatus[PipeHandle];
+}
+
+HCD_STATUS HcdDataTransfer(uint32_t PipeHandle, uint8_t* const buffer,
+    uint32_t const length, uint16_t* const pActualTransferred)
+{
+  uint32_t len = length;
+
+  CHECK(busy[PipeHandle] == 0);
+
+  if (PipeHandle == OUT_PIPE) {
+    CHECK(sentLen + len <= STREAM_SIZE);
+    memcpy(&sent[sentLen], buffer, len);
+    sentLen += len;
+  }
+  else {
+    if (len == HCD_ENDPOINT_MAXPACKET_XFER_LEN || len > PACKET_SIZE) {
+      len = PACKET_SIZE;
+    }
+    CHECK(devicePos + len <= STREAM_SIZE);
+    memcpy(buffer, &device[devicePos], len);
+    devicePos += len;
+    *pActualTransferred = len;
+  }
+
+  busy[PipeHandle] = (maxBusy > 0 ? rand() % (maxBusy + 1) : 0);
+
+  return HCD_STATUS_OK;
+}
+
+uint8_t* USB_Memory_Alloc(uint32_t size)
+{
+  return malloc(size);
+}
+
+void USB_Memory_Free(uint8_t* ptr)
+{
+  free(ptr);
+}
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void reset(void)
+{
+  int i = 0;
+
+  for (i = 0; i < PIPE_TOTAL_PIPES; i++) {
+    busy[i] = 0;
+    pipeStatus[i] = HCD_STATUS_OK;
+  }
+
+  USB_HostState[CORE] = HOST_STATE_Configured;
+  sentLen = 0;
+  devicePos = 0;
+
+  Pipe_SelectPipe(CORE, OUT_PIPE);
+  Pipe_ClearIN(CORE);
+  Pipe_SelectPipe(CORE, IN_PIPE);
+  Pipe_ClearIN(CORE);
+}
+
+// Wait for the transfer in progress, the buffer may be full
+static void waitIdle(uint32_t pipe)
+{
+  while (HcdGetPipeStatus(pipe) != HCD_STATUS_OK) {
+  }
+}
+
+// Write a stream, with BytesProcessed the call is repeated until done
+static uint8_t writeStream(int kind, const uint8_t* buf, uint16_t len, uint8_t partial)
+{
+  uint16_t done = 0;
+  uint16_t* bp = (partial ? &done : NULL);
+  uint8_t err = 0;
+
+  do {
+    switch (kind) {
+    case 0:
+      err = Pipe_Write_Stream_LE(CORE, buf, len, bp);
+      break;
+    case 1:
+      err = Pipe_Write_Stream_BE(CORE, buf, len, bp);
+      break;
+    default:
+      err = Pipe_Null_Stream(CORE, len, bp);
+      break;
+    }
+  } while (err == PIPE_RWSTREAM_IncompleteTransfer);
+
+  return err;
+}
+
+static uint8_t readStream(int kind, uint8_t* buf, uint16_t len, uint8_t partial)
+{
+  uint16_t done = 0;
+  uint16_t* bp = (partial ? &done : NULL);
+  uint8_t err = 0;
+
+  do {
+    switch (kind) {
+    case 0:
+      err = Pipe_Read_Stream_LE(CORE, buf, len, bp);
+      break;
+    case 1:
+      err = Pipe_Read_Stream_BE(CORE, buf, len, bp);
+      break;
+    default:
+      err = Pipe_Discard_Stream(CORE, len, bp);
+      break;
+    }
+  } while (err == PIPE_RWSTREAM_IncompleteTransfer);
+
+  return err;
+}
+
+static void testWrite(void)
+{
+  uint8_t buf[2000];
+  uint32_t total = 0;
+  uint16_t len = 0;
+  int kind = 0;
+  int i = 0;
+  int j = 0;
+
+  reset();
+  maxBusy = 5;
+  Pipe_SelectPipe(CORE, OUT_PIPE);
+
+  for (i = 0; i < RANDOM_STREAMS; i++) {
+    len = rand() % sizeof(buf);
+    kind = rand() % 3;
+
+    for (j = 0; j < len; j++) {
+      buf[j] = rand();
+      expected[total + j] = (kind == 0 ? buf[j] : 0);
+    }
+    if (kind == 1) {
+      for (j = 0; j < len; j++) {
+        expected[total + j] = buf[len - 1 - j];
+      }
+    }
+    total += len;
+
+    CHECK(writeStream(kind, buf, len, rand() & 1) == PIPE_RWSTREAM_NoError);
+
+    // a transfer of the stream so far
+    if (rand() % 4 == 0) {
+      waitIdle(OUT_PIPE);
+      Pipe_ClearOUT(CORE);
+    }
+  }
+
+  waitIdle(OUT_PIPE);
+  Pipe_ClearOUT(CORE);
+
+  CHECK(sentLen == total);
+  CHECK(memcmp(sent, expected, total) == 0);
+}
+
+static void testRead(void)
+{
+  uint8_t buf[2000];
+  uint32_t pos = 0;
+  uint16_t len = 0;
+  int kind = 0;
+  int i = 0;
+  int j = 0;
+
+  reset();
+  maxBusy = 5;
+  for (i = 0; i < STREAM_SIZE; i++) {
+    device[i] = rand();
+  }
+
+  // start the first IN transfer as the class drivers do
+  Pipe_SelectPipe(CORE, IN_PIPE);
+  while (!Pipe_IsINReceived(CORE)) {
+  }
+
+  for (i = 0; i < RANDOM_STREAMS / 2; i++) {
+    len = rand() % sizeof(buf);
+    kind = rand() % 3;
+
+    CHECK(readStream(kind, buf, len, rand() & 1) == PIPE_RWSTREAM_NoError);
+
+    for (j = 0; j < len && kind != 2; j++) {
+      CHECK(buf[kind == 0 ? j : len - 1 - j] == device[pos + j]);
+    }
+    pos += len;
+  }
+
+  // the rest is in the pipe, nothing has been skipped
+  CHECK(devicePos - pos == Pipe_BytesInPipe(CORE));
+}
+
+static void testErrors(void)
+{
+  uint8_t buf[PIPE_MAX_SIZE];
+  uint32_t start = 0;
+
+  memset(buf, 0x55, sizeof(buf));
+  maxBusy = 0;
+
+  // the device doesn't accept the transfer of a full buffer, the next
+  // write times out
+  reset();
+  Pipe_SelectPipe(CORE, OUT_PIPE);
+  CHECK(Pipe_Write_Stream_LE(CORE, buf, PIPE_MAX_SIZE, NULL) == PIPE_RWSTREAM_NoError);
+  Pipe_ClearOUT(CORE);
+  busy[OUT_PIPE] = 0xFFFFFFFF;
+  start = frame;
+  CHECK(Pipe_Write_Stream_LE(CORE, buf, 1, NULL) == PIPE_RWSTREAM_Timeout);
+  CHECK(frame - start >= USB_STREAM_TIMEOUT_MS && frame - start <= USB_STREAM_TIMEOUT_MS + 3);
+
+  // stalled and disconnected while waiting
+  reset();
+  Pipe_SelectPipe(CORE, OUT_PIPE);
+  CHECK(Pipe_Write_Stream_LE(CORE, buf, PIPE_MAX_SIZE, NULL) == PIPE_RWSTREAM_NoError);
+  Pipe_ClearOUT(CORE);
+  pipeStatus[OUT_PIPE] = HCD_STATUS_TRANSFER_Stall;
+  CHECK(Pipe_Write_Stream_LE(CORE, buf, 1, NULL) == PIPE_RWSTREAM_PipeStalled);
+
+  reset();
+  Pipe_SelectPipe(CORE, IN_PIPE);
+  USB_HostState[CORE] = HOST_STATE_Unattached;
+  busy[IN_PIPE] = 0xFFFFFFFF;
+  CHECK(Pipe_Read_Stream_LE(CORE, buf, 1, NULL) == PIPE_RWSTREAM_DeviceDisconnected);
+
+  // a read that never gets a packet
+  reset();
+  Pipe_SelectPipe(CORE, IN_PIPE);
+  busy[IN_PIPE] = 0xFFFFFFFF;
+  start = frame;
+  CHECK(Pipe_Read_Stream_LE(CORE, buf, 1, NULL) == PIPE_RWSTREAM_Timeout);
+  CHECK(frame - start >= USB_STREAM_TIMEOUT_MS && frame - start <= USB_STREAM_TIMEOUT_MS + 3);
+}
+
+static void benchWrite(void)
+{
+  uint8_t buf[PIPE_MAX_SIZE];
+  double t8 = 0;
+  double ts = 0;
+  int i = 0;
+  int j = 0;
+
+  reset();
+  maxBusy = 0;
+  Pipe_SelectPipe(CORE, OUT_PIPE);
+  for (i = 0; i < PIPE_MAX_SIZE; i++) {
+    buf[i] = rand();
+  }
+
+  t8 = test_seconds();
+  for (i = 0; i < BENCH_WRITES; i++) {
+    sentLen = 0;
+    for (j = 0; j < PIPE_MAX_SIZE; j++) {
+      Pipe_Write_8(CORE, buf[j]);
+    }
+    Pipe_ClearOUT(CORE);
+  }
+  t8 = test_seconds() - t8;
+  CHECK(memcmp(sent, buf, PIPE_MAX_SIZE) == 0);
+
+  ts = test_seconds();
+  for (i = 0; i < BENCH_WRITES; i++) {
+    sentLen = 0;
+    Pipe_Write_Stream_LE(CORE, buf, PIPE_MAX_SIZE, NULL);
+    Pipe_ClearOUT(CORE);
+  }
+  ts = test_seconds() - ts;
+  CHECK(memcmp(sent, buf, PIPE_MAX_SIZE) == 0);
+
+  // the transfer itself (a memcpy here) is included in both
+  printf("%d byte write: Pipe_Write_8 %.0f ns, Pipe_Write_Stream_LE %.0f ns\n",
+      PIPE_MAX_SIZE, t8 / BENCH_WRITES * 1e9, ts / BENCH_WRITES * 1e9);
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  CHECK(Pipe_ConfigurePipe(CORE, OUT_PIPE, EP_TYPE_BULK, PIPE_TOKEN_OUT, 0x01,
+      PACKET_SIZE, PIPE_BANK_SINGLE));
+  CHECK(Pipe_ConfigurePipe(CORE, IN_PIPE, EP_TYPE_BULK, PIPE_TOKEN_IN, 0x82,
+      PACKET_SIZE, PIPE_BANK_SINGLE));
+
+  testWrite();
+  testRead();
+  testErrors();
+  benchWrite();
+
+  printf("pipestream_test ok\n");
+  return 0;
+}
@@ -0,0 +1,86 @@
+/****************************************************************************************************//**
+*
+* @file		test.h
+* @brief	Helpers for the host tests
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+
+/********************************************************************************************************
+*** MODULE
+********************************************************************************************************/
+#ifndef __TEST_H
+#define __TEST_H
+
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/********************************************************************************************************
+*** MACROS
+********************************************************************************************************/
+
+// Fail the test (exit code 1) if 'cond' is false
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    exit(1); \
+  } \
+} while (0)
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+// Monotonic time in seconds
+static inline double test_seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Cycle counter for code built with a CPU cycle counter hook, the time
+// stamp counter on x86 and nanoseconds elsewhere
+static inline uint32_t test_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+// Seed the random generator from argv[1] (or a fixed seed) and report it
+static inline unsigned int test_seed(int argc, char** argv)
+{
+  unsigned int seed = (argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 0) : 1);
+
+  srand(seed);
+  printf("seed %u\n", seed);
+  return seed;
+}
+
+
+/********************************************************************************************************
+*** MODULE END
+********************************************************************************************************/
+
+#endif
@@ -0,0 +1,303 @@
+/****************************************************************************************************//**
+*
+* @file		usbmemory_test.c
+* @brief	Host stress test of the USB RAM allocator
+* @version	1.01
+* @date		17/10/2026
+*
+*
+*********************************************************************************************************
+*** REVISION HISTORY
+*
+********************************************************************************************************/
+
+/*
+ * Runs USBMemory.c with random allocations and frees. Every block is
+ * filled with its own pattern and checked before it is freed, so blocks
+ * that overlap or leave the pool are found. The statistics are checked
+ * against a model after every call, then the pool exhaustion, the arena
+ * fallback and a pool smaller than the buffer are checked separately.
+ *
+ * Usage: usbmemory_test [seed]
+ */
+
+/********************************************************************************************************
+*** INCLUDES
+********************************************************************************************************/
+
+#include <string.h>
+#include "Drivers/USB/USB.h"
+#include "Drivers/USB/Core/USBMemory.h"
+#include "test.h"
+
+/********************************************************************************************************
+*** PRIVATE DEFINES
+********************************************************************************************************/
+
+#define SLOTS      (16)
+#define ITERATIONS (200000)
+
+// bytes of an arena block header
+#define HEADER (4)
+
+/********************************************************************************************************
+*** PRIVATE DATA TYPES
+********************************************************************************************************/
+
+typedef struct {
+  uint8_t* ptr;
+  uint32_t size;
+  uint32_t used;  // InUse bytes of the block
+} slot_t;
+
+/********************************************************************************************************
+*** PRIVATE GLOBAL VARIABLES
+********************************************************************************************************/
+
+static slot_t slots[SLOTS];
+
+// expected statistics
+static uint32_t inUse = 0;
+static uint32_t highWater = 0;
+static uint32_t allocs = 0;
+static uint32_t failures = 0;
+
+static uint32_t arenaSize = 0;
+
+/********************************************************************************************************
+*** PRIVATE FUNCTIONS
+********************************************************************************************************/
+
+static void resetModel(uint32_t poolSize)
+{
+  USB_Memory_Stats_t st;
+
+  USB_Memory_Init(poolSize);
+  memset(slots, 0, sizeof(slots));
+  inUse = 0;
+  highWater = 0;
+  allocs = 0;
+  failures = 0;
+
+  USB_Memory_GetStats(&st);
+  arenaSize = st.ArenaFree;
+}
+
+static void checkStats(void)
+{
+  USB_Memory_Stats_t st;
+
+  USB_Memory_GetStats(&st);
+  CHECK(st.InUse == inUse);
+  CHECK(st.HighWater == highWater);
+  CHECK(st.Allocs == allocs);
+  CHECK(st.Failures == failures);
+  CHECK(st.ArenaLargest <= st.ArenaFree && st.ArenaFree <= arenaSize);
+  CHECK(st.Fragmentation == (st.ArenaFree == 0 ? 0
+      : 100 - st.ArenaLargest * 100 / st.ArenaFree));
+  CHECK(st.BlocksFree[0] >= st.BlocksMin[0] && st.BlocksFree[1] >= st.BlocksMin[1]);
+}
+
+// Allocate a slot and check where the block comes from
+static void allocSlot(slot_t* s, uint32_t size)
+{
+  USB_Memory_Stats_t before;
+  USB_Memory_Stats_t after;
+  uint32_t aligned = (size + 3) & ~3UL;
+  uint32_t i = 0;
+
+  USB_Memory_GetStats(&before);
+  s->ptr = USB_Memory_Alloc(size);
+  USB_Memory_GetStats(&after);
+
+  if (s->ptr == NULL) {
+    // no free block of a class that fits and no room in the arena
+    for (i = 0; i < USB_MEMORY_NUM_CLASSES; i++) {
+      CHECK(size > (i == 0 ? 64 : 512) || before.BlocksFree[i] == 0);
+    }
+    CHECK(before.ArenaLargest < aligned);
+    failures++;
+    return;
+  }
+
+  CHECK(((uintptr_t)s->ptr & 3) == 0);
+  s->size = size;
+  s->used = after.InUse - before.InUse;
+
+  // the smallest class with a free block, else the arena (a remainder
+  // too small for a header is handed out with the block)
+  if (size <= 64 && before.BlocksFree[0] > 0) {
+    CHECK(s->used == 64 && after.BlocksFree[0] == before.BlocksFree[0] - 1);
+  }
+  else if (size <= 512 && before.BlocksFree[1] > 0) {
+    CHECK(s->used == 512 && after.BlocksFree[1] == before.BlocksFree[1] - 1);
+  }
+  else {
+    CHECK(s->used >= aligned + HEADER && s->used <= aligned + 2 * HEADER);
+    CHECK(after.ArenaFree <= before.ArenaFree - aligned);
+  }
+
+  memset(s->ptr, (uint8_t)(uintptr_t)s, size);
+  inUse += s->used;
+  allocs++;
+  if (inUse > highWater) {
+    highWater = inUse;
+  }
+}
+
+static void freeSlot(slot_t* s)
+{
+  uint32_t i = 0;
+
+  for (i = 0; i < s->size; i++) {
+    CHECK(s->ptr[i] == (uint8_t)(uintptr_t)s);
+  }
+
+  USB_Memory_Free(s->ptr);
+  inUse -= s->used;
+  s->ptr = NULL;
+}
+
+static uint32_t randomSize(void)
+{
+  static const uint32_t sizes[] = {1, 8, 63, 64, 65, 100, 200, 511, 512, 513};
+
+  return (rand() % 2 ? sizes[rand() % 10] : 1 + rand() % 600);
+}
+
+static void testRandom(void)
+{
+  USB_Memory_Stats_t st;
+  uint32_t i = 0;
+  slot_t* s = NULL;
+
+  resetModel(USBRAM_BUFFER_SIZE);
+
+  for (i = 0; i < ITERATIONS; i++) {
+    s = &slots[rand() % SLOTS];
+    if (s->ptr != NULL) {
+      freeSlot(s);
+    }
+    else {
+      allocSlot(s, randomSize());
+    }
+    checkStats();
+  }
+
+  for (i = 0; i < SLOTS; i++) {
+    if (slots[i].ptr != NULL) {
+      freeSlot(&slots[i]);
+    }
+  }
+  checkStats();
+
+  // all free again and the arena merged into one block
+  USB_Memory_GetStats(&st);
+  CHECK(st.InUse == 0);
+  CHECK(st.BlocksFree[0] == USB_MEMORY_BLOCKS_64 && st.BlocksFree[1] == USB_MEMORY_BLOCKS_512);
+  CHECK(st.ArenaFree == arenaSize && st.Fragmentation == 0);
+
+  printf("%u allocs, %u failures, high water %u of %u bytes, blocks min %u/%u\n",
+      allocs, failures, highWater, USBRAM_BUFFER_SIZE, st.BlocksMin[0], st.BlocksMin[1]);
+}
+
+static void testExhaustion(void)
+{
+  USB_Memory_Stats_t st;
+  uint32_t n = 0;
+  uint32_t i = 0;
+
+  resetModel(USBRAM_BUFFER_SIZE);
+
+  // larger than every class and the arena
+  allocSlot(&slots[0], 513 + arenaSize);
+  CHECK(slots[0].ptr == NULL);
+
+  // 64 byte requests use the 64 byte blocks, then the 512 byte blocks,
+  // then the arena until it is full
+  while (n < SLOTS) {
+    allocSlot(&slots[n], 64);
+    checkStats();
+    if (slots[n].ptr == NULL) {
+      break;
+    }
+    n++;
+  }
+  CHECK(n < SLOTS);
+  CHECK(n == USB_MEMORY_BLOCKS_64 + USB_MEMORY_BLOCKS_512 + arenaSize / (64 + HEADER));
+
+  USB_Memory_GetStats(&st);
+  CHECK(st.BlocksFree[0] == 0 && st.BlocksMin[0] == 0);
+  CHECK(st.BlocksFree[1] == 0 && st.BlocksMin[1] == 0);
+
+  // a freed block is used again
+  freeSlot(&slots[1]);
+  allocSlot(&slots[1], 10);
+  CHECK(slots[1].ptr != NULL && slots[1].used == 64);
+  checkStats();
+
+  // freeing every other arena block leaves holes, one request larger
+  // than a hole fails although the free bytes would be enough
+  for (i = USB_MEMORY_BLOCKS_64 + USB_MEMORY_BLOCKS_512; i < n; i += 2) {
+    freeSlot(&slots[i]);
+  }
+  checkStats();
+  USB_Memory_GetStats(&st);
+  if (st.ArenaFree > st.ArenaLargest) {
+    CHECK(st.Fragmentation > 0);
+    allocSlot(&slots[SLOTS - 1], st.ArenaLargest + 1);
+    CHECK(slots[SLOTS - 1].ptr == NULL);
+    checkStats();
+  }
+
+  for (i = 0; i < n; i++) {
+    if (slots[i].ptr != NULL) {
+      freeSlot(&slots[i]);
+    }
+  }
+  checkStats();
+  USB_Memory_GetStats(&st);
+  CHECK(st.InUse == 0 && st.ArenaFree == arenaSize && st.Fragmentation == 0);
+}
+
+static void testSmallPool(void)
+{
+  USB_Memory_Stats_t st;
+
+  // room for the 64 byte blocks and a little arena only
+  resetModel(USB_MEMORY_BLOCKS_64 * 64 + 100);
+  USB_Memory_GetStats(&st);
+  CHECK(st.BlocksFree[0] == USB_MEMORY_BLOCKS_64 && st.BlocksFree[1] == 0);
+  CHECK(arenaSize == 100 - HEADER);
+
+  allocSlot(&slots[0], 200);
+  CHECK(slots[0].ptr == NULL);
+  allocSlot(&slots[1], 96);
+  CHECK(slots[1].ptr != NULL);
+  checkStats();
+  freeSlot(&slots[1]);
+
+  // no arena at all
+  resetModel(USB_MEMORY_BLOCKS_64 * 64);
+  CHECK(arenaSize == 0);
+  allocSlot(&slots[0], 65);
+  CHECK(slots[0].ptr == NULL);
+  checkStats();
+}
+
+
+/********************************************************************************************************
+*** PUBLIC FUNCTIONS
+********************************************************************************************************/
+
+int main(int argc, char** argv)
+{
+  test_seed(argc, argv);
+
+  testRandom();
+  testExhaustion();
+  testSmallPool();
+
+  printf("usbmemory_test ok\n");
+  return 0;
+}